@@ -0,0 +1,227 @@
+// Copyright (c) 2018 Arista Networks, Inc.
+// Use of this source code is governed by the Apache License 2.0
+// that can be found in the COPYING file.
+
+package quantumfs
+
+import (
+	"bytes"
+	"encoding/json"
+	"fmt"
+	"io"
+	"reflect"
+	"testing"
+)
+
+func TestBinaryCommandRoundTrip(t *testing.T) {
+	runTest(t, func(test *testHelper) {
+		cmd := InsertInodeRequest{
+			CommandCommon: CommandCommon{
+				CommandId: CmdInsertInode,
+				RequestId: 0x1122334455667788,
+			},
+			DstPath:     "user/joe/ws/usr/lib/file",
+			Key:         "thisisadummyextendedkey01234567890123456",
+			Uid:         2001,
+			Gid:         3001,
+			Permissions: 0765,
+		}
+
+		frame := EncodeBinaryCommand(cmd)
+
+		var common CommandCommon
+		test.AssertNoErr(DecodeBinaryCommand(frame, &common))
+		test.Assert(common.CommandId == CmdInsertInode,
+			"Wrong command id %d", common.CommandId)
+		test.Assert(common.RequestId == cmd.RequestId,
+			"Wrong request id %x", common.RequestId)
+
+		var decoded InsertInodeRequest
+		test.AssertNoErr(DecodeBinaryCommand(frame, &decoded))
+		test.Assert(decoded == cmd, "Decoded %v expected %v", decoded, cmd)
+	})
+}
+
+func TestBinaryResponseRoundTrip(t *testing.T) {
+	runTest(t, func(test *testHelper) {
+		response := AccessListResponse{
+			ErrorResponse: ErrorResponse{
+				CommandCommon: CommandCommon{CommandId: CmdError},
+				ErrorCode:     ErrorOK,
+			},
+			PathList: NewPathsAccessed(),
+		}
+		response.PathList.Paths["/file1"] = PathCreated
+		response.PathList.Paths["/dir"] = PathRead | PathIsDir
+
+		var decoded AccessListResponse
+		test.AssertNoErr(DecodeBinaryCommand(
+			EncodeBinaryCommand(response), &decoded))
+		test.Assert(len(decoded.PathList.Paths) == 2,
+			"Wrong number of paths")
+		for path, flags := range response.PathList.Paths {
+			test.Assert(decoded.PathList.Paths[path] == flags,
+				"Wrong flags for %s", path)
+		}
+
+		// Data which ends in zeros must survive intact
+		block := GetBlockResponse{Data: []byte{1, 2, 0, 0}}
+		var decodedBlock GetBlockResponse
+		test.AssertNoErr(DecodeBinaryCommand(EncodeBinaryCommand(block),
+			&decodedBlock))
+		test.Assert(bytes.Equal(block.Data, decodedBlock.Data),
+			"Data mismatch %v", decodedBlock.Data)
+
+		// Pages of an accessed list keep their order
+		page := AccessedPageResponse{
+			Paths: []AccessedPath{
+				{Path: "/a", Flags: PathRead},
+				{Path: "/b", Flags: PathCreated | PathUpdated},
+			},
+			NextCursor: 1<<32 | 2,
+		}
+		var decodedPage AccessedPageResponse
+		test.AssertNoErr(DecodeBinaryCommand(EncodeBinaryCommand(page),
+			&decodedPage))
+		test.Assert(reflect.DeepEqual(page, decodedPage),
+			"Page mismatch %v", decodedPage)
+	})
+}
+
+func TestBinaryBatchRoundTrip(t *testing.T) {
+	runTest(t, func(test *testHelper) {
+		branch := BranchRequest{
+			CommandCommon: CommandCommon{CommandId: CmdBranchRequest},
+			Src:           "a/b/c",
+			Dst:           "d/e/f",
+		}
+		batch := BatchRequest{
+			CommandCommon: CommandCommon{CommandId: CmdBatch},
+			Commands: []json.RawMessage{
+				EncodeBinaryCommand(branch),
+				EncodeBinaryCommand(GetBlockRequest{
+					CommandCommon: CommandCommon{
+						CommandId: CmdGetBlock,
+					},
+					Key: []byte{1, 2, 3},
+				}),
+			},
+		}
+
+		// Every command of the batch is a whole frame of its own
+		var decoded BatchRequest
+		test.AssertNoErr(DecodeBinaryCommand(EncodeBinaryCommand(batch),
+			&decoded))
+		test.Assert(len(decoded.Commands) == 2, "Wrong number of commands")
+
+		var decodedBranch BranchRequest
+		test.AssertNoErr(DecodeBinaryCommand(decoded.Commands[0],
+			&decodedBranch))
+		test.Assert(decodedBranch == branch, "Decoded %v expected %v",
+			decodedBranch, branch)
+	})
+}
+
+func TestBinaryCompression(t *testing.T) {
+	runTest(t, func(test *testHelper) {
+		response := AccessedPageResponse{}
+		for i := 0; i < 1000; i++ {
+			response.Paths = append(response.Paths, AccessedPath{
+				Path:  fmt.Sprintf("/usr/lib/python/site/file%d", i),
+				Flags: PathRead,
+			})
+		}
+		frame := EncodeBinaryCommand(response)
+
+		compressed := CompressBinaryFrame(frame)
+		test.Assert(len(compressed) < len(frame)/2,
+			"Poor compression %d of %d bytes", len(compressed),
+			len(frame))
+
+		// Compressed frames must be decompressed before they are decoded
+		var decoded AccessedPageResponse
+		test.AssertErr(DecodeBinaryCommand(compressed, &decoded))
+
+		length := uint32(len(frame) - BinaryHeaderSize)
+		decompressed, err := DecompressBinaryFrame(compressed, length)
+		test.AssertNoErr(err)
+		test.Assert(bytes.Equal(frame, decompressed),
+			"Decompressed frame differs")
+
+		_, err = DecompressBinaryFrame(compressed, length-1)
+		test.AssertErr(err)
+
+		corrupt := append([]byte{}, compressed...)
+		corrupt[len(corrupt)-1] ^= 0xff
+		_, err = DecompressBinaryFrame(corrupt, length)
+		test.AssertErr(err)
+
+		// Small frames are left alone, as are those which aren't compressed
+		small := EncodeBinaryCommand(BranchRequest{Src: "a/b/c"})
+		test.Assert(bytes.Equal(small, CompressBinaryFrame(small)),
+			"Small frame compressed")
+		decompressed, err = DecompressBinaryFrame(small, 0)
+		test.AssertNoErr(err)
+		test.Assert(bytes.Equal(small, decompressed), "Frame changed")
+	})
+}
+
+func TestBinaryCommandCorrupt(t *testing.T) {
+	runTest(t, func(test *testHelper) {
+		frame := EncodeBinaryCommand(BranchRequest{
+			CommandCommon: CommandCommon{CommandId: CmdBranchRequest},
+			Src:           "a/b/c",
+			Dst:           "d/e/f",
+		})
+
+		var cmd BranchRequest
+		test.AssertErr(DecodeBinaryCommand(frame[:BinaryHeaderSize-1], &cmd))
+		test.AssertErr(DecodeBinaryCommand(frame[:len(frame)-1], &cmd))
+		test.AssertErr(DecodeBinaryCommand([]byte("{\"CommandId\":2}"),
+			&cmd))
+
+		// A string length running past the end of the payload, after
+		// the CommandId and RequestId
+		corrupt := append([]byte{}, frame...)
+		corrupt[BinaryHeaderSize+12] = 0xff
+		test.AssertErr(DecodeBinaryCommand(corrupt, &cmd))
+	})
+}
+
+func TestReadBinaryFrame(t *testing.T) {
+	runTest(t, func(test *testHelper) {
+		first := EncodeBinaryCommand(BranchRequest{
+			CommandCommon: CommandCommon{CommandId: CmdBranchRequest},
+			Src:           "a/b/c",
+			Dst:           "d/e/f",
+		})
+		second := EncodeBinaryCommand(CommandCommon{CommandId: CmdSyncAll})
+
+		// Frames which follow one another are read one at a time
+		var stream bytes.Buffer
+		stream.Write(first)
+		stream.Write(second)
+
+		frame, err := ReadBinaryFrame(&stream, 1024)
+		test.AssertNoErr(err)
+		test.Assert(bytes.Equal(frame, first), "First frame %q", frame)
+
+		frame, err = ReadBinaryFrame(&stream, 1024)
+		test.AssertNoErr(err)
+		test.Assert(bytes.Equal(frame, second), "Second frame %q", frame)
+
+		_, err = ReadBinaryFrame(&stream, 1024)
+		test.Assert(err == io.EOF, "Expected EOF, got %v", err)
+
+		// A frame cut short
+		_, err = ReadBinaryFrame(bytes.NewReader(first[:len(first)-1]),
+			1024)
+		test.Assert(err == io.ErrUnexpectedEOF,
+			"Expected unexpected EOF, got %v", err)
+
+		// A frame longer than allowed
+		_, err = ReadBinaryFrame(bytes.NewReader(first),
+			uint32(len(first)-BinaryHeaderSize-1))
+		test.AssertErr(err)
+	})
+}
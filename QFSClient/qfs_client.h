@@ -6,6 +6,7 @@
 #define QFSCLIENT_QFS_CLIENT_H_
 
 #include <stdint.h>
+#include <functional>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -14,6 +15,10 @@ namespace qfsclient {
 
 typedef uint8_t byte;
 
+/// Identifies a command started by one of the pipelined `Api` functions, such
+/// as `Api::StartInsertInode()`, until its response is collected by `Api::Wait()`.
+typedef uint64_t RequestId;
+
 /// Potential error values that may be returned in an ErrorCode object
 /// by methods of the Api class
 enum ErrorCode {
@@ -73,6 +78,26 @@ enum ErrorCode {
 
 	// a JSON object was found with the wrong type
 	kJsonObjectWrongType = 16,
+
+	// Api.Wait() was passed a request ID which isn't in flight
+	kUnknownRequestId = 17,
+
+	// The region of shared memory for moving blocks couldn't be set up
+	kSharedMemoryFail = 18,
+
+	// The manifest or a chunk of an object stored by `Api::PutObject()` is
+	// malformed
+	kObjectCorrupt = 19,
+
+	// Writing an object to the file descriptor given to `Api::GetObject()`
+	// failed
+	kObjectFileWriteFail = 20,
+
+	// The buffer given to `Api::GetBlockInto()` is too small for the block
+	kBufferTooSmall = 21,
+
+	// A worker thread of an `AsyncApi` couldn't be started
+	kCantStartWorker = 22,
 };
 
 /// An `Error` object is returned by many member functions of the Api class. The
@@ -98,9 +123,52 @@ struct PathsAccessed {
 	std::unordered_map<std::string, PathFlags> paths;
 };
 
-/// `Api` provides the public interface to QuantumFS API calls.
+/// One entry of a page of an accessed list, see `Api::GetAccessedPage()`.
+struct PathAccessed {
+	std::string path;
+	PathFlags flags;
+};
+
+/// Identifies the next page of an accessed list being read with
+/// `Api::GetAccessedPage()`. Zero starts a new listing.
+typedef uint64_t AccessedCursor;
+
+/// The counters of the block cache of an `Api`, see `Api::EnableBlockCache()`.
+struct BlockCacheStats {
+	/// `GetBlock()` calls answered from the cache, and those which weren't
+	uint64_t hits;
+	uint64_t misses;
+
+	/// The blocks in the cache and the bytes of their keys and data
+	uint64_t blocks;
+	uint64_t bytes;
+};
+
+/// A block of data and the key it is stored under, see `Api::SetBlocks()`.
+struct Block {
+	std::vector<byte> key;
+	std::vector<byte> data;
+};
+
+/// A file to insert with `Api::InsertInodes()`, with the arguments of
+/// `Api::InsertInode()`.
+struct InsertInodeEntry {
+	std::string destination;
+	std::string key;
+	uint32_t permissions;
+	uint32_t uid;
+	uint32_t gid;
+};
+
+class Batch;
+
+/// `Api` provides the public interface to QuantumFS API calls. An `Api` object
+/// obtained from `GetApi()` must only be used by one thread at a time, whereas one
+/// obtained from `GetPooledApi()` may be shared by many threads.
 class Api {
  public:
+	virtual ~Api() {}
+
 	/// Retrieve the list of accessed and created files for a specified
 	/// workspace. This list will be written to standard output.
 	///
@@ -111,6 +179,28 @@ class Api {
 	virtual Error GetAccessed(const char *workspace_root,
 				PathsAccessed *paths) = 0;
 
+	/// Retrieve one page of the list of accessed and created files for a
+	/// specified workspace. Unlike `GetAccessed()`, each response is bounded in
+	/// size however long the list is. The list is captured when the first page
+	/// is requested, so the pages of one listing are consistent with each
+	/// other. See `AccessedIterator` for visiting every entry.
+	///
+	/// @param [in] `workspace_root` A string containing the workspace root name
+	/// whose list of accessed files is to be retrieved.
+	/// @param [in,out] `cursor` Zero to request the first page, otherwise the
+	/// cursor set by the call which returned the previous page. Set to the
+	/// cursor of the next page, or to zero once the last page is returned.
+	/// @param [in] `max_paths` The most paths to return, or zero for the
+	/// QuantumFS default.
+	/// @param [out] `paths` Replaced with the paths of the page, in sorted
+	/// order.
+	///
+	/// @return An `Error` object that indicates success or failure.
+	virtual Error GetAccessedPage(const char *workspace_root,
+				      AccessedCursor *cursor,
+				      uint32_t max_paths,
+				      std::vector<PathAccessed> *paths) = 0;
+
 	/// Takes an extended key along with other file metadata (permissions,
 	/// UID and GID) and inserts it into the given destination directory.
 	///
@@ -130,6 +220,20 @@ class Api {
 				  uint32_t uid,
 				  uint32_t gid) = 0;
 
+	/// Insert many files in as few requests as possible. QuantumFS checks the
+	/// keys of the files concurrently and inserts all the files of a directory
+	/// at once, which is much faster than calling `InsertInode()` for each.
+	/// Inserting a destination twice leaves the latter file.
+	///
+	/// @param [in] `inodes` The files to insert.
+	/// @param [out] `results` Receives the outcome of inserting each file, in
+	/// the order of `inodes`.
+	///
+	/// @return An `Error` object that indicates whether the files could be
+	/// sent, as for `SetBlocks()`.
+	virtual Error InsertInodes(const std::vector<InsertInodeEntry> &inodes,
+				   std::vector<Error> *results) = 0;
+
 	/// Branch a given workspace into a new workspace with the supplied name.
 	///
 	/// @param [in] `source` A string containing the root name of the workspace
@@ -171,11 +275,399 @@ class Api {
 	/// @return An `Error` object that indicates success or failure.
 	virtual Error GetBlock(const std::vector<byte> &key,
 			       std::vector<byte> *data) = 0;
+
+	/// Versions of `SetBlock()` and `GetBlock()` for callers whose key and
+	/// block are already in contiguous memory of their own, which spare them
+	/// building vectors of them first.
+	///
+	/// @param [in] `key`, `key_size` The key of the block.
+	/// @param [in] `data`, `data_size` The block of data to store.
+	///
+	/// @return An `Error` object that indicates success or failure.
+	virtual Error SetBlock(const byte *key, size_t key_size,
+			       const byte *data, size_t data_size) = 0;
+
+	/// @param [in] `key`, `key_size` The key of the block.
+	/// @param [out] `data` Receives the block.
+	///
+	/// @return An `Error` object that indicates success or failure.
+	virtual Error GetBlock(const byte *key, size_t key_size,
+			       std::vector<byte> *data) = 0;
+
+	/// Retrieve a block straight into memory of the caller's, rather than into
+	/// a vector which then has to be copied. A buffer of `kMaxBlockSize` bytes
+	/// fits any block, or `StatBlock()` gives the size of a particular one.
+	///
+	/// @param [in] `key`, `key_size` The key of the block.
+	/// @param [out] `data`, `capacity` The buffer to receive the block.
+	/// @param [out] `written` The size of the block. It is set even if the
+	/// block doesn't fit, in which case nothing is written to `data`.
+	///
+	/// @return An `Error` object that indicates success or failure, which is
+	/// `kBufferTooSmall` if the block doesn't fit in `capacity` bytes.
+	virtual Error GetBlockInto(const byte *key, size_t key_size,
+				   byte *data, size_t capacity,
+				   size_t *written) = 0;
+
+	/// Find the size of a block without retrieving it.
+	///
+	/// @param [in] `key` The key of the block.
+	/// @param [out] `size` The size of the block.
+	///
+	/// @return An `Error` object that indicates success or failure.
+	virtual Error StatBlock(const std::vector<byte> &key, size_t *size) = 0;
+
+	/// Find which of many blocks are already stored, in as few requests as
+	/// possible, which QuantumFS answers concurrently.
+	///
+	/// @param [in] `keys` The keys of the blocks.
+	/// @param [out] `present` Receives whether each block is stored, in the
+	/// order of `keys`.
+	///
+	/// @return An `Error` object that indicates success or failure.
+	virtual Error HasBlocks(const std::vector<std::vector<byte>> &keys,
+				std::vector<bool> *present) = 0;
+
+	/// Store a block under a key derived from its content, unless QuantumFS
+	/// already has it, in which case the data isn't sent at all.
+	///
+	/// The key is the SHA-1 of the data, not the CityHash QuantumFS uses for
+	/// its own blocks. Keys of blocks stored through the API are chosen by
+	/// clients, so they only need to agree with each other. Because a block
+	/// already stored under the key is trusted to hold the same data, the
+	/// hash must resist collisions, which CityHash doesn't.
+	///
+	/// @param [in] `data`, `size` The block of data to store.
+	/// @param [out] `key` Receives the key of the block, the SHA-1 of `data`.
+	/// @param [out] `stored` Set to whether the block had to be stored. May be
+	/// NULL.
+	///
+	/// @return An `Error` object that indicates success or failure.
+	virtual Error SetBlockIfAbsent(const byte *data, size_t size,
+				       std::vector<byte> *key,
+				       bool *stored) = 0;
+
+	/// Ask QuantumFS to load blocks into its cache in the background, so that
+	/// retrieving them later doesn't wait on the datastore. Returns without
+	/// waiting for QuantumFS to answer, and the answer is dropped when it
+	/// arrives, so neither blocks which aren't stored nor invalid keys are
+	/// reported. QuantumFS drops blocks while it is already prefetching as
+	/// many as it allows at once. QuantumFS versions which don't support the
+	/// binary protocol are waited for, and their answer, even an error, is
+	/// dropped.
+	///
+	/// @param [in] `keys` The keys of blocks stored with `SetBlock()`.
+	/// @param [in] `extended_keys` Extended keys, as read from the
+	/// `quantumfs.key` extended attribute of files.
+	///
+	/// @return An `Error` object that indicates whether the requests could be
+	/// sent.
+	virtual Error Prefetch(const std::vector<std::vector<byte>> &keys,
+			       const std::vector<std::string> &extended_keys) = 0;
+
+	/// Move the data of subsequent `SetBlock()` and `GetBlock()` calls through
+	/// a region of memory shared with QuantumFS, rather than encoding it into
+	/// commands and responses which are copied through the API file. The
+	/// pipelined Start functions are unaffected.
+	///
+	/// @return An `Error` object that indicates success or failure. On failure
+	/// blocks continue to be moved through the API file.
+	virtual Error EnableSharedMemory() = 0;
+
+	/// The Start functions below are pipelined versions of the functions above.
+	/// They send the command without waiting for QuantumFS to process it, so
+	/// that many commands may be in flight at once. The outcome of each command
+	/// must be collected by passing the request ID returned in `request_id` to
+	/// `Wait()`. Responses may arrive in any order. Starting a command while
+	/// the maximum number of commands is already in flight will first read
+	/// a response, which is kept until `Wait()` is called for it. QuantumFS
+	/// versions which don't support the binary protocol don't pipeline
+	/// commands, so with them each command is processed before the Start
+	/// function returns.
+	///
+	/// @return An `Error` object that indicates whether the command was sent.
+	virtual Error StartInsertInode(const char *destination,
+				       const char *key,
+				       uint32_t permissions,
+				       uint32_t uid,
+				       uint32_t gid,
+				       RequestId *request_id) = 0;
+
+	virtual Error StartSetBlock(const std::vector<byte> &key,
+				    const std::vector<byte> &data,
+				    RequestId *request_id) = 0;
+
+	virtual Error StartGetBlock(const std::vector<byte> &key,
+				    RequestId *request_id) = 0;
+
+	/// Wait for the response to a command started by one of the Start functions.
+	///
+	/// @param [in] `request_id` The request ID returned when the command was
+	/// started. Each request ID may only be waited for once.
+	/// @param [out] `data` Receives the block for a command started with
+	/// `StartGetBlock()`. May be NULL for other commands.
+	///
+	/// @return An `Error` object that indicates success or failure of the
+	/// command.
+	virtual Error Wait(RequestId request_id, std::vector<byte> *data) = 0;
+
+	/// Send every command of a `Batch` to QuantumFS in as few requests as
+	/// possible, see `Batch::Execute()`.
+	virtual Error ExecuteBatch(const Batch &batch,
+				   std::vector<Error> *results) = 0;
+
+	/// Store many blocks in as few requests as possible, which QuantumFS
+	/// stores concurrently. Like a `Batch`, the blocks are always encoded into
+	/// the requests, even if `EnableSharedMemory()` has been called.
+	///
+	/// @param [in] `blocks` The blocks to store, with their keys.
+	/// @param [out] `results` Receives the outcome of storing each block, in
+	/// the order of `blocks`.
+	///
+	/// @return An `Error` object that indicates whether the blocks could be
+	/// sent. On failure the blocks which weren't stored are given the same
+	/// error in `results`.
+	virtual Error SetBlocks(const std::vector<Block> &blocks,
+				std::vector<Error> *results) = 0;
+
+	/// Retrieve many blocks in as few requests as possible, which QuantumFS
+	/// retrieves concurrently.
+	///
+	/// @param [in] `keys` The keys of the blocks to retrieve.
+	/// @param [out] `blocks` Receives each block, in the order of `keys`. The
+	/// block of a key which couldn't be retrieved is left empty.
+	/// @param [out] `results` Receives the outcome of retrieving each block, in
+	/// the order of `keys`.
+	///
+	/// @return An `Error` object that indicates whether the keys could be
+	/// sent, as for `SetBlocks()`.
+	virtual Error GetBlocks(const std::vector<std::vector<byte>> &keys,
+				std::vector<std::vector<byte>> *blocks,
+				std::vector<Error> *results) = 0;
+
+	/// The number of bytes which compression of large commands and responses
+	/// has saved sending over the api file so far. Compression is used where
+	/// QuantumFS supports it.
+	virtual uint64_t CompressionSavings() = 0;
+
+	/// Store an object of any size, which is split into blocks stored
+	/// concurrently, along with a manifest block listing them which is stored
+	/// under the key of the object. The blocks are keyed by the SHA-1 of their
+	/// data, so objects sharing blocks share their storage.
+	///
+	/// @param [in] `key` The key of the object, as for `SetBlock()`.
+	/// @param [in] `data`, `size` The contents of the object.
+	///
+	/// @return An `Error` object that indicates success or failure. The object
+	/// may be at most `kMaxObjectChunks` blocks, about 3.4GB.
+	virtual Error PutObject(const std::vector<byte> &key,
+				const byte *data,
+				size_t size) = 0;
+
+	/// Retrieve an object stored by `PutObject()`, whose blocks are retrieved
+	/// concurrently.
+	///
+	/// @param [in] `key` The key of the object.
+	/// @param [out] `data` Receives the contents of the object.
+	///
+	/// @return An `Error` object that indicates success or failure.
+	virtual Error GetObject(const std::vector<byte> &key,
+				std::vector<byte> *data) = 0;
+
+	/// Retrieve an object stored by `PutObject()` and write its contents to a
+	/// file descriptor as they arrive, rather than holding all of it in memory.
+	///
+	/// @param [in] `key` The key of the object.
+	/// @param [in] `fd` The file descriptor to write the object to, from its
+	/// current offset. On failure part of the object may have been written.
+	///
+	/// @return An `Error` object that indicates success or failure.
+	virtual Error GetObject(const std::vector<byte> &key, int fd) = 0;
+
+	/// Keep blocks retrieved by `GetBlock()` and `GetBlocks()` in memory, so
+	/// that later calls for the same keys are answered without asking
+	/// QuantumFS. Storing a block drops its key from the cache, but blocks
+	/// stored under the same key by other processes aren't noticed, so only
+	/// enable the cache when keys which are stored again are stored through
+	/// this `Api`. The least recently used blocks are dropped to stay within
+	/// the budget. The pipelined `StartGetBlock()` doesn't use the
+	/// cache.
+	///
+	/// @param [in] `max_bytes` The budget for the keys and data of the cached
+	/// blocks. Zero drops the cache and disables it again.
+	///
+	/// @return An `Error` object that indicates success or failure.
+	virtual Error EnableBlockCache(size_t max_bytes) = 0;
+
+	/// The counters of the block cache. All zero if it isn't enabled.
+	virtual BlockCacheStats GetBlockCacheStats() = 0;
+};
+
+/// `Batch` collects commands to be sent to QuantumFS together, which costs a
+/// single request rather than one for each command:
+///
+///     Batch batch(api);
+///     batch.AddInsertInode("user/joe/myws/file", key, 0644, 0, 0);
+///     batch.AddBranch("user/joe/myws", "user/joe/otherws");
+///     std::vector<Error> results;
+///     Error err = batch.Execute(&results);
+///
+/// The commands are processed in the order they were added. The arguments of
+/// each command are copied when it is added.
+class Batch {
+ public:
+	/// @param [in] `api` The `Api` to execute the batch with, which must
+	/// outlive the batch.
+	explicit Batch(Api *api);
+
+	void AddInsertInode(const char *destination,
+			    const char *key,
+			    uint32_t permissions,
+			    uint32_t uid,
+			    uint32_t gid);
+	void AddBranch(const char *source, const char *destination);
+	void AddDelete(const char *workspace);
+
+	/// Blocks of a batch are always encoded into the request, even if
+	/// `Api::EnableSharedMemory()` has been called.
+	void AddSetBlock(const std::vector<byte> &key,
+			 const std::vector<byte> &data);
+
+	/// The number of commands added since the batch was created or cleared.
+	size_t Size() const;
+
+	/// Remove every command from the batch, so that it may be reused.
+	void Clear();
+
+	/// Send the commands of the batch. The failure of one command doesn't
+	/// prevent the others from being processed.
+	///
+	/// @param [out] `results` Receives the outcome of each command, in the
+	/// order the commands were added.
+	///
+	/// @return An `Error` object that indicates whether the batch could be
+	/// sent. On failure the commands which weren't processed are given the
+	/// same error in `results`.
+	Error Execute(std::vector<Error> *results);
+
+ private:
+	// The arguments of one command of the batch. Only those of the command's
+	// type are set.
+	struct Command {
+		uint32_t command_id;
+		std::string source;
+		std::string destination;
+		std::string key;
+		std::vector<byte> block_key;
+		std::vector<byte> data;
+		uint32_t permissions;
+		uint32_t uid;
+		uint32_t gid;
+	};
+
+	Api *api;
+	std::vector<Command> commands;
+
+	friend class ApiImpl;
+};
+
+/// `AccessedIterator` visits the accessed list of a workspace one batch at a time
+/// using `Api::GetAccessedPage()`, so that only a single batch of a very large list
+/// is held in memory at once:
+///
+///     AccessedIterator accessed(api, "user/joe/myws", 0);
+///     std::vector<PathAccessed> batch;
+///     while (accessed.Next(&batch)) {
+///         ...
+///     }
+///     if (accessed.LastError().code != kSuccess) {
+///         ...
+///     }
+class AccessedIterator {
+ public:
+	/// @param [in] `api` The `Api` to retrieve the list with, which must
+	/// outlive the iterator.
+	/// @param [in] `workspace_root` The workspace root whose list to visit.
+	/// @param [in] `batch_size` The most entries in each batch, or zero for the
+	/// QuantumFS default.
+	AccessedIterator(Api *api, const char *workspace_root, uint32_t batch_size);
+
+	/// Replace the contents of `batch` with the next batch of entries.
+	///
+	/// @return false, with `batch` empty, once every entry has been returned
+	/// or if retrieving the batch failed, as given by `LastError()`.
+	bool Next(std::vector<PathAccessed> *batch);
+
+	/// The outcome of the last call to `Next()`.
+	const Error &LastError() const;
+
+ private:
+	Api *api;
+	std::string workspace_root;
+	uint32_t batch_size;
+	AccessedCursor cursor;
+	bool done;
+	Error err;
+};
+
+/// `AsyncApi` provides the QuantumFS API calls of `Api` without blocking the
+/// caller. Each function queues the call and returns immediately. The call is
+/// later made by one of a fixed number of worker threads, which then passes the
+/// outcome to the completion callback given with the call. Callbacks run on a
+/// worker thread, so they should be quick and must not call `WaitAll()`. A
+/// callback may be empty if the outcome isn't needed. If the queue of calls is
+/// full, the functions block until a worker takes a call from it.
+class AsyncApi {
+ public:
+	typedef std::function<void(const Error &err)> Callback;
+	typedef std::function<void(const Error &err,
+				   const PathsAccessed &paths)> AccessedCallback;
+	typedef std::function<void(const Error &err,
+				   const std::vector<byte> &data)> BlockCallback;
+
+	virtual ~AsyncApi() {}
+
+	/// See `Api::GetAccessed()`
+	virtual void GetAccessed(const char *workspace_root,
+				 AccessedCallback callback) = 0;
+
+	/// See `Api::InsertInode()`
+	virtual void InsertInode(const char *destination,
+				 const char *key,
+				 uint32_t permissions,
+				 uint32_t uid,
+				 uint32_t gid,
+				 Callback callback) = 0;
+
+	/// See `Api::Branch()`
+	virtual void Branch(const char *source,
+			    const char *destination,
+			    Callback callback) = 0;
+
+	/// See `Api::Delete()`
+	virtual void Delete(const char *workspace, Callback callback) = 0;
+
+	/// See `Api::SetBlock()`
+	virtual void SetBlock(const std::vector<byte> &key,
+			      const std::vector<byte> &data,
+			      Callback callback) = 0;
+
+	/// See `Api::GetBlock()`
+	virtual void GetBlock(const std::vector<byte> &key,
+			      BlockCallback callback) = 0;
+
+	/// Wait until every call queued so far has completed and its callback has
+	/// returned.
+	virtual void WaitAll() = 0;
 };
 
 /// Get an instance of an `Api` object that can be used to call QuantumFS API
-/// functions. The API file is searched for starting in the current working
-/// directory and walking up the directory tree from there.
+/// functions. If the environment variable `QUANTUMFS_API_SOCKET` names the api
+/// socket of quantumfsd, calls are made over that socket rather than through
+/// FUSE. Otherwise the API file is searched for starting in the current working
+/// directory and walking up the directory tree from there. If the environment
+/// variable `QUANTUMFS_API_IO_URING` is set, the API file is written and read
+/// through io_uring where the kernel allows it.
 ///
 /// @param [out] `api` A pointer to an `Api` pointer that will be modified.
 ///
@@ -184,14 +676,64 @@ Error GetApi(Api **api);
 
 /// Get an instance of an `Api` object that can be used to call QuantumFS API
 /// functions. The API file is searched for starting in the given directory and
-/// walking up the directory tree from there.
+/// walking up the directory tree from there. If the path is that of the api socket
+/// of quantumfsd, calls are made over the socket instead.
 ///
-/// @param [in] A path to a directory where the search for the API file will begin.
+/// @param [in] A path to a directory where the search for the API file will begin,
+/// or the path of the api socket.
 /// @param [out] `api` A pointer to an `Api` pointer that will be modified.
 ///
 /// @return An `Error` object that indicates success or failure.
 Error GetApi(const char *path, Api **api);
 
+/// Get an instance of an `Api` object which may be called from many threads at
+/// once. Each concurrent call is made on its own handle of the API file, of which
+/// up to `max_connections` are opened as they are needed. Calls made while all
+/// of them are busy wait for one to become free. The API file is searched for as
+/// by `GetApi(Api **api)`.
+///
+/// @param [in] `max_connections` The maximum number of API file handles to open.
+/// @param [out] `api` A pointer to an `Api` pointer that will be modified.
+///
+/// @return An `Error` object that indicates success or failure.
+Error GetPooledApi(size_t max_connections, Api **api);
+
+/// Get an instance of an `Api` object which may be called from many threads at
+/// once, using the API file at the given path.
+///
+/// @param [in] A path to the API file.
+/// @param [in] `max_connections` The maximum number of API file handles to open.
+/// @param [out] `api` A pointer to an `Api` pointer that will be modified.
+///
+/// @return An `Error` object that indicates success or failure.
+Error GetPooledApi(const char *path, size_t max_connections, Api **api);
+
+/// Get an instance of an `AsyncApi` object whose calls are made by `num_workers`
+/// worker threads, each with its own handle of the API file. The API file is
+/// searched for as by `GetApi(Api **api)`.
+///
+/// @param [in] `num_workers` The number of worker threads.
+/// @param [out] `api` A pointer to an `AsyncApi` pointer that will be modified.
+///
+/// @return An `Error` object that indicates success or failure, which is
+/// `kCantStartWorker` if a worker thread couldn't be started.
+Error GetAsyncApi(size_t num_workers, AsyncApi **api);
+
+/// Get an instance of an `AsyncApi` object using the API file at the given path.
+///
+/// @param [in] A path to the API file.
+/// @param [in] `num_workers` The number of worker threads.
+/// @param [out] `api` A pointer to an `AsyncApi` pointer that will be modified.
+///
+/// @return An `Error` object that indicates success or failure, which is
+/// `kCantStartWorker` if a worker thread couldn't be started.
+Error GetAsyncApi(const char *path, size_t num_workers, AsyncApi **api);
+
+/// Release an AsyncApi object after completing every call queued on it.
+///
+/// @param [in] `api` A pointer to an `AsyncApi` object that will be released.
+void ReleaseAsyncApi(AsyncApi *api);
+
 /// Release an Api object and any resources (such as open files) associated
 /// with it. The pointer will no longer be valid after it has been released.
 ///
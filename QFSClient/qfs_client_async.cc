@@ -0,0 +1,250 @@
+// Copyright (c) 2018 Arista Networks, Inc.
+// Use of this source code is governed by the Apache License 2.0
+// that can be found in the COPYING file.
+
+#include "QFSClient/qfs_client_async.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+#include "QFSClient/qfs_client_pool.h"
+#include "QFSClient/qfs_client_util.h"
+
+namespace qfsclient {
+
+Error GetAsyncApi(size_t num_workers, AsyncApi **api) {
+	return GetAsyncApi(NULL, num_workers, api);
+}
+
+Error GetAsyncApi(const char *path, size_t num_workers, AsyncApi **api) {
+	num_workers = std::max(num_workers, (size_t)1);
+
+	// Each worker will find a connection of its own in the pool
+	size_t max_queued = num_workers * kAsyncQueueDepthPerWorker;
+	AsyncApiImpl *impl = new AsyncApiImpl(new PooledApi(path, num_workers),
+					      num_workers, max_queued);
+
+	Error err = impl->StartError();
+	if (err.code != kSuccess) {
+		delete impl;
+		*api = NULL;
+		return err;
+	}
+
+	*api = impl;
+	return util::getError(kSuccess);
+}
+
+void ReleaseAsyncApi(AsyncApi *api) {
+	if (api != NULL) {
+		delete api;
+	}
+}
+
+AsyncApiImpl::AsyncApiImpl(Api *api, size_t num_workers, size_t max_queued)
+	: api(api),
+	  max_queued(std::max(max_queued, (size_t)1)),
+	  start_error(util::getError(kSuccess)),
+	  outstanding(0),
+	  stopping(false) {
+	pthread_mutex_init(&this->mutex, NULL);
+	pthread_cond_init(&this->call_queued, NULL);
+	pthread_cond_init(&this->call_taken, NULL);
+	pthread_cond_init(&this->calls_done, NULL);
+
+	num_workers = std::max(num_workers, (size_t)1);
+	for (size_t i = 0; i < num_workers; i++) {
+		pthread_t worker;
+		int err = pthread_create(&worker, NULL, WorkerMain, this);
+		if (err != 0) {
+			// pthread_create() returns the error, not errno
+			this->start_error = util::getError(kCantStartWorker,
+							   strerror(err));
+			break;
+		}
+		this->workers.push_back(worker);
+	}
+}
+
+Error AsyncApiImpl::StartError() const {
+	return this->start_error;
+}
+
+AsyncApiImpl::~AsyncApiImpl() {
+	pthread_mutex_lock(&this->mutex);
+	this->stopping = true;
+	pthread_mutex_unlock(&this->mutex);
+	pthread_cond_broadcast(&this->call_queued);
+
+	for (pthread_t worker : this->workers) {
+		pthread_join(worker, NULL);
+	}
+
+	pthread_cond_destroy(&this->calls_done);
+	pthread_cond_destroy(&this->call_taken);
+	pthread_cond_destroy(&this->call_queued);
+	pthread_mutex_destroy(&this->mutex);
+
+	delete this->api;
+}
+
+void AsyncApiImpl::Queue(const Call &call) {
+	if (this->workers.empty()) {
+		// No worker could be started, so the caller has to make the call
+		call();
+		return;
+	}
+
+	pthread_mutex_lock(&this->mutex);
+
+	while (this->queue.size() >= this->max_queued) {
+		pthread_cond_wait(&this->call_taken, &this->mutex);
+	}
+
+	this->queue.push_back(call);
+	this->outstanding++;
+
+	pthread_mutex_unlock(&this->mutex);
+	pthread_cond_signal(&this->call_queued);
+}
+
+void *AsyncApiImpl::WorkerMain(void *arg) {
+	reinterpret_cast<AsyncApiImpl *>(arg)->Work();
+	return NULL;
+}
+
+void AsyncApiImpl::Work() {
+	pthread_mutex_lock(&this->mutex);
+
+	while (true) {
+		while (this->queue.empty() && !this->stopping) {
+			pthread_cond_wait(&this->call_queued, &this->mutex);
+		}
+
+		if (this->queue.empty()) {
+			// stopping, and every queued call has been taken
+			break;
+		}
+
+		Call call = this->queue.front();
+		this->queue.pop_front();
+		pthread_cond_signal(&this->call_taken);
+
+		pthread_mutex_unlock(&this->mutex);
+		call();
+		pthread_mutex_lock(&this->mutex);
+
+		this->outstanding--;
+		if (this->outstanding == 0) {
+			pthread_cond_broadcast(&this->calls_done);
+		}
+	}
+
+	pthread_mutex_unlock(&this->mutex);
+}
+
+void AsyncApiImpl::WaitAll() {
+	pthread_mutex_lock(&this->mutex);
+
+	while (this->outstanding != 0) {
+		pthread_cond_wait(&this->calls_done, &this->mutex);
+	}
+
+	pthread_mutex_unlock(&this->mutex);
+}
+
+// The arguments of each call are copied, since the call is made after the
+// function returns to its caller.
+
+void AsyncApiImpl::GetAccessed(const char *workspace_root,
+			       AccessedCallback callback) {
+	Api *api = this->api;
+	std::string workspace_root_copy(workspace_root);
+
+	this->Queue([api, workspace_root_copy, callback]() {
+		PathsAccessed paths;
+		Error err = api->GetAccessed(workspace_root_copy.c_str(), &paths);
+		if (callback) {
+			callback(err, paths);
+		}
+	});
+}
+
+void AsyncApiImpl::InsertInode(const char *destination,
+			       const char *key,
+			       uint32_t permissions,
+			       uint32_t uid,
+			       uint32_t gid,
+			       Callback callback) {
+	Api *api = this->api;
+	std::string destination_copy(destination);
+	std::string key_copy(key);
+
+	this->Queue([api, destination_copy, key_copy, permissions, uid, gid,
+		     callback]() {
+		Error err = api->InsertInode(destination_copy.c_str(),
+					     key_copy.c_str(), permissions, uid,
+					     gid);
+		if (callback) {
+			callback(err);
+		}
+	});
+}
+
+void AsyncApiImpl::Branch(const char *source,
+			  const char *destination,
+			  Callback callback) {
+	Api *api = this->api;
+	std::string source_copy(source);
+	std::string destination_copy(destination);
+
+	this->Queue([api, source_copy, destination_copy, callback]() {
+		Error err = api->Branch(source_copy.c_str(),
+					destination_copy.c_str());
+		if (callback) {
+			callback(err);
+		}
+	});
+}
+
+void AsyncApiImpl::Delete(const char *workspace, Callback callback) {
+	Api *api = this->api;
+	std::string workspace_copy(workspace);
+
+	this->Queue([api, workspace_copy, callback]() {
+		Error err = api->Delete(workspace_copy.c_str());
+		if (callback) {
+			callback(err);
+		}
+	});
+}
+
+void AsyncApiImpl::SetBlock(const std::vector<byte> &key,
+			    const std::vector<byte> &data,
+			    Callback callback) {
+	Api *api = this->api;
+
+	this->Queue([api, key, data, callback]() {
+		Error err = api->SetBlock(key, data);
+		if (callback) {
+			callback(err);
+		}
+	});
+}
+
+void AsyncApiImpl::GetBlock(const std::vector<byte> &key,
+			    BlockCallback callback) {
+	Api *api = this->api;
+
+	this->Queue([api, key, callback]() {
+		std::vector<byte> data;
+		Error err = api->GetBlock(key, &data);
+		if (callback) {
+			callback(err, data);
+		}
+	});
+}
+
+}  // namespace qfsclient
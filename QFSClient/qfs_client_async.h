@@ -0,0 +1,104 @@
+// Copyright (c) 2018 Arista Networks, Inc.
+// Use of this source code is governed by the Apache License 2.0
+// that can be found in the COPYING file.
+
+#ifndef QFSCLIENT_QFS_CLIENT_ASYNC_H_
+#define QFSCLIENT_QFS_CLIENT_ASYNC_H_
+
+#include <pthread.h>
+
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include "QFSClient/qfs_client.h"
+
+namespace qfsclient {
+
+// The number of calls which may be queued on an AsyncApi per worker thread before
+// further calls block
+const size_t kAsyncQueueDepthPerWorker = 64;
+
+// AsyncApiImpl implements AsyncApi by queueing each call for a fixed set of worker
+// threads, which make the call on an Api shared between them. The queue is bounded
+// so that a caller issuing calls faster than they complete is held back rather
+// than queueing them without limit.
+class AsyncApiImpl: public AsyncApi {
+ public:
+	// The Api must be safe to call from num_workers threads at once, such as a
+	// PooledApi. It is released along with the AsyncApiImpl.
+	AsyncApiImpl(Api *api, size_t num_workers, size_t max_queued);
+
+	// Completes every queued call before stopping the worker threads
+	virtual ~AsyncApiImpl();
+
+	// Whether every worker thread was started. Calls queued on an AsyncApiImpl
+	// without any worker threads are made by the thread queueing them.
+	Error StartError() const;
+
+	virtual void GetAccessed(const char *workspace_root,
+				 AccessedCallback callback);
+
+	virtual void InsertInode(const char *destination,
+				 const char *key,
+				 uint32_t permissions,
+				 uint32_t uid,
+				 uint32_t gid,
+				 Callback callback);
+
+	virtual void Branch(const char *source,
+			    const char *destination,
+			    Callback callback);
+
+	virtual void Delete(const char *workspace, Callback callback);
+
+	virtual void SetBlock(const std::vector<byte> &key,
+			      const std::vector<byte> &data,
+			      Callback callback);
+
+	virtual void GetBlock(const std::vector<byte> &key,
+			      BlockCallback callback);
+
+	virtual void WaitAll();
+
+ private:
+	typedef std::function<void()> Call;
+
+	// Add a call to the queue, waiting for room if it is full
+	void Queue(const Call &call);
+
+	// The body of each worker thread, which makes queued calls until the
+	// AsyncApiImpl is released and the queue is empty
+	static void *WorkerMain(void *arg);
+	void Work();
+
+	Api *api;
+	size_t max_queued;
+	std::vector<pthread_t> workers;
+
+	// Why a worker thread couldn't be started, if one couldn't
+	Error start_error;
+
+	// Protects every member below
+	pthread_mutex_t mutex;
+
+	// Signalled when a call is queued or the workers should stop
+	pthread_cond_t call_queued;
+
+	// Signalled when a worker takes a call, making room in the queue
+	pthread_cond_t call_taken;
+
+	// Signalled when the last outstanding call completes
+	pthread_cond_t calls_done;
+
+	std::deque<Call> queue;
+
+	// Calls which have been queued but haven't yet completed
+	size_t outstanding;
+
+	bool stopping;
+};
+
+}  // namespace qfsclient
+
+#endif  // QFSCLIENT_QFS_CLIENT_ASYNC_H_
@@ -0,0 +1,308 @@
+// Copyright (c) 2018 Arista Networks, Inc.
+// Use of this source code is governed by the Apache License 2.0
+// that can be found in the COPYING file.
+
+#include "QFSClient/qfs_client_async.h"
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "QFSClient/qfs_client_util.h"
+
+namespace qfsclient {
+
+// FakeApi stands in for quantumfsd, recording the calls made by the workers of an
+// AsyncApiImpl and how many of them are in progress at once.
+class FakeApi: public Api {
+ public:
+	FakeApi() : calls(0), in_progress(0), max_in_progress(0), uid_total(0) {
+	}
+
+	virtual Error GetAccessed(const char *workspace_root, PathsAccessed *paths) {
+		Call();
+		paths->paths[workspace_root] = kPathRead;
+		return util::getError(kSuccess);
+	}
+
+	virtual Error GetAccessedPage(const char *workspace_root,
+				      AccessedCursor *cursor,
+				      uint32_t max_paths,
+				      std::vector<PathAccessed> *paths) {
+		return util::getError(kApiError);
+	}
+
+	virtual Error InsertInode(const char *destination,
+				  const char *key,
+				  uint32_t permissions,
+				  uint32_t uid,
+				  uint32_t gid) {
+		Call();
+		this->uid_total += uid;
+		return util::getError(kSuccess);
+	}
+
+	virtual Error InsertInodes(const std::vector<InsertInodeEntry> &inodes,
+				   std::vector<Error> *results) {
+		Call();
+		for (const InsertInodeEntry &inode : inodes) {
+			this->uid_total += inode.uid;
+		}
+		results->assign(inodes.size(), util::getError(kSuccess));
+		return util::getError(kSuccess);
+	}
+
+	virtual Error Branch(const char *source, const char *destination) {
+		Call();
+		return util::getError(kSuccess);
+	}
+
+	virtual Error Delete(const char *workspace) {
+		Call();
+		return util::getError(kWorkspaceNameInvalid, workspace);
+	}
+
+	virtual Error SetBlock(const std::vector<byte> &key,
+			       const std::vector<byte> &data) {
+		Call();
+		return util::getError(kSuccess);
+	}
+
+	// Returns the key reversed
+	virtual Error GetBlock(const std::vector<byte> &key,
+			       std::vector<byte> *data) {
+		Call();
+		data->assign(key.rbegin(), key.rend());
+		return util::getError(kSuccess);
+	}
+
+	virtual Error SetBlock(const byte *key, size_t key_size,
+			       const byte *data, size_t data_size) {
+		Call();
+		return util::getError(kSuccess);
+	}
+
+	virtual Error GetBlock(const byte *key, size_t key_size,
+			       std::vector<byte> *data) {
+		Call();
+		data->assign(key, key + key_size);
+		std::reverse(data->begin(), data->end());
+		return util::getError(kSuccess);
+	}
+
+	virtual Error GetBlockInto(const byte *key, size_t key_size,
+				   byte *data, size_t capacity,
+				   size_t *written) {
+		Call();
+		return util::getError(kApiError);
+	}
+
+	virtual Error StatBlock(const std::vector<byte> &key, size_t *size) {
+		Call();
+		*size = key.size();
+		return util::getError(kSuccess);
+	}
+
+	virtual Error HasBlocks(const std::vector<std::vector<byte>> &keys,
+				std::vector<bool> *present) {
+		Call();
+		present->assign(keys.size(), false);
+		return util::getError(kSuccess);
+	}
+
+	virtual Error SetBlockIfAbsent(const byte *data, size_t size,
+				       std::vector<byte> *key,
+				       bool *stored) {
+		Call();
+		return util::getError(kApiError);
+	}
+
+	virtual Error Prefetch(const std::vector<std::vector<byte>> &keys,
+			       const std::vector<std::string> &extended_keys) {
+		Call();
+		return util::getError(kApiError);
+	}
+
+	virtual Error EnableSharedMemory() {
+		return util::getError(kSharedMemoryFail);
+	}
+
+	virtual Error StartInsertInode(const char *destination,
+				       const char *key,
+				       uint32_t permissions,
+				       uint32_t uid,
+				       uint32_t gid,
+				       RequestId *request_id) {
+		return util::getError(kApiError);
+	}
+
+	virtual Error StartSetBlock(const std::vector<byte> &key,
+				    const std::vector<byte> &data,
+				    RequestId *request_id) {
+		return util::getError(kApiError);
+	}
+
+	virtual Error StartGetBlock(const std::vector<byte> &key,
+				    RequestId *request_id) {
+		return util::getError(kApiError);
+	}
+
+	virtual Error Wait(RequestId request_id, std::vector<byte> *data) {
+		return util::getError(kUnknownRequestId);
+	}
+
+	virtual Error ExecuteBatch(const Batch &batch,
+				   std::vector<Error> *results) {
+		return util::getError(kApiError);
+	}
+
+	virtual Error SetBlocks(const std::vector<Block> &blocks,
+				std::vector<Error> *results) {
+		return util::getError(kApiError);
+	}
+
+	virtual Error GetBlocks(const std::vector<std::vector<byte>> &keys,
+				std::vector<std::vector<byte>> *blocks,
+				std::vector<Error> *results) {
+		return util::getError(kApiError);
+	}
+
+	virtual uint64_t CompressionSavings() {
+		return 0;
+	}
+
+	virtual Error PutObject(const std::vector<byte> &key,
+				const byte *data,
+				size_t size) {
+		return util::getError(kApiError);
+	}
+
+	virtual Error GetObject(const std::vector<byte> &key,
+				std::vector<byte> *data) {
+		return util::getError(kApiError);
+	}
+
+	virtual Error GetObject(const std::vector<byte> &key, int fd) {
+		return util::getError(kApiError);
+	}
+
+	virtual Error EnableBlockCache(size_t max_bytes) {
+		return util::getError(kSuccess);
+	}
+
+	virtual BlockCacheStats GetBlockCacheStats() {
+		return BlockCacheStats();
+	}
+
+	std::atomic<size_t> calls;
+	std::atomic<size_t> in_progress;
+	std::atomic<size_t> max_in_progress;
+	std::atomic<uint64_t> uid_total;
+
+ private:
+	// Note the call and give other calls a chance to overlap with it
+	void Call() {
+		this->calls++;
+
+		size_t now = ++this->in_progress;
+		size_t seen = this->max_in_progress;
+		while (now > seen &&
+		       !this->max_in_progress.compare_exchange_weak(seen, now)) {
+		}
+		usleep(100);
+		this->in_progress--;
+	}
+};
+
+class QfsClientAsyncTest : public testing::Test {
+};
+
+TEST_F(QfsClientAsyncTest, ManyCallsTest) {
+	FakeApi *fake = new FakeApi;
+	const size_t num_workers = 4;
+	AsyncApiImpl api(fake, num_workers, 16);
+	ASSERT_EQ(api.StartError().code, kSuccess);
+
+	std::atomic<size_t> succeeded(0);
+	uint64_t uid_total = 0;
+	for (uint32_t i = 0; i < 1000; i++) {
+		api.InsertInode("test/workspace/root/file", "key", 0644, i, i,
+				[&succeeded](const Error &err) {
+			if (err.code == kSuccess) {
+				succeeded++;
+			}
+		});
+		uid_total += i;
+	}
+	api.WaitAll();
+
+	ASSERT_EQ(succeeded, 1000);
+	ASSERT_EQ(fake->calls, 1000);
+	ASSERT_EQ(fake->uid_total, uid_total);
+
+	// The calls were spread across the workers, but no further
+	ASSERT_GT(fake->max_in_progress, 1);
+	ASSERT_LE(fake->max_in_progress, num_workers);
+}
+
+TEST_F(QfsClientAsyncTest, ResultsTest) {
+	FakeApi *fake = new FakeApi;
+	AsyncApiImpl api(fake, 2, 4);
+
+	std::vector<byte> key = { 1, 2, 3 };
+	std::vector<byte> block;
+	Error get_block_err;
+	api.GetBlock(key, [&block, &get_block_err](const Error &err,
+						   const std::vector<byte> &data) {
+		get_block_err = err;
+		block = data;
+	});
+
+	PathsAccessed paths;
+	api.GetAccessed("test/workspace/root",
+			[&paths](const Error &err, const PathsAccessed &accessed) {
+		paths = accessed;
+	});
+
+	Error delete_err;
+	api.Delete("test/workspace", [&delete_err](const Error &err) {
+		delete_err = err;
+	});
+
+	// Arguments must be copied before the call returns
+	std::string *workspace = new std::string("test/workspace/other");
+	api.Branch(workspace->c_str(), "test/workspace/branch", NULL);
+	delete workspace;
+	api.SetBlock(key, key, NULL);
+	api.WaitAll();
+
+	ASSERT_EQ(get_block_err.code, kSuccess);
+	ASSERT_EQ(block, std::vector<byte>({ 3, 2, 1 }));
+	ASSERT_EQ(paths.paths.size(), 1);
+	ASSERT_EQ(paths.paths["test/workspace/root"], kPathRead);
+	ASSERT_EQ(delete_err.code, kWorkspaceNameInvalid);
+	ASSERT_EQ(fake->calls, 5);
+}
+
+TEST_F(QfsClientAsyncTest, ReleaseCompletesCallsTest) {
+	FakeApi *fake = new FakeApi;
+	std::atomic<size_t> completed(0);
+
+	AsyncApi *api = new AsyncApiImpl(fake, 3, 8);
+	for (int i = 0; i < 100; i++) {
+		std::vector<byte> key = { (byte)i };
+		api->SetBlock(key, key, [&completed](const Error &err) {
+			completed++;
+		});
+	}
+	ReleaseAsyncApi(api);
+
+	ASSERT_EQ(completed, 100);
+}
+
+}  // namespace qfsclient
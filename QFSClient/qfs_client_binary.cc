@@ -0,0 +1,303 @@
+// Copyright (c) 2018 Arista Networks, Inc.
+// Use of this source code is governed by the Apache License 2.0
+// that can be found in the COPYING file.
+
+#include "QFSClient/qfs_client_binary.h"
+
+#include <string.h>
+#include <zlib.h>
+
+#include "QFSClient/qfs_client_util.h"
+
+namespace qfsclient {
+
+// All integers in a frame are little endian regardless of the host
+static void PutUint32(byte *out, uint32_t value) {
+	out[0] = value;
+	out[1] = value >> 8;
+	out[2] = value >> 16;
+	out[3] = value >> 24;
+}
+
+static uint32_t GetUint32(const byte *in) {
+	return (uint32_t)in[0] | ((uint32_t)in[1] << 8) |
+	       ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+static uint16_t GetUint16(const byte *in) {
+	return (uint16_t)in[0] | ((uint16_t)in[1] << 8);
+}
+
+static void PutUint16(byte *out, uint16_t value) {
+	out[0] = value;
+	out[1] = value >> 8;
+}
+
+bool BinaryFrameSize(const CommandBuffer &frame, size_t *size) {
+	if (frame.Size() < kBinaryHeaderSize ||
+	    GetUint32(frame.Data()) != kBinaryMagic) {
+		return false;
+	}
+
+	*size = kBinaryHeaderSize + GetUint32(frame.Data() + 8);
+	return true;
+}
+
+bool CompressBinaryFrame(const CommandBuffer &frame, CommandBuffer *compressed) {
+	if (frame.Size() < kBinaryHeaderSize + kCompressionThreshold ||
+	    frame.Size() - kBinaryHeaderSize > UINT32_MAX) {
+		return false;
+	}
+	size_t payload_size = frame.Size() - kBinaryHeaderSize;
+
+	// the header, the uncompressed length and the zlib stream
+	const size_t prefix_size = kBinaryHeaderSize + 4;
+	uLongf stream_size = compressBound(payload_size);
+	if (compressed->Resize(prefix_size + stream_size) != kSuccess) {
+		return false;
+	}
+
+	byte *out = compressed->MutableData();
+	int err = compress2(out + prefix_size, &stream_size,
+			    frame.Data() + kBinaryHeaderSize, payload_size,
+			    Z_BEST_SPEED);
+	size_t size = prefix_size + stream_size;
+	if (err != Z_OK || size >= frame.Size()) {
+		return false;
+	}
+
+	compressed->Resize(size);
+	memcpy(out, frame.Data(), kBinaryHeaderSize);
+	PutUint16(out + 6, GetUint16(out + 6) | kBinaryFlagCompressed);
+	PutUint32(out + 8, size - kBinaryHeaderSize);
+	PutUint32(out + kBinaryHeaderSize, payload_size);
+	return true;
+}
+
+bool IsCompressedBinaryFrame(const CommandBuffer &frame) {
+	return frame.Size() >= kBinaryHeaderSize &&
+	       GetUint32(frame.Data()) == kBinaryMagic &&
+	       (GetUint16(frame.Data() + 6) & kBinaryFlagCompressed) != 0;
+}
+
+Error DecompressBinaryFrame(const CommandBuffer &frame,
+			    CommandBuffer *decompressed) {
+	size_t length = GetUint32(frame.Data() + 8);
+	if (length > frame.Size() - kBinaryHeaderSize || length < 4) {
+		return util::getError(kJsonDecodingError,
+				      "compressed binary response is truncated");
+	}
+
+	const byte *payload = frame.Data() + kBinaryHeaderSize;
+	uLongf payload_size = GetUint32(payload);
+	ErrorCode code = decompressed->Resize(kBinaryHeaderSize + payload_size);
+	if (code != kSuccess) {
+		return util::getError(code);
+	}
+
+	byte *out = decompressed->MutableData();
+	uLongf size = payload_size;
+	int err = uncompress(out + kBinaryHeaderSize, &size, payload + 4,
+			     length - 4);
+	if (err != Z_OK || size != payload_size) {
+		return util::getError(kJsonDecodingError,
+				      "compressed binary response is corrupt");
+	}
+
+	memcpy(out, frame.Data(), kBinaryHeaderSize);
+	PutUint16(out + 6, GetUint16(out + 6) & ~kBinaryFlagCompressed);
+	PutUint32(out + 8, payload_size);
+	return util::getError(kSuccess);
+}
+
+BinaryWriter::BinaryWriter(CommandID command_id, RequestId request_id)
+	: error(kSuccess) {
+	// The header is completed by Finish() once the length is known
+	byte header[kBinaryHeaderSize] = { 0 };
+	PutUint32(header, kBinaryMagic);
+	header[4] = kBinaryVersion;
+	header[5] = kBinaryVersion >> 8;
+	this->error = this->buffer.Append(header, sizeof(header));
+
+	AppendUint32(command_id);
+	AppendUint64(request_id);
+}
+
+void BinaryWriter::AppendUint32(uint32_t value) {
+	byte data[4];
+	PutUint32(data, value);
+	AppendRaw(data, sizeof(data));
+}
+
+void BinaryWriter::AppendUint64(uint64_t value) {
+	AppendUint32(value);
+	AppendUint32(value >> 32);
+}
+
+void BinaryWriter::AppendString(const char *value) {
+	AppendBytes(reinterpret_cast<const byte *>(value), strlen(value));
+}
+
+void BinaryWriter::AppendBytes(const byte *data, size_t size) {
+	if (size > UINT32_MAX) {
+		this->error = kBufferTooBig;
+		return;
+	}
+
+	AppendUint32(size);
+	AppendRaw(data, size);
+}
+
+void BinaryWriter::AppendBytes(const std::vector<byte> &data) {
+	AppendBytes(data.data(), data.size());
+}
+
+void BinaryWriter::AppendRaw(const byte *data, size_t size) {
+	if (this->error != kSuccess) {
+		return;
+	}
+
+	this->error = this->buffer.Append(data, size);
+}
+
+ErrorCode BinaryWriter::Finish() {
+	if (this->error != kSuccess) {
+		return this->error;
+	}
+
+	if (this->buffer.Size() - kBinaryHeaderSize > UINT32_MAX) {
+		return kBufferTooBig;
+	}
+
+	PutUint32(this->buffer.MutableData() + 8,
+		  this->buffer.Size() - kBinaryHeaderSize);
+	return kSuccess;
+}
+
+const CommandBuffer &BinaryWriter::Frame() const {
+	return this->buffer;
+}
+
+void BinaryWriter::TakeFrame(CommandBuffer *frame) {
+	frame->Swap(&this->buffer);
+}
+
+BinaryReader::BinaryReader() : payload(NULL), size(0), offset(0) {
+}
+
+Error BinaryReader::Open(const CommandBuffer &frame) {
+	this->payload = NULL;
+	this->size = 0;
+	this->offset = 0;
+
+	if (frame.Size() < kBinaryHeaderSize) {
+		return util::getError(kJsonDecodingError,
+				      "binary response shorter than its header");
+	}
+
+	const byte *header = frame.Data();
+	if (GetUint32(header) != kBinaryMagic) {
+		return util::getError(kJsonDecodingError,
+				      "binary response has a bad magic number");
+	}
+	if (GetUint16(header + 4) != kBinaryVersion) {
+		return util::getError(kJsonDecodingError,
+				      "binary response has an unknown version");
+	}
+	if ((GetUint16(header + 6) & kBinaryFlagCompressed) != 0) {
+		return util::getError(kJsonDecodingError,
+				      "binary response is still compressed");
+	}
+
+	size_t length = GetUint32(header + 8);
+	if (length > frame.Size() - kBinaryHeaderSize) {
+		return util::getError(kJsonDecodingError,
+				      "binary response is truncated");
+	}
+
+	this->payload = header + kBinaryHeaderSize;
+	this->size = length;
+	return util::getError(kSuccess);
+}
+
+bool BinaryReader::Next(size_t size, const byte **data) {
+	if (size > this->size - this->offset) {
+		return false;
+	}
+
+	*data = this->payload + this->offset;
+	this->offset += size;
+	return true;
+}
+
+bool BinaryReader::ReadBool(bool *value) {
+	const byte *data;
+	if (!Next(1, &data)) {
+		return false;
+	}
+
+	*value = *data != 0;
+	return true;
+}
+
+bool BinaryReader::ReadUint32(uint32_t *value) {
+	const byte *data;
+	if (!Next(4, &data)) {
+		return false;
+	}
+
+	*value = GetUint32(data);
+	return true;
+}
+
+bool BinaryReader::ReadUint64(uint64_t *value) {
+	uint32_t low, high;
+	if (!ReadUint32(&low) || !ReadUint32(&high)) {
+		return false;
+	}
+
+	*value = ((uint64_t)high << 32) | low;
+	return true;
+}
+
+bool BinaryReader::ReadString(std::string *value) {
+	uint32_t length;
+	const byte *data;
+	if (!ReadUint32(&length) || !Next(length, &data)) {
+		return false;
+	}
+
+	value->assign(reinterpret_cast<const char *>(data), length);
+	return true;
+}
+
+bool BinaryReader::ReadBytes(std::vector<byte> *value) {
+	uint32_t length;
+	const byte *data;
+	if (!ReadUint32(&length) || !Next(length, &data)) {
+		return false;
+	}
+
+	value->assign(data, data + length);
+	return true;
+}
+
+bool BinaryReader::ReadBytes(byte *value, size_t capacity, size_t *size) {
+	uint32_t length;
+	const byte *data;
+	if (!ReadUint32(&length) || !Next(length, &data)) {
+		return false;
+	}
+
+	*size = length;
+	if (length <= capacity) {
+		memcpy(value, data, length);
+	}
+	return true;
+}
+
+size_t BinaryReader::Remaining() const {
+	return this->size - this->offset;
+}
+
+}  // namespace qfsclient
@@ -0,0 +1,115 @@
+// Copyright (c) 2018 Arista Networks, Inc.
+// Use of this source code is governed by the Apache License 2.0
+// that can be found in the COPYING file.
+
+#ifndef QFSCLIENT_QFS_CLIENT_BINARY_H_
+#define QFSCLIENT_QFS_CLIENT_BINARY_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "QFSClient/qfs_client.h"
+#include "QFSClient/qfs_client_data.h"
+#include "QFSClient/qfs_client_implementation.h"
+
+namespace qfsclient {
+
+// These values are based on their master definitions in quantumfs/binarycmds.go,
+// which also describes the encoding itself: a fixed header followed by the fields
+// of the command in the order they are declared in quantumfs/cmds.go.
+const uint32_t kBinaryMagic = 0x42534651;  // "QFSB"
+const uint16_t kBinaryVersion = 1;
+const size_t kBinaryHeaderSize = 12;
+
+// Set in the flags of the header of a frame whose payload is compressed. Such a
+// payload is the uint32 length of the uncompressed payload followed by the zlib
+// stream of it.
+const uint16_t kBinaryFlagCompressed = 1 << 0;
+
+// If the buffer starts with the header of a binary frame, set size to the size of
+// the whole frame, including the header, and return true. The rest of the frame
+// needn't have been read yet.
+bool BinaryFrameSize(const CommandBuffer &frame, size_t *size);
+
+// Compress the payload of the frame into compressed and return true, unless the
+// frame is too small to be worth compressing or doesn't shrink, in which case it
+// should be sent as it is.
+bool CompressBinaryFrame(const CommandBuffer &frame, CommandBuffer *compressed);
+
+// Whether the buffer holds a binary frame with a compressed payload
+bool IsCompressedBinaryFrame(const CommandBuffer &frame);
+
+// Decompress a frame for which IsCompressedBinaryFrame() is true into
+// decompressed
+Error DecompressBinaryFrame(const CommandBuffer &frame,
+			    CommandBuffer *decompressed);
+
+// BinaryWriter builds a binary frame for a command in a CommandBuffer. The frame
+// header and the fields of CommandCommon are written by the constructor and the
+// payload length is filled in by Finish(), which must be called before the frame
+// is sent.
+class BinaryWriter {
+ public:
+	BinaryWriter(CommandID command_id, RequestId request_id);
+
+	void AppendUint32(uint32_t value);
+	void AppendUint64(uint64_t value);
+
+	// Strings and byte arrays are prefixed with their length
+	void AppendString(const char *value);
+	void AppendBytes(const byte *data, size_t size);
+	void AppendBytes(const std::vector<byte> &data);
+
+	// Complete the frame header. Returns an error if the frame couldn't be
+	// built because it grew too large.
+	ErrorCode Finish();
+
+	const CommandBuffer &Frame() const;
+
+	// Move the frame into the given buffer, without copying it. The writer
+	// must not be used afterwards.
+	void TakeFrame(CommandBuffer *frame);
+
+ private:
+	void AppendRaw(const byte *data, size_t size);
+
+	CommandBuffer buffer;
+	ErrorCode error;
+};
+
+// BinaryReader parses the fields of a binary frame in order. Every read checks
+// the bounds of the payload and returns false if the field isn't complete.
+class BinaryReader {
+ public:
+	BinaryReader();
+
+	// Check the frame header of the given buffer and prepare to read its
+	// payload. The buffer must outlive the reader.
+	Error Open(const CommandBuffer &frame);
+
+	bool ReadBool(bool *value);
+	bool ReadUint32(uint32_t *value);
+	bool ReadUint64(uint64_t *value);
+	bool ReadString(std::string *value);
+	bool ReadBytes(std::vector<byte> *value);
+
+	// Read bytes into the capacity bytes at value, setting size to how many
+	// there are. If they don't fit, size is set but nothing is copied.
+	bool ReadBytes(byte *value, size_t capacity, size_t *size);
+
+	// The number of payload bytes which haven't been read yet
+	size_t Remaining() const;
+
+ private:
+	bool Next(size_t size, const byte **data);
+
+	const byte *payload;
+	size_t size;
+	size_t offset;
+};
+
+}  // namespace qfsclient
+
+#endif  // QFSCLIENT_QFS_CLIENT_BINARY_H_
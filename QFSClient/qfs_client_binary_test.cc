@@ -0,0 +1,312 @@
+// Copyright (c) 2018 Arista Networks, Inc.
+// Use of this source code is governed by the Apache License 2.0
+// that can be found in the COPYING file.
+
+#include "QFSClient/qfs_client_binary.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+namespace qfsclient {
+
+class QfsClientBinaryTest : public testing::Test {
+};
+
+TEST_F(QfsClientBinaryTest, RoundTripTest) {
+	std::vector<byte> bytes = { 0, 1, 2, 0 };
+
+	BinaryWriter writer(kCmdInsertInode, 0x1122334455667788ULL);
+	writer.AppendString("some/workspace/path");
+	writer.AppendUint32(0xdeadbeef);
+	writer.AppendUint64(0x0123456789abcdefULL);
+	writer.AppendBytes(bytes);
+	writer.AppendString("");
+	ASSERT_EQ(writer.Finish(), kSuccess);
+
+	BinaryReader reader;
+	Error err = reader.Open(writer.Frame());
+	ASSERT_EQ(err.code, kSuccess);
+
+	uint32_t command_id;
+	ASSERT_TRUE(reader.ReadUint32(&command_id));
+	ASSERT_EQ(command_id, kCmdInsertInode);
+
+	uint64_t request_id;
+	ASSERT_TRUE(reader.ReadUint64(&request_id));
+	ASSERT_EQ(request_id, 0x1122334455667788ULL);
+
+	std::string path;
+	ASSERT_TRUE(reader.ReadString(&path));
+	ASSERT_EQ(path, "some/workspace/path");
+
+	uint32_t value32;
+	ASSERT_TRUE(reader.ReadUint32(&value32));
+	ASSERT_EQ(value32, 0xdeadbeef);
+
+	uint64_t value64;
+	ASSERT_TRUE(reader.ReadUint64(&value64));
+	ASSERT_EQ(value64, 0x0123456789abcdefULL);
+
+	std::vector<byte> read_bytes;
+	ASSERT_TRUE(reader.ReadBytes(&read_bytes));
+	ASSERT_EQ(read_bytes, bytes);
+
+	std::string empty = "not empty";
+	ASSERT_TRUE(reader.ReadString(&empty));
+	ASSERT_EQ(empty, "");
+
+	ASSERT_EQ(reader.Remaining(), 0);
+	ASSERT_FALSE(reader.ReadUint32(&value32));
+}
+
+TEST_F(QfsClientBinaryTest, ReadBytesIntoTest) {
+	std::vector<byte> bytes = { 1, 2, 3, 4 };
+
+	BinaryWriter writer(kCmdError, 0);
+	writer.AppendBytes(bytes);
+	writer.AppendBytes(bytes);
+	ASSERT_EQ(writer.Finish(), kSuccess);
+
+	BinaryReader reader;
+	Error err = reader.Open(writer.Frame());
+	ASSERT_EQ(err.code, kSuccess);
+	uint32_t command_id;
+	uint64_t request_id;
+	ASSERT_TRUE(reader.ReadUint32(&command_id));
+	ASSERT_TRUE(reader.ReadUint64(&request_id));
+
+	// bytes which don't fit are skipped, but their size is given
+	byte buffer[4] = { 0 };
+	size_t size = 0;
+	ASSERT_TRUE(reader.ReadBytes(buffer, 3, &size));
+	ASSERT_EQ(size, bytes.size());
+	ASSERT_EQ(buffer[0], 0);
+
+	ASSERT_TRUE(reader.ReadBytes(buffer, sizeof(buffer), &size));
+	ASSERT_EQ(size, bytes.size());
+	ASSERT_EQ(std::vector<byte>(buffer, buffer + size), bytes);
+
+	ASSERT_FALSE(reader.ReadBytes(buffer, sizeof(buffer), &size));
+}
+
+TEST_F(QfsClientBinaryTest, ReadBoolTest) {
+	// a bool is a single byte, any but zero being true
+	BinaryWriter writer(kCmdError, 0);
+	writer.AppendUint32(0x00020100);
+	ASSERT_EQ(writer.Finish(), kSuccess);
+
+	BinaryReader reader;
+	Error err = reader.Open(writer.Frame());
+	ASSERT_EQ(err.code, kSuccess);
+	uint32_t command_id;
+	uint64_t request_id;
+	ASSERT_TRUE(reader.ReadUint32(&command_id));
+	ASSERT_TRUE(reader.ReadUint64(&request_id));
+
+	bool value;
+	ASSERT_TRUE(reader.ReadBool(&value));
+	ASSERT_FALSE(value);
+	ASSERT_TRUE(reader.ReadBool(&value));
+	ASSERT_TRUE(value);
+	ASSERT_TRUE(reader.ReadBool(&value));
+	ASSERT_TRUE(value);
+	ASSERT_TRUE(reader.ReadBool(&value));
+	ASSERT_FALSE(value);
+	ASSERT_FALSE(reader.ReadBool(&value));
+}
+
+TEST_F(QfsClientBinaryTest, TakeFrameTest) {
+	BinaryWriter writer(kCmdGetBlock, 3);
+	writer.AppendString("key");
+	ASSERT_EQ(writer.Finish(), kSuccess);
+
+	CommandBuffer expected;
+	expected.Copy(writer.Frame());
+
+	CommandBuffer frame;
+	writer.TakeFrame(&frame);
+	ASSERT_EQ(frame.Size(), expected.Size());
+	ASSERT_EQ(memcmp(frame.Data(), expected.Data(), frame.Size()), 0);
+}
+
+// The layout of a frame must match EncodeBinaryCommand() in quantumfs/binarycmds.go
+TEST_F(QfsClientBinaryTest, FrameLayoutTest) {
+	BinaryWriter writer(kCmdGetAccessed, 7);
+	writer.AppendString("a/b/c");
+	ASSERT_EQ(writer.Finish(), kSuccess);
+
+	const byte expected[] = {
+		'Q', 'F', 'S', 'B',      // magic
+		1, 0,                    // version
+		0, 0,                    // flags
+		21, 0, 0, 0,             // payload length
+		3, 0, 0, 0,              // CommandId
+		7, 0, 0, 0, 0, 0, 0, 0,  // RequestId
+		5, 0, 0, 0,              // WorkspaceRoot length
+		'a', '/', 'b', '/', 'c',
+	};
+
+	const CommandBuffer &frame = writer.Frame();
+	ASSERT_EQ(frame.Size(), sizeof(expected));
+	ASSERT_EQ(memcmp(frame.Data(), expected, sizeof(expected)), 0);
+}
+
+TEST_F(QfsClientBinaryTest, CorruptFrameTest) {
+	BinaryWriter writer(kCmdBranchRequest, 0);
+	writer.AppendString("a/b/c");
+	ASSERT_EQ(writer.Finish(), kSuccess);
+	const CommandBuffer &frame = writer.Frame();
+
+	BinaryReader reader;
+	CommandBuffer corrupt;
+
+	// too short to hold a header
+	corrupt.Append(frame.Data(), kBinaryHeaderSize - 1);
+	ASSERT_EQ(reader.Open(corrupt).code, kJsonDecodingError);
+
+	// payload shorter than the header claims
+	corrupt.Reset();
+	corrupt.Append(frame.Data(), frame.Size() - 1);
+	ASSERT_EQ(reader.Open(corrupt).code, kJsonDecodingError);
+
+	// bad magic
+	corrupt.Copy(frame);
+	corrupt.MutableData()[0] = '{';
+	ASSERT_EQ(reader.Open(corrupt).code, kJsonDecodingError);
+
+	// unknown version
+	corrupt.Copy(frame);
+	corrupt.MutableData()[4] = 2;
+	ASSERT_EQ(reader.Open(corrupt).code, kJsonDecodingError);
+
+	// a string length running past the end of the payload
+	corrupt.Copy(frame);
+	corrupt.MutableData()[kBinaryHeaderSize + 12] = 0xff;
+	ASSERT_EQ(reader.Open(corrupt).code, kSuccess);
+
+	uint32_t command_id;
+	uint64_t request_id;
+	std::string value;
+	ASSERT_TRUE(reader.ReadUint32(&command_id));
+	ASSERT_TRUE(reader.ReadUint64(&request_id));
+	ASSERT_FALSE(reader.ReadString(&value));
+}
+
+TEST_F(QfsClientBinaryTest, FrameSizeTest) {
+	BinaryWriter writer(kCmdBranchRequest, 0);
+	writer.AppendString("a/b/c");
+	ASSERT_EQ(writer.Finish(), kSuccess);
+	const CommandBuffer &frame = writer.Frame();
+
+	size_t size = 0;
+	ASSERT_TRUE(BinaryFrameSize(frame, &size));
+	ASSERT_EQ(size, frame.Size());
+
+	// The header alone is enough
+	CommandBuffer partial;
+	partial.Append(frame.Data(), kBinaryHeaderSize);
+	size = 0;
+	ASSERT_TRUE(BinaryFrameSize(partial, &size));
+	ASSERT_EQ(size, frame.Size());
+
+	partial.Reset();
+	partial.Append(frame.Data(), kBinaryHeaderSize - 1);
+	ASSERT_FALSE(BinaryFrameSize(partial, &size));
+
+	CommandBuffer json;
+	json.CopyString("{\"CommandId\":2,\"ErrorCode\":0,\"Message\":\"\"}");
+	ASSERT_FALSE(BinaryFrameSize(json, &size));
+}
+
+TEST_F(QfsClientBinaryTest, CompressionTest) {
+	std::string value;
+	while (value.size() < 4 * kCompressionThreshold) {
+		value += "compressible ";
+	}
+
+	BinaryWriter writer(kCmdSetBlock, 7);
+	writer.AppendString(value.c_str());
+	ASSERT_EQ(writer.Finish(), kSuccess);
+	const CommandBuffer &frame = writer.Frame();
+
+	CommandBuffer compressed;
+	ASSERT_TRUE(CompressBinaryFrame(frame, &compressed));
+	ASSERT_LT(compressed.Size(), frame.Size());
+	ASSERT_TRUE(IsCompressedBinaryFrame(compressed));
+	ASSERT_FALSE(IsCompressedBinaryFrame(frame));
+
+	// A compressed frame can't be read until it is decompressed
+	BinaryReader reader;
+	ASSERT_EQ(reader.Open(compressed).code, kJsonDecodingError);
+
+	CommandBuffer decompressed;
+	ASSERT_EQ(DecompressBinaryFrame(compressed, &decompressed).code, kSuccess);
+	ASSERT_EQ(decompressed.Size(), frame.Size());
+	ASSERT_EQ(memcmp(decompressed.Data(), frame.Data(), frame.Size()), 0);
+
+	ASSERT_EQ(reader.Open(decompressed).code, kSuccess);
+	uint32_t command_id;
+	uint64_t request_id;
+	std::string read_value;
+	ASSERT_TRUE(reader.ReadUint32(&command_id));
+	ASSERT_TRUE(reader.ReadUint64(&request_id));
+	ASSERT_TRUE(reader.ReadString(&read_value));
+	ASSERT_EQ(request_id, 7);
+	ASSERT_EQ(read_value, value);
+}
+
+TEST_F(QfsClientBinaryTest, CompressionSkippedTest) {
+	// too small to be worth compressing
+	BinaryWriter small(kCmdBranchRequest, 0);
+	small.AppendString("a/b/c");
+	ASSERT_EQ(small.Finish(), kSuccess);
+
+	CommandBuffer compressed;
+	ASSERT_FALSE(CompressBinaryFrame(small.Frame(), &compressed));
+
+	// large, but random enough not to shrink
+	std::vector<byte> noise(2 * kCompressionThreshold);
+	uint32_t state = 1;
+	for (size_t i = 0; i < noise.size(); i++) {
+		state = state * 1103515245 + 12345;
+		noise[i] = state >> 24;
+	}
+	BinaryWriter large(kCmdSetBlock, 0);
+	large.AppendBytes(noise);
+	ASSERT_EQ(large.Finish(), kSuccess);
+	ASSERT_FALSE(CompressBinaryFrame(large.Frame(), &compressed));
+}
+
+TEST_F(QfsClientBinaryTest, CorruptCompressedFrameTest) {
+	std::string value(4 * kCompressionThreshold, 'x');
+	BinaryWriter writer(kCmdSetBlock, 0);
+	writer.AppendString(value.c_str());
+	ASSERT_EQ(writer.Finish(), kSuccess);
+
+	CommandBuffer compressed;
+	ASSERT_TRUE(CompressBinaryFrame(writer.Frame(), &compressed));
+
+	CommandBuffer corrupt;
+	CommandBuffer decompressed;
+
+	// payload shorter than the header claims
+	corrupt.Append(compressed.Data(), compressed.Size() - 1);
+	ASSERT_EQ(DecompressBinaryFrame(corrupt, &decompressed).code,
+		  kJsonDecodingError);
+
+	// a damaged zlib stream
+	corrupt.Copy(compressed);
+	corrupt.MutableData()[kBinaryHeaderSize + 6] ^= 0xff;
+	ASSERT_EQ(DecompressBinaryFrame(corrupt, &decompressed).code,
+		  kJsonDecodingError);
+
+	// an uncompressed length which doesn't match the stream
+	corrupt.Copy(compressed);
+	corrupt.MutableData()[kBinaryHeaderSize] += 1;
+	ASSERT_EQ(DecompressBinaryFrame(corrupt, &decompressed).code,
+		  kJsonDecodingError);
+}
+
+}  // namespace qfsclient
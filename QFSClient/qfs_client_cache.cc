@@ -0,0 +1,123 @@
+// Copyright (c) 2018 Arista Networks, Inc.
+// Use of this source code is governed by the Apache License 2.0
+// that can be found in the COPYING file.
+
+#include "QFSClient/qfs_client_cache.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace qfsclient {
+
+BlockCache::BlockCache(size_t max_bytes) : max_bytes(max_bytes), stats() {
+	pthread_mutex_init(&this->mutex, NULL);
+}
+
+BlockCache::~BlockCache() {
+	pthread_mutex_destroy(&this->mutex);
+}
+
+bool BlockCache::Get(const byte *key, size_t key_size, std::vector<byte> *data) {
+	std::string cache_key(reinterpret_cast<const char *>(key), key_size);
+
+	pthread_mutex_lock(&this->mutex);
+
+	auto it = this->index.find(cache_key);
+	if (it == this->index.end()) {
+		this->stats.misses++;
+		pthread_mutex_unlock(&this->mutex);
+		return false;
+	}
+
+	this->stats.hits++;
+	this->entries.splice(this->entries.begin(), this->entries, it->second);
+	*data = it->second->data;
+
+	pthread_mutex_unlock(&this->mutex);
+	return true;
+}
+
+bool BlockCache::Get(const byte *key, size_t key_size, byte *data,
+		     size_t capacity, size_t *size) {
+	std::string cache_key(reinterpret_cast<const char *>(key), key_size);
+
+	pthread_mutex_lock(&this->mutex);
+
+	auto it = this->index.find(cache_key);
+	if (it == this->index.end()) {
+		this->stats.misses++;
+		pthread_mutex_unlock(&this->mutex);
+		return false;
+	}
+
+	this->stats.hits++;
+	this->entries.splice(this->entries.begin(), this->entries, it->second);
+	const std::vector<byte> &cached = it->second->data;
+	*size = cached.size();
+	if (cached.size() <= capacity) {
+		std::copy(cached.begin(), cached.end(), data);
+	}
+
+	pthread_mutex_unlock(&this->mutex);
+	return true;
+}
+
+void BlockCache::Put(const byte *key, size_t key_size,
+		     const std::vector<byte> &data) {
+	if (key_size + data.size() > this->max_bytes) {
+		return;
+	}
+
+	std::string cache_key(reinterpret_cast<const char *>(key), key_size);
+
+	pthread_mutex_lock(&this->mutex);
+
+	// Another thread may have retrieved the same block meanwhile, which is
+	// the same as this one unless the key was stored again, which erases it
+	if (this->index.find(cache_key) == this->index.end()) {
+		this->entries.push_front({ cache_key, data });
+		this->index[cache_key] = this->entries.begin();
+		this->stats.blocks++;
+		this->stats.bytes += key_size + data.size();
+		this->Evict();
+	}
+
+	pthread_mutex_unlock(&this->mutex);
+}
+
+void BlockCache::Erase(const byte *key, size_t key_size) {
+	std::string cache_key(reinterpret_cast<const char *>(key), key_size);
+
+	pthread_mutex_lock(&this->mutex);
+
+	auto it = this->index.find(cache_key);
+	if (it != this->index.end()) {
+		this->stats.blocks--;
+		this->stats.bytes -= key_size + it->second->data.size();
+		this->entries.erase(it->second);
+		this->index.erase(it);
+	}
+
+	pthread_mutex_unlock(&this->mutex);
+}
+
+BlockCacheStats BlockCache::Stats() {
+	pthread_mutex_lock(&this->mutex);
+	BlockCacheStats stats = this->stats;
+	pthread_mutex_unlock(&this->mutex);
+
+	return stats;
+}
+
+void BlockCache::Evict() {
+	while (this->stats.bytes > this->max_bytes) {
+		const Entry &oldest = this->entries.back();
+		this->stats.blocks--;
+		this->stats.bytes -= oldest.key.size() + oldest.data.size();
+		this->index.erase(oldest.key);
+		this->entries.pop_back();
+	}
+}
+
+}  // namespace qfsclient
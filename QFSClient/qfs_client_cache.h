@@ -0,0 +1,69 @@
+// Copyright (c) 2018 Arista Networks, Inc.
+// Use of this source code is governed by the Apache License 2.0
+// that can be found in the COPYING file.
+
+#ifndef QFSCLIENT_QFS_CLIENT_CACHE_H_
+#define QFSCLIENT_QFS_CLIENT_CACHE_H_
+
+#include <pthread.h>
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "QFSClient/qfs_client.h"
+
+namespace qfsclient {
+
+// BlockCache keeps recently retrieved blocks in memory, up to a budget of bytes
+// of keys and blocks, evicting the least recently used block to make room for
+// another. quantumfsd doesn't check that a key matches the content of its block, so
+// a key stored again is erased from the cache. BlockCache may be shared by many
+// threads, such as by the connections of a PooledApi.
+class BlockCache {
+ public:
+	explicit BlockCache(size_t max_bytes);
+	~BlockCache();
+
+	// If the block of the key is cached, copy it into data and return true
+	bool Get(const byte *key, size_t key_size, std::vector<byte> *data);
+
+	// If the block of the key is cached, set size to its size and return true,
+	// copying it into data if it fits in capacity bytes
+	bool Get(const byte *key, size_t key_size, byte *data, size_t capacity,
+		 size_t *size);
+
+	// Cache the block of the key. A block which doesn't fit in the budget on
+	// its own isn't kept.
+	void Put(const byte *key, size_t key_size, const std::vector<byte> &data);
+
+	// Drop the block of the key, if it is cached, as it is being replaced
+	void Erase(const byte *key, size_t key_size);
+
+	BlockCacheStats Stats();
+
+ private:
+	struct Entry {
+		std::string key;
+		std::vector<byte> data;
+	};
+
+	// Remove least recently used blocks until the cache is within max_bytes
+	void Evict();
+
+	size_t max_bytes;
+
+	// Protects every member below
+	pthread_mutex_t mutex;
+
+	// The cached blocks, most recently used first, and an index of them by key
+	std::list<Entry> entries;
+	std::unordered_map<std::string, std::list<Entry>::iterator> index;
+
+	BlockCacheStats stats;
+};
+
+}  // namespace qfsclient
+
+#endif  // QFSCLIENT_QFS_CLIENT_CACHE_H_
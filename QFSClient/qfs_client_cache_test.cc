@@ -0,0 +1,133 @@
+// Copyright (c) 2018 Arista Networks, Inc.
+// Use of this source code is governed by the Apache License 2.0
+// that can be found in the COPYING file.
+
+#include "QFSClient/qfs_client_cache.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace qfsclient {
+
+class QfsClientCacheTest : public testing::Test {
+};
+
+TEST_F(QfsClientCacheTest, GetPutTest) {
+	BlockCache cache(1024);
+	const byte key[] = { 1, 2, 3 };
+	std::vector<byte> data = { 'a', 'b', 'c' };
+
+	std::vector<byte> read_data;
+	ASSERT_FALSE(cache.Get(key, sizeof(key), &read_data));
+
+	cache.Put(key, sizeof(key), data);
+	ASSERT_TRUE(cache.Get(key, sizeof(key), &read_data));
+	ASSERT_EQ(read_data, data);
+
+	// The key is compared in full
+	ASSERT_FALSE(cache.Get(key, sizeof(key) - 1, &read_data));
+
+	BlockCacheStats stats = cache.Stats();
+	ASSERT_EQ(stats.hits, 1);
+	ASSERT_EQ(stats.misses, 2);
+	ASSERT_EQ(stats.blocks, 1);
+	ASSERT_EQ(stats.bytes, sizeof(key) + data.size());
+}
+
+TEST_F(QfsClientCacheTest, GetIntoTest) {
+	BlockCache cache(1024);
+	const byte key[] = { 1, 2, 3 };
+	std::vector<byte> data = { 'a', 'b', 'c' };
+
+	byte buffer[3] = { 0 };
+	size_t size = 0;
+	ASSERT_FALSE(cache.Get(key, sizeof(key), buffer, sizeof(buffer), &size));
+
+	cache.Put(key, sizeof(key), data);
+
+	// a block which doesn't fit is still found, but not copied
+	ASSERT_TRUE(cache.Get(key, sizeof(key), buffer, 2, &size));
+	ASSERT_EQ(size, data.size());
+	ASSERT_EQ(buffer[0], 0);
+
+	ASSERT_TRUE(cache.Get(key, sizeof(key), buffer, sizeof(buffer), &size));
+	ASSERT_EQ(size, data.size());
+	ASSERT_EQ(std::vector<byte>(buffer, buffer + size), data);
+
+	BlockCacheStats stats = cache.Stats();
+	ASSERT_EQ(stats.hits, 2);
+	ASSERT_EQ(stats.misses, 1);
+}
+
+TEST_F(QfsClientCacheTest, EraseTest) {
+	BlockCache cache(1024);
+	const byte key[] = { 1, 2, 3 };
+	std::vector<byte> data = { 'a', 'b', 'c' };
+	std::vector<byte> read_data;
+
+	// erasing a key which isn't cached does nothing
+	cache.Erase(key, sizeof(key));
+	ASSERT_EQ(cache.Stats().blocks, 0);
+
+	cache.Put(key, sizeof(key), data);
+	cache.Erase(key, sizeof(key));
+	ASSERT_FALSE(cache.Get(key, sizeof(key), &read_data));
+
+	BlockCacheStats stats = cache.Stats();
+	ASSERT_EQ(stats.blocks, 0);
+	ASSERT_EQ(stats.bytes, 0);
+
+	// the key may be cached again, with another block
+	std::vector<byte> new_data = { 'd' };
+	cache.Put(key, sizeof(key), new_data);
+	ASSERT_TRUE(cache.Get(key, sizeof(key), &read_data));
+	ASSERT_EQ(read_data, new_data);
+}
+
+TEST_F(QfsClientCacheTest, EvictionTest) {
+	// Room for three blocks of a one byte key and 9 bytes of data
+	BlockCache cache(30);
+	std::vector<byte> data(9, 7);
+	std::vector<byte> read_data;
+
+	for (byte key = 0; key < 3; key++) {
+		cache.Put(&key, 1, data);
+	}
+	ASSERT_EQ(cache.Stats().blocks, 3);
+
+	// Using the oldest block makes the second the least recently used
+	byte key = 0;
+	ASSERT_TRUE(cache.Get(&key, 1, &read_data));
+
+	key = 3;
+	cache.Put(&key, 1, data);
+	ASSERT_EQ(cache.Stats().blocks, 3);
+	ASSERT_EQ(cache.Stats().bytes, 30);
+
+	for (key = 0; key < 4; key++) {
+		ASSERT_EQ(cache.Get(&key, 1, &read_data), key != 1);
+	}
+
+	// A block larger than the whole cache isn't kept, nor does it evict others
+	std::vector<byte> large(30, 1);
+	key = 4;
+	cache.Put(&key, 1, large);
+	ASSERT_FALSE(cache.Get(&key, 1, &read_data));
+	ASSERT_EQ(cache.Stats().blocks, 3);
+}
+
+TEST_F(QfsClientCacheTest, DuplicatePutTest) {
+	BlockCache cache(1024);
+	const byte key[] = { 1 };
+	std::vector<byte> data = { 'a' };
+
+	cache.Put(key, sizeof(key), data);
+	cache.Put(key, sizeof(key), data);
+
+	BlockCacheStats stats = cache.Stats();
+	ASSERT_EQ(stats.blocks, 1);
+	ASSERT_EQ(stats.bytes, 2);
+}
+
+}  // namespace qfsclient
@@ -2,25 +2,56 @@
 // Use of this source code is governed by the Apache License 2.0
 // that can be found in the COPYING file.
 
+// Code generated by cmd/qfsclientgen from the quantumfs package. DO NOT EDIT.
+// Run "make qfsclientdata" after changing the api to regenerate it.
+
 #ifndef QFSCLIENT_QFS_CLIENT_DATA_H_
 #define QFSCLIENT_QFS_CLIENT_DATA_H_
 
-// These enums (CommandID and CommandError) are based on their master
-// definitions in quantumfs/cmds.go
+#include <stddef.h>
+
+// The ids of the api commands
 enum CommandID {
 	kCmdInvalid = 0,
 	kCmdError = 1,
 	kCmdBranchRequest = 2,
-	kCmdGetAccessed = 3,    // not in aid/3015
-	kCmdClearAccessed = 4,  // not in aid/3015
-	kCmdSyncAll = 5,        // not in aid/3015
+	kCmdGetAccessed = 3,
+	kCmdClearAccessed = 4,
+	kCmdSyncAll = 5,
 	kCmdInsertInode = 6,
 	kCmdDeleteWorkspace = 7,
 	kCmdSetBlock = 8,
 	kCmdGetBlock = 9,
 	kCmdEnableRootWrite = 10,
+	kCmdSetWorkspaceImmutable = 11,
+	kCmdMergeWorkspaces = 12,
+	kCmdSyncWorkspace = 13,
+	kCmdWorkspaceFinished = 14,
+	kCmdSetProtocol = 15,
+	kCmdGetAccessedPage = 16,
+	kCmdRegisterSharedMemory = 17,
+	kCmdSetBlockShared = 18,
+	kCmdGetBlockShared = 19,
+	kCmdBatch = 20,
+	kCmdStatBlock = 21,
+	kCmdHasBlocks = 22,
+	kCmdPrefetch = 23,
+	kCmdInsertInodes = 24,
+};
+
+// The encodings an api file handle may use, see qfs_client_binary.h
+enum Protocol {
+	kProtocolJson = 0,
+	kProtocolBinary = 1,
 };
 
+// The compression of binary frames which may be asked for with SetProtocol
+enum Compression {
+	kCompressionNone = 0,
+	kCompressionZlib = 1,
+};
+
+// The errors the api commands may fail with
 enum CommandError {
 	// Command Successful
 	kCmdOk = 0,
@@ -34,48 +65,402 @@ enum CommandError {
 	// Unknown command ID
 	kCmdBadCommandId = 3,
 
-	// The Command failed, see the error for more info
+	// The Command failed, see the error for info
 	kCmdCommandFailed = 4,
 
-	// The extended key is not stored in the datastore
+	// The extended key isn't stored in datastore
 	kCmdKeyNotFound = 5,
 
-	// SetBlock was passed a block that was too large
-	kErrorBlockTooLarge = 6,
+	// SetBlock was passed a block that's too large
+	kCmdBlockTooLarge = 6,
+
+	// The workspace cannot be found in QuantumFS
+	kCmdWorkspaceNotFound = 7,
 };
 
-// names of commonly-used JSON fields
+// The names of the fields of the JSON commands and responses
+static const char kBaseWorkspace[] = "BaseWorkspace";
+static const char kCapacity[] = "Capacity";
 static const char kCommandId[] = "CommandId";
-static const char kWorkspaceRoot[] = "WorkspaceRoot";
-static const char kWorkspacePath[] = "WorkspacePath";
+static const char kCommands[] = "Commands";
+static const char kCompression[] = "Compression";
+static const char kConflictPreference[] = "ConflictPreference";
+static const char kCursor[] = "Cursor";
+static const char kData[] = "Data";
+static const char kDst[] = "Dst";
+static const char kDstPath[] = "DstPath";
 static const char kErrorCode[] = "ErrorCode";
+static const char kExtendedKeys[] = "ExtendedKeys";
+static const char kFlags[] = "Flags";
+static const char kGid[] = "Gid";
+static const char kInodes[] = "Inodes";
+static const char kKey[] = "Key";
+static const char kKeys[] = "Keys";
+static const char kLength[] = "Length";
+static const char kLocalWorkspace[] = "LocalWorkspace";
 static const char kMessage[] = "Message";
+static const char kNextCursor[] = "NextCursor";
+static const char kOffset[] = "Offset";
+static const char kPageSize[] = "PageSize";
+static const char kPath[] = "Path";
 static const char kPathList[] = "PathList";
 static const char kPaths[] = "Paths";
-static const char kDstPath[] = "DstPath";
-static const char kKey[] = "Key";
-static const char kData[] = "Data";
-static const char kUid[] = "Uid";
-static const char kGid[] = "Gid";
 static const char kPermissions[] = "Permissions";
-static const char kSource[] = "Src";
-static const char kDestination[] = "Dst";
+static const char kPresent[] = "Present";
+static const char kProtocol[] = "Protocol";
+static const char kReferenceWorkspace[] = "ReferenceWorkspace";
+static const char kRemoteWorkspace[] = "RemoteWorkspace";
+static const char kRequestId[] = "RequestId";
+static const char kResults[] = "Results";
+static const char kSize[] = "Size";
+static const char kSkipPaths[] = "SkipPaths";
+static const char kSrc[] = "Src";
+static const char kUid[] = "Uid";
+static const char kWorkspace[] = "Workspace";
+static const char kWorkspacePath[] = "WorkspacePath";
+static const char kWorkspaceRoot[] = "WorkspaceRoot";
+
+// A field of an api structure in the binary encoding of binarycmds.go. Its format
+// gives the encoding of its type: 'I' for uint32 and int32; 'L' for uint64, int64,
+// uint and int; 'B' for bool; 'S' for string and []byte; '[' followed by the format
+// of the elements for other slices; '{' followed by the formats of the key and the
+// value for maps; and the formats of the fields between '(' and ')' for other
+// structures.
+struct BinaryField {
+	const char *name;
+	const char *format;
+};
+
+// The fields of each api structure in encoding order, ending at a NULL name
+static const BinaryField kPathsAccessedFields[] = {
+	{ kPaths, "{SL" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kCommandCommonFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kErrorResponseFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kErrorCode, "I" },
+	{ kMessage, "S" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kAccessListResponseFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kErrorCode, "I" },
+	{ kMessage, "S" },
+	{ kPathList, "({SL)" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kBranchRequestFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kSrc, "S" },
+	{ kDst, "S" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kMergeRequestFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kBaseWorkspace, "S" },
+	{ kRemoteWorkspace, "S" },
+	{ kLocalWorkspace, "S" },
+	{ kConflictPreference, "L" },
+	{ kSkipPaths, "[S" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kRefreshRequestFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kWorkspace, "S" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kAdvanceWSDBRequestFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kWorkspace, "S" },
+	{ kReferenceWorkspace, "S" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kAccessedRequestFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kWorkspaceRoot, "S" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kAccessedPageRequestFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kWorkspaceRoot, "S" },
+	{ kCursor, "L" },
+	{ kPageSize, "I" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kAccessedPathFields[] = {
+	{ kPath, "S" },
+	{ kFlags, "L" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kAccessedPageResponseFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kErrorCode, "I" },
+	{ kMessage, "S" },
+	{ kPaths, "[(SL)" },
+	{ kNextCursor, "L" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kSyncAllRequestFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kSyncWorkspaceRequestFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kWorkspace, "S" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kInsertInodeRequestFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kDstPath, "S" },
+	{ kKey, "S" },
+	{ kUid, "I" },
+	{ kGid, "I" },
+	{ kPermissions, "I" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kInsertInodeEntryFields[] = {
+	{ kDstPath, "S" },
+	{ kKey, "S" },
+	{ kUid, "I" },
+	{ kGid, "I" },
+	{ kPermissions, "I" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kInsertInodesRequestFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kInodes, "[(SSIII)" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kInsertInodesResponseFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kErrorCode, "I" },
+	{ kMessage, "S" },
+	{ kResults, "[(ILIS)" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kEnableRootWriteRequestFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kWorkspace, "S" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kDeleteWorkspaceRequestFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kWorkspacePath, "S" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kSetBlockRequestFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kKey, "S" },
+	{ kData, "S" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kGetBlockRequestFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kKey, "S" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kGetBlockResponseFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kErrorCode, "I" },
+	{ kMessage, "S" },
+	{ kData, "S" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kSetWorkspaceImmutableRequestFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kWorkspacePath, "S" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kWorkspaceFinishedRequestFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kWorkspacePath, "S" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kSetProtocolRequestFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kProtocol, "I" },
+	{ kCompression, "I" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kSetProtocolResponseFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kErrorCode, "I" },
+	{ kMessage, "S" },
+	{ kCompression, "I" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kRegisterSharedMemoryRequestFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kPath, "S" },
+	{ kSize, "L" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kSetBlockSharedRequestFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kKey, "S" },
+	{ kOffset, "L" },
+	{ kLength, "L" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kGetBlockSharedRequestFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kKey, "S" },
+	{ kOffset, "L" },
+	{ kCapacity, "L" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kGetBlockSharedResponseFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kErrorCode, "I" },
+	{ kMessage, "S" },
+	{ kLength, "L" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kStatBlockRequestFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kKey, "S" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kStatBlockResponseFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kErrorCode, "I" },
+	{ kMessage, "S" },
+	{ kSize, "L" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kHasBlocksRequestFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kKeys, "[S" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kHasBlocksResponseFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kErrorCode, "I" },
+	{ kMessage, "S" },
+	{ kPresent, "[B" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kPrefetchRequestFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kKeys, "[S" },
+	{ kExtendedKeys, "[S" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kBatchRequestFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kCommands, "[S" },
+	{ NULL, NULL },
+};
+
+static const BinaryField kBatchResponseFields[] = {
+	{ kCommandId, "I" },
+	{ kRequestId, "L" },
+	{ kErrorCode, "I" },
+	{ kMessage, "S" },
+	{ kResults, "[S" },
+	{ NULL, NULL },
+};
 
-// from datastore.go:
 // base64 consume more memory than daemon.sourceDataLength: 30 * 4 / 3
 const int kExtendedKeyLength = 40;
 
-// format strings (as used by json_pack_ex() for building JSON) used whenever we
-// need to build a JSON string.
-// See http://jansson.readthedocs.io/en/2.4/apiref.html#building-values for
-// an explanation of the format strings that json_pack_ex() can take.
-// These must match the structures in quantumfs/cmds.go
-static const char kGetAccessedJSON[] = "{s:i,s:s}";
-static const char kInsertInodeJSON[] = "{s:i,s:s,s:s,s:i,s:i,s:i}";
-static const char kBranchJSON[] = "{s:i,s:s,s:s}";
-static const char kDeleteJSON[] = "{s:i,s:s}";
-static const char kSetBlockJSON[] = "{s:i,s:s,s:s}";
-static const char kGetBlockJSON[] = "{s:i,s:s}";
+// Maximum size of a block which can be stored in a datastore
+const int kMaxBlockSize = 262144;
 
-#endif  // QFSCLIENT_QFS_CLIENT_DATA_H_
+// The directory files registered by RegisterSharedMemory requests must be in
+static const char kSharedMemoryDir[] = "/dev/shm";
+
+// The maximum number of requests on a single api file handle whose responses
+// haven't been read yet. Writing further requests fails with EAGAIN.
+const int kMaxPipelineDepth = 64;
 
+// Frames with less payload than this aren't worth compressing
+const int kCompressionThreshold = 4096;
+
+// The most commands a single Batch request may carry
+const int kMaxBatchCommands = 4096;
+
+// The most keys a single HasBlocks request may carry
+const int kMaxHasBlocksKeys = 4096;
+
+// The most keys, of both kinds together, a single Prefetch request may carry
+const int kMaxPrefetchKeys = 4096;
+
+// The most inodes a single InsertInodes request may carry
+const int kMaxInsertInodes = 4096;
+
+#endif  // QFSCLIENT_QFS_CLIENT_DATA_H_
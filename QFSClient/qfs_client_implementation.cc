@@ -4,61 +4,155 @@
 
 #include "QFSClient/qfs_client_implementation.h"
 
+#include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/un.h>
 #include <unistd.h>
 
-#include <jansson.h>
-
 #include <algorithm>
+#include <deque>
 #include <ios>
+#include <memory>
 #include <vector>
 
 #include "./libqfs.h"
 #include "QFSClient/qfs_client.h"
+#include "QFSClient/qfs_client_binary.h"
+#include "QFSClient/qfs_client_cache.h"
 #include "QFSClient/qfs_client_data.h"
+#include "QFSClient/qfs_client_json.h"
+#include "QFSClient/qfs_client_object.h"
 #include "QFSClient/qfs_client_test.h"
+#include "QFSClient/qfs_client_uring.h"
 #include "QFSClient/qfs_client_util.h"
 
 namespace qfsclient {
 
-ApiContext::ApiContext() : request_json_object(NULL), response_json_object(NULL) {
+// Pooled buffer sizes are powers of two from kMinPooledBufferSize up to
+// kMaxPooledBufferSize. Larger buffers aren't pooled.
+static const size_t kNumBufferClasses = 11;
+static_assert(kMinPooledBufferSize << (kNumBufferClasses - 1) ==
+	      kMaxPooledBufferSize, "buffer size classes don't span the pool");
+
+static size_t BufferClassSize(size_t size_class) {
+	return kMinPooledBufferSize << size_class;
+}
+
+// Returns the smallest size class which fits the given size, or
+// kNumBufferClasses if the size is too large to be pooled
+static size_t BufferSizeClass(size_t size) {
+	size_t size_class = 0;
+	while (size_class < kNumBufferClasses &&
+	       BufferClassSize(size_class) < size) {
+		size_class++;
+	}
+	return size_class;
+}
+
+// The storage freed by a thread, by size class, for reuse by that thread
+class BufferCache {
+ public:
+	BufferCache();
+	~BufferCache();
+
+	// Take a cached buffer of the given class, or NULL if there is none
+	void *Take(size_t size_class);
+
+	// Cache a buffer of the given class. Returns false if the cache is full.
+	bool Keep(void *buffer, size_t size_class);
+
+ private:
+	std::vector<void *> buffers[kNumBufferClasses];
+	size_t cached_bytes;
+};
+
+static thread_local BufferCache buffer_cache;
+
+// Storage may be freed during thread exit after buffer_cache has been destroyed,
+// in which case it can no longer be cached.
+static thread_local bool buffer_cache_destroyed = false;
+
+BufferCache::BufferCache() : cached_bytes(0) {
 }
 
-ApiContext::~ApiContext() {
-	SetRequestJsonObject(NULL);
-	SetResponseJsonObject(NULL);
+BufferCache::~BufferCache() {
+	for (auto &size_class : this->buffers) {
+		for (void *buffer : size_class) {
+			free(buffer);
+		}
+	}
+	buffer_cache_destroyed = true;
 }
 
-void ApiContext::SetRequestJsonObject(json_t *request_json_object) {
-	if (this->request_json_object) {
-		json_decref(this->request_json_object);
-		this->request_json_object = NULL;
+void *BufferCache::Take(size_t size_class) {
+	if (this->buffers[size_class].empty()) {
+		return NULL;
 	}
 
-	this->request_json_object = request_json_object;
+	void *buffer = this->buffers[size_class].back();
+	this->buffers[size_class].pop_back();
+	this->cached_bytes -= BufferClassSize(size_class);
+	return buffer;
 }
 
-json_t *ApiContext::GetRequestJsonObject() const {
-	return request_json_object;
+bool BufferCache::Keep(void *buffer, size_t size_class) {
+	size_t size = BufferClassSize(size_class);
+	if (this->cached_bytes + size > kMaxCachedBufferBytes) {
+		return false;
+	}
+
+	try {
+		this->buffers[size_class].push_back(buffer);
+	}
+	catch (...) {
+		return false;
+	}
+
+	this->cached_bytes += size;
+	return true;
 }
 
-void ApiContext::SetResponseJsonObject(json_t *response_json_object) {
-	if (this->response_json_object) {
-		json_decref(this->response_json_object);
-		this->response_json_object = NULL;
+void *AllocateBuffer(size_t size) {
+	size_t size_class = BufferSizeClass(size);
+	if (size_class < kNumBufferClasses) {
+		if (!buffer_cache_destroyed) {
+			void *buffer = buffer_cache.Take(size_class);
+			if (buffer != NULL) {
+				return buffer;
+			}
+		}
+
+		// Allocate the whole class so the storage may be reused for any
+		// size in it
+		size = BufferClassSize(size_class);
 	}
 
-	this->response_json_object = response_json_object;
+	void *buffer;
+	if (posix_memalign(&buffer, kBufferAlignment, size) != 0) {
+		return NULL;
+	}
+	return buffer;
 }
 
-json_t *ApiContext::GetResponseJsonObject() const {
-	return response_json_object;
+void FreeBuffer(void *buffer, size_t size) {
+	size_t size_class = BufferSizeClass(size);
+	if (size_class < kNumBufferClasses && !buffer_cache_destroyed &&
+	    buffer_cache.Keep(buffer, size_class)) {
+		return;
+	}
+
+	free(buffer);
 }
 
 CommandBuffer::CommandBuffer() {
+	// Most commands and responses fit in the smallest pooled buffer, which
+	// avoids growing the storage as they are built
+	this->data.reserve(kMinPooledBufferSize);
 }
 
 CommandBuffer::~CommandBuffer() {
@@ -86,11 +180,22 @@ void CommandBuffer::Copy(const CommandBuffer &source) {
 	this->data = source.data;
 }
 
+// Exchange the contents of this CommandBuffer with those of other
+void CommandBuffer::Swap(CommandBuffer *other) {
+	this->data.swap(other->data);
+}
+
 // Return a const pointer to the data in the buffer
 const byte *CommandBuffer::Data() const {
 	return this->data.data();
 }
 
+// Return a pointer to the data in the buffer which may be used to modify
+// the data in place
+byte *CommandBuffer::MutableData() {
+	return this->data.data();
+}
+
 // Return the size of the data stored in the buffer
 size_t CommandBuffer::Size() const {
 	return this->data.size();
@@ -115,6 +220,19 @@ ErrorCode CommandBuffer::Append(const byte *data, size_t size) {
 	return kSuccess;
 }
 
+// Change the size of the buffer, leaving any bytes added uninitialised. Returns an
+// error if the buffer would have to be grown too large.
+ErrorCode CommandBuffer::Resize(size_t size) {
+	try {
+		this->data.resize(size);
+	}
+	catch (...) {
+		return kBufferTooBig;
+	}
+
+	return kSuccess;
+}
+
 // copy a string into the buffer, but without a NUL terminator. An error will
 // be returned if the buffer would have to be grown too large to fit the string.
 ErrorCode CommandBuffer::CopyString(const char *s) {
@@ -135,22 +253,129 @@ Error GetApi(const char *path, Api **api) {
 
 void ReleaseApi(Api *api) {
 	if (api != NULL) {
-		delete reinterpret_cast<ApiImpl*>(api);
+		delete api;
+	}
+}
+
+AccessedIterator::AccessedIterator(Api *api,
+				   const char *workspace_root,
+				   uint32_t batch_size)
+	: api(api),
+	  workspace_root(workspace_root),
+	  batch_size(batch_size),
+	  cursor(0),
+	  done(false),
+	  err(util::getError(kSuccess)) {
+}
+
+bool AccessedIterator::Next(std::vector<PathAccessed> *batch) {
+	batch->clear();
+
+	if (this->done) {
+		return false;
 	}
+
+	this->err = this->api->GetAccessedPage(this->workspace_root.c_str(),
+					       &this->cursor, this->batch_size,
+					       batch);
+	if (this->err.code != kSuccess) {
+		this->done = true;
+		batch->clear();
+		return false;
+	}
+
+	if (this->cursor == 0) {
+		this->done = true;
+	}
+
+	// only the page of an empty list is empty
+	return !batch->empty();
+}
+
+const Error &AccessedIterator::LastError() const {
+	return this->err;
+}
+
+Batch::Batch(Api *api) : api(api) {
+}
+
+void Batch::AddInsertInode(const char *destination,
+			   const char *key,
+			   uint32_t permissions,
+			   uint32_t uid,
+			   uint32_t gid) {
+	Command command = {};
+	command.command_id = kCmdInsertInode;
+	command.destination = destination;
+	command.key = key;
+	command.permissions = permissions;
+	command.uid = uid;
+	command.gid = gid;
+	this->commands.push_back(command);
+}
+
+void Batch::AddBranch(const char *source, const char *destination) {
+	Command command = {};
+	command.command_id = kCmdBranchRequest;
+	command.source = source;
+	command.destination = destination;
+	this->commands.push_back(command);
+}
+
+void Batch::AddDelete(const char *workspace) {
+	Command command = {};
+	command.command_id = kCmdDeleteWorkspace;
+	command.destination = workspace;
+	this->commands.push_back(command);
+}
+
+void Batch::AddSetBlock(const std::vector<byte> &key,
+			const std::vector<byte> &data) {
+	Command command = {};
+	command.command_id = kCmdSetBlock;
+	command.block_key = key;
+	command.data = data;
+	this->commands.push_back(command);
+}
+
+size_t Batch::Size() const {
+	return this->commands.size();
+}
+
+void Batch::Clear() {
+	this->commands.clear();
+}
+
+Error Batch::Execute(std::vector<Error> *results) {
+	return this->api->ExecuteBatch(*this, results);
 }
 
 ApiImpl::ApiImpl()
 	: fd(-1),
+	  api_socket(false),
 	  path(""),
 	  api_inode_id(kInodeIdApi),
-	  test_hook(NULL) {
+	  test_hook(NULL),
+	  protocol(kProtocolJson),
+	  compression(kCompressionNone),
+	  compression_savings(0),
+	  next_request_id(1),
+	  shared_memory(NULL),
+	  shared_memory_size(0) {
 }
 
 ApiImpl::ApiImpl(const char *path)
 	: fd(-1),
+	  api_socket(false),
 	  path(path),
 	  api_inode_id(kInodeIdApi),
-	  test_hook(NULL) {
+	  test_hook(NULL),
+	  protocol(kProtocolJson),
+	  compression(kCompressionNone),
+	  compression_savings(0),
+	  next_request_id(1),
+	  shared_memory(NULL),
+	  shared_memory_size(0) {
 }
 
 ApiImpl::~ApiImpl() {
@@ -180,6 +405,12 @@ Error ApiImpl::OpenCommon(bool inTest) {
 	}
 
 	if (this->fd == -1) {
+		struct stat path_status;
+		if (stat(this->path.c_str(), &path_status) == 0 &&
+		    S_ISSOCK(path_status.st_mode)) {
+			return this->OpenSocket();
+		}
+
 		int flags = O_RDWR | O_CLOEXEC;
 #if defined(O_DIRECT)
 		if (!inTest) {
@@ -191,66 +422,356 @@ Error ApiImpl::OpenCommon(bool inTest) {
 		if (this->fd == -1) {
 			return util::getError(kCantOpenApiFile, this->path);
 		}
+
+		// Without io_uring the api file is written and read by plain
+		// system calls
+		const char *io_uring = getenv(kApiIoUringEnvironment);
+		if (!this->io_uring && io_uring != NULL && io_uring[0] != '\0') {
+			std::unique_ptr<IoUring> ring(new IoUring);
+			if (ring->Init(kIoUringEntries)) {
+				this->io_uring.swap(ring);
+			}
+		}
+
+		if (!inTest) {
+			this->NegotiateProtocol();
+		}
+	}
+
+	return util::getError(kSuccess);
+}
+
+Error ApiImpl::OpenSocket() {
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (this->path.length() >= sizeof(address.sun_path)) {
+		return util::getError(kCantOpenApiFile, this->path);
+	}
+	memcpy(address.sun_path, this->path.c_str(), this->path.length());
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1) {
+		return util::getError(kCantOpenApiFile, this->path);
 	}
 
+	if (connect(fd, reinterpret_cast<struct sockaddr *>(&address),
+		    sizeof(address)) != 0) {
+		close(fd);
+		return util::getError(kCantOpenApiFile, this->path);
+	}
+
+	this->fd = fd;
+	this->api_socket = true;
+	this->protocol = kProtocolBinary;
+
+	// quantumfsd decompresses requests whenever they arrive, only compressed
+	// responses have to be asked for, which isn't worth a round trip locally
+	this->compression = kCompressionNone;
+
 	return util::getError(kSuccess);
 }
 
+void ApiImpl::NegotiateProtocol() {
+	// create JSON with:
+	//    CommandId = kCmdSetProtocol,
+	//    Compression = kCompressionZlib and
+	//    Protocol = kProtocolBinary
+	CommandBuffer request;
+	JsonWriter writer(&request);
+	writer.AppendInt(kCommandId, kCmdSetProtocol);
+	writer.AppendInt(kCompression, kCompressionZlib);
+	writer.AppendInt(kProtocol, kProtocolBinary);
+
+	// The response is still in JSON, only later commands use the new protocol
+	CommandBuffer response;
+	JsonReader reader;
+	Error err = this->SendJson(&writer, &response, &reader);
+	if (err.code != kSuccess) {
+		return;
+	}
+	this->protocol = kProtocolBinary;
+
+	// quantumfsd versions which don't compress leave the field out
+	int64_t compression;
+	if (reader.Find(kCompression) && reader.ReadInt(&compression) &&
+	    compression == kCompressionZlib) {
+		this->compression = kCompressionZlib;
+	}
+}
+
 void ApiImpl::Close() {
 	if (this->fd != -1) {
+		// Queued commands are still sent, even if nothing will read their
+		// responses
+		this->FlushQueued();
+
 		int err = close(this->fd);
 		if (err != 0) {
 			printf("Error when closing api: %d\n", errno);
 		}
 		this->fd = -1;
 	}
+	this->api_socket = false;
+
+	// A new handle will have to negotiate its protocol again
+	this->protocol = kProtocolJson;
+	this->compression = kCompressionNone;
+
+	// Responses to any pipelined commands were lost with the handle
+	this->in_flight.clear();
+	this->completed.clear();
+	this->discarded.clear();
+
+	// as was the registration of the shared memory
+	this->ReleaseSharedMemory();
 }
 
 Error ApiImpl::SendCommand(const CommandBuffer &command, CommandBuffer *response) {
+	Error err = this->StartCommand(command);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	return this->CollectResponse(0, response);
+}
+
+Error ApiImpl::StartCommand(const CommandBuffer &command) {
 	Error err = this->Open();
 	if (err.code != kSuccess) {
 		return err;
 	}
 
+	// quantumfsd refuses commands beyond the pipeline depth, so read
+	// responses until there is room for this one
+	while (this->in_flight.size() >= kMaxPipelineDepth) {
+		CommandBuffer response;
+		err = this->ReceiveResponse(&response);
+		if (err.code != kSuccess) {
+			return err;
+		}
+
+		RequestId request_id;
+		err = this->ParseRequestId(response, &request_id);
+		if (err.code != kSuccess) {
+			return err;
+		}
+
+		err = this->SetAside(request_id, response);
+		if (err.code != kSuccess) {
+			return err;
+		}
+	}
+
 	err = this->WriteCommand(command);
 	if (err.code != kSuccess) {
 		return err;
 	}
 
 	if (this->test_hook) {
-		Error err = this->test_hook->PostWriteHook();
+		err = this->test_hook->PostWriteHook();
+		if (err.code != kSuccess) {
+			return err;
+		}
+	}
+
+	return util::getError(kSuccess);
+}
+
+Error ApiImpl::CollectResponse(RequestId request_id, CommandBuffer *response) {
+	if (request_id != 0) {
+		auto it = this->completed.find(request_id);
+		if (it != this->completed.end()) {
+			response->Swap(&it->second);
+			this->completed.erase(it);
+			return util::getError(kSuccess);
+		}
+
+		if (this->in_flight.count(request_id) == 0) {
+			return util::getError(kUnknownRequestId,
+					      std::to_string(request_id));
+		}
+	}
+
+	if (this->in_flight.empty()) {
+		// the only response to expect is the one to the synchronous command
+		return this->ReceiveResponse(response);
+	}
+
+	while (true) {
+		Error err = this->ReceiveResponse(response);
+		if (err.code != kSuccess) {
+			return err;
+		}
+
+		RequestId response_id;
+		err = this->ParseRequestId(*response, &response_id);
+		if (err.code != kSuccess) {
+			return err;
+		}
+
+		if (response_id == request_id) {
+			this->in_flight.erase(request_id);
+			return util::getError(kSuccess);
+		}
+
+		err = this->SetAside(response_id, *response);
 		if (err.code != kSuccess) {
 			return err;
 		}
+	}
+}
+
+Error ApiImpl::SetAside(RequestId request_id, const CommandBuffer &response) {
+	if (this->in_flight.erase(request_id) == 0) {
+		return util::getError(kUnknownRequestId,
+				      std::to_string(request_id));
+	}
+
+	if (this->discarded.erase(request_id) == 0) {
+		this->completed[request_id].Copy(response);
+	}
+
+	return util::getError(kSuccess);
+}
 
+Error ApiImpl::ReceiveResponse(CommandBuffer *response) {
+	Error err;
+	if (this->test_hook) {
 		err = this->test_hook->PreReadHook(response);
+	} else {
+		err = this->ReadResponse(response);
+	}
+	if (err.code != kSuccess || this->protocol != kProtocolBinary ||
+	    !IsCompressedBinaryFrame(*response)) {
+		return err;
+	}
+
+	CommandBuffer decompressed;
+	err = DecompressBinaryFrame(*response, &decompressed);
+	if (err.code != kSuccess) {
+		return err;
+	}
+	this->compression_savings += decompressed.Size() - response->Size();
+	response->Swap(&decompressed);
+
+	return util::getError(kSuccess);
+}
+
+Error ApiImpl::ParseRequestId(const CommandBuffer &response,
+			      RequestId *request_id) {
+	if (this->protocol == kProtocolBinary) {
+		BinaryReader reader;
+		Error err = reader.Open(response);
+		if (err.code != kSuccess) {
+			return err;
+		}
+
+		uint32_t command_id;
+		if (!reader.ReadUint32(&command_id) ||
+		    !reader.ReadUint64(request_id)) {
+			return util::getError(kMissingJsonObject, kRequestId);
+		}
+
+		return util::getError(kSuccess);
+	}
+
+	JsonReader reader;
+	Error err = reader.Open(response);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	// responses to synchronous commands don't carry a RequestId
+	*request_id = 0;
+	int64_t value;
+	if (reader.Find(kRequestId) && reader.ReadInt(&value)) {
+		*request_id = value;
+	}
+
+	return util::getError(kSuccess);
+}
+
+Error ApiImpl::StartPipelined(const CommandBuffer &command,
+			      RequestId *request_id) {
+	Error err = this->StartCommand(command);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	*request_id = this->next_request_id++;
+
+	// Only quantumfsd versions which speak the binary protocol answer with the
+	// RequestId of the command, so older ones are only sent one command at a
+	// time. Its response is kept until it is waited for.
+	if (this->protocol != kProtocolBinary) {
+		CommandBuffer response;
+		err = this->ReceiveResponse(&response);
 		if (err.code != kSuccess) {
 			return err;
 		}
 
+		this->completed[*request_id].Swap(&response);
 		return util::getError(kSuccess);
 	}
 
-	return this->ReadResponse(response);
+	this->in_flight.insert(*request_id);
+
+	return util::getError(kSuccess);
 }
 
-Error ApiImpl::WriteCommand(const CommandBuffer &command) {
+Error ApiImpl::WriteCommand(const CommandBuffer &uncompressed) {
 	if (this->fd == -1) {
 		return util::getError(kApiFileNotOpen);
 	}
 
-	int err = lseek(this->fd, 0, SEEK_SET);
-	if (err == -1) {
-		return util::getError(kApiFileSeekFail, this->path);
+	CommandBuffer compressed;
+	const CommandBuffer *frame = &uncompressed;
+	if (this->protocol == kProtocolBinary &&
+	    this->compression == kCompressionZlib &&
+	    CompressBinaryFrame(uncompressed, &compressed)) {
+		this->compression_savings += uncompressed.Size() - compressed.Size();
+		frame = &compressed;
+	}
+	const CommandBuffer &command = *frame;
+
+	if (this->api_socket) {
+		// Frames follow one another on the socket, so a short write just
+		// leaves the rest of the frame to be sent. MSG_NOSIGNAL turns a
+		// quantumfsd which has gone away into an error rather than SIGPIPE.
+		for (size_t sent = 0; sent < command.Size();) {
+			ssize_t num = send(this->fd, command.Data() + sent,
+					   command.Size() - sent, MSG_NOSIGNAL);
+			if (num == -1 && errno == EINTR) {
+				continue;
+			}
+			if (num <= 0) {
+				return util::getError(kApiFileWriteFail, this->path);
+			}
+			sent += num;
+		}
+		return util::getError(kSuccess);
 	}
 
-	util::AlignedMem<512> data(command.Size());
-	memcpy(*data, command.Data(), command.Size());
+	if (this->io_uring) {
+		// A small command is cheaply copied to be submitted together with
+		// the read of its response, or the next one for a pipelined command.
+		// A larger one is sent straight away, after any queued before it.
+		if (command.Size() <= kResponseReadSize &&
+		    this->queued_commands.size() + 1 < this->io_uring->Capacity()) {
+			this->queued_commands.emplace_back();
+			this->queued_commands.back().Copy(command);
+			return util::getError(kSuccess);
+		}
+		return this->SubmitQueued(&command, NULL, 0, NULL);
+	}
 
-	// We must write the whole command at once
-	int written = write(this->fd, *data, command.Size());
+	// We must write the whole command at once. Every command is written at
+	// the start of the file, which pwrite() does without a separate seek. The
+	// storage of the command is already aligned for O_DIRECT.
+	ssize_t written = pwrite(this->fd, command.Data(), command.Size(), 0);
 
-	if (written == -1 || written != command.Size()) {
+	if (written == -1 || written != (ssize_t)command.Size()) {
 		return util::getError(kApiFileWriteFail, this->path);
 	}
 
@@ -264,68 +785,220 @@ Error ApiImpl::ReadResponse(CommandBuffer *command) {
 		return util::getError(kApiFileNotOpen);
 	}
 
-	int errCode = lseek(this->fd, 0, SEEK_SET);
-	if (errCode == -1) {
-		return util::getError(kApiFileSeekFail);
+	if (this->api_socket) {
+		return this->ReadSocketResponse(command);
 	}
 
-	// read up to 4k at a time, stopping on EOF
 	command->Reset();
 
-	static const ssize_t BufferSize = 4096;
-	util::AlignedMem<512> data(BufferSize);
+	// Most responses fit in the first read. A read which returns less than
+	// was asked for has reached the end of the response.
+	size_t size = kResponseReadSize;
+	bool hinted = false;
 
-	for (ssize_t num = BufferSize; num == BufferSize;) {
-		num = read(this->fd, *data, data.Size());
-		if (num == 0) {
-			break;
+	for (size_t offset = 0; true;) {
+		// The response is read straight into the command buffer, which is
+		// aligned as O_DIRECT requires. Reads start at multiples of
+		// kResponseReadSize, so stay aligned.
+		err = command->Resize(offset + size);
+		if (err != kSuccess) {
+			return util::getError(err);
 		}
 
+		// Reading at explicit offsets saves a seek per response. The first
+		// read is submitted to io_uring along with the queued commands.
+		ssize_t num;
+		if (offset == 0 && this->io_uring) {
+			Error submitted = this->SubmitQueued(
+				NULL, command->MutableData(), size, &num);
+			if (submitted.code != kSuccess) {
+				command->Reset();
+				return submitted;
+			}
+		} else {
+			num = pread(this->fd, command->MutableData() + offset, size,
+				    offset);
+		}
 		if (num < 0) {
 			// any read failure *except* an EOF is a failure
+			command->Reset();
 			return util::getError(kApiFileReadFail, this->path);
 		}
 
-		err = command->Append(reinterpret_cast<const byte *>(*data), num);
+		offset += num;
+		command->Resize(offset);
+		if (num < size) {
+			break;
+		}
 
-		if (err != kSuccess) {
-			return util::getError(err);
+		// Size the next read to fetch the remainder of a large response at
+		// once, rather than 4k at a time
+		size_t frame_size;
+		if (this->protocol == kProtocolBinary &&
+		    BinaryFrameSize(*command, &frame_size)) {
+			// The frame header says exactly how much remains
+			if (frame_size <= offset) {
+				break;
+			}
+			size = frame_size - offset;
+		} else if (!hinted) {
+			// The size of the api file is that of the responses
+			// queued by quantumfsd, which bounds the rest of this one
+			hinted = true;
+			struct stat api_status;
+			if (fstat(this->fd, &api_status) == 0 &&
+			    api_status.st_size > offset) {
+				size = std::min(
+					(size_t)(api_status.st_size - offset),
+					kMaxResponseReadHint);
+			}
+			// Ask for a little more than the hint, so that the read
+			// is short if the hint was right
+			size++;
+		} else {
+			size = std::min(size * 2, kMaxResponseReadHint);
 		}
+
+		// Keep reads in whole pages
+		size = (size + kResponseReadSize - 1) / kResponseReadSize *
+		       kResponseReadSize;
 	}
 
-	command->Sanitize();
+	if (this->protocol == kProtocolJson) {
+		// Binary responses carry their own length and may legitimately end
+		// in zeros
+		command->Sanitize();
+	}
 	return util::getError(err);
 }
 
-Error ApiImpl::DeterminePath() {
-	FindApiPath_return apiPath = FindApiPath();
-	if (strlen(apiPath.r1) != 0) {
-		return util::getError(kCantFindApiFile, std::string(apiPath.r1));
+Error ApiImpl::SubmitQueued(const CommandBuffer *command, byte *data, size_t size,
+			    ssize_t *num_read) {
+	for (const CommandBuffer &queued : this->queued_commands) {
+		this->io_uring->AddWrite(this->fd, queued.Data(), queued.Size(), 0);
+	}
+	if (command != NULL) {
+		this->io_uring->AddWrite(this->fd, command->Data(), command->Size(),
+					 0);
+	}
+	if (data != NULL) {
+		this->io_uring->AddRead(this->fd, data, size, 0);
+	}
+
+	// Each request of the chain only starts once the one before it has
+	// completed, so the commands arrive in order, each with a write of its own,
+	// and the read follows them all
+	std::vector<ssize_t> results;
+	if (!this->io_uring->Submit(&results)) {
+		// Later commands are written by plain system calls
+		this->io_uring.reset();
+		this->queued_commands.clear();
+		return util::getError(kApiFileWriteFail, this->path);
+	}
+
+	bool written = true;
+	size_t i = 0;
+	for (const CommandBuffer &queued : this->queued_commands) {
+		written = written && results[i++] == (ssize_t)queued.Size();
+	}
+	this->queued_commands.clear();
+	if (command != NULL) {
+		written = written && results[i++] == (ssize_t)command->Size();
+	}
+	if (!written) {
+		return util::getError(kApiFileWriteFail, this->path);
+	}
+
+	if (num_read != NULL) {
+		*num_read = results[i];
 	}
 
-	this->path = std::string(apiPath.r0);
 	return util::getError(kSuccess);
 }
 
-Error ApiImpl::DeterminePathInTest() {
-	// getcwd() with a NULL first parameter results in a buffer of whatever size
-	// is required being allocated, which we must then free. PATH_MAX isn't
-	// known at compile time (and it is possible for paths to be longer than
-	// PATH_MAX anyway)
-	char *cwd = getcwd(NULL, 0);
-	if (!cwd) {
-		return util::getError(kDontKnowCwd);
+Error ApiImpl::FlushQueued() {
+	if (this->queued_commands.empty()) {
+		return util::getError(kSuccess);
 	}
 
-	std::vector<std::string> directories;
-	std::string path;
-	std::string currentDir(cwd);
-
-	free(cwd);
+	return this->SubmitQueued(NULL, NULL, 0, NULL);
+}
 
-	util::Split(currentDir, "/", &directories);
+Error ApiImpl::ReadSocketResponse(CommandBuffer *command) {
+	// The header says how long the rest of the frame is
+	size_t size = kBinaryHeaderSize;
+	bool sized = false;
 
-	while (true) {
+	for (size_t offset = 0; offset < size;) {
+		ErrorCode err = command->Resize(size);
+		if (err != kSuccess) {
+			command->Reset();
+			return util::getError(err);
+		}
+
+		ssize_t num = recv(this->fd, command->MutableData() + offset,
+				   size - offset, 0);
+		if (num == -1 && errno == EINTR) {
+			continue;
+		}
+		if (num <= 0) {
+			// quantumfsd never closes the socket part way through a
+			// response
+			command->Reset();
+			return util::getError(kApiFileReadFail, this->path);
+		}
+		offset += num;
+
+		if (!sized && offset == kBinaryHeaderSize) {
+			sized = true;
+			if (!BinaryFrameSize(*command, &size)) {
+				command->Reset();
+				return util::getError(kApiFileReadFail, this->path);
+			}
+		}
+	}
+
+	return util::getError(kSuccess);
+}
+
+Error ApiImpl::DeterminePath() {
+	// An api socket named by the environment is preferred over the api file.
+	// The environment is read here rather than by libqfs, whose Go runtime
+	// doesn't see variables set after it was loaded.
+	const char *socket_path = getenv(kApiSocketEnvironment);
+	if (socket_path != NULL && IsApiSocket(const_cast<char *>(socket_path))) {
+		this->path = socket_path;
+		return util::getError(kSuccess);
+	}
+
+	FindApiPath_return apiPath = FindApiPath();
+	if (strlen(apiPath.r1) != 0) {
+		return util::getError(kCantFindApiFile, std::string(apiPath.r1));
+	}
+
+	this->path = std::string(apiPath.r0);
+	return util::getError(kSuccess);
+}
+
+Error ApiImpl::DeterminePathInTest() {
+	// getcwd() with a NULL first parameter results in a buffer of whatever size
+	// is required being allocated, which we must then free. PATH_MAX isn't
+	// known at compile time (and it is possible for paths to be longer than
+	// PATH_MAX anyway)
+	char *cwd = getcwd(NULL, 0);
+	if (!cwd) {
+		return util::getError(kDontKnowCwd);
+	}
+
+	std::vector<std::string> directories;
+	std::string path;
+	std::string currentDir(cwd);
+
+	free(cwd);
+
+	util::Split(currentDir, "/", &directories);
+
+	while (true) {
 		util::Join(directories, "/", &path);
 		path = "/" + path + "/" + kApiPath;
 
@@ -390,59 +1063,31 @@ Error ApiImpl::CheckWorkspacePathValid(const char *workspace_path) {
 }
 
 Error ApiImpl::CheckCommonApiResponse(const CommandBuffer &response,
-				      ApiContext *context) {
-	json_error_t json_error;
-
-	// parse JSON in response into a std::unordered_map<std::string, bool>
-	json_t *response_json = json_loadb((const char *)response.Data(),
-					   response.Size(),
-					   0,
-					   &json_error);
-
-	context->SetResponseJsonObject(response_json);
-
-	if (response_json == NULL) {
-		std::string details = util::buildJsonErrorDetails(
-			json_error.text,
-			(const char *)response.Data(),
-			response.Size());
-		return util::getError(kJsonDecodingError, details);
-	}
-
-	json_t *response_json_obj;
-	// note about cleaning up response_json_obj: this isn't necessary
-	// as long as we use format character 'o' below, because in this case
-	// the reference count of response_json isn't increased and we don't
-	// leak any references. However, format character 'O' *will* increase the
-	// reference count and in that case we would need to clean up afterwards.
-	int success = json_unpack_ex(response_json, &json_error, 0,
-				     "o", &response_json_obj);
-
-	if (success != 0) {
-		std::string details = util::buildJsonErrorDetails(
-			json_error.text,
-			(const char *)response.Data(),
-			response.Size());
-		return util::getError(kJsonDecodingError, details);
+				      JsonReader *reader) {
+	Error err = reader->Open(response);
+	if (err.code != kSuccess) {
+		return err;
 	}
 
-	json_t *error_json_obj = json_object_get(response_json_obj, kErrorCode);
-	if (error_json_obj == NULL) {
+	int64_t error_code;
+	if (!reader->Find(kErrorCode)) {
 		std::string details = util::buildJsonErrorDetails(
 			kErrorCode,
 			(const char *)response.Data(),
 			response.Size());
 		return util::getError(kMissingJsonObject, details);
 	}
+	bool error_code_valid = reader->ReadInt(&error_code);
 
-	json_t *message_json_obj = json_object_get(response_json_obj, kMessage);
-	if (message_json_obj == NULL) {
+	std::string message;
+	if (!reader->Find(kMessage)) {
 		std::string details = util::buildJsonErrorDetails(
 			kMessage, (const char *)response.Data(), response.Size());
 		return util::getError(kMissingJsonObject, details);
 	}
+	reader->ReadString(&message);
 
-	if (!json_is_integer(error_json_obj)) {
+	if (!error_code_valid) {
 		std::string details = util::buildJsonErrorDetails(
 			"error code in response JSON is not valid",
 			(const char *)response.Data(),
@@ -451,11 +1096,9 @@ Error ApiImpl::CheckCommonApiResponse(const CommandBuffer &response,
 				      details);
 	}
 
-	CommandError apiError = (CommandError)json_integer_value(error_json_obj);
+	CommandError apiError = (CommandError)error_code;
 	if (apiError != kCmdOk) {
-		std::string api_error = util::getApiError(
-			apiError,
-			json_string_value(message_json_obj));
+		std::string api_error = util::getApiError(apiError, message);
 
 		std::string details = util::buildJsonErrorDetails(
 			api_error, (const char *)response.Data(), response.Size());
@@ -466,29 +1109,21 @@ Error ApiImpl::CheckCommonApiResponse(const CommandBuffer &response,
 	return util::getError(kSuccess);
 }
 
-Error ApiImpl::SendJson(ApiContext *context) {
-	json_t *request_json = context->GetRequestJsonObject();
-	// we pass these flags to json_dumps() because:
-	//    JSON_COMPACT: there's no good reason for verbose JSON
-	//    JSON_SORT_KEYS: so that the tests can get predictable JSON and will
-	//                    be able to compare generated JSON reliably
-	char *request_json_str = json_dumps(request_json,
-					    JSON_COMPACT | JSON_SORT_KEYS);
-
-	CommandBuffer command;
-
-	command.CopyString(request_json_str);
-
-	free(request_json_str);    // free the JSON string created by json_dumps()
+Error ApiImpl::SendJson(JsonWriter *writer,
+			CommandBuffer *response,
+			JsonReader *reader) {
+	ErrorCode code = writer->Finish();
+	if (code != kSuccess) {
+		 return util::getError(code);
+	}
 
 	// send CommandBuffer and receive response in another one
-	CommandBuffer response;
-	Error err = this->SendCommand(command, &response);
+	Error err = this->SendCommand(writer->Json(), response);
 	if (err.code != kSuccess) {
 		 return err;
 	}
 
-	err = this->CheckCommonApiResponse(response, context);
+	err = this->CheckCommonApiResponse(*response, reader);
 	if (err.code != kSuccess) {
 		 return err;
 	}
@@ -496,109 +1131,175 @@ Error ApiImpl::SendJson(ApiContext *context) {
 	return util::getError(kSuccess);
 }
 
-Error ApiImpl::GetAccessed(const char *workspace_root, PathsAccessed *paths) {
-	Error err = this->CheckWorkspaceNameValid(workspace_root);
-	if (err.code != kSuccess) {
+Error ApiImpl::CheckResponse(const CommandBuffer &response,
+			     std::vector<byte> *data) {
+	if (this->protocol == kProtocolBinary) {
+		BinaryReader reader;
+		Error err = this->CheckBinaryApiResponse(response, &reader);
+		if (err.code != kSuccess) {
+			return err;
+		}
+
+		if (data != NULL && !reader.ReadBytes(data)) {
+			return util::getError(kMissingJsonObject, kData);
+		}
+
+		return util::getError(kSuccess);
+	}
+
+	JsonReader reader;
+	Error err = this->CheckCommonApiResponse(response, &reader);
+	if (err.code != kSuccess || data == NULL) {
 		return err;
 	}
 
-	// create JSON in a CommandBuffer with:
-	//    CommandId = kGetAccessed and
-	//    WorkspaceRoot = workspace_root
-	json_error_t json_error;
-	json_t *request_json = json_pack_ex(&json_error, 0,
-					    kGetAccessedJSON,
-					    kCommandId, kCmdGetAccessed,
-					    kWorkspaceRoot, workspace_root);
-	if (request_json == NULL) {
-		return util::getError(kJsonEncodingError, json_error.text);
+	if (!reader.Find(kData)) {
+		return util::getError(kMissingJsonObject, kData);
+	}
+	// the data is decoded from base64 straight out of the response
+	if (!reader.ReadBytes(data)) {
+		return util::getError(kJsonDecodingError,
+				      "expected base64 string for " +
+				      std::string(kData));
 	}
 
-	ApiContext context;
-	context.SetRequestJsonObject(request_json);
-	err = this->SendJson(&context);
-	if (err.code != kSuccess) {
-		return err;
+	return util::getError(kSuccess);
+}
+
+Error ApiImpl::CheckResponse(const CommandBuffer &response, byte *data,
+			     size_t capacity, size_t *size) {
+	if (this->protocol == kProtocolBinary) {
+		BinaryReader reader;
+		Error err = this->CheckBinaryApiResponse(response, &reader);
+		if (err.code != kSuccess) {
+			return err;
+		}
+
+		if (!reader.ReadBytes(data, capacity, size)) {
+			return util::getError(kMissingJsonObject, kData);
+		}
+
+		return util::getError(kSuccess);
 	}
 
-	err = this->PrepareAccessedListResponse(&context, paths);
+	JsonReader reader;
+	Error err = this->CheckCommonApiResponse(response, &reader);
 	if (err.code != kSuccess) {
 		return err;
 	}
 
+	if (!reader.Find(kData)) {
+		return util::getError(kMissingJsonObject, kData);
+	}
+	if (!reader.ReadBytes(data, capacity, size)) {
+		return util::getError(kJsonDecodingError,
+				      "expected base64 string for " +
+				      std::string(kData));
+	}
+
 	return util::getError(kSuccess);
 }
 
-Error ApiImpl::InsertInode(const char *destination,
-			   const char *key,
-			   uint32_t permissions,
-			   uint32_t uid,
-			   uint32_t gid) {
-	Error err = this->CheckWorkspacePathValid(destination);
+// Read the fields of an ErrorResponse, setting err to the outcome they report.
+// Returns false if they aren't all there.
+static bool ReadBinaryErrorResponse(BinaryReader *reader, Error *err) {
+	uint32_t command_id;
+	uint64_t request_id;
+	uint32_t error_code;
+	std::string message;
+	if (!reader->ReadUint32(&command_id) ||
+	    !reader->ReadUint64(&request_id) ||
+	    !reader->ReadUint32(&error_code) ||
+	    !reader->ReadString(&message)) {
+		return false;
+	}
+
+	CommandError apiError = (CommandError)error_code;
+	if (apiError != kCmdOk) {
+		*err = util::getError(kApiError,
+				      util::getApiError(apiError, message));
+	} else {
+		*err = util::getError(kSuccess);
+	}
+
+	return true;
+}
+
+Error ApiImpl::CheckBinaryApiResponse(const CommandBuffer &response,
+				      BinaryReader *reader) {
+	Error err = reader->Open(response);
 	if (err.code != kSuccess) {
 		return err;
 	}
 
-	// create JSON with:
-	//    CommandId = kCmdInsertInode and
-	//    DstPath = destination
-	//    Key = key
-	//    Uid = uid
-	//    Gid = gid
-	//    Permissions = permissions
-	json_error_t json_error;
-	json_t *request_json = json_pack_ex(&json_error, 0,
-					    kInsertInodeJSON,
-					    kCommandId, kCmdInsertInode,
-					    kDstPath, destination,
-					    kKey, key,
-					    kUid, uid,
-					    kGid, gid,
-					    kPermissions, permissions);
-	if (request_json == NULL) {
-		return util::getError(kJsonEncodingError, json_error.text);
+	// every response begins with the fields of ErrorResponse
+	if (!ReadBinaryErrorResponse(reader, &err)) {
+		return util::getError(kMissingJsonObject,
+				      "binary response is missing " +
+				      std::string(kErrorCode));
 	}
 
-	ApiContext context;
-	context.SetRequestJsonObject(request_json);
+	return err;
+}
+
+Error ApiImpl::SendBinary(BinaryWriter *writer,
+			  CommandBuffer *response,
+			  BinaryReader *reader) {
+	ErrorCode code = writer->Finish();
+	if (code != kSuccess) {
+		return util::getError(code);
+	}
 
-	err = this->SendJson(&context);
+	Error err = this->SendCommand(writer->Frame(), response);
 	if (err.code != kSuccess) {
 		return err;
 	}
 
-	return util::getError(kSuccess);
+	return this->CheckBinaryApiResponse(*response, reader);
 }
 
-Error ApiImpl::Branch(const char *source, const char *destination) {
-	Error err = this->CheckWorkspaceNameValid(source);
+Error ApiImpl::GetAccessed(const char *workspace_root, PathsAccessed *paths) {
+	Error err = this->CheckWorkspaceNameValid(workspace_root);
 	if (err.code != kSuccess) {
 		return err;
 	}
 
-	err = this->CheckWorkspaceNameValid(destination);
+	// The protocol is only known once the api file is open
+	err = this->Open();
 	if (err.code != kSuccess) {
 		return err;
 	}
 
-	// create JSON with:
-	//    CommandId = kCmdBranchRequest and
-	//    Src = source
-	//    Dst = destination
-	json_error_t json_error;
-	json_t *request_json = json_pack_ex(&json_error, 0,
-					    kBranchJSON,
-					    kCommandId, kCmdBranchRequest,
-					    kSource, source,
-					    kDestination, destination);
-	if (request_json == NULL) {
-		return util::getError(kJsonEncodingError, json_error.text);
+	if (this->protocol == kProtocolBinary) {
+		BinaryWriter writer(kCmdGetAccessed, 0);
+		writer.AppendString(workspace_root);
+
+		CommandBuffer response;
+		BinaryReader reader;
+		err = this->SendBinary(&writer, &response, &reader);
+		if (err.code != kSuccess) {
+			return err;
+		}
+
+		return this->PrepareBinaryAccessedListResponse(&reader, paths);
 	}
 
-	ApiContext context;
-	context.SetRequestJsonObject(request_json);
+	// create JSON in a CommandBuffer with:
+	//    CommandId = kGetAccessed and
+	//    WorkspaceRoot = workspace_root
+	CommandBuffer request;
+	JsonWriter writer(&request);
+	writer.AppendInt(kCommandId, kCmdGetAccessed);
+	writer.AppendString(kWorkspaceRoot, workspace_root);
+
+	CommandBuffer response;
+	JsonReader reader;
+	err = this->SendJson(&writer, &response, &reader);
+	if (err.code != kSuccess) {
+		return err;
+	}
 
-	err = this->SendJson(&context);
+	err = this->PrepareAccessedListResponse(&reader, paths);
 	if (err.code != kSuccess) {
 		return err;
 	}
@@ -606,156 +1307,1807 @@ Error ApiImpl::Branch(const char *source, const char *destination) {
 	return util::getError(kSuccess);
 }
 
-Error ApiImpl::Delete(const char *workspace) {
-	Error err = this->CheckWorkspaceNameValid(workspace);
+Error ApiImpl::GetAccessedPage(const char *workspace_root,
+			       AccessedCursor *cursor,
+			       uint32_t max_paths,
+			       std::vector<PathAccessed> *paths) {
+	paths->clear();
+
+	Error err = this->CheckWorkspaceNameValid(workspace_root);
 	if (err.code != kSuccess) {
 		return err;
 	}
 
-	// create JSON with:
-	//    CommandId = kCmdDeleteWorkspace and
-	//    Workspace = workspace
-	json_error_t json_error;
-	json_t *request_json = json_pack_ex(&json_error, 0,
-					    kDeleteJSON,
-					    kCommandId, kCmdDeleteWorkspace,
-					    kWorkspacePath, workspace);
-	if (request_json == NULL) {
-		return util::getError(kJsonEncodingError, json_error.text);
+	err = this->Open();
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	if (this->protocol == kProtocolBinary) {
+		BinaryWriter writer(kCmdGetAccessedPage, 0);
+		writer.AppendString(workspace_root);
+		writer.AppendUint64(*cursor);
+		writer.AppendUint32(max_paths);
+
+		CommandBuffer response;
+		BinaryReader reader;
+		err = this->SendBinary(&writer, &response, &reader);
+		if (err.code != kSuccess) {
+			return err;
+		}
+
+		return this->PrepareBinaryAccessedPageResponse(&reader, cursor,
+							       paths);
 	}
 
-	ApiContext context;
-	context.SetRequestJsonObject(request_json);
+	// create JSON in a CommandBuffer with:
+	//    CommandId = kCmdGetAccessedPage and
+	//    Cursor = cursor and
+	//    PageSize = max_paths and
+	//    WorkspaceRoot = workspace_root
+	CommandBuffer request;
+	JsonWriter writer(&request);
+	writer.AppendInt(kCommandId, kCmdGetAccessedPage);
+	writer.AppendInt(kCursor, *cursor);
+	writer.AppendInt(kPageSize, max_paths);
+	writer.AppendString(kWorkspaceRoot, workspace_root);
 
-	err = this->SendJson(&context);
+	CommandBuffer response;
+	JsonReader reader;
+	err = this->SendJson(&writer, &response, &reader);
 	if (err.code != kSuccess) {
 		return err;
 	}
 
-	return util::getError(kSuccess);
+	return this->PrepareAccessedPageResponse(&reader, cursor, paths);
 }
 
-Error ApiImpl::SetBlock(const std::vector<byte> &key,
-			const std::vector<byte> &data) {
-	// convert key and data to base64 before stuffing into JSON
-	std::string base64_key;
-	std::string base64_data;
-	Error err;
-
-	err = util::base64_encode(key, &base64_key);
+Error ApiImpl::InsertInode(const char *destination,
+			   const char *key,
+			   uint32_t permissions,
+			   uint32_t uid,
+			   uint32_t gid) {
+	CommandBuffer command;
+	Error err = this->PrepareInsertInode(destination, key, permissions, uid,
+					     gid, 0, &command);
 	if (err.code != kSuccess) {
 		return err;
 	}
-	err = util::base64_encode(data, &base64_data);
+
+	CommandBuffer response;
+	err = this->SendCommand(command, &response);
 	if (err.code != kSuccess) {
 		return err;
 	}
 
-	// create JSON with:
-	//    CommandId = kCmdSetBlock and
-	//    Key = key
-	//    Data = data
-	json_error_t json_error;
-	json_t *request_json = json_pack_ex(&json_error, 0,
-					    kSetBlockJSON,
-					    kCommandId, kCmdSetBlock,
-					    kKey, base64_key.c_str(),
-					    kData, base64_data.c_str());
-	if (request_json == NULL) {
-		return util::getError(kJsonEncodingError, json_error.text);
-	}
-
-	ApiContext context;
-	context.SetRequestJsonObject(request_json);
+	return this->CheckResponse(response, NULL);
+}
 
-	err = this->SendJson(&context);
+Error ApiImpl::StartInsertInode(const char *destination,
+				const char *key,
+				uint32_t permissions,
+				uint32_t uid,
+				uint32_t gid,
+				RequestId *request_id) {
+	CommandBuffer command;
+	Error err = this->PrepareInsertInode(destination, key, permissions, uid,
+					     gid, this->next_request_id, &command);
 	if (err.code != kSuccess) {
 		return err;
 	}
 
-	return util::getError(kSuccess);
+	return this->StartPipelined(command, request_id);
 }
 
-Error ApiImpl::GetBlock(const std::vector<byte> &key, std::vector<byte> *data) {
-	// convert key to base64 before stuffing into JSON
-	std::string base64_key;
-	Error err;
-
-	err = util::base64_encode(key, &base64_key);
+Error ApiImpl::PrepareInsertInode(const char *destination,
+				  const char *key,
+				  uint32_t permissions,
+				  uint32_t uid,
+				  uint32_t gid,
+				  RequestId request_id,
+				  CommandBuffer *command) {
+	Error err = this->CheckWorkspacePathValid(destination);
+	if (err.code != kSuccess) {
+		return err;
+	}
 
+	// The protocol is only known once the api file is open
+	err = this->Open();
 	if (err.code != kSuccess) {
 		return err;
 	}
 
+	if (this->protocol == kProtocolBinary) {
+		BinaryWriter writer(kCmdInsertInode, request_id);
+		writer.AppendString(destination);
+		writer.AppendString(key);
+		writer.AppendUint32(uid);
+		writer.AppendUint32(gid);
+		writer.AppendUint32(permissions);
+
+		ErrorCode code = writer.Finish();
+		if (code == kSuccess) {
+			writer.TakeFrame(command);
+		}
+		return util::getError(code);
+	}
+
 	// create JSON with:
-	//    CommandId = kCmdGetBlock and
+	//    CommandId = kCmdInsertInode and
+	//    DstPath = destination
+	//    Gid = gid
 	//    Key = key
-	json_error_t json_error;
-	json_t *request_json = json_pack_ex(&json_error, 0,
-					    kGetBlockJSON,
-					    kCommandId, kCmdGetBlock,
-					    kKey, base64_key.c_str());
-	if (request_json == NULL) {
-		return util::getError(kJsonEncodingError, json_error.text);
+	//    Permissions = permissions
+	//    RequestId = request_id, if the command is pipelined
+	//    Uid = uid
+	JsonWriter writer(command);
+	writer.AppendInt(kCommandId, kCmdInsertInode);
+	writer.AppendString(kDstPath, destination);
+	writer.AppendInt(kGid, gid);
+	writer.AppendString(kKey, key);
+	writer.AppendInt(kPermissions, permissions);
+	if (request_id != 0) {
+		writer.AppendInt(kRequestId, request_id);
 	}
+	writer.AppendInt(kUid, uid);
+
+	return util::getError(writer.Finish());
+}
 
-	ApiContext context;
-	context.SetRequestJsonObject(request_json);
+Error ApiImpl::InsertInodes(const std::vector<InsertInodeEntry> &inodes,
+			    std::vector<Error> *results) {
+	size_t count = inodes.size();
+	results->assign(count, util::getError(kSuccess));
 
-	err = this->SendJson(&context);
+	// The protocol is only known once the api file is open
+	Error err = this->Open();
 	if (err.code != kSuccess) {
+		results->assign(count, err);
 		return err;
 	}
 
-	json_t *response_json = context.GetResponseJsonObject();
+	// An inode which can't be encoded fails on its own, without being sent
+	bool binary = this->protocol == kProtocolBinary;
+	std::vector<CommandBuffer> entries(binary ? 0 : count);
+	std::vector<size_t> sizes(count);
+	std::vector<size_t> prepared;
+	for (size_t i = 0; i < count; i++) {
+		const InsertInodeEntry &inode = inodes[i];
+		err = this->CheckWorkspacePathValid(inode.destination.c_str());
+		if (err.code == kSuccess && !binary) {
+			err = this->PrepareInsertInodeEntry(inode, &entries[i]);
+		}
+		if (err.code != kSuccess) {
+			(*results)[i] = err;
+			continue;
+		}
 
-	json_t *data_json_obj = json_object_get(response_json, kData);
-	if (data_json_obj == NULL) {
-		return util::getError(kMissingJsonObject, kData);
-	}
-	if (!json_is_string(data_json_obj)) {
-		return util::getError(kJsonObjectWrongType,
-				      "expected string for " + std::string(kData));
+		// the two strings, each after its length, and three uint32s
+		sizes[i] = binary ? inode.destination.size() + inode.key.size() + 20
+				  : entries[i].Size() + 1;
+		prepared.push_back(i);
 	}
 
-	const char *data_base64 = json_string_value(data_json_obj);
+	// Send as many inodes in each request as fit
+	const size_t max_size = kMaxBatchBytes - kBatchRequestOverhead;
+	size_t start = 0;
+	while (start < prepared.size()) {
+		size_t size = 0;
+		size_t end = start;
+		for (; end < prepared.size() && end - start < kMaxInsertInodes;
+		     end++) {
+			size_t entry_size = sizes[prepared[end]];
+			if (end != start && size + entry_size > max_size) {
+				break;
+			}
+			size += entry_size;
+		}
 
-	// convert data_base64 from base64 to binary before setting value in data
-	err = util::base64_decode(data_base64, data);
-	if (err.code != kSuccess) {
-		return err;
+		std::vector<Error> chunk_results;
+		err = this->SendInsertInodes(inodes, entries, &prepared[start],
+					     end - start, &chunk_results);
+		if (err.code != kSuccess) {
+			for (size_t i = start; i < prepared.size(); i++) {
+				(*results)[prepared[i]] = err;
+			}
+			return err;
+		}
+
+		for (size_t i = start; i < end; i++) {
+			(*results)[prepared[i]] = chunk_results[i - start];
+		}
+		start = end;
 	}
 
 	return util::getError(kSuccess);
 }
 
-Error ApiImpl::PrepareAccessedListResponse(
-	const ApiContext *context,
-	PathsAccessed *accessed_list) {
+Error ApiImpl::PrepareInsertInodeEntry(const InsertInodeEntry &inode,
+				       CommandBuffer *entry) {
+	// create JSON with:
+	//    DstPath = destination
+	//    Gid = gid
+	//    Key = key
+	//    Permissions = permissions
+	//    Uid = uid
+	JsonWriter writer(entry);
+	writer.AppendString(kDstPath, inode.destination);
+	writer.AppendInt(kGid, inode.gid);
+	writer.AppendString(kKey, inode.key);
+	writer.AppendInt(kPermissions, inode.permissions);
+	writer.AppendInt(kUid, inode.uid);
+
+	return util::getError(writer.Finish());
+}
+
+Error ApiImpl::SendInsertInodes(const std::vector<InsertInodeEntry> &inodes,
+				const std::vector<CommandBuffer> &entries,
+				const size_t *indices,
+				size_t count,
+				std::vector<Error> *results) {
+	if (this->protocol == kProtocolBinary) {
+		BinaryWriter writer(kCmdInsertInodes, 0);
+		writer.AppendUint32(count);
+		for (size_t i = 0; i < count; i++) {
+			const InsertInodeEntry &inode = inodes[indices[i]];
+			writer.AppendString(inode.destination.c_str());
+			writer.AppendString(inode.key.c_str());
+			writer.AppendUint32(inode.uid);
+			writer.AppendUint32(inode.gid);
+			writer.AppendUint32(inode.permissions);
+		}
 
-	json_error_t json_error;
-	json_t *response_json = context->GetResponseJsonObject();
+		CommandBuffer response;
+		BinaryReader reader;
+		Error err = this->SendBinary(&writer, &response, &reader);
+		if (err.code != kSuccess) {
+			return err;
+		}
 
-	json_t *path_list_json_obj = json_object_get(response_json, kPathList);
-	if (path_list_json_obj == NULL) {
-		return util::getError(kMissingJsonObject, kPathList);
-	}
+		// each result holds the fields of a whole ErrorResponse
+		uint32_t num_results;
+		if (!reader.ReadUint32(&num_results) || num_results != count) {
+			return util::getError(kMissingJsonObject, kResults);
+		}
+		for (uint32_t i = 0; i < num_results; i++) {
+			Error result;
+			if (!ReadBinaryErrorResponse(&reader, &result)) {
+				return util::getError(kMissingJsonObject, kResults);
+			}
+			results->push_back(result);
+		}
 
-	json_t *accessed_list_json_obj = json_object_get(path_list_json_obj, kPaths);
-	if (accessed_list_json_obj == NULL) {
-		return util::getError(kMissingJsonObject, kPaths);
+		return util::getError(kSuccess);
 	}
 
-	const char *k;
-	json_t *v;
-	json_object_foreach(accessed_list_json_obj, k, v) {
-		if (json_is_integer(v)) {
-			accessed_list->paths[std::string(k)] = json_integer_value(v);
+	// The inodes are already encoded as JSON objects, so the request is built
+	// around them as a Batch request is:
+	//    {"CommandId":24,"Inodes":[inode,...]}
+	std::string prefix = std::string("{\"") + kCommandId + "\":" +
+			     std::to_string(kCmdInsertInodes) + ",\"" + kInodes +
+			     "\":[";
+	CommandBuffer request;
+	ErrorCode code = request.CopyString(prefix.c_str());
+	for (size_t i = 0; i < count && code == kSuccess; i++) {
+		if (i != 0) {
+			code = request.Append((const byte *)",", 1);
+		}
+		if (code == kSuccess) {
+			const CommandBuffer &entry = entries[indices[i]];
+			code = request.Append(entry.Data(), entry.Size());
 		}
 	}
+	if (code == kSuccess) {
+		code = request.Append((const byte *)"]}", 2);
+	}
+	if (code != kSuccess) {
+		return util::getError(code);
+	}
 
-	return util::getError(kSuccess);
-}
+	CommandBuffer response;
+	Error err = this->SendCommand(request, &response);
+	if (err.code != kSuccess) {
+		return err;
+	}
 
-}  // namespace qfsclient
+	JsonReader reader;
+	err = this->CheckCommonApiResponse(response, &reader);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	if (!reader.Find(kResults)) {
+		return util::getError(kMissingJsonObject, kResults);
+	}
 
+	// Each result is an ErrorResponse, which is checked from its own text
+	std::vector<Error> inode_results;
+	CommandBuffer result;
+	bool is_array = reader.EnterArray();
+	while (is_array && inode_results.size() <= count &&
+	       reader.NextElement()) {
+		const char *result_json;
+		size_t result_size;
+		reader.ReadRaw(&result_json, &result_size);
+
+		result.Reset();
+		code = result.Append((const byte *)result_json, result_size);
+		if (code != kSuccess) {
+			return util::getError(code);
+		}
+		inode_results.push_back(this->CheckResponse(result, NULL));
+	}
+	if (!is_array || inode_results.size() != count) {
+		return util::getError(kJsonObjectWrongType,
+				      "expected array of " +
+				      std::to_string(count) +
+				      " for " + std::string(kResults));
+	}
+
+	results->insert(results->end(), inode_results.begin(),
+			inode_results.end());
+	return util::getError(kSuccess);
+}
+
+Error ApiImpl::Branch(const char *source, const char *destination) {
+	CommandBuffer command;
+	Error err = this->PrepareBranch(source, destination, &command);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	CommandBuffer response;
+	err = this->SendCommand(command, &response);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	return this->CheckResponse(response, NULL);
+}
+
+Error ApiImpl::PrepareBranch(const char *source,
+			     const char *destination,
+			     CommandBuffer *command) {
+	Error err = this->CheckWorkspaceNameValid(source);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	err = this->CheckWorkspaceNameValid(destination);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	// The protocol is only known once the api file is open
+	err = this->Open();
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	if (this->protocol == kProtocolBinary) {
+		BinaryWriter writer(kCmdBranchRequest, 0);
+		writer.AppendString(source);
+		writer.AppendString(destination);
+
+		ErrorCode code = writer.Finish();
+		if (code == kSuccess) {
+			writer.TakeFrame(command);
+		}
+		return util::getError(code);
+	}
+
+	// create JSON with:
+	//    CommandId = kCmdBranchRequest and
+	//    Dst = destination
+	//    Src = source
+	JsonWriter writer(command);
+	writer.AppendInt(kCommandId, kCmdBranchRequest);
+	writer.AppendString(kDst, destination);
+	writer.AppendString(kSrc, source);
+
+	return util::getError(writer.Finish());
+}
+
+Error ApiImpl::Delete(const char *workspace) {
+	CommandBuffer command;
+	Error err = this->PrepareDelete(workspace, &command);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	CommandBuffer response;
+	err = this->SendCommand(command, &response);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	return this->CheckResponse(response, NULL);
+}
+
+Error ApiImpl::PrepareDelete(const char *workspace, CommandBuffer *command) {
+	Error err = this->CheckWorkspaceNameValid(workspace);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	// The protocol is only known once the api file is open
+	err = this->Open();
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	if (this->protocol == kProtocolBinary) {
+		BinaryWriter writer(kCmdDeleteWorkspace, 0);
+		writer.AppendString(workspace);
+
+		ErrorCode code = writer.Finish();
+		if (code == kSuccess) {
+			writer.TakeFrame(command);
+		}
+		return util::getError(code);
+	}
+
+	// create JSON with:
+	//    CommandId = kCmdDeleteWorkspace and
+	//    WorkspacePath = workspace
+	JsonWriter writer(command);
+	writer.AppendInt(kCommandId, kCmdDeleteWorkspace);
+	writer.AppendString(kWorkspacePath, workspace);
+
+	return util::getError(writer.Finish());
+}
+
+Error ApiImpl::SetBlock(const std::vector<byte> &key,
+			const std::vector<byte> &data) {
+	return this->SetBlock(key.data(), key.size(), data.data(), data.size());
+}
+
+Error ApiImpl::SetBlock(const byte *key, size_t key_size,
+			const byte *data, size_t data_size) {
+	if (this->shared_memory != NULL &&
+	    data_size <= this->shared_memory_size) {
+		memcpy(this->shared_memory, data, data_size);
+		return this->SetSharedBlock(key, key_size, data_size);
+	}
+
+	CommandBuffer command;
+	Error err = this->PrepareSetBlock(key, key_size, data, data_size, 0,
+					  &command);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	CommandBuffer response;
+	err = this->SendCommand(command, &response);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	return this->CheckResponse(response, NULL);
+}
+
+Error ApiImpl::StartSetBlock(const std::vector<byte> &key,
+			     const std::vector<byte> &data,
+			     RequestId *request_id) {
+	CommandBuffer command;
+	Error err = this->PrepareSetBlock(key.data(), key.size(), data.data(),
+					  data.size(), this->next_request_id,
+					  &command);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	return this->StartPipelined(command, request_id);
+}
+
+Error ApiImpl::PrepareSetBlock(const byte *key, size_t key_size,
+			       const byte *data, size_t data_size,
+			       RequestId request_id,
+			       CommandBuffer *command) {
+	// The protocol is only known once the api file is open
+	Error err = this->Open();
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	// The key may be stored with different data than is cached
+	if (this->block_cache) {
+		this->block_cache->Erase(key, key_size);
+	}
+
+	if (this->protocol == kProtocolBinary) {
+		// no base64 needed, the key and data are sent as they are
+		BinaryWriter writer(kCmdSetBlock, request_id);
+		writer.AppendBytes(key, key_size);
+		writer.AppendBytes(data, data_size);
+
+		ErrorCode code = writer.Finish();
+		if (code == kSuccess) {
+			writer.TakeFrame(command);
+		}
+		return util::getError(code);
+	}
+
+	// create JSON with:
+	//    CommandId = kCmdSetBlock and
+	//    Data = data, in base64
+	//    Key = key, in base64
+	//    RequestId = request_id, if the command is pipelined
+	JsonWriter writer(command);
+	writer.AppendInt(kCommandId, kCmdSetBlock);
+	writer.AppendBytes(kData, data, data_size);
+	writer.AppendBytes(kKey, key, key_size);
+	if (request_id != 0) {
+		writer.AppendInt(kRequestId, request_id);
+	}
+
+	return util::getError(writer.Finish());
+}
+
+Error ApiImpl::GetBlock(const std::vector<byte> &key, std::vector<byte> *data) {
+	return this->GetBlock(key.data(), key.size(), data);
+}
+
+Error ApiImpl::GetBlock(const byte *key, size_t key_size,
+			std::vector<byte> *data) {
+	if (this->block_cache && this->block_cache->Get(key, key_size, data)) {
+		return util::getError(kSuccess);
+	}
+
+	Error err = this->FetchBlock(key, key_size, data);
+	if (err.code == kSuccess && this->block_cache) {
+		this->block_cache->Put(key, key_size, *data);
+	}
+	return err;
+}
+
+Error ApiImpl::FetchBlock(const byte *key, size_t key_size,
+			  std::vector<byte> *data) {
+	if (this->shared_memory != NULL) {
+		uint64_t length;
+		Error err = this->GetSharedBlock(key, key_size, &length);
+		if (err.code == kSuccess) {
+			data->assign(this->shared_memory,
+				     this->shared_memory + length);
+		}
+		return err;
+	}
+
+	CommandBuffer command;
+	Error err = this->PrepareGetBlock(key, key_size, 0, &command);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	CommandBuffer response;
+	err = this->SendCommand(command, &response);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	return this->CheckResponse(response, data);
+}
+
+Error ApiImpl::GetBlockInto(const byte *key, size_t key_size,
+			    byte *data, size_t capacity,
+			    size_t *written) {
+	size_t size;
+	if (!this->block_cache ||
+	    !this->block_cache->Get(key, key_size, data, capacity, &size)) {
+		Error err = this->FetchBlock(key, key_size, data, capacity, &size);
+		if (err.code != kSuccess) {
+			return err;
+		}
+
+		if (this->block_cache && size <= capacity) {
+			this->block_cache->Put(key, key_size,
+					       std::vector<byte>(data, data + size));
+		}
+	}
+
+	*written = size;
+	if (size > capacity) {
+		return util::getError(kBufferTooSmall, std::to_string(size));
+	}
+
+	return util::getError(kSuccess);
+}
+
+Error ApiImpl::FetchBlock(const byte *key, size_t key_size, byte *data,
+			  size_t capacity, size_t *size) {
+	if (this->shared_memory != NULL) {
+		uint64_t length;
+		Error err = this->GetSharedBlock(key, key_size, &length);
+		if (err.code != kSuccess) {
+			return err;
+		}
+
+		*size = length;
+		if (length <= capacity) {
+			memcpy(data, this->shared_memory, length);
+		}
+		return err;
+	}
+
+	CommandBuffer command;
+	Error err = this->PrepareGetBlock(key, key_size, 0, &command);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	CommandBuffer response;
+	err = this->SendCommand(command, &response);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	return this->CheckResponse(response, data, capacity, size);
+}
+
+Error ApiImpl::StatBlock(const std::vector<byte> &key, size_t *size) {
+	Error err = this->Open();
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	if (this->protocol == kProtocolBinary) {
+		BinaryWriter writer(kCmdStatBlock, 0);
+		writer.AppendBytes(key);
+
+		CommandBuffer response;
+		BinaryReader reader;
+		err = this->SendBinary(&writer, &response, &reader);
+		if (err.code != kSuccess) {
+			return err;
+		}
+
+		uint64_t value;
+		if (!reader.ReadUint64(&value)) {
+			return util::getError(kMissingJsonObject, kSize);
+		}
+		*size = value;
+		return util::getError(kSuccess);
+	}
+
+	// create JSON with:
+	//    CommandId = kCmdStatBlock and
+	//    Key = key, in base64
+	CommandBuffer request;
+	JsonWriter writer(&request);
+	writer.AppendInt(kCommandId, kCmdStatBlock);
+	writer.AppendBytes(kKey, key);
+
+	CommandBuffer response;
+	JsonReader reader;
+	err = this->SendJson(&writer, &response, &reader);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	if (!reader.Find(kSize)) {
+		return util::getError(kMissingJsonObject, kSize);
+	}
+	int64_t value;
+	if (!reader.ReadInt(&value) || value < 0) {
+		return util::getError(kJsonObjectWrongType,
+				      "expected integer for " +
+				      std::string(kSize));
+	}
+	*size = value;
+
+	return util::getError(kSuccess);
+}
+
+Error ApiImpl::HasBlocks(const std::vector<std::vector<byte>> &keys,
+			 std::vector<bool> *present) {
+	present->clear();
+	present->reserve(keys.size());
+	for (size_t start = 0; start < keys.size(); start += kMaxHasBlocksKeys) {
+		size_t count = std::min<size_t>(kMaxHasBlocksKeys,
+						keys.size() - start);
+		Error err = this->SendHasBlocks(keys.data() + start, count,
+						present);
+		if (err.code != kSuccess) {
+			present->clear();
+			return err;
+		}
+	}
+
+	return util::getError(kSuccess);
+}
+
+Error ApiImpl::SendHasBlocks(const std::vector<byte> *keys,
+			     size_t count,
+			     std::vector<bool> *present) {
+	Error err = this->Open();
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	if (this->protocol == kProtocolBinary) {
+		BinaryWriter writer(kCmdHasBlocks, 0);
+		writer.AppendUint32(count);
+		for (size_t i = 0; i < count; i++) {
+			writer.AppendBytes(keys[i]);
+		}
+
+		CommandBuffer response;
+		BinaryReader reader;
+		err = this->SendBinary(&writer, &response, &reader);
+		if (err.code != kSuccess) {
+			return err;
+		}
+
+		uint32_t num_present;
+		if (!reader.ReadUint32(&num_present) || num_present != count) {
+			return util::getError(kMissingJsonObject, kPresent);
+		}
+		for (uint32_t i = 0; i < num_present; i++) {
+			bool value;
+			if (!reader.ReadBool(&value)) {
+				return util::getError(kMissingJsonObject, kPresent);
+			}
+			present->push_back(value);
+		}
+
+		return util::getError(kSuccess);
+	}
+
+	// create JSON with:
+	//    CommandId = kCmdHasBlocks and
+	//    Keys = keys, each in base64
+	CommandBuffer request;
+	JsonWriter writer(&request);
+	writer.AppendInt(kCommandId, kCmdHasBlocks);
+	writer.AppendBytesArray(kKeys, keys, count);
+
+	CommandBuffer response;
+	JsonReader reader;
+	err = this->SendJson(&writer, &response, &reader);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	if (!reader.Find(kPresent)) {
+		return util::getError(kMissingJsonObject, kPresent);
+	}
+
+	size_t found = 0;
+	bool is_array = reader.EnterArray();
+	while (is_array && found <= count && reader.NextElement()) {
+		bool value;
+		if (!reader.ReadBool(&value)) {
+			is_array = false;
+			break;
+		}
+		present->push_back(value);
+		found++;
+	}
+	if (!is_array || found != count) {
+		return util::getError(kJsonObjectWrongType,
+				      "expected array of " + std::to_string(count) +
+				      " booleans for " + std::string(kPresent));
+	}
+
+	return util::getError(kSuccess);
+}
+
+Error ApiImpl::SetBlockIfAbsent(const byte *data, size_t size,
+				std::vector<byte> *key,
+				bool *stored) {
+	// The key is derived from the data, so a block stored under it already
+	// holds the same data. SHA-1 rather than CityHash makes that safe to
+	// assume; see qfs_client.h.
+	key->resize(util::kSha1Size);
+	util::sha1(data, size, key->data());
+
+	std::vector<bool> present;
+	Error err = this->HasBlocks({ *key }, &present);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	if (stored != NULL) {
+		*stored = !present[0];
+	}
+	if (present[0]) {
+		return util::getError(kSuccess);
+	}
+
+	return this->SetBlock(key->data(), key->size(), data, size);
+}
+
+Error ApiImpl::Prefetch(const std::vector<std::vector<byte>> &keys,
+			const std::vector<std::string> &extended_keys) {
+	// Each request carries up to kMaxPrefetchKeys keys, the api keys first
+	size_t key_start = 0;
+	size_t extended_start = 0;
+	while (key_start < keys.size() || extended_start < extended_keys.size()) {
+		size_t key_count = std::min<size_t>(kMaxPrefetchKeys,
+						    keys.size() - key_start);
+		size_t extended_count = std::min<size_t>(
+			kMaxPrefetchKeys - key_count,
+			extended_keys.size() - extended_start);
+
+		Error err = this->SendPrefetch(keys.data() + key_start, key_count,
+					       extended_keys.data() + extended_start,
+					       extended_count);
+		if (err.code != kSuccess) {
+			return err;
+		}
+
+		key_start += key_count;
+		extended_start += extended_count;
+	}
+
+	return util::getError(kSuccess);
+}
+
+Error ApiImpl::SendPrefetch(const std::vector<byte> *keys,
+			    size_t key_count,
+			    const std::string *extended_keys,
+			    size_t extended_key_count) {
+	// The protocol is only known once the api file is open
+	Error err = this->Open();
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	CommandBuffer command;
+	ErrorCode code;
+	if (this->protocol == kProtocolBinary) {
+		BinaryWriter writer(kCmdPrefetch, this->next_request_id);
+		writer.AppendUint32(key_count);
+		for (size_t i = 0; i < key_count; i++) {
+			writer.AppendBytes(keys[i]);
+		}
+		writer.AppendUint32(extended_key_count);
+		for (size_t i = 0; i < extended_key_count; i++) {
+			writer.AppendString(extended_keys[i].c_str());
+		}
+
+		code = writer.Finish();
+		if (code == kSuccess) {
+			writer.TakeFrame(&command);
+		}
+	} else {
+		// create JSON with:
+		//    CommandId = kCmdPrefetch and
+		//    ExtendedKeys = extended_keys
+		//    Keys = keys, each in base64
+		JsonWriter writer(&command);
+		writer.AppendInt(kCommandId, kCmdPrefetch);
+		writer.AppendStringArray(kExtendedKeys, extended_keys,
+					 extended_key_count);
+		writer.AppendBytesArray(kKeys, keys, key_count);
+		code = writer.Finish();
+	}
+	if (code != kSuccess) {
+		return util::getError(code);
+	}
+
+	// quantumfsd versions without the binary protocol don't pipeline commands,
+	// and may not know Prefetch either, so the command is sent synchronously
+	// and whatever it answers is ignored
+	if (this->protocol != kProtocolBinary) {
+		CommandBuffer response;
+		return this->SendCommand(command, &response);
+	}
+
+	// Nothing waits for the response, which is dropped once it is read
+	RequestId request_id;
+	err = this->StartPipelined(command, &request_id);
+	if (err.code != kSuccess) {
+		return err;
+	}
+	this->discarded.insert(request_id);
+
+	// The blocks should be fetched now, not with the next command
+	return this->FlushQueued();
+}
+
+Error ApiImpl::StartGetBlock(const std::vector<byte> &key,
+			     RequestId *request_id) {
+	CommandBuffer command;
+	Error err = this->PrepareGetBlock(key.data(), key.size(),
+					  this->next_request_id, &command);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	return this->StartPipelined(command, request_id);
+}
+
+Error ApiImpl::PrepareGetBlock(const byte *key, size_t key_size,
+			       RequestId request_id,
+			       CommandBuffer *command) {
+	// The protocol is only known once the api file is open
+	Error err = this->Open();
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	if (this->protocol == kProtocolBinary) {
+		BinaryWriter writer(kCmdGetBlock, request_id);
+		writer.AppendBytes(key, key_size);
+
+		ErrorCode code = writer.Finish();
+		if (code == kSuccess) {
+			writer.TakeFrame(command);
+		}
+		return util::getError(code);
+	}
+
+	// create JSON with:
+	//    CommandId = kCmdGetBlock and
+	//    Key = key, in base64
+	//    RequestId = request_id, if the command is pipelined
+	JsonWriter writer(command);
+	writer.AppendInt(kCommandId, kCmdGetBlock);
+	writer.AppendBytes(kKey, key, key_size);
+	if (request_id != 0) {
+		writer.AppendInt(kRequestId, request_id);
+	}
+
+	return util::getError(writer.Finish());
+}
+
+Error ApiImpl::EnableSharedMemory() {
+	Error err = this->Open();
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	if (this->shared_memory != NULL) {
+		return util::getError(kSuccess);
+	}
+
+	return this->CreateSharedMemory();
+}
+
+Error ApiImpl::CreateSharedMemory() {
+	// The region holds the largest block quantumfsd will store, so that
+	// GetBlock() never finds a block which doesn't fit
+	const size_t size = kMaxBlockSize;
+
+	std::string path = std::string(kSharedMemoryDir) + "/qfsclient-XXXXXX";
+	int fd = mkstemp(&path[0]);
+	if (fd == -1) {
+		return util::getError(kSharedMemoryFail,
+				      path + ": " + strerror(errno));
+	}
+
+	void *region = MAP_FAILED;
+	if (ftruncate(fd, size) == 0) {
+		region = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+			      0);
+	}
+	int map_errno = errno;
+	close(fd);
+
+	if (region == MAP_FAILED) {
+		unlink(path.c_str());
+		return util::getError(kSharedMemoryFail,
+				      path + ": " + strerror(map_errno));
+	}
+
+	Error err;
+	if (this->protocol == kProtocolBinary) {
+		BinaryWriter writer(kCmdRegisterSharedMemory, 0);
+		writer.AppendString(path.c_str());
+		writer.AppendUint64(size);
+
+		CommandBuffer response;
+		BinaryReader reader;
+		err = this->SendBinary(&writer, &response, &reader);
+	} else {
+		// create JSON with:
+		//    CommandId = kCmdRegisterSharedMemory and
+		//    Path = path
+		//    Size = size
+		CommandBuffer request;
+		JsonWriter writer(&request);
+		writer.AppendInt(kCommandId, kCmdRegisterSharedMemory);
+		writer.AppendString(kPath, path);
+		writer.AppendInt(kSize, size);
+
+		CommandBuffer response;
+		JsonReader reader;
+		err = this->SendJson(&writer, &response, &reader);
+	}
+
+	// quantumfsd keeps the file open once it is registered, so it needn't
+	// be left behind
+	unlink(path.c_str());
+
+	if (err.code != kSuccess) {
+		munmap(region, size);
+		return err;
+	}
+
+	this->shared_memory = reinterpret_cast<byte *>(region);
+	this->shared_memory_size = size;
+
+	return util::getError(kSuccess);
+}
+
+void ApiImpl::ReleaseSharedMemory() {
+	if (this->shared_memory != NULL) {
+		munmap(this->shared_memory, this->shared_memory_size);
+		this->shared_memory = NULL;
+		this->shared_memory_size = 0;
+	}
+}
+
+Error ApiImpl::SetSharedBlock(const byte *key, size_t key_size, size_t length) {
+	// The key may be stored with different data than is cached
+	if (this->block_cache) {
+		this->block_cache->Erase(key, key_size);
+	}
+
+	if (this->protocol == kProtocolBinary) {
+		BinaryWriter writer(kCmdSetBlockShared, 0);
+		writer.AppendBytes(key, key_size);
+		writer.AppendUint64(0);
+		writer.AppendUint64(length);
+
+		CommandBuffer response;
+		BinaryReader reader;
+		return this->SendBinary(&writer, &response, &reader);
+	}
+
+	// create JSON with:
+	//    CommandId = kCmdSetBlockShared and
+	//    Key = key, in base64
+	//    Length = length
+	//    Offset = 0
+	CommandBuffer request;
+	JsonWriter writer(&request);
+	writer.AppendInt(kCommandId, kCmdSetBlockShared);
+	writer.AppendBytes(kKey, key, key_size);
+	writer.AppendInt(kLength, length);
+	writer.AppendInt(kOffset, 0);
+
+	CommandBuffer response;
+	JsonReader reader;
+	return this->SendJson(&writer, &response, &reader);
+}
+
+Error ApiImpl::GetSharedBlock(const byte *key, size_t key_size,
+			      uint64_t *length) {
+	if (this->protocol == kProtocolBinary) {
+		BinaryWriter writer(kCmdGetBlockShared, 0);
+		writer.AppendBytes(key, key_size);
+		writer.AppendUint64(0);
+		writer.AppendUint64(this->shared_memory_size);
+
+		CommandBuffer response;
+		BinaryReader reader;
+		Error err = this->SendBinary(&writer, &response, &reader);
+		if (err.code != kSuccess) {
+			return err;
+		}
+
+		if (!reader.ReadUint64(length)) {
+			return util::getError(kMissingJsonObject, kLength);
+		}
+	} else {
+		// create JSON with:
+		//    Capacity = shared_memory_size
+		//    CommandId = kCmdGetBlockShared and
+		//    Key = key, in base64
+		//    Offset = 0
+		CommandBuffer request;
+		JsonWriter writer(&request);
+		writer.AppendInt(kCapacity, this->shared_memory_size);
+		writer.AppendInt(kCommandId, kCmdGetBlockShared);
+		writer.AppendBytes(kKey, key, key_size);
+		writer.AppendInt(kOffset, 0);
+
+		CommandBuffer response;
+		JsonReader reader;
+		Error err = this->SendJson(&writer, &response, &reader);
+		if (err.code != kSuccess) {
+			return err;
+		}
+
+		if (!reader.Find(kLength)) {
+			return util::getError(kMissingJsonObject, kLength);
+		}
+		int64_t value;
+		if (!reader.ReadInt(&value) || value < 0) {
+			return util::getError(kJsonObjectWrongType,
+					      "expected integer for " +
+					      std::string(kLength));
+		}
+		*length = value;
+	}
+
+	if (*length > this->shared_memory_size) {
+		return util::getError(kBufferTooBig);
+	}
+
+	return util::getError(kSuccess);
+}
+
+Error ApiImpl::Wait(RequestId request_id, std::vector<byte> *data) {
+	if (request_id == 0) {
+		return util::getError(kUnknownRequestId, "0");
+	}
+
+	CommandBuffer response;
+	Error err = this->CollectResponse(request_id, &response);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	return this->CheckResponse(response, data);
+}
+
+uint64_t ApiImpl::CompressionSavings() {
+	return this->compression_savings;
+}
+
+Error ApiImpl::PutObject(const std::vector<byte> &key,
+			 const byte *data,
+			 size_t size) {
+	size_t count = ObjectChunkCount(size);
+	if (count > kMaxObjectChunks) {
+		return util::getError(kBufferTooBig);
+	}
+
+	// The chunks are pipelined, keeping kObjectChunksInFlight of them in
+	// flight, so that quantumfsd stores them concurrently
+	std::vector<byte> chunk_keys(count * util::kSha1Size);
+	std::deque<RequestId> in_flight;
+	Error err = util::getError(kSuccess);
+	for (size_t i = 0; i < count && err.code == kSuccess; i++) {
+		if (in_flight.size() == kObjectChunksInFlight) {
+			err = this->Wait(in_flight.front(), NULL);
+			in_flight.pop_front();
+			if (err.code != kSuccess) {
+				break;
+			}
+		}
+
+		size_t offset = i * kObjectChunkSize;
+		size_t chunk_size = std::min(kObjectChunkSize, size - offset);
+		byte *chunk_key = chunk_keys.data() + i * util::kSha1Size;
+		util::sha1(data + offset, chunk_size, chunk_key);
+
+		CommandBuffer command;
+		err = this->PrepareSetBlock(chunk_key, util::kSha1Size,
+					    data + offset, chunk_size,
+					    this->next_request_id, &command);
+		if (err.code != kSuccess) {
+			break;
+		}
+
+		RequestId request_id;
+		err = this->StartPipelined(command, &request_id);
+		if (err.code == kSuccess) {
+			in_flight.push_back(request_id);
+		}
+	}
+
+	// Every chunk in flight must be waited for, even once one has failed
+	for (RequestId request_id : in_flight) {
+		Error chunk_err = this->Wait(request_id, NULL);
+		if (err.code == kSuccess) {
+			err = chunk_err;
+		}
+	}
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	// The manifest is only stored once every chunk it lists has been
+	std::vector<byte> manifest;
+	EncodeObjectManifest(size, chunk_keys, &manifest);
+	return this->SetBlock(key, manifest);
+}
+
+Error ApiImpl::GetObject(const std::vector<byte> &key, std::vector<byte> *data) {
+	std::vector<byte> manifest;
+	Error err = this->GetBlock(key, &manifest);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	uint64_t size;
+	std::vector<byte> chunk_keys;
+	err = DecodeObjectManifest(manifest, &size, &chunk_keys);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	data->clear();
+	data->reserve(size);
+	err = this->GetObjectChunks(size, chunk_keys,
+				    [data](const std::vector<byte> &chunk) {
+		data->insert(data->end(), chunk.begin(), chunk.end());
+		return util::getError(kSuccess);
+	});
+	if (err.code != kSuccess) {
+		data->clear();
+	}
+
+	return err;
+}
+
+Error ApiImpl::GetObject(const std::vector<byte> &key, int fd) {
+	std::vector<byte> manifest;
+	Error err = this->GetBlock(key, &manifest);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	uint64_t size;
+	std::vector<byte> chunk_keys;
+	err = DecodeObjectManifest(manifest, &size, &chunk_keys);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	return this->GetObjectChunks(size, chunk_keys,
+				     [fd](const std::vector<byte> &chunk) {
+		const byte *next = chunk.data();
+		size_t remaining = chunk.size();
+		while (remaining > 0) {
+			ssize_t written = write(fd, next, remaining);
+			if (written < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return util::getError(kObjectFileWriteFail,
+						      strerror(errno));
+			}
+			next += written;
+			remaining -= written;
+		}
+		return util::getError(kSuccess);
+	});
+}
+
+Error ApiImpl::GetObjectChunks(
+	uint64_t size,
+	const std::vector<byte> &chunk_keys,
+	const std::function<Error(const std::vector<byte> &chunk)> &sink) {
+	size_t count = chunk_keys.size() / util::kSha1Size;
+	std::deque<RequestId> in_flight;
+	size_t next = 0;
+	std::vector<byte> chunk;
+	Error err = util::getError(kSuccess);
+	for (size_t i = 0; i < count && err.code == kSuccess; i++) {
+		while (next < count && in_flight.size() < kObjectChunksInFlight) {
+			CommandBuffer command;
+			err = this->PrepareGetBlock(
+				chunk_keys.data() + next * util::kSha1Size,
+				util::kSha1Size, this->next_request_id, &command);
+			RequestId request_id;
+			if (err.code == kSuccess) {
+				err = this->StartPipelined(command, &request_id);
+			}
+			if (err.code != kSuccess) {
+				break;
+			}
+			in_flight.push_back(request_id);
+			next++;
+		}
+		if (err.code != kSuccess) {
+			break;
+		}
+
+		// Responses may arrive in any order, but the chunks are passed on
+		// in the order of the object
+		err = this->Wait(in_flight.front(), &chunk);
+		in_flight.pop_front();
+		if (err.code != kSuccess) {
+			break;
+		}
+
+		uint64_t offset = i * kObjectChunkSize;
+		uint64_t expected = std::min<uint64_t>(kObjectChunkSize,
+						       size - offset);
+		if (chunk.size() != expected) {
+			err = util::getError(kObjectCorrupt,
+					     "chunk " + std::to_string(i) + " is " +
+					     std::to_string(chunk.size()) +
+					     " bytes, expected " +
+					     std::to_string(expected));
+			break;
+		}
+
+		err = sink(chunk);
+	}
+
+	for (RequestId request_id : in_flight) {
+		this->Wait(request_id, NULL);
+	}
+
+	return err;
+}
+
+Error ApiImpl::EnableBlockCache(size_t max_bytes) {
+	if (max_bytes == 0) {
+		this->block_cache.reset();
+	} else {
+		this->block_cache = std::make_shared<BlockCache>(max_bytes);
+	}
+
+	return util::getError(kSuccess);
+}
+
+BlockCacheStats ApiImpl::GetBlockCacheStats() {
+	if (!this->block_cache) {
+		return BlockCacheStats();
+	}
+
+	return this->block_cache->Stats();
+}
+
+void ApiImpl::UseBlockCache(const std::shared_ptr<BlockCache> &cache) {
+	this->block_cache = cache;
+}
+
+Error ApiImpl::ExecuteBatch(const Batch &batch, std::vector<Error> *results) {
+	size_t count = batch.commands.size();
+	results->assign(count, util::getError(kSuccess));
+
+	// A command which can't be built fails on its own, without being sent
+	std::vector<CommandBuffer> commands(count);
+	std::vector<size_t> prepared;
+	for (size_t i = 0; i < count; i++) {
+		Error err = this->PrepareBatchCommand(batch.commands[i],
+						      &commands[i]);
+		if (err.code != kSuccess) {
+			(*results)[i] = err;
+			continue;
+		}
+		prepared.push_back(i);
+	}
+
+	return this->SendBatchCommands(commands, prepared, kMaxBatchCommands,
+				       results, NULL);
+}
+
+Error ApiImpl::SetBlocks(const std::vector<Block> &blocks,
+			 std::vector<Error> *results) {
+	size_t count = blocks.size();
+	results->assign(count, util::getError(kSuccess));
+
+	std::vector<CommandBuffer> commands(count);
+	std::vector<size_t> prepared;
+	for (size_t i = 0; i < count; i++) {
+		const Block &block = blocks[i];
+		Error err = this->PrepareSetBlock(block.key.data(), block.key.size(),
+						  block.data.data(),
+						  block.data.size(), 0,
+						  &commands[i]);
+		if (err.code != kSuccess) {
+			(*results)[i] = err;
+			continue;
+		}
+		prepared.push_back(i);
+	}
+
+	return this->SendBatchCommands(commands, prepared, kMaxBatchCommands,
+				       results, NULL);
+}
+
+Error ApiImpl::GetBlocks(const std::vector<std::vector<byte>> &keys,
+			 std::vector<std::vector<byte>> *blocks,
+			 std::vector<Error> *results) {
+	size_t count = keys.size();
+	results->assign(count, util::getError(kSuccess));
+	blocks->assign(count, std::vector<byte>());
+
+	std::vector<CommandBuffer> commands(count);
+	std::vector<size_t> prepared;
+	for (size_t i = 0; i < count; i++) {
+		if (this->block_cache &&
+		    this->block_cache->Get(keys[i].data(), keys[i].size(),
+					   &(*blocks)[i])) {
+			continue;
+		}
+
+		Error err = this->PrepareGetBlock(keys[i].data(), keys[i].size(), 0,
+						  &commands[i]);
+		if (err.code != kSuccess) {
+			(*results)[i] = err;
+			continue;
+		}
+		prepared.push_back(i);
+	}
+
+	Error err = this->SendBatchCommands(commands, prepared, kMaxBatchGetBlocks,
+					    results, blocks);
+
+	if (this->block_cache) {
+		for (size_t i : prepared) {
+			if ((*results)[i].code == kSuccess) {
+				this->block_cache->Put(keys[i].data(),
+						       keys[i].size(), (*blocks)[i]);
+			}
+		}
+	}
+
+	return err;
+}
+
+Error ApiImpl::SendBatchCommands(const std::vector<CommandBuffer> &commands,
+				 const std::vector<size_t> &prepared,
+				 size_t max_commands,
+				 std::vector<Error> *results,
+				 std::vector<std::vector<byte>> *blocks) {
+	// Send as many commands in each request as fit
+	const size_t max_size = kMaxBatchBytes - kBatchRequestOverhead;
+	size_t start = 0;
+	while (start < prepared.size()) {
+		std::vector<const CommandBuffer *> chunk;
+		size_t size = 0;
+		size_t end = start;
+		for (; end < prepared.size() && chunk.size() < max_commands; end++) {
+			const CommandBuffer *command = &commands[prepared[end]];
+			size_t command_size = command->Size() +
+					      kBatchCommandOverhead;
+			if (!chunk.empty() && size + command_size > max_size) {
+				break;
+			}
+			chunk.push_back(command);
+			size += command_size;
+		}
+
+		std::vector<Error> chunk_results;
+		std::vector<std::vector<byte>> chunk_blocks;
+		std::vector<std::vector<byte>> *chunk_blocks_ptr =
+			blocks != NULL ? &chunk_blocks : NULL;
+		Error err;
+		if (size > max_size) {
+			// A command too large to be batched is sent on its own
+			CommandBuffer response;
+			err = this->SendCommand(*chunk[0], &response);
+			if (err.code == kSuccess) {
+				std::vector<byte> *block = NULL;
+				if (chunk_blocks_ptr != NULL) {
+					chunk_blocks.resize(1);
+					block = &chunk_blocks[0];
+				}
+				chunk_results.push_back(
+					this->CheckResponse(response, block));
+			}
+		} else {
+			err = this->SendBatch(chunk, &chunk_results,
+					      chunk_blocks_ptr);
+		}
+
+		if (err.code != kSuccess) {
+			for (size_t i = start; i < prepared.size(); i++) {
+				(*results)[prepared[i]] = err;
+			}
+			return err;
+		}
+
+		for (size_t i = start; i < end; i++) {
+			(*results)[prepared[i]] = chunk_results[i - start];
+			if (blocks != NULL) {
+				(*blocks)[prepared[i]].swap(chunk_blocks[i - start]);
+			}
+		}
+		start = end;
+	}
+
+	return util::getError(kSuccess);
+}
+
+Error ApiImpl::PrepareBatchCommand(const Batch::Command &batch_command,
+				   CommandBuffer *command) {
+	switch (batch_command.command_id) {
+	case kCmdInsertInode:
+		return this->PrepareInsertInode(batch_command.destination.c_str(),
+						batch_command.key.c_str(),
+						batch_command.permissions,
+						batch_command.uid,
+						batch_command.gid, 0, command);
+	case kCmdBranchRequest:
+		return this->PrepareBranch(batch_command.source.c_str(),
+					   batch_command.destination.c_str(),
+					   command);
+	case kCmdDeleteWorkspace:
+		// the workspace to delete is kept as the destination
+		return this->PrepareDelete(batch_command.destination.c_str(),
+					   command);
+	case kCmdSetBlock:
+		return this->PrepareSetBlock(batch_command.block_key.data(),
+					     batch_command.block_key.size(),
+					     batch_command.data.data(),
+					     batch_command.data.size(), 0, command);
+	default:
+		return util::getError(kApiError,
+				      util::getApiError(kCmdBadCommandId,
+					std::to_string(batch_command.command_id)));
+	}
+}
+
+Error ApiImpl::SendBatch(const std::vector<const CommandBuffer *> &commands,
+			 std::vector<Error> *results,
+			 std::vector<std::vector<byte>> *blocks) {
+	if (this->protocol == kProtocolBinary) {
+		// each command is a whole frame within the frame of the batch
+		BinaryWriter writer(kCmdBatch, 0);
+		writer.AppendUint32(commands.size());
+		for (const CommandBuffer *command : commands) {
+			writer.AppendBytes(command->Data(), command->Size());
+		}
+
+		CommandBuffer response;
+		BinaryReader reader;
+		Error err = this->SendBinary(&writer, &response, &reader);
+		if (err.code != kSuccess) {
+			return err;
+		}
+
+		uint32_t num_results;
+		if (!reader.ReadUint32(&num_results) ||
+		    num_results != commands.size()) {
+			return util::getError(kMissingJsonObject, kResults);
+		}
+
+		std::vector<byte> result;
+		CommandBuffer result_frame;
+		for (uint32_t i = 0; i < num_results; i++) {
+			if (!reader.ReadBytes(&result)) {
+				return util::getError(kMissingJsonObject, kResults);
+			}
+			result_frame.Reset();
+			result_frame.Append(result.data(), result.size());
+
+			std::vector<byte> *block = NULL;
+			if (blocks != NULL) {
+				blocks->emplace_back();
+				block = &blocks->back();
+			}
+			results->push_back(this->CheckResponse(result_frame, block));
+		}
+
+		return util::getError(kSuccess);
+	}
+
+	// The commands are already encoded as JSON objects, so the request is
+	// built around them rather than by jansson:
+	//    {"CommandId":20,"Commands":[command,...]}
+	std::string prefix = std::string("{\"") + kCommandId + "\":" +
+			     std::to_string(kCmdBatch) + ",\"" + kCommands +
+			     "\":[";
+	CommandBuffer request;
+	ErrorCode code = request.CopyString(prefix.c_str());
+	for (size_t i = 0; i < commands.size() && code == kSuccess; i++) {
+		if (i != 0) {
+			code = request.Append((const byte *)",", 1);
+		}
+		if (code == kSuccess) {
+			code = request.Append(commands[i]->Data(),
+					      commands[i]->Size());
+		}
+	}
+	if (code == kSuccess) {
+		code = request.Append((const byte *)"]}", 2);
+	}
+	if (code != kSuccess) {
+		return util::getError(code);
+	}
+
+	CommandBuffer response;
+	Error err = this->SendCommand(request, &response);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	JsonReader reader;
+	err = this->CheckCommonApiResponse(response, &reader);
+	if (err.code != kSuccess) {
+		return err;
+	}
+
+	if (!reader.Find(kResults)) {
+		return util::getError(kMissingJsonObject, kResults);
+	}
+
+	// Each result is itself a response, which is checked from its own text
+	std::vector<Error> batch_results;
+	CommandBuffer result;
+	bool is_array = reader.EnterArray();
+	while (is_array && batch_results.size() <= commands.size() &&
+	       reader.NextElement()) {
+		const char *result_json;
+		size_t result_size;
+		reader.ReadRaw(&result_json, &result_size);
+
+		result.Reset();
+		ErrorCode code = result.Append((const byte *)result_json,
+					       result_size);
+		if (code != kSuccess) {
+			return util::getError(code);
+		}
+
+		std::vector<byte> *block = NULL;
+		if (blocks != NULL) {
+			blocks->emplace_back();
+			block = &blocks->back();
+		}
+		batch_results.push_back(this->CheckResponse(result, block));
+	}
+	if (!is_array || batch_results.size() != commands.size()) {
+		return util::getError(kJsonObjectWrongType,
+				      "expected array of " +
+				      std::to_string(commands.size()) +
+				      " for " + std::string(kResults));
+	}
+
+	results->insert(results->end(), batch_results.begin(),
+			batch_results.end());
+	return util::getError(kSuccess);
+}
+
+Error ApiImpl::PrepareAccessedListResponse(JsonReader *reader,
+					   PathsAccessed *accessed_list) {
+	if (!reader->Find(kPathList) || !reader->EnterObject()) {
+		return util::getError(kMissingJsonObject, kPathList);
+	}
+
+	// The paths are decoded straight into the map, skipping anything else
+	bool found_paths = false;
+	std::string key;
+	while (reader->NextMember(&key)) {
+		if (key != kPaths) {
+			reader->Skip();
+			continue;
+		}
+
+		found_paths = true;
+		if (!reader->EnterObject()) {
+			// such as null for an empty map
+			reader->Skip();
+			continue;
+		}
+
+		std::string path;
+		while (reader->NextMember(&path)) {
+			int64_t flags;
+			if (reader->ReadInt(&flags)) {
+				accessed_list->paths[std::move(path)] = flags;
+			} else {
+				reader->Skip();
+			}
+		}
+	}
+
+	if (!found_paths) {
+		return util::getError(kMissingJsonObject, kPaths);
+	}
+
+	return util::getError(kSuccess);
+}
+
+Error ApiImpl::PrepareBinaryAccessedListResponse(BinaryReader *reader,
+						 PathsAccessed *accessed_list) {
+	// PathList is a map of path to flags
+	uint32_t count;
+	if (!reader->ReadUint32(&count)) {
+		return util::getError(kMissingJsonObject, kPathList);
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		std::string path;
+		uint64_t flags;
+		if (!reader->ReadString(&path) || !reader->ReadUint64(&flags)) {
+			return util::getError(kMissingJsonObject, kPaths);
+		}
+
+		accessed_list->paths[path] = (PathFlags)flags;
+	}
+
+	return util::getError(kSuccess);
+}
+
+// Read an entry of the Paths of a GetAccessedPage response, returning false if it
+// lacks either field
+static bool ReadPathAccessed(JsonReader *reader, PathAccessed *entry) {
+	if (!reader->EnterObject()) {
+		reader->Skip();
+		return false;
+	}
+
+	bool found_path = false;
+	bool found_flags = false;
+	int64_t flags = 0;
+	std::string key;
+	while (reader->NextMember(&key)) {
+		if (key == kPath && reader->ReadString(&entry->path)) {
+			found_path = true;
+		} else if (key == kFlags && reader->ReadInt(&flags)) {
+			found_flags = true;
+		} else {
+			reader->Skip();
+		}
+	}
+
+	entry->flags = (PathFlags)flags;
+	return found_path && found_flags;
+}
+
+Error ApiImpl::PrepareAccessedPageResponse(JsonReader *reader,
+					  AccessedCursor *cursor,
+					  std::vector<PathAccessed> *paths) {
+	if (!reader->Find(kNextCursor)) {
+		return util::getError(kMissingJsonObject, kNextCursor);
+	}
+	int64_t next_cursor;
+	if (!reader->ReadInt(&next_cursor)) {
+		return util::getError(kJsonObjectWrongType,
+				      "expected integer for " +
+				      std::string(kNextCursor));
+	}
+
+	if (!reader->Find(kPaths)) {
+		return util::getError(kMissingJsonObject, kPaths);
+	}
+
+	// an empty page may be sent as null
+	if (!reader->ReadNull()) {
+		if (!reader->EnterArray()) {
+			return util::getError(kJsonObjectWrongType,
+					      "expected array for " +
+					      std::string(kPaths));
+		}
+
+		while (reader->NextElement()) {
+			PathAccessed entry;
+			if (!ReadPathAccessed(reader, &entry)) {
+				return util::getError(kJsonObjectWrongType,
+						      "expected Path and Flags in " +
+						      std::string(kPaths));
+			}
+			paths->push_back(std::move(entry));
+		}
+	}
+
+	*cursor = (AccessedCursor)next_cursor;
+
+	return util::getError(kSuccess);
+}
+
+Error ApiImpl::PrepareBinaryAccessedPageResponse(BinaryReader *reader,
+						 AccessedCursor *cursor,
+						 std::vector<PathAccessed> *paths) {
+	// Paths is a list of Path and Flags pairs, followed by NextCursor
+	uint32_t count;
+	if (!reader->ReadUint32(&count)) {
+		return util::getError(kMissingJsonObject, kPaths);
+	}
+
+	// the count is untrusted, so don't reserve more entries than the response
+	// could hold, each being at least a string length and the flags
+	paths->reserve(std::min((size_t)count, reader->Remaining() / 12));
+	for (uint32_t i = 0; i < count; i++) {
+		PathAccessed entry;
+		uint64_t flags;
+		if (!reader->ReadString(&entry.path) ||
+		    !reader->ReadUint64(&flags)) {
+			return util::getError(kMissingJsonObject, kPaths);
+		}
+
+		entry.flags = (PathFlags)flags;
+		paths->push_back(entry);
+	}
+
+	uint64_t next_cursor;
+	if (!reader->ReadUint64(&next_cursor)) {
+		return util::getError(kMissingJsonObject, kNextCursor);
+	}
+	*cursor = next_cursor;
+
+	return util::getError(kSuccess);
+}
+
+}  // namespace qfsclient
@@ -6,15 +6,22 @@
 #define QFSCLIENT_QFS_CLIENT_IMPLEMENTATION_H_
 
 #include "QFSClient/qfs_client.h"
+#include "QFSClient/qfs_client_data.h"
 
 #include <stdint.h>
 #include <sys/types.h>
 
 #include <gtest/gtest_prod.h>
-#include <jansson.h>
 
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <new>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 namespace qfsclient {
@@ -22,34 +29,120 @@ namespace qfsclient {
 const char kApiPath[] = "api";
 const int kInodeIdApi = 2;
 
-// Class used for holding internal context about an in-flight API call. It may be
-// passed between functions used to handle an API call and should should be created
-// on the stack so that useful cleanup happens automatically.
-class ApiContext {
+// The environment variable which gives the path of the api socket of quantumfsd,
+// as libqfs.ApiSocketEnvironment
+const char kApiSocketEnvironment[] = "QUANTUMFS_API_SOCKET";
+
+// If this environment variable is set, commands are written to the api file and
+// their responses read through io_uring, where the kernel allows it. The ring
+// holds the commands of a full pipeline along with the read of a response.
+const char kApiIoUringEnvironment[] = "QUANTUMFS_API_IO_URING";
+const unsigned kIoUringEntries = 2 * kMaxPipelineDepth;
+
+// Responses are read from the api file in multiples of kResponseReadSize bytes,
+// starting with a single multiple. A guess at the size of the rest of a response
+// is limited to kMaxResponseReadHint bytes.
+const size_t kResponseReadSize = 4096;
+const size_t kMaxResponseReadHint = 4 * 1024 * 1024;
+
+// CommandBuffer storage is aligned to kBufferAlignment bytes so that it may be
+// used for O_DIRECT I/O on the api file as it is. Freed storage is kept by each
+// thread for reuse, in power of two size classes from kMinPooledBufferSize to
+// kMaxPooledBufferSize bytes, up to a total of kMaxCachedBufferBytes.
+const size_t kBufferAlignment = 512;
+const size_t kMinPooledBufferSize = 4096;
+const size_t kMaxPooledBufferSize = 4 * 1024 * 1024;
+const size_t kMaxCachedBufferBytes = 8 * 1024 * 1024;
+
+// A Batch request is written to the api file at once, so it must fit in the
+// largest write quantumfsd accepts, which is kMaxBlockSize bytes
+const int kMaxBatchBytes = kMaxBlockSize;
+
+// The room taken in a Batch request by its own fields, and by the framing of each
+// of its commands, which the commands of a batch must leave within kMaxBatchBytes
+const size_t kBatchRequestOverhead = 64;
+const size_t kBatchCommandOverhead = 4;
+
+// The response to a GetBlock command may carry up to kMaxBlockSize bytes, so the
+// GetBlock commands of a single Batch request are limited to keep its response
+// within kMaxBatchResponseBytes
+const size_t kMaxBatchResponseBytes = 16 * 1024 * 1024;
+const size_t kMaxBatchGetBlocks = kMaxBatchResponseBytes / kMaxBlockSize;
+
+// Allocate aligned storage of at least the given size, preferably storage freed
+// earlier by this thread. Returns NULL if the allocation fails.
+void *AllocateBuffer(size_t size);
+
+// Free storage from AllocateBuffer() of the size it was allocated with
+void FreeBuffer(void *buffer, size_t size);
+
+// BufferAllocator allows a standard container to keep its elements in storage
+// from AllocateBuffer(). Elements added by resize() are left uninitialised,
+// since they are only added to be read into.
+template <typename T>
+class BufferAllocator {
  public:
-	ApiContext();
-	~ApiContext();
-
-	void SetRequestJsonObject(json_t *request_json_object);
-	json_t *GetRequestJsonObject() const;
+	typedef T value_type;
+
+	BufferAllocator() {
+	}
+
+	template <typename U>
+	BufferAllocator(const BufferAllocator<U> &other) {  // NOLINT
+	}
+
+	T *allocate(size_t count) {
+		void *buffer = AllocateBuffer(count * sizeof(T));
+		if (buffer == NULL) {
+			throw std::bad_alloc();
+		}
+		return static_cast<T *>(buffer);
+	}
+
+	void deallocate(T *buffer, size_t count) {
+		FreeBuffer(buffer, count * sizeof(T));
+	}
+
+	template <typename U>
+	void construct(U *element) {
+		::new(static_cast<void *>(element)) U;
+	}
+
+	template <typename U, typename... Args>
+	void construct(U *element, Args&&... args) {
+		::new(static_cast<void *>(element)) U(std::forward<Args>(args)...);
+	}
+};
 
-	void SetResponseJsonObject(json_t *response_json_object);
-	json_t *GetResponseJsonObject() const;
+template <typename T, typename U>
+bool operator==(const BufferAllocator<T> &a, const BufferAllocator<U> &b) {
+	return true;
+}
 
- private:
-	json_t *request_json_object;
-	json_t *response_json_object;
-};
+template <typename T, typename U>
+bool operator!=(const BufferAllocator<T> &a, const BufferAllocator<U> &b) {
+	return false;
+}
 
 // forward declarations
+class BinaryReader;
+class BinaryWriter;
+class BlockCache;
 class CommandBuffer;
+class IoUring;
+class JsonReader;
+class JsonWriter;
 class TestHook;
 
 // ApiImpl provides the concrete implentation for QuantumFS API calls and whatever
 // related support logic they need. If an ApiImpl object is constructed with no
 // path, it will start looking for the API file in the current working directory
 // and work upwards towards the root from there. If it is constructed with a path,
-// then it is assumed that the API file will be found at the given location.
+// then it is assumed that the API file will be found at the given location. If the
+// location is that of the api socket of quantumfsd, commands are sent over the
+// socket instead of through the API file.
+// ApiImpl uses a single handle of the API file and so must only be used by one
+// thread at a time, see PooledApi for an Api which may be shared.
 class ApiImpl: public Api {
  public:
 	ApiImpl();
@@ -68,15 +161,27 @@ class ApiImpl: public Api {
 	// Closes the api file if it's still open.
 	void Close();
 
+	// Use the given block cache, which may be shared with other connections,
+	// in place of any of its own. NULL disables the cache.
+	void UseBlockCache(const std::shared_ptr<BlockCache> &cache);
+
 	// implemented API functions
 	virtual Error GetAccessed(const char *workspace_root, PathsAccessed *paths);
 
+	virtual Error GetAccessedPage(const char *workspace_root,
+				      AccessedCursor *cursor,
+				      uint32_t max_paths,
+				      std::vector<PathAccessed> *paths);
+
 	virtual Error InsertInode(const char *destination,
 				  const char *key,
 				  uint32_t permissions,
 				  uint32_t uid,
 				  uint32_t gid);
 
+	virtual Error InsertInodes(const std::vector<InsertInodeEntry> &inodes,
+				   std::vector<Error> *results);
+
 	virtual Error Branch(const char *source, const char *destination);
 
 	virtual Error Delete(const char *workspace);
@@ -87,6 +192,70 @@ class ApiImpl: public Api {
 	virtual Error GetBlock(const std::vector<byte> &key,
 			       std::vector<byte> *data);
 
+	virtual Error SetBlock(const byte *key, size_t key_size,
+			       const byte *data, size_t data_size);
+
+	virtual Error GetBlock(const byte *key, size_t key_size,
+			       std::vector<byte> *data);
+
+	virtual Error GetBlockInto(const byte *key, size_t key_size,
+				   byte *data, size_t capacity,
+				   size_t *written);
+
+	virtual Error StatBlock(const std::vector<byte> &key, size_t *size);
+
+	virtual Error HasBlocks(const std::vector<std::vector<byte>> &keys,
+				std::vector<bool> *present);
+
+	virtual Error SetBlockIfAbsent(const byte *data, size_t size,
+				       std::vector<byte> *key,
+				       bool *stored);
+
+	virtual Error Prefetch(const std::vector<std::vector<byte>> &keys,
+			       const std::vector<std::string> &extended_keys);
+
+	virtual Error EnableSharedMemory();
+
+	virtual Error StartInsertInode(const char *destination,
+				       const char *key,
+				       uint32_t permissions,
+				       uint32_t uid,
+				       uint32_t gid,
+				       RequestId *request_id);
+
+	virtual Error StartSetBlock(const std::vector<byte> &key,
+				    const std::vector<byte> &data,
+				    RequestId *request_id);
+
+	virtual Error StartGetBlock(const std::vector<byte> &key,
+				    RequestId *request_id);
+
+	virtual Error Wait(RequestId request_id, std::vector<byte> *data);
+
+	virtual Error ExecuteBatch(const Batch &batch, std::vector<Error> *results);
+
+	virtual Error SetBlocks(const std::vector<Block> &blocks,
+				std::vector<Error> *results);
+
+	virtual Error GetBlocks(const std::vector<std::vector<byte>> &keys,
+				std::vector<std::vector<byte>> *blocks,
+				std::vector<Error> *results);
+
+	virtual uint64_t CompressionSavings();
+
+	virtual Error PutObject(const std::vector<byte> &key,
+				const byte *data,
+				size_t size);
+
+	virtual Error GetObject(const std::vector<byte> &key,
+				std::vector<byte> *data);
+
+	virtual Error GetObject(const std::vector<byte> &key, int fd);
+
+	virtual Error EnableBlockCache(size_t max_bytes);
+
+	virtual BlockCacheStats GetBlockCacheStats();
+
 	// The libqfs method for finding the api will not recognize our hacked test
 	// api as being real, since it isn't a real api file, so we need to use our
 	// own method for finding the api file in tests.
@@ -96,6 +265,16 @@ class ApiImpl: public Api {
 	// Open an Api
 	Error OpenCommon(bool directIo);
 
+	// Connect to the api socket at path. The socket only speaks the binary
+	// protocol, so there is nothing to negotiate.
+	Error OpenSocket();
+
+	// Ask quantumfsd to switch the freshly opened api file handle over to the
+	// binary protocol, with compression of large frames. Older versions of
+	// quantumfsd don't know the command, in which case the handle keeps using
+	// JSON, or ignore the compression, in which case frames aren't compressed.
+	void NegotiateProtocol();
+
 	// Work out the location of the api file (which must be called 'api'
 	// and have an inode ID of 2) by looking in the current directory
 	// and walking up the directory tree towards the root until it's found.
@@ -107,6 +286,31 @@ class ApiImpl: public Api {
 	// indicate the outcome.
 	Error SendCommand(const CommandBuffer &command, CommandBuffer *response);
 
+	// Writes the given command to the api file without reading its response,
+	// first making room for it if the pipeline is full.
+	Error StartCommand(const CommandBuffer &command);
+
+	// Read the response to the command with the given request ID, or to the
+	// synchronous command just sent if it is zero. Responses to other
+	// pipelined commands which are read first are kept for Wait().
+	Error CollectResponse(RequestId request_id, CommandBuffer *response);
+
+	// Reads the next response, from the test hook if one is installed, and
+	// decompresses it if necessary
+	Error ReceiveResponse(CommandBuffer *response);
+
+	// Extract the RequestId of a response
+	Error ParseRequestId(const CommandBuffer &response, RequestId *request_id);
+
+	// Send a pipelined command which was built with next_request_id and
+	// return that request ID.
+	Error StartPipelined(const CommandBuffer &command, RequestId *request_id);
+
+	// Account for the response to the pipelined command with the given
+	// request ID, which has been read before it was waited for, keeping it
+	// for Wait() unless the command was sent to be forgotten
+	Error SetAside(RequestId request_id, const CommandBuffer &response);
+
 	// Writes the given command to the api file. Returns an error object to
 	// indicate the outcome.
 	Error WriteCommand(const CommandBuffer &command);
@@ -115,6 +319,60 @@ class ApiImpl: public Api {
 	// indicate the outcome.
 	Error ReadResponse(CommandBuffer *command);
 
+	// Submit the commands queued for io_uring in a single chain, followed by
+	// the given command and a read of up to size bytes of the next response
+	// into data, setting num_read to its result, where these aren't NULL
+	Error SubmitQueued(const CommandBuffer *command, byte *data, size_t size,
+			   ssize_t *num_read);
+
+	// Submit any commands queued for io_uring without reading a response
+	Error FlushQueued();
+
+	// Read the next whole binary frame from the api socket
+	Error ReadSocketResponse(CommandBuffer *command);
+
+	// Create a file in kSharedMemoryDir, map it and register it with
+	// quantumfsd. The file is unlinked again once quantumfsd has it open.
+	Error CreateSharedMemory();
+
+	// Unmap the region set up by EnableSharedMemory(), if there is one
+	void ReleaseSharedMemory();
+
+	// Retrieve the chunks of an object, kObjectChunksInFlight at a time, and
+	// pass each to sink in order. Returns the first error of sink.
+	Error GetObjectChunks(
+		uint64_t size,
+		const std::vector<byte> &chunk_keys,
+		const std::function<Error(const std::vector<byte> &chunk)> &sink);
+
+	// Retrieve a block from quantumfsd, bypassing the block cache
+	Error FetchBlock(const byte *key, size_t key_size, std::vector<byte> *data);
+
+	// The same, into capacity bytes at data, setting size to the size of the
+	// block. Nothing is copied if the block doesn't fit.
+	Error FetchBlock(const byte *key, size_t key_size, byte *data,
+			 size_t capacity, size_t *size);
+
+	// Store the block, which is already in the shared memory region
+	Error SetSharedBlock(const byte *key, size_t key_size, size_t length);
+
+	// Ask whether the count blocks of keys are stored, in a single request,
+	// appending the answers to present
+	Error SendHasBlocks(const std::vector<byte> *keys,
+			    size_t count,
+			    std::vector<bool> *present);
+
+	// Send a Prefetch request for the given keys without waiting for its
+	// response
+	Error SendPrefetch(const std::vector<byte> *keys,
+			   size_t key_count,
+			   const std::string *extended_keys,
+			   size_t extended_key_count);
+
+	// Have quantumfsd place the block in the shared memory region, setting
+	// length to its size
+	Error GetSharedBlock(const byte *key, size_t key_size, uint64_t *length);
+
 	// Given a workspace name, test it for validity, returning an error to
 	// indicate the name's validity.
 	Error CheckWorkspaceNameValid(const char *workspace_name);
@@ -125,6 +383,10 @@ class ApiImpl: public Api {
 
 	int fd;
 
+	// Whether fd is a connection to the api socket rather than a handle of the
+	// api file
+	bool api_socket;
+
 	// We use the presence of a value in this member variable to indicate that
 	// the API file's location is known (either because it was passed to the
 	// Api constructor, or because it was found by DeterminePath()). It doesn't
@@ -145,27 +407,171 @@ class ApiImpl: public Api {
 	// definition.
 	TestHook *test_hook;
 
+	// The encoding used for commands and responses on the api file handle.
+	// Starts out as JSON for every newly opened handle.
+	Protocol protocol;
+
+	// The compression quantumfsd agreed to for binary frames on the handle
+	Compression compression;
+
+	// The bytes compression has kept off the api file so far. Read without
+	// holding the connection by PooledApi::CompressionSavings().
+	std::atomic<uint64_t> compression_savings;
+
+	// The request ID for the next pipelined command. Zero is reserved for
+	// commands which are answered synchronously.
+	RequestId next_request_id;
+
+	// The ring through which the api file is written and read, if
+	// kApiIoUringEnvironment is set and io_uring could be set up. NULL if plain
+	// system calls are used.
+	std::unique_ptr<IoUring> io_uring;
+
+	// Small commands which WriteCommand() has queued to be submitted to
+	// io_uring along with the read of the next response. A write which fails
+	// is reported by that read.
+	std::deque<CommandBuffer> queued_commands;
+
+	// Pipelined commands whose response hasn't been read yet
+	std::unordered_set<RequestId> in_flight;
+
+	// Responses which have been read but not yet collected by Wait()
+	std::unordered_map<RequestId, CommandBuffer> completed;
+
+	// Pipelined commands whose response is dropped when it is read, as nothing
+	// will wait for it
+	std::unordered_set<RequestId> discarded;
+
+	// The region shared with quantumfsd by EnableSharedMemory(), which holds
+	// the block of one SetBlock() or GetBlock() call at a time. NULL if
+	// blocks are moved through the api file.
+	byte *shared_memory;
+	size_t shared_memory_size;
+
+	// Blocks retrieved by GetBlock(), if EnableBlockCache() has been called
+	std::shared_ptr<BlockCache> block_cache;
+
 	// Internal member function to perform processing common to all API calls,
-	// such as parsing JSON and checking for response errors
+	// such as checking the JSON and the response for errors. The reader is
+	// opened on the response, which must outlive it, so that the caller may
+	// read any further fields.
 	Error CheckCommonApiResponse(const CommandBuffer &response,
-				     ApiContext *context);
+				     JsonReader *reader);
 
-	// Send the JSON representation of the command to the API file and parse the
-	// response, then check the response for an error. The context object will
-	// be used to carry the request JSON object so that it gets released
-	// properly and the parsed JSON response object for use by the next stage.
-	Error SendJson(ApiContext *context);
+	// Complete the JSON command in the writer, send it to the API file and
+	// check the response for an error. The reader is opened on the response
+	// as by CheckCommonApiResponse().
+	Error SendJson(JsonWriter *writer,
+		       CommandBuffer *response,
+		       JsonReader *reader);
 
 	// Convert the JSON response received for the GetAccessed() API call into
 	// a structure ready for formatting and then writing to stdout. Returns
 	// an Error struct to indicate success or otherwise
-	Error PrepareAccessedListResponse(
-		const ApiContext *context,
-		PathsAccessed *accessed_list);
+	Error PrepareAccessedListResponse(JsonReader *reader,
+					  PathsAccessed *accessed_list);
+
+	// Check the fields common to all binary responses for an error. On
+	// success the reader is left positioned after the common fields.
+	Error CheckBinaryApiResponse(const CommandBuffer &response,
+				     BinaryReader *reader);
+
+	// Complete the binary command in the writer, send it to the API file and
+	// check the response for an error. The reader is opened on the response,
+	// which must outlive it, so that the caller may read any further fields.
+	Error SendBinary(BinaryWriter *writer,
+			 CommandBuffer *response,
+			 BinaryReader *reader);
+
+	// The binary equivalent of PrepareAccessedListResponse()
+	Error PrepareBinaryAccessedListResponse(BinaryReader *reader,
+						PathsAccessed *accessed_list);
+
+	// Convert the response received for the GetAccessedPage() API call into the
+	// paths of the page and the cursor of the next page
+	Error PrepareAccessedPageResponse(JsonReader *reader,
+					  AccessedCursor *cursor,
+					  std::vector<PathAccessed> *paths);
+
+	// The binary equivalent of PrepareAccessedPageResponse()
+	Error PrepareBinaryAccessedPageResponse(BinaryReader *reader,
+						AccessedCursor *cursor,
+						std::vector<PathAccessed> *paths);
+
+	// Build the InsertInode, SetBlock and GetBlock commands in the protocol
+	// of the handle, which are shared by the synchronous and the pipelined
+	// versions of the calls.
+	Error PrepareInsertInode(const char *destination,
+				 const char *key,
+				 uint32_t permissions,
+				 uint32_t uid,
+				 uint32_t gid,
+				 RequestId request_id,
+				 CommandBuffer *command);
+	Error PrepareSetBlock(const byte *key, size_t key_size,
+			      const byte *data, size_t data_size,
+			      RequestId request_id,
+			      CommandBuffer *command);
+	Error PrepareGetBlock(const byte *key, size_t key_size,
+			      RequestId request_id,
+			      CommandBuffer *command);
+
+	// Encode an inode of an InsertInodes request as a JSON object. Its size
+	// decides how many inodes fit in each request.
+	Error PrepareInsertInodeEntry(const InsertInodeEntry &inode,
+				      CommandBuffer *entry);
+
+	// Send an InsertInodes request for the inodes at the count given indices
+	// of inodes, with their JSON objects in entries if the handle uses JSON,
+	// appending the outcome of inserting each to results
+	Error SendInsertInodes(const std::vector<InsertInodeEntry> &inodes,
+			       const std::vector<CommandBuffer> &entries,
+			       const size_t *indices,
+			       size_t count,
+			       std::vector<Error> *results);
+
+	// Build the Branch and Delete commands in the protocol of the handle
+	Error PrepareBranch(const char *source,
+			    const char *destination,
+			    CommandBuffer *command);
+	Error PrepareDelete(const char *workspace, CommandBuffer *command);
+
+	// Build a command of a Batch as it would be sent on its own
+	Error PrepareBatchCommand(const Batch::Command &batch_command,
+				  CommandBuffer *command);
+
+	// Send the prepared commands, those at the given indices of commands, in
+	// as few Batch requests of at most max_commands commands as they fit in.
+	// The outcome of each is placed at its index of results and, if blocks
+	// isn't NULL, the block carried by its response at its index of blocks.
+	Error SendBatchCommands(const std::vector<CommandBuffer> &commands,
+				const std::vector<size_t> &prepared,
+				size_t max_commands,
+				std::vector<Error> *results,
+				std::vector<std::vector<byte>> *blocks);
+
+	// Send the commands as a single Batch request. The outcome of each command
+	// is appended to results and, if blocks isn't NULL, the block carried by
+	// its response to blocks.
+	Error SendBatch(const std::vector<const CommandBuffer *> &commands,
+			std::vector<Error> *results,
+			std::vector<std::vector<byte>> *blocks);
+
+	// Check a response in the protocol of the handle for an error. If data
+	// isn't NULL the block carried by a GetBlock response is placed in it.
+	Error CheckResponse(const CommandBuffer &response, std::vector<byte> *data);
+
+	// The same, placing the block in capacity bytes at data and setting size to
+	// the size of the block. Nothing is copied if the block doesn't fit.
+	Error CheckResponse(const CommandBuffer &response, byte *data,
+			    size_t capacity, size_t *size);
 
 	friend class QfsClientTest;
 	FRIEND_TEST(QfsClientTest, SendCommandTest);
 	FRIEND_TEST(QfsClientTest, SendLargeCommandTest);
+	FRIEND_TEST(QfsClientTest, SendLargeBinaryCommandTest);
+	FRIEND_TEST(QfsClientTest, IoUringSendCommandTest);
+	FRIEND_TEST(QfsClientTest, IoUringQueuedCommandsTest);
 	FRIEND_TEST(QfsClientTest, SendCommandFileRemovedTest);
 	FRIEND_TEST(QfsClientTest, SendCommandNoFileTest);
 	FRIEND_TEST(QfsClientTest, SendCommandCantOpenFileTest);
@@ -173,6 +579,7 @@ class ApiImpl: public Api {
 	FRIEND_TEST(QfsClientTest, OpenTest);
 	FRIEND_TEST(QfsClientTest, CheckWorkspaceNameValidTest);
 	FRIEND_TEST(QfsClientTest, CheckWorkspacePathValidTest);
+	FRIEND_TEST(QfsClientTest, SocketTest);
 
 	friend class QfsClientApiTest;
 	FRIEND_TEST(QfsClientApiTest, CheckCommonApiResponseTest);
@@ -182,6 +589,29 @@ class ApiImpl: public Api {
 	FRIEND_TEST(QfsClientApiTest, PrepareAccessedListResponseNoAccessListTest);
 	FRIEND_TEST(QfsClientApiTest, SendJsonTest);
 	FRIEND_TEST(QfsClientApiTest, SendJsonTestJsonTooBig);
+	FRIEND_TEST(QfsClientApiTest, CheckBinaryApiResponseTest);
+	FRIEND_TEST(QfsClientApiTest, BinaryCommandsTest);
+	FRIEND_TEST(QfsClientApiTest, BinaryGetAccessedTest);
+	FRIEND_TEST(QfsClientApiTest, BinaryGetAccessedPageTest);
+	FRIEND_TEST(QfsClientApiTest, BinaryGetBlockTest);
+	FRIEND_TEST(QfsClientApiTest, BinarySpanBlockTest);
+	FRIEND_TEST(QfsClientApiTest, PipelinedTest);
+	FRIEND_TEST(QfsClientApiTest, BinaryPipelinedTest);
+	FRIEND_TEST(QfsClientApiTest, PoolPipelinedTest);
+	FRIEND_TEST(QfsClientApiTest, PoolAccessedPageTest);
+	FRIEND_TEST(QfsClientApiTest, SharedMemoryTest);
+	FRIEND_TEST(QfsClientApiTest, BinarySharedMemoryTest);
+	FRIEND_TEST(QfsClientApiTest, BatchTest);
+	FRIEND_TEST(QfsClientApiTest, BinaryBatchTest);
+	FRIEND_TEST(QfsClientApiTest, BlocksTest);
+	FRIEND_TEST(QfsClientApiTest, BinaryBlocksTest);
+	FRIEND_TEST(QfsClientApiTest, BinaryObjectTest);
+	FRIEND_TEST(QfsClientApiTest, BinaryObjectCacheTest);
+	FRIEND_TEST(QfsClientApiTest, BinaryGetBlockIntoTest);
+	FRIEND_TEST(QfsClientApiTest, BinaryHasBlocksTest);
+	FRIEND_TEST(QfsClientApiTest, BinaryPrefetchTest);
+	FRIEND_TEST(QfsClientApiTest, BinaryInsertInodesTest);
+	FRIEND_TEST(QfsClientApiTest, BinaryCompressionTest);
 
 	FRIEND_TEST(QfsClientDeterminePathTest, DeterminePathTest);
 
@@ -193,7 +623,9 @@ class ApiImpl: public Api {
 };
 
 // CommandBuffer is used internally to store the raw content of a command to
-// send to (or a response received from) the API - typically in JSON format.
+// send to (or a response received from) the API - typically in JSON format. Its
+// storage is suitably aligned to be written to, or read from, the api file
+// directly.
 class CommandBuffer {
  public:
 	CommandBuffer();
@@ -205,9 +637,17 @@ class CommandBuffer {
 	// Copy the contents of the given CommandBuffer into this one
 	void Copy(const CommandBuffer &source);
 
+	// Exchange the contents of this CommandBuffer with those of other without
+	// copying them
+	void Swap(CommandBuffer *other);
+
 	// Return a const pointer to the data in the buffer
 	const byte *Data() const;
 
+	// Return a pointer to the data in the buffer which may be used to modify
+	// the data in place
+	byte *MutableData();
+
 	// Return the size of the data stored in the buffer
 	size_t Size() const;
 
@@ -219,12 +659,16 @@ class CommandBuffer {
 	// buffer would have to be grown too large to add this block
 	ErrorCode Append(const byte *data, size_t size);
 
+	// Change the size of the buffer. Any bytes added are uninitialised. Returns
+	// an error if the buffer would have to be grown too large.
+	ErrorCode Resize(size_t size);
+
 	// Copy a string into the buffer. An error will be returned if
 	// the buffer would have to be grown too large to fit the string.
 	ErrorCode CopyString(const char *s);
 
  private:
-	std::vector<byte> data;
+	std::vector<byte, BufferAllocator<byte>> data;
 
 	FRIEND_TEST(QfsClientApiTest, CheckCommonApiResponseBadJsonTest);
 	FRIEND_TEST(QfsClientApiTest, CheckCommonApiMissingJsonObjectTest);
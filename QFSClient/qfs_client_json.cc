@@ -0,0 +1,958 @@
+// Copyright (c) 2018 Arista Networks, Inc.
+// Use of this source code is governed by the Apache License 2.0
+// that can be found in the COPYING file.
+
+#include "QFSClient/qfs_client_json.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+
+#include "QFSClient/qfs_client_util.h"
+
+namespace qfsclient {
+
+static bool IsWhitespace(char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool IsDigit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+static int HexValue(char c) {
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	if (c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+// The value of the four hex digits at in, which have already been checked
+static uint32_t Hex4(const char *in) {
+	return (HexValue(in[0]) << 12) | (HexValue(in[1]) << 8) |
+	       (HexValue(in[2]) << 4) | HexValue(in[3]);
+}
+
+static void AppendUtf8(uint32_t code_point, std::string *out) {
+	if (code_point < 0x80) {
+		out->push_back(code_point);
+	} else if (code_point < 0x800) {
+		out->push_back(0xc0 | (code_point >> 6));
+		out->push_back(0x80 | (code_point & 0x3f));
+	} else if (code_point < 0x10000) {
+		out->push_back(0xe0 | (code_point >> 12));
+		out->push_back(0x80 | ((code_point >> 6) & 0x3f));
+		out->push_back(0x80 | (code_point & 0x3f));
+	} else {
+		out->push_back(0xf0 | (code_point >> 18));
+		out->push_back(0x80 | ((code_point >> 12) & 0x3f));
+		out->push_back(0x80 | ((code_point >> 6) & 0x3f));
+		out->push_back(0x80 | (code_point & 0x3f));
+	}
+}
+
+// Whether the character ends a run of plain characters within a string
+static bool IsStringSpecial(char c) {
+	return c == '"' || c == '\\' || (unsigned char)c < 0x20;
+}
+
+typedef size_t (*StringScanner)(const char *data, size_t size);
+
+static size_t FindStringSpecialScalar(const char *data, size_t size) {
+	size_t i = 0;
+	while (i < size && !IsStringSpecial(data[i])) {
+		i++;
+	}
+	return i;
+}
+
+#if defined(__x86_64__)
+
+// The vectorised scanners find the special characters of each 64 byte block as a
+// bitmask, one bit per byte, and then the first of them from the lowest set bit.
+// Control characters are those for which max(c, 0x1f) == 0x1f, as there is no
+// unsigned byte comparison.
+
+__attribute__((target("avx2")))
+static uint32_t StringSpecialMask256(const char *data) {
+	const __m256i quote = _mm256_set1_epi8('"');
+	const __m256i backslash = _mm256_set1_epi8('\\');
+	const __m256i control = _mm256_set1_epi8(0x1f);
+
+	__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+	__m256i special = _mm256_or_si256(
+		_mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+				_mm256_cmpeq_epi8(v, backslash)),
+		_mm256_cmpeq_epi8(_mm256_max_epu8(v, control), control));
+	return _mm256_movemask_epi8(special);
+}
+
+__attribute__((target("avx2")))
+static size_t FindStringSpecialAvx2(const char *data, size_t size) {
+	size_t i = 0;
+	for (; size - i >= 64; i += 64) {
+		uint64_t low = StringSpecialMask256(data + i);
+		uint64_t high = StringSpecialMask256(data + i + 32);
+		uint64_t mask = low | (high << 32);
+		if (mask != 0) {
+			return i + __builtin_ctzll(mask);
+		}
+	}
+
+	return i + FindStringSpecialScalar(data + i, size - i);
+}
+
+static uint32_t StringSpecialMask128(const char *data) {
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i control = _mm_set1_epi8(0x1f);
+
+	__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+	__m128i special = _mm_or_si128(
+		_mm_or_si128(_mm_cmpeq_epi8(v, quote),
+			     _mm_cmpeq_epi8(v, backslash)),
+		_mm_cmpeq_epi8(_mm_max_epu8(v, control), control));
+	return _mm_movemask_epi8(special);
+}
+
+// SSE2 is part of x86-64 itself, so this needs no check
+static size_t FindStringSpecialSse2(const char *data, size_t size) {
+	size_t i = 0;
+	for (; size - i >= 64; i += 64) {
+		uint64_t mask = 0;
+		for (size_t j = 0; j < 64; j += 16) {
+			uint64_t block = StringSpecialMask128(data + i + j);
+			mask |= block << j;
+		}
+		if (mask != 0) {
+			return i + __builtin_ctzll(mask);
+		}
+	}
+
+	return i + FindStringSpecialScalar(data + i, size - i);
+}
+
+static StringScanner SelectFindStringSpecial() {
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return FindStringSpecialAvx2;
+	}
+	return FindStringSpecialSse2;
+}
+
+#else
+
+static StringScanner SelectFindStringSpecial() {
+	return FindStringSpecialScalar;
+}
+
+#endif
+
+size_t FindStringSpecial(const char *data, size_t size) {
+	// chosen once for the CPU the library finds itself running on
+	static const StringScanner find = SelectFindStringSpecial();
+
+	return find(data, size);
+}
+
+// Return the length of the valid UTF-8 sequence at the start of data, or zero if
+// there isn't one. Like jansson, overlong forms, surrogates and code points beyond
+// U+10FFFF are refused.
+static size_t Utf8SequenceLength(const char *data, size_t size) {
+	unsigned char first = data[0];
+	size_t length;
+	uint32_t code_point;
+	if (first < 0x80) {
+		return 1;
+	} else if (first >= 0xc2 && first <= 0xdf) {
+		length = 2;
+		code_point = first & 0x1f;
+	} else if (first >= 0xe0 && first <= 0xef) {
+		length = 3;
+		code_point = first & 0x0f;
+	} else if (first >= 0xf0 && first <= 0xf4) {
+		length = 4;
+		code_point = first & 0x07;
+	} else {
+		return 0;
+	}
+
+	if (size < length) {
+		return 0;
+	}
+	for (size_t i = 1; i < length; i++) {
+		unsigned char c = data[i];
+		if ((c & 0xc0) != 0x80) {
+			return 0;
+		}
+		code_point = (code_point << 6) | (c & 0x3f);
+	}
+
+	if ((length == 3 && code_point < 0x800) ||
+	    (length == 4 && code_point < 0x10000) ||
+	    (code_point >= 0xd800 && code_point <= 0xdfff) ||
+	    code_point > 0x10ffff) {
+		return 0;
+	}
+	return length;
+}
+
+// Whether the run of characters, which needn't be escaped, is valid UTF-8
+static bool IsValidUtf8(const char *data, size_t size) {
+	size_t i = 0;
+	while (i < size) {
+		// skip ASCII a word at a time
+		uint64_t word;
+		if (size - i >= sizeof(word)) {
+			memcpy(&word, data + i, sizeof(word));
+			if ((word & 0x8080808080808080ULL) == 0) {
+				i += sizeof(word);
+				continue;
+			}
+		}
+
+		size_t length = Utf8SequenceLength(data + i, size - i);
+		if (length == 0) {
+			return false;
+		}
+		i += length;
+	}
+	return true;
+}
+
+JsonWriter::JsonWriter(CommandBuffer *json)
+	: json(json), error(kSuccess), first(true) {
+	this->json->Reset();
+	this->AppendRaw("{", 1);
+}
+
+void JsonWriter::AppendName(const char *name, size_t size) {
+	if (!this->first) {
+		this->AppendRaw(",", 1);
+	}
+	this->first = false;
+
+	this->AppendRaw("\"", 1);
+	this->AppendRaw(name, size);
+	this->AppendRaw("\":", 2);
+}
+
+void JsonWriter::AppendRawInt(int64_t value) {
+	// digits are produced from the least significant, into the end of digits
+	char digits[20];
+	size_t start = sizeof(digits);
+	uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : value;
+	do {
+		digits[--start] = '0' + magnitude % 10;
+		magnitude /= 10;
+	} while (magnitude != 0);
+
+	if (value < 0) {
+		this->AppendRaw("-", 1);
+	}
+	this->AppendRaw(digits + start, sizeof(digits) - start);
+}
+
+void JsonWriter::AppendRawString(const char *value, size_t size) {
+	this->AppendRaw("\"", 1);
+
+	size_t i = 0;
+	while (i < size) {
+		// copy the run of characters which needn't be escaped at once
+		size_t run = FindStringSpecial(value + i, size - i);
+		if (!IsValidUtf8(value + i, run)) {
+			this->error = kJsonEncodingError;
+			return;
+		}
+		this->AppendRaw(value + i, run);
+		i += run;
+		if (i == size) {
+			break;
+		}
+
+		char escaped[7];
+		const char *escape = escaped;
+		size_t escape_size = 2;
+		switch (value[i]) {
+		case '"':
+			escape = "\\\"";
+			break;
+		case '\\':
+			escape = "\\\\";
+			break;
+		case '\b':
+			escape = "\\b";
+			break;
+		case '\f':
+			escape = "\\f";
+			break;
+		case '\n':
+			escape = "\\n";
+			break;
+		case '\r':
+			escape = "\\r";
+			break;
+		case '\t':
+			escape = "\\t";
+			break;
+		default:
+			// the remaining control characters, as jansson writes them
+			snprintf(escaped, sizeof(escaped), "\\u%04X", value[i]);
+			escape_size = 6;
+			break;
+		}
+		this->AppendRaw(escape, escape_size);
+		i++;
+	}
+
+	this->AppendRaw("\"", 1);
+}
+
+void JsonWriter::AppendRawBytes(const byte *value, size_t size) {
+	this->AppendRaw("\"", 1);
+	if (this->error != kSuccess) {
+		return;
+	}
+
+	// base64 needs no escaping, so it is encoded straight into the buffer
+	size_t start = this->json->Size();
+	this->error = this->json->Resize(start + util::base64_encoded_size(size));
+	if (this->error != kSuccess) {
+		return;
+	}
+	util::base64_encode(value, size,
+			    reinterpret_cast<char *>(this->json->MutableData()) +
+			    start);
+
+	this->AppendRaw("\"", 1);
+}
+
+void JsonWriter::AppendRaw(const char *data, size_t size) {
+	if (this->error != kSuccess) {
+		return;
+	}
+
+	this->error = this->json->Append(reinterpret_cast<const byte *>(data),
+					 size);
+}
+
+ErrorCode JsonWriter::Finish() {
+	this->AppendRaw("}", 1);
+	return this->error;
+}
+
+const CommandBuffer &JsonWriter::Json() const {
+	return *this->json;
+}
+
+static Error MalformedJson(const char *json, size_t size, size_t pos) {
+	return util::getError(kJsonDecodingError,
+			      util::buildJsonErrorDetails(
+				"malformed JSON at offset " + std::to_string(pos),
+				json, size));
+}
+
+JsonReader::JsonReader() : json(NULL), size(0), offset(0) {
+}
+
+Error JsonReader::Open(const CommandBuffer &response) {
+	return this->Open(reinterpret_cast<const char *>(response.Data()),
+			  response.Size());
+}
+
+Error JsonReader::Open(const char *json, size_t size) {
+	this->json = json;
+	this->size = size;
+	this->offset = 0;
+	this->members.clear();
+
+	Error err = this->IndexMembers();
+	if (err.code != kSuccess) {
+		// nothing may be read from a malformed response
+		this->members.clear();
+	}
+	return err;
+}
+
+Error JsonReader::IndexMembers() {
+	const char *json = this->json;
+	size_t size = this->size;
+	size_t pos = 0;
+	this->SkipWhitespace(&pos);
+	if (pos == size || json[pos] != '{') {
+		return util::getError(kJsonDecodingError,
+				      util::buildJsonErrorDetails(
+					"response is not a JSON object",
+					json, size));
+	}
+	pos++;
+	this->SkipWhitespace(&pos);
+
+	// The top level object is checked here rather than by ScanValue() so that
+	// its members may be indexed on the way
+	bool empty = pos < size && json[pos] == '}';
+	while (!empty) {
+		Member member;
+		size_t key = pos;
+		if (!this->ScanString(&pos)) {
+			return MalformedJson(json, size, key);
+		}
+		member.key = json + key + 1;
+		member.key_size = pos - key - 2;
+
+		this->SkipWhitespace(&pos);
+		if (pos == size || json[pos] != ':') {
+			return MalformedJson(json, size, pos);
+		}
+		pos++;
+		this->SkipWhitespace(&pos);
+
+		member.value = pos;
+		if (!this->ScanValue(&pos, 1)) {
+			return MalformedJson(json, size, member.value);
+		}
+		this->members.push_back(member);
+
+		this->SkipWhitespace(&pos);
+		if (pos < size && json[pos] == '}') {
+			break;
+		}
+		if (pos == size || json[pos] != ',') {
+			return MalformedJson(json, size, pos);
+		}
+		pos++;
+		this->SkipWhitespace(&pos);
+	}
+	pos++;
+
+	this->SkipWhitespace(&pos);
+	if (pos != size) {
+		return MalformedJson(json, size, pos);
+	}
+
+	return util::getError(kSuccess);
+}
+
+bool JsonReader::Find(const char *key) {
+	size_t key_size = strlen(key);
+
+	// Like other decoders, the last of duplicate members wins
+	for (auto it = this->members.rbegin(); it != this->members.rend(); ++it) {
+		if (it->key_size == key_size &&
+		    memcmp(it->key, key, key_size) == 0) {
+			this->offset = it->value;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool JsonReader::ReadInt(int64_t *value) {
+	size_t pos = this->offset;
+	bool negative = pos < this->size && this->json[pos] == '-';
+	if (negative) {
+		pos++;
+	}
+	if (pos == this->size || !IsDigit(this->json[pos])) {
+		return false;
+	}
+
+	const uint64_t limit = negative ? (uint64_t)INT64_MAX + 1 : INT64_MAX;
+	uint64_t magnitude = 0;
+	for (; pos < this->size && IsDigit(this->json[pos]); pos++) {
+		uint64_t digit = this->json[pos] - '0';
+		if (magnitude > (limit - digit) / 10) {
+			return false;
+		}
+		magnitude = magnitude * 10 + digit;
+	}
+
+	if (pos < this->size && (this->json[pos] == '.' ||
+				 this->json[pos] == 'e' ||
+				 this->json[pos] == 'E')) {
+		return false;
+	}
+
+	*value = negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+	this->offset = pos;
+	return true;
+}
+
+bool JsonReader::ReadString(std::string *value) {
+	if (this->offset == this->size || this->json[this->offset] != '"') {
+		return false;
+	}
+
+	this->DecodeString(&this->offset, value);
+	return true;
+}
+
+bool JsonReader::ReadBytes(std::vector<byte> *value) {
+	if (this->offset == this->size || this->json[this->offset] != '"') {
+		return false;
+	}
+
+	// The string has already been checked, so it ends at the first quote
+	// unless it holds escapes, which base64 from quantumfsd never does
+	const char *start = this->json + this->offset + 1;
+	size_t remaining = this->size - this->offset - 1;
+	size_t length = FindStringSpecial(start, remaining);
+	if (length == remaining || start[length] != '"') {
+		size_t pos = this->offset;
+		std::string decoded;
+		this->DecodeString(&pos, &decoded);
+		if (util::base64_decode(decoded, value).code != kSuccess) {
+			return false;
+		}
+		this->offset = pos;
+		return true;
+	}
+
+	value->resize(util::base64_decoded_capacity(length));
+	size_t decoded;
+	if (!util::base64_decode(start, length, value->data(), &decoded)) {
+		value->clear();
+		return false;
+	}
+	value->resize(decoded);
+
+	this->offset += length + 2;
+	return true;
+}
+
+bool JsonReader::ReadBytes(byte *value, size_t capacity, size_t *size) {
+	if (this->offset == this->size || this->json[this->offset] != '"') {
+		return false;
+	}
+
+	const char *start = this->json + this->offset + 1;
+	size_t remaining = this->size - this->offset - 1;
+	size_t length = FindStringSpecial(start, remaining);
+	if (length == remaining || start[length] != '"') {
+		std::vector<byte> decoded;
+		if (!this->ReadBytes(&decoded)) {
+			return false;
+		}
+		*size = decoded.size();
+		if (decoded.size() <= capacity) {
+			std::copy(decoded.begin(), decoded.end(), value);
+		}
+		return true;
+	}
+
+	if (length % 4 != 0) {
+		return false;
+	}
+
+	// The size is known from the padding without decoding anything, so the
+	// bytes are decoded straight into value when they fit
+	size_t padding = 0;
+	if (length != 0 && start[length - 1] == '=') {
+		padding = start[length - 2] == '=' ? 2 : 1;
+	}
+	*size = util::base64_decoded_capacity(length) - padding;
+	if (*size <= capacity) {
+		size_t decoded;
+		if (!util::base64_decode(start, length, value, &decoded)) {
+			return false;
+		}
+	}
+
+	this->offset += length + 2;
+	return true;
+}
+
+bool JsonReader::ReadBool(bool *value) {
+	size_t pos = this->offset;
+	if (this->ScanLiteral(&pos, "true")) {
+		*value = true;
+	} else if (this->ScanLiteral(&pos, "false")) {
+		*value = false;
+	} else {
+		return false;
+	}
+
+	this->offset = pos;
+	return true;
+}
+
+bool JsonReader::ReadNull() {
+	size_t pos = this->offset;
+	if (!this->ScanLiteral(&pos, "null")) {
+		return false;
+	}
+
+	this->offset = pos;
+	return true;
+}
+
+bool JsonReader::Skip() {
+	return this->ScanValue(&this->offset, 0);
+}
+
+bool JsonReader::ReadRaw(const char **json, size_t *size) {
+	size_t start = this->offset;
+	if (!this->Skip()) {
+		return false;
+	}
+
+	*json = this->json + start;
+	*size = this->offset - start;
+	return true;
+}
+
+bool JsonReader::EnterObject() {
+	if (this->offset == this->size || this->json[this->offset] != '{') {
+		return false;
+	}
+
+	this->offset++;
+	return true;
+}
+
+bool JsonReader::NextMember(std::string *key) {
+	this->SkipWhitespace(&this->offset);
+	if (this->offset < this->size && this->json[this->offset] == ',') {
+		this->offset++;
+		this->SkipWhitespace(&this->offset);
+	}
+	if (this->offset == this->size || this->json[this->offset] != '"') {
+		// the end of the object
+		if (this->offset < this->size) {
+			this->offset++;
+		}
+		return false;
+	}
+
+	this->DecodeString(&this->offset, key);
+
+	// then the colon, which was checked by Open()
+	this->SkipWhitespace(&this->offset);
+	this->offset++;
+	this->SkipWhitespace(&this->offset);
+	return true;
+}
+
+bool JsonReader::EnterArray() {
+	if (this->offset == this->size || this->json[this->offset] != '[') {
+		return false;
+	}
+
+	this->offset++;
+	return true;
+}
+
+bool JsonReader::NextElement() {
+	this->SkipWhitespace(&this->offset);
+	if (this->offset < this->size && this->json[this->offset] == ',') {
+		this->offset++;
+		this->SkipWhitespace(&this->offset);
+	}
+	if (this->offset == this->size || this->json[this->offset] == ']') {
+		// the end of the array
+		if (this->offset < this->size) {
+			this->offset++;
+		}
+		return false;
+	}
+
+	return true;
+}
+
+void JsonReader::SkipWhitespace(size_t *pos) const {
+	while (*pos < this->size && IsWhitespace(this->json[*pos])) {
+		(*pos)++;
+	}
+}
+
+bool JsonReader::ScanValue(size_t *pos, int depth) const {
+	if (*pos == this->size || depth > kMaxJsonDepth) {
+		return false;
+	}
+
+	const char *json = this->json;
+	switch (json[*pos]) {
+	case '{':
+		(*pos)++;
+		this->SkipWhitespace(pos);
+		if (*pos < this->size && json[*pos] == '}') {
+			(*pos)++;
+			return true;
+		}
+
+		while (true) {
+			if (!this->ScanString(pos)) {
+				return false;
+			}
+			this->SkipWhitespace(pos);
+			if (*pos == this->size || json[*pos] != ':') {
+				return false;
+			}
+			(*pos)++;
+			this->SkipWhitespace(pos);
+
+			if (!this->ScanValue(pos, depth + 1)) {
+				return false;
+			}
+			this->SkipWhitespace(pos);
+			if (*pos == this->size) {
+				return false;
+			}
+			if (json[*pos] == '}') {
+				(*pos)++;
+				return true;
+			}
+			if (json[*pos] != ',') {
+				return false;
+			}
+			(*pos)++;
+			this->SkipWhitespace(pos);
+		}
+
+	case '[':
+		(*pos)++;
+		this->SkipWhitespace(pos);
+		if (*pos < this->size && json[*pos] == ']') {
+			(*pos)++;
+			return true;
+		}
+
+		while (true) {
+			if (!this->ScanValue(pos, depth + 1)) {
+				return false;
+			}
+			this->SkipWhitespace(pos);
+			if (*pos == this->size) {
+				return false;
+			}
+			if (json[*pos] == ']') {
+				(*pos)++;
+				return true;
+			}
+			if (json[*pos] != ',') {
+				return false;
+			}
+			(*pos)++;
+			this->SkipWhitespace(pos);
+		}
+
+	case '"':
+		return this->ScanString(pos);
+
+	case 't':
+		return this->ScanLiteral(pos, "true");
+
+	case 'f':
+		return this->ScanLiteral(pos, "false");
+
+	case 'n':
+		return this->ScanLiteral(pos, "null");
+
+	default:
+		return this->ScanNumber(pos);
+	}
+}
+
+bool JsonReader::ScanString(size_t *pos) const {
+	const char *json = this->json;
+	size_t p = *pos;
+	if (p == this->size || json[p] != '"') {
+		return false;
+	}
+	p++;
+
+	while (true) {
+		p += FindStringSpecial(json + p, this->size - p);
+		if (p == this->size) {
+			return false;
+		}
+
+		char c = json[p];
+		if (c == '"') {
+			*pos = p + 1;
+			return true;
+		}
+		if (c != '\\') {
+			// control characters must be escaped
+			return false;
+		}
+
+		if (p + 1 == this->size) {
+			return false;
+		}
+		switch (json[p + 1]) {
+		case '"':
+		case '\\':
+		case '/':
+		case 'b':
+		case 'f':
+		case 'n':
+		case 'r':
+		case 't':
+			p += 2;
+			break;
+
+		case 'u':
+			if (this->size - p < 6) {
+				return false;
+			}
+			for (size_t i = 2; i < 6; i++) {
+				if (HexValue(json[p + i]) < 0) {
+					return false;
+				}
+			}
+			p += 6;
+			break;
+
+		default:
+			return false;
+		}
+	}
+}
+
+bool JsonReader::ScanNumber(size_t *pos) const {
+	const char *json = this->json;
+	size_t p = *pos;
+
+	if (p < this->size && json[p] == '-') {
+		p++;
+	}
+	if (p == this->size || !IsDigit(json[p])) {
+		return false;
+	}
+	if (json[p] == '0') {
+		// no leading zeros
+		p++;
+	} else {
+		while (p < this->size && IsDigit(json[p])) {
+			p++;
+		}
+	}
+
+	if (p < this->size && json[p] == '.') {
+		p++;
+		if (p == this->size || !IsDigit(json[p])) {
+			return false;
+		}
+		while (p < this->size && IsDigit(json[p])) {
+			p++;
+		}
+	}
+
+	if (p < this->size && (json[p] == 'e' || json[p] == 'E')) {
+		p++;
+		if (p < this->size && (json[p] == '+' || json[p] == '-')) {
+			p++;
+		}
+		if (p == this->size || !IsDigit(json[p])) {
+			return false;
+		}
+		while (p < this->size && IsDigit(json[p])) {
+			p++;
+		}
+	}
+
+	*pos = p;
+	return true;
+}
+
+bool JsonReader::ScanLiteral(size_t *pos, const char *literal) const {
+	size_t length = strlen(literal);
+	if (this->size - *pos < length ||
+	    memcmp(this->json + *pos, literal, length) != 0) {
+		return false;
+	}
+
+	*pos += length;
+	return true;
+}
+
+void JsonReader::DecodeString(size_t *pos, std::string *value) const {
+	const char *json = this->json;
+	size_t p = *pos + 1;
+	value->clear();
+
+	// The string has been checked, but stay within the buffer regardless
+	while (true) {
+		// copy the run of plain characters at once
+		size_t start = p;
+		p += FindStringSpecial(json + p, this->size - p);
+		value->append(json + start, p - start);
+
+		if (p == this->size || json[p] == '"') {
+			*pos = std::min(p + 1, this->size);
+			return;
+		}
+		if (json[p] != '\\') {
+			// an unescaped control character
+			value->push_back(json[p]);
+			p++;
+			continue;
+		}
+		size_t left = this->size - p;
+		if (left < 2 || (left < 6 && json[p + 1] == 'u')) {
+			*pos = this->size;
+			return;
+		}
+
+		char escaped = json[p + 1];
+		p += 2;
+		switch (escaped) {
+		case 'b':
+			value->push_back('\b');
+			break;
+		case 'f':
+			value->push_back('\f');
+			break;
+		case 'n':
+			value->push_back('\n');
+			break;
+		case 'r':
+			value->push_back('\r');
+			break;
+		case 't':
+			value->push_back('\t');
+			break;
+		case 'u': {
+			uint32_t code_point = Hex4(json + p);
+			p += 4;
+
+			if (code_point >= 0xd800 && code_point <= 0xdbff &&
+			    this->size - p >= 6 && json[p] == '\\' &&
+			    json[p + 1] == 'u') {
+				uint32_t low = Hex4(json + p + 2);
+				if (low >= 0xdc00 && low <= 0xdfff) {
+					code_point = 0x10000 +
+						     ((code_point - 0xd800) << 10) +
+						     (low - 0xdc00);
+					p += 6;
+				}
+			}
+			if (code_point >= 0xd800 && code_point <= 0xdfff) {
+				// an unpaired surrogate
+				code_point = 0xfffd;
+			}
+			AppendUtf8(code_point, value);
+			break;
+		}
+		default:
+			// '"', '\\' and '/' stand for themselves
+			value->push_back(escaped);
+			break;
+		}
+	}
+}
+
+}  // namespace qfsclient
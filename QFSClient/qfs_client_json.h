@@ -0,0 +1,206 @@
+// Copyright (c) 2018 Arista Networks, Inc.
+// Use of this source code is governed by the Apache License 2.0
+// that can be found in the COPYING file.
+
+#ifndef QFSCLIENT_QFS_CLIENT_JSON_H_
+#define QFSCLIENT_QFS_CLIENT_JSON_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "QFSClient/qfs_client.h"
+#include "QFSClient/qfs_client_implementation.h"
+
+namespace qfsclient {
+
+// Values nested deeper than this are rejected rather than risk the stack
+const int kMaxJsonDepth = 512;
+
+// Return the offset of the first quote, backslash or control character in the
+// buffer, or size if there is none. These are the only characters which end a
+// run of plain characters within a JSON string. The buffer is scanned 64 bytes at
+// a time with AVX2 or SSE2 where the CPU supports them.
+size_t FindStringSpecial(const char *data, size_t size);
+
+// JsonWriter builds the JSON of a request straight into a CommandBuffer, writing
+// exactly what jansson wrote when asked for compact JSON with sorted keys, so
+// members must be appended in the order of their names. Names are written as they
+// are, so must not need escaping.
+class JsonWriter {
+ public:
+	// Start the object of the request in the buffer, replacing its contents
+	explicit JsonWriter(CommandBuffer *json);
+
+	// The length of the name is taken from the array holding it, so that it is
+	// known when compiling
+	template <size_t N>
+	void AppendInt(const char (&name)[N], int64_t value) {
+		this->AppendName(name, N - 1);
+		this->AppendRawInt(value);
+	}
+
+	// Strings must be valid UTF-8
+	template <size_t N>
+	void AppendString(const char (&name)[N], const char *value) {
+		this->AppendName(name, N - 1);
+		this->AppendRawString(value, strlen(value));
+	}
+
+	template <size_t N>
+	void AppendString(const char (&name)[N], const std::string &value) {
+		this->AppendName(name, N - 1);
+		this->AppendRawString(value.data(), value.size());
+	}
+
+	// Bytes are written as a base64 string, as Go encodes []byte
+	template <size_t N>
+	void AppendBytes(const char (&name)[N], const std::vector<byte> &value) {
+		this->AppendName(name, N - 1);
+		this->AppendRawBytes(value.data(), value.size());
+	}
+
+	template <size_t N>
+	void AppendBytes(const char (&name)[N], const byte *value, size_t size) {
+		this->AppendName(name, N - 1);
+		this->AppendRawBytes(value, size);
+	}
+
+	// An array of byte arrays, as Go encodes [][]byte
+	template <size_t N>
+	void AppendBytesArray(const char (&name)[N],
+			      const std::vector<byte> *values,
+			      size_t count) {
+		this->AppendName(name, N - 1);
+		this->AppendRaw("[", 1);
+		for (size_t i = 0; i < count; i++) {
+			if (i != 0) {
+				this->AppendRaw(",", 1);
+			}
+			this->AppendRawBytes(values[i].data(), values[i].size());
+		}
+		this->AppendRaw("]", 1);
+	}
+
+	// An array of strings, as Go encodes []string
+	template <size_t N>
+	void AppendStringArray(const char (&name)[N],
+			       const std::string *values,
+			       size_t count) {
+		this->AppendName(name, N - 1);
+		this->AppendRaw("[", 1);
+		for (size_t i = 0; i < count; i++) {
+			if (i != 0) {
+				this->AppendRaw(",", 1);
+			}
+			this->AppendRawString(values[i].data(), values[i].size());
+		}
+		this->AppendRaw("]", 1);
+	}
+
+	// Complete the object. Returns an error if it couldn't be built because a
+	// string wasn't valid UTF-8 or the buffer grew too large.
+	ErrorCode Finish();
+
+	const CommandBuffer &Json() const;
+
+ private:
+	void AppendName(const char *name, size_t size);
+	void AppendRawInt(int64_t value);
+	void AppendRawString(const char *value, size_t size);
+	void AppendRawBytes(const byte *value, size_t size);
+	void AppendRaw(const char *data, size_t size);
+
+	CommandBuffer *json;
+	ErrorCode error;
+	bool first;
+};
+
+// JsonReader is a pull parser for the JSON responses of quantumfsd. Rather than
+// building a tree of the whole response, it checks the response and indexes the
+// members of its top level object when it is opened, and then decodes values only
+// as they are asked for, straight into the caller's structures.
+//
+// Values are read at the current position, which Find() moves to the value of a
+// top level member. Objects and arrays are read by entering them and then calling
+// NextMember() or NextElement() before each of their values, each of which must
+// be read or skipped, until those return false at the end of the container.
+class JsonReader {
+ public:
+	JsonReader();
+
+	// Check that the buffer holds a single well formed JSON object and prepare
+	// to read it. The buffer must outlive the reader.
+	Error Open(const CommandBuffer &response);
+	Error Open(const char *json, size_t size);
+
+	// Move to the value of the member of the top level object with the given
+	// name, which is matched as written without decoding escapes. Returns
+	// false if there is no such member.
+	bool Find(const char *key);
+
+	// Read the value at the current position and move past it. Each returns
+	// false, without moving, if the value is of another type. ReadInt() also
+	// refuses numbers with a fraction or exponent and those out of range.
+	bool ReadInt(int64_t *value);
+	bool ReadBool(bool *value);
+	bool ReadString(std::string *value);
+	bool ReadNull();
+
+	// Read a base64 string as the bytes it encodes. Also returns false if the
+	// string isn't valid base64.
+	bool ReadBytes(std::vector<byte> *value);
+
+	// Decode a base64 string into the capacity bytes at value, setting size to
+	// the number of bytes it encodes. If they don't fit, size is set but
+	// nothing is decoded.
+	bool ReadBytes(byte *value, size_t capacity, size_t *size);
+
+	// Move past the value at the current position, whatever it is
+	bool Skip();
+
+	// Move past the value at the current position, returning its JSON text
+	bool ReadRaw(const char **json, size_t *size);
+
+	bool EnterObject();
+	bool NextMember(std::string *key);
+
+	bool EnterArray();
+	bool NextElement();
+
+ private:
+	// The position of the value of a member of the top level object
+	struct Member {
+		const char *key;
+		size_t key_size;
+		size_t value;
+	};
+
+	// Check the top level object and record where the value of each of its
+	// members is
+	Error IndexMembers();
+
+	void SkipWhitespace(size_t *pos) const;
+
+	// Check the syntax of the value at pos and move past it
+	bool ScanValue(size_t *pos, int depth) const;
+	bool ScanString(size_t *pos) const;
+	bool ScanNumber(size_t *pos) const;
+	bool ScanLiteral(size_t *pos, const char *literal) const;
+
+	// Decode the string at pos, which has already been checked, and move past
+	// it
+	void DecodeString(size_t *pos, std::string *value) const;
+
+	const char *json;
+	size_t size;
+	size_t offset;
+
+	std::vector<Member> members;
+};
+
+}  // namespace qfsclient
+
+#endif  // QFSCLIENT_QFS_CLIENT_JSON_H_
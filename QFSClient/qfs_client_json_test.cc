@@ -0,0 +1,446 @@
+// Copyright (c) 2018 Arista Networks, Inc.
+// Use of this source code is governed by the Apache License 2.0
+// that can be found in the COPYING file.
+
+#include "QFSClient/qfs_client_json.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "QFSClient/qfs_client_util.h"
+
+namespace qfsclient {
+
+class QfsClientJsonTest : public testing::Test {
+ protected:
+	// Open a reader on JSON written with single quotes for readability
+	Error Open(const char *json, JsonReader *reader) {
+		this->json = json;
+		util::requote(&this->json);
+		return reader->Open(this->json.c_str(), this->json.size());
+	}
+
+	std::string json;
+};
+
+TEST_F(QfsClientJsonTest, ReadTest) {
+	JsonReader reader;
+	Error err = this->Open("{ 'ErrorCode': 0,"
+			       " 'Message': 'a\\tb\\u00e9\\ud83d\\ude00',"
+			       " 'Negative': -12, 'Large': 9223372036854775807,"
+			       " 'Real': 1.5e3, 'Nothing': null }", &reader);
+	ASSERT_EQ(err.code, kSuccess);
+
+	int64_t value;
+	ASSERT_TRUE(reader.Find(kErrorCode));
+	ASSERT_TRUE(reader.ReadInt(&value));
+	ASSERT_EQ(value, 0);
+
+	std::string message;
+	ASSERT_TRUE(reader.Find(kMessage));
+	ASSERT_FALSE(reader.ReadInt(&value));
+	ASSERT_TRUE(reader.ReadString(&message));
+	ASSERT_EQ(message, "a\tb\xc3\xa9\xf0\x9f\x98\x80");
+
+	ASSERT_TRUE(reader.Find("Negative"));
+	ASSERT_TRUE(reader.ReadInt(&value));
+	ASSERT_EQ(value, -12);
+
+	ASSERT_TRUE(reader.Find("Large"));
+	ASSERT_TRUE(reader.ReadInt(&value));
+	ASSERT_EQ(value, INT64_MAX);
+
+	// integers only
+	ASSERT_TRUE(reader.Find("Real"));
+	ASSERT_FALSE(reader.ReadInt(&value));
+	ASSERT_TRUE(reader.Skip());
+
+	ASSERT_TRUE(reader.Find("Nothing"));
+	ASSERT_FALSE(reader.ReadString(&message));
+	ASSERT_TRUE(reader.ReadNull());
+
+	ASSERT_FALSE(reader.Find("Missing"));
+}
+
+TEST_F(QfsClientJsonTest, ContainersTest) {
+	JsonReader reader;
+	Error err = this->Open("{'PathList': {'Paths': {'a/b': 1, 'c\\/d': 2},"
+			       " 'Other': [1, {'x': [true, false]}]},"
+			       " 'Empty': [], 'List': [ 'one' , 'two' ]}", &reader);
+	ASSERT_EQ(err.code, kSuccess);
+
+	ASSERT_TRUE(reader.Find(kPathList));
+	ASSERT_TRUE(reader.EnterObject());
+
+	std::string key;
+	ASSERT_TRUE(reader.NextMember(&key));
+	ASSERT_EQ(key, kPaths);
+	ASSERT_TRUE(reader.EnterObject());
+
+	int64_t flags;
+	ASSERT_TRUE(reader.NextMember(&key));
+	ASSERT_EQ(key, "a/b");
+	ASSERT_TRUE(reader.ReadInt(&flags));
+	ASSERT_EQ(flags, 1);
+	ASSERT_TRUE(reader.NextMember(&key));
+	ASSERT_EQ(key, "c/d");
+	ASSERT_TRUE(reader.ReadInt(&flags));
+	ASSERT_EQ(flags, 2);
+	ASSERT_FALSE(reader.NextMember(&key));
+
+	// the remaining member is skipped whole
+	const char *raw;
+	size_t raw_size;
+	ASSERT_TRUE(reader.NextMember(&key));
+	ASSERT_EQ(key, "Other");
+	ASSERT_TRUE(reader.ReadRaw(&raw, &raw_size));
+	ASSERT_EQ(std::string(raw, raw_size), "[1, {\"x\": [true, false]}]");
+	ASSERT_FALSE(reader.NextMember(&key));
+
+	ASSERT_TRUE(reader.Find("Empty"));
+	ASSERT_FALSE(reader.EnterObject());
+	ASSERT_TRUE(reader.EnterArray());
+	ASSERT_FALSE(reader.NextElement());
+
+	std::vector<std::string> list;
+	std::string element;
+	ASSERT_TRUE(reader.Find("List"));
+	ASSERT_TRUE(reader.EnterArray());
+	while (reader.NextElement()) {
+		ASSERT_TRUE(reader.ReadString(&element));
+		list.push_back(element);
+	}
+	ASSERT_EQ(list, std::vector<std::string>({ "one", "two" }));
+}
+
+TEST_F(QfsClientJsonTest, MalformedTest) {
+	const char *malformed[] = {
+		"",
+		"[1, 2]",
+		"{'ErrorCode': 0",
+		"{'ErrorCode': 0,}",
+		"{'ErrorCode' 0}",
+		"{ErrorCode: 0}",
+		"{'ErrorCode': 01}",
+		"{'ErrorCode': -}",
+		"{'ErrorCode': 1.}",
+		"{'ErrorCode': tru}",
+		"{'Message': 'bad \\q escape'}",
+		"{'Message': 'bad \\u12 escape'}",
+		"{'Message': 'unterminated}",
+		"{'List': [1 2]}",
+		"{'List': [1, ]}",
+		"{'Object': {'a': 1,}}",
+		"{'ErrorCode': 0} trailing",
+	};
+
+	for (const char *json : malformed) {
+		JsonReader reader;
+		Error err = this->Open(json, &reader);
+		ASSERT_EQ(err.code, kJsonDecodingError) << json;
+		ASSERT_FALSE(reader.Find(kErrorCode));
+	}
+
+	// control characters must be escaped
+	JsonReader reader;
+	Error err = this->Open("{'Message': 'a\nb'}", &reader);
+	ASSERT_EQ(err.code, kJsonDecodingError);
+
+	// as deep as a response may go
+	std::string deep = "{'List': ";
+	for (int i = 0; i < kMaxJsonDepth + 1; i++) {
+		deep += "[";
+	}
+	for (int i = 0; i < kMaxJsonDepth + 1; i++) {
+		deep += "]";
+	}
+	deep += "}";
+	err = this->Open(deep.c_str(), &reader);
+	ASSERT_EQ(err.code, kJsonDecodingError);
+}
+
+TEST_F(QfsClientJsonTest, FindStringSpecialTest) {
+	// plain characters, including those of multibyte UTF-8 sequences
+	std::string plain;
+	for (int i = 0; plain.size() < 300; i++) {
+		char c = 0x20 + (i % 0xe0);
+		if (c != '"' && c != '\\') {
+			plain.push_back(c);
+		}
+	}
+	ASSERT_EQ(FindStringSpecial(plain.data(), plain.size()), plain.size());
+	ASSERT_EQ(FindStringSpecial(plain.data(), 0), 0);
+
+	// each special character at every offset of the blocks and the tail
+	const char special[] = { '"', '\\', '\n', 0, 0x1f };
+	for (char c : special) {
+		for (size_t offset = 0; offset < 200; offset++) {
+			std::string data = plain;
+			data[offset] = c;
+			data[offset + 50] = c;
+			size_t found = FindStringSpecial(data.data(), data.size());
+			ASSERT_EQ(found, offset);
+
+			// not found beyond the end of the buffer
+			ASSERT_EQ(FindStringSpecial(data.data(), offset), offset);
+		}
+	}
+}
+
+TEST_F(QfsClientJsonTest, LongStringTest) {
+	// long enough for the vectorised scanner, with escapes in every block
+	std::string expected;
+	std::string escaped;
+	for (int i = 0; i < 1000; i++) {
+		expected += "path/\xc3\xa9/\"" + std::to_string(i) + "\"\\";
+		escaped += "path/\\u00e9/\\\"" + std::to_string(i) + "\\\"\\\\";
+	}
+
+	std::string json = "{\"Data\":\"" + escaped + "\"}";
+	JsonReader reader;
+	ASSERT_EQ(reader.Open(json.c_str(), json.size()).code, kSuccess);
+
+	std::string value;
+	ASSERT_TRUE(reader.Find(kData));
+	ASSERT_TRUE(reader.ReadString(&value));
+	ASSERT_EQ(value, expected);
+
+	// a control character deep into a long string
+	json.insert(json.size() - 100, "\x01");
+	ASSERT_EQ(reader.Open(json.c_str(), json.size()).code,
+		  kJsonDecodingError);
+}
+
+TEST_F(QfsClientJsonTest, IntegerRangeTest) {
+	JsonReader reader;
+	Error err = this->Open("{'Min': -9223372036854775808,"
+			       " 'TooLarge': 9223372036854775808}", &reader);
+	ASSERT_EQ(err.code, kSuccess);
+
+	int64_t value;
+	ASSERT_TRUE(reader.Find("Min"));
+	ASSERT_TRUE(reader.ReadInt(&value));
+	ASSERT_EQ(value, INT64_MIN);
+
+	ASSERT_TRUE(reader.Find("TooLarge"));
+	ASSERT_FALSE(reader.ReadInt(&value));
+}
+
+TEST_F(QfsClientJsonTest, WriteTest) {
+	CommandBuffer json;
+	JsonWriter writer(&json);
+	writer.AppendInt("Max", INT64_MAX);
+	writer.AppendInt("Min", INT64_MIN);
+	writer.AppendString("Plain", "one/two/three");
+	writer.AppendString("Special", std::string("\"\\\b\f\n\r\t\x01\x1f", 9));
+	writer.AppendString("Utf8", "\xc3\xa9\xf0\x9f\x98\x80");
+	writer.AppendInt("Zero", 0);
+	ASSERT_EQ(writer.Finish(), kSuccess);
+
+	// the same bytes as jansson wrote with JSON_COMPACT | JSON_SORT_KEYS
+	std::string written((const char *)writer.Json().Data(),
+			    writer.Json().Size());
+	ASSERT_EQ(written,
+		  "{\"Max\":9223372036854775807,\"Min\":-9223372036854775808,"
+		  "\"Plain\":\"one/two/three\","
+		  "\"Special\":\"\\\"\\\\\\b\\f\\n\\r\\t\\u0001\\u001F\","
+		  "\"Utf8\":\"\xc3\xa9\xf0\x9f\x98\x80\",\"Zero\":0}");
+
+	// and what was written reads back as it was
+	JsonReader reader;
+	ASSERT_EQ(reader.Open(json).code, kSuccess);
+
+	std::string value;
+	ASSERT_TRUE(reader.Find("Special"));
+	ASSERT_TRUE(reader.ReadString(&value));
+	ASSERT_EQ(value, std::string("\"\\\b\f\n\r\t\x01\x1f", 9));
+}
+
+TEST_F(QfsClientJsonTest, WriteEmptyTest) {
+	CommandBuffer json;
+	json.CopyString("left over");
+
+	JsonWriter writer(&json);
+	ASSERT_EQ(writer.Finish(), kSuccess);
+	ASSERT_EQ(std::string((const char *)json.Data(), json.Size()), "{}");
+}
+
+TEST_F(QfsClientJsonTest, WriteInvalidUtf8Test) {
+	const char *invalid[] = {
+		"\xff",                  // never valid
+		"ab\xc3",                // truncated sequence
+		"\xc0\xaf",              // overlong '/'
+		"\xed\xa0\x80",          // surrogate
+		"\xf4\x90\x80\x80",      // beyond U+10FFFF
+		"0123456789\x80",        // continuation after an ASCII run
+	};
+
+	for (const char *value : invalid) {
+		CommandBuffer json;
+		JsonWriter writer(&json);
+		writer.AppendString(kKey, value);
+		ASSERT_EQ(writer.Finish(), kJsonEncodingError) << value;
+	}
+}
+
+TEST_F(QfsClientJsonTest, BytesTest) {
+	std::vector<byte> data(1000);
+	for (size_t i = 0; i < data.size(); i++) {
+		data[i] = i * 7;
+	}
+	std::vector<byte> empty;
+
+	CommandBuffer json;
+	JsonWriter writer(&json);
+	writer.AppendBytes(kData, data);
+	writer.AppendBytes(kKey, empty);
+	ASSERT_EQ(writer.Finish(), kSuccess);
+
+	std::string b64;
+	util::base64_encode(data, &b64);
+	ASSERT_EQ(std::string((const char *)json.Data(), json.Size()),
+		  "{\"Data\":\"" + b64 + "\",\"Key\":\"\"}");
+
+	JsonReader reader;
+	ASSERT_EQ(reader.Open(json).code, kSuccess);
+
+	std::vector<byte> value;
+	ASSERT_TRUE(reader.Find(kData));
+	ASSERT_TRUE(reader.ReadBytes(&value));
+	ASSERT_EQ(value, data);
+	ASSERT_TRUE(reader.Find(kKey));
+	ASSERT_TRUE(reader.ReadBytes(&value));
+	ASSERT_TRUE(value.empty());
+}
+
+TEST_F(QfsClientJsonTest, BytesArrayTest) {
+	std::vector<std::vector<byte>> keys = { { 'a' }, {}, { 'b', 'c' } };
+
+	CommandBuffer json;
+	JsonWriter writer(&json);
+	writer.AppendInt(kCommandId, kCmdHasBlocks);
+	writer.AppendBytesArray(kKeys, keys.data(), keys.size());
+	writer.AppendBytesArray(kPaths, keys.data(), 0);
+	ASSERT_EQ(writer.Finish(), kSuccess);
+	ASSERT_EQ(std::string((const char *)json.Data(), json.Size()),
+		  "{\"CommandId\":22,\"Keys\":[\"YQ==\",\"\",\"YmM=\"],"
+		  "\"Paths\":[]}");
+}
+
+TEST_F(QfsClientJsonTest, StringArrayTest) {
+	std::vector<std::string> keys = { "a", "", "b\"c" };
+
+	CommandBuffer json;
+	JsonWriter writer(&json);
+	writer.AppendInt(kCommandId, kCmdPrefetch);
+	writer.AppendStringArray(kExtendedKeys, keys.data(), keys.size());
+	writer.AppendStringArray(kPaths, keys.data(), 0);
+	ASSERT_EQ(writer.Finish(), kSuccess);
+	ASSERT_EQ(std::string((const char *)json.Data(), json.Size()),
+		  "{\"CommandId\":23,\"ExtendedKeys\":[\"a\",\"\",\"b\\\"c\"],"
+		  "\"Paths\":[]}");
+
+	// the strings must still be valid UTF-8
+	keys = { "\xff" };
+	JsonWriter invalid(&json);
+	invalid.AppendStringArray(kExtendedKeys, keys.data(), keys.size());
+	ASSERT_EQ(invalid.Finish(), kJsonEncodingError);
+}
+
+TEST_F(QfsClientJsonTest, ReadBoolTest) {
+	JsonReader reader;
+	Error err = this->Open("{'Present': [true, false], 'Number': 1}",
+			       &reader);
+	ASSERT_EQ(err.code, kSuccess);
+
+	bool value;
+	ASSERT_TRUE(reader.Find("Present"));
+	ASSERT_FALSE(reader.ReadBool(&value));
+	ASSERT_TRUE(reader.EnterArray());
+	ASSERT_TRUE(reader.NextElement());
+	ASSERT_TRUE(reader.ReadBool(&value));
+	ASSERT_TRUE(value);
+	ASSERT_TRUE(reader.NextElement());
+	ASSERT_TRUE(reader.ReadBool(&value));
+	ASSERT_FALSE(value);
+	ASSERT_FALSE(reader.NextElement());
+
+	ASSERT_TRUE(reader.Find("Number"));
+	ASSERT_FALSE(reader.ReadBool(&value));
+}
+
+TEST_F(QfsClientJsonTest, ReadBytesIntoTest) {
+	// every amount of padding, and the SIMD decoders
+	for (size_t length : { 0, 1, 2, 3, 40, 100 }) {
+		std::vector<byte> data(length);
+		for (size_t i = 0; i < data.size(); i++) {
+			data[i] = i * 13;
+		}
+
+		CommandBuffer json;
+		JsonWriter writer(&json);
+		writer.AppendBytes(kData, data);
+		writer.AppendBytes(kKey, data);
+		ASSERT_EQ(writer.Finish(), kSuccess);
+
+		JsonReader reader;
+		ASSERT_EQ(reader.Open(json).code, kSuccess);
+
+		// the decoded bytes may fill the buffer exactly
+		std::vector<byte> buffer(length + 1, 0xff);
+		size_t size = 0;
+		ASSERT_TRUE(reader.Find(kData));
+		ASSERT_TRUE(reader.ReadBytes(buffer.data(), length, &size));
+		ASSERT_EQ(size, length);
+		ASSERT_EQ(std::vector<byte>(buffer.begin(), buffer.begin() + size),
+			  data);
+		ASSERT_EQ(buffer[length], 0xff);
+
+		if (length > 0) {
+			std::fill(buffer.begin(), buffer.end(), 0xff);
+			ASSERT_TRUE(reader.Find(kKey));
+			ASSERT_TRUE(reader.ReadBytes(buffer.data(), length - 1,
+						     &size));
+			ASSERT_EQ(size, length);
+			ASSERT_EQ(buffer[0], 0xff);
+		}
+	}
+
+	JsonReader reader;
+	Error err = this->Open("{'Escaped': 'QUJ\\/', 'Invalid': 'QUJ*',"
+			       " 'Short': 'QUJ'}", &reader);
+	ASSERT_EQ(err.code, kSuccess);
+
+	byte buffer[3];
+	size_t size;
+	ASSERT_TRUE(reader.Find("Escaped"));
+	ASSERT_TRUE(reader.ReadBytes(buffer, sizeof(buffer), &size));
+	ASSERT_EQ(std::vector<byte>(buffer, buffer + size),
+		  std::vector<byte>({ 'A', 'B', 0x7f }));
+	ASSERT_TRUE(reader.Find("Invalid"));
+	ASSERT_FALSE(reader.ReadBytes(buffer, sizeof(buffer), &size));
+	ASSERT_TRUE(reader.Find("Short"));
+	ASSERT_FALSE(reader.ReadBytes(buffer, sizeof(buffer), &size));
+}
+
+TEST_F(QfsClientJsonTest, ReadBytesTest) {
+	JsonReader reader;
+	Error err = this->Open("{'Escaped': 'QUJ\\/', 'Invalid': 'QUJ*',"
+			       " 'Number': 1}", &reader);
+	ASSERT_EQ(err.code, kSuccess);
+
+	// escapes are unusual in base64, but allowed
+	std::vector<byte> value;
+	ASSERT_TRUE(reader.Find("Escaped"));
+	ASSERT_TRUE(reader.ReadBytes(&value));
+	ASSERT_EQ(value, std::vector<byte>({ 'A', 'B', 0x7f }));
+	ASSERT_TRUE(reader.Find("Invalid"));
+	ASSERT_FALSE(reader.ReadBytes(&value));
+	ASSERT_TRUE(reader.Find("Number"));
+	ASSERT_FALSE(reader.ReadBytes(&value));
+}
+
+}  // namespace qfsclient
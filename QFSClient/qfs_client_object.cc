@@ -0,0 +1,67 @@
+// Copyright (c) 2018 Arista Networks, Inc.
+// Use of this source code is governed by the Apache License 2.0
+// that can be found in the COPYING file.
+
+#include "QFSClient/qfs_client_object.h"
+
+#include <string>
+#include <vector>
+
+namespace qfsclient {
+
+static void AppendUint32(std::vector<byte> *out, uint32_t value) {
+	for (int i = 0; i < 4; i++) {
+		out->push_back(value >> (8 * i));
+	}
+}
+
+static uint64_t GetUint(const byte *in, int size) {
+	uint64_t value = 0;
+	for (int i = size - 1; i >= 0; i--) {
+		value = (value << 8) | in[i];
+	}
+	return value;
+}
+
+size_t ObjectChunkCount(uint64_t size) {
+	return size / kObjectChunkSize + (size % kObjectChunkSize != 0 ? 1 : 0);
+}
+
+void EncodeObjectManifest(uint64_t size,
+			  const std::vector<byte> &chunk_keys,
+			  std::vector<byte> *manifest) {
+	manifest->clear();
+	manifest->reserve(kObjectManifestHeaderSize + chunk_keys.size());
+
+	AppendUint32(manifest, kObjectMagic);
+	AppendUint32(manifest, chunk_keys.size() / util::kSha1Size);
+	AppendUint32(manifest, size);
+	AppendUint32(manifest, size >> 32);
+	manifest->insert(manifest->end(), chunk_keys.begin(), chunk_keys.end());
+}
+
+Error DecodeObjectManifest(const std::vector<byte> &manifest,
+			   uint64_t *size,
+			   std::vector<byte> *chunk_keys) {
+	if (manifest.size() < kObjectManifestHeaderSize ||
+	    GetUint(manifest.data(), 4) != kObjectMagic) {
+		return util::getError(kObjectCorrupt, "not an object manifest");
+	}
+
+	uint64_t count = GetUint(manifest.data() + 4, 4);
+	*size = GetUint(manifest.data() + 8, 8);
+	if (count > kMaxObjectChunks || count != ObjectChunkCount(*size) ||
+	    manifest.size() != kObjectManifestHeaderSize +
+			       count * util::kSha1Size) {
+		return util::getError(kObjectCorrupt,
+				      "manifest of " + std::to_string(count) +
+				      " chunks for " + std::to_string(*size) +
+				      " bytes");
+	}
+
+	chunk_keys->assign(manifest.begin() + kObjectManifestHeaderSize,
+			   manifest.end());
+	return util::getError(kSuccess);
+}
+
+}  // namespace qfsclient
@@ -0,0 +1,54 @@
+// Copyright (c) 2018 Arista Networks, Inc.
+// Use of this source code is governed by the Apache License 2.0
+// that can be found in the COPYING file.
+
+#ifndef QFSCLIENT_QFS_CLIENT_OBJECT_H_
+#define QFSCLIENT_QFS_CLIENT_OBJECT_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "QFSClient/qfs_client.h"
+#include "QFSClient/qfs_client_data.h"
+#include "QFSClient/qfs_client_util.h"
+
+namespace qfsclient {
+
+// An object stored by Api::PutObject() is split into chunks of kObjectChunkSize
+// bytes, the last of which may be shorter. Each chunk is a block stored under the
+// SHA-1 of its data. The manifest of the object, listing its chunks, is a block
+// stored under the key of the object and is encoded, in little endian, as:
+//    uint32 kObjectMagic
+//    uint32 the number of chunks
+//    uint64 the size of the object
+//    the key of each chunk, in order
+const uint32_t kObjectMagic = 0x4f534651;  // "QFSO"
+const size_t kObjectChunkSize = kMaxBlockSize;
+const size_t kObjectManifestHeaderSize = 16;
+
+// The manifest must fit in a block of its own
+const size_t kMaxObjectChunks =
+	(kMaxBlockSize - kObjectManifestHeaderSize) / util::kSha1Size;
+
+// The chunks of an object which are stored or retrieved at once
+const size_t kObjectChunksInFlight = 16;
+
+// The number of chunks an object of the given size is split into
+size_t ObjectChunkCount(uint64_t size);
+
+// Build the manifest of an object of the given size from the concatenated keys of
+// its chunks
+void EncodeObjectManifest(uint64_t size,
+			  const std::vector<byte> &chunk_keys,
+			  std::vector<byte> *manifest);
+
+// Parse and check a manifest, setting size to the size of the object and
+// chunk_keys to the concatenated keys of its chunks
+Error DecodeObjectManifest(const std::vector<byte> &manifest,
+			   uint64_t *size,
+			   std::vector<byte> *chunk_keys);
+
+}  // namespace qfsclient
+
+#endif  // QFSCLIENT_QFS_CLIENT_OBJECT_H_
@@ -0,0 +1,83 @@
+// Copyright (c) 2018 Arista Networks, Inc.
+// Use of this source code is governed by the Apache License 2.0
+// that can be found in the COPYING file.
+
+#include "QFSClient/qfs_client_object.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace qfsclient {
+
+class QfsClientObjectTest : public testing::Test {
+};
+
+TEST_F(QfsClientObjectTest, ChunkCountTest) {
+	ASSERT_EQ(ObjectChunkCount(0), 0);
+	ASSERT_EQ(ObjectChunkCount(1), 1);
+	ASSERT_EQ(ObjectChunkCount(kObjectChunkSize), 1);
+	ASSERT_EQ(ObjectChunkCount(kObjectChunkSize + 1), 2);
+	ASSERT_EQ(ObjectChunkCount(3 * kObjectChunkSize), 3);
+}
+
+TEST_F(QfsClientObjectTest, ManifestTest) {
+	uint64_t size = 2 * kObjectChunkSize + 7;
+	std::vector<byte> chunk_keys(3 * util::kSha1Size);
+	for (size_t i = 0; i < chunk_keys.size(); i++) {
+		chunk_keys[i] = i;
+	}
+
+	std::vector<byte> manifest;
+	EncodeObjectManifest(size, chunk_keys, &manifest);
+	ASSERT_EQ(manifest.size(),
+		  kObjectManifestHeaderSize + chunk_keys.size());
+	ASSERT_LE(manifest.size(), kMaxBlockSize);
+
+	uint64_t read_size = 0;
+	std::vector<byte> read_keys;
+	Error err = DecodeObjectManifest(manifest, &read_size, &read_keys);
+	ASSERT_EQ(err.code, kSuccess) << err.message;
+	ASSERT_EQ(read_size, size);
+	ASSERT_EQ(read_keys, chunk_keys);
+
+	// the manifest of an empty object has no chunks
+	EncodeObjectManifest(0, std::vector<byte>(), &manifest);
+	err = DecodeObjectManifest(manifest, &read_size, &read_keys);
+	ASSERT_EQ(err.code, kSuccess) << err.message;
+	ASSERT_EQ(read_size, 0);
+	ASSERT_TRUE(read_keys.empty());
+}
+
+TEST_F(QfsClientObjectTest, CorruptManifestTest) {
+	std::vector<byte> chunk_keys(2 * util::kSha1Size, 'k');
+	std::vector<byte> manifest;
+	EncodeObjectManifest(kObjectChunkSize + 1, chunk_keys, &manifest);
+
+	uint64_t size;
+	std::vector<byte> read_keys;
+
+	// a block which isn't a manifest
+	std::vector<byte> corrupt = manifest;
+	corrupt[0] ^= 0xff;
+	Error err = DecodeObjectManifest(corrupt, &size, &read_keys);
+	ASSERT_EQ(err.code, kObjectCorrupt);
+
+	// too short to hold the header
+	corrupt.assign(manifest.begin(),
+		       manifest.begin() + kObjectManifestHeaderSize - 1);
+	err = DecodeObjectManifest(corrupt, &size, &read_keys);
+	ASSERT_EQ(err.code, kObjectCorrupt);
+
+	// a chunk key is missing
+	corrupt.assign(manifest.begin(), manifest.end() - 1);
+	err = DecodeObjectManifest(corrupt, &size, &read_keys);
+	ASSERT_EQ(err.code, kObjectCorrupt);
+
+	// the number of chunks doesn't match the size
+	EncodeObjectManifest(kObjectChunkSize, chunk_keys, &corrupt);
+	err = DecodeObjectManifest(corrupt, &size, &read_keys);
+	ASSERT_EQ(err.code, kObjectCorrupt);
+}
+
+}  // namespace qfsclient
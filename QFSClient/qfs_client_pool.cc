@@ -0,0 +1,458 @@
+// Copyright (c) 2018 Arista Networks, Inc.
+// Use of this source code is governed by the Apache License 2.0
+// that can be found in the COPYING file.
+
+#include "QFSClient/qfs_client_pool.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+#include "QFSClient/qfs_client_cache.h"
+#include "QFSClient/qfs_client_util.h"
+
+namespace qfsclient {
+
+Error GetPooledApi(size_t max_connections, Api **api) {
+	*api = new PooledApi(NULL, max_connections);
+	return util::getError(kSuccess);
+}
+
+Error GetPooledApi(const char *path, size_t max_connections, Api **api) {
+	*api = new PooledApi(path, max_connections);
+	return util::getError(kSuccess);
+}
+
+PooledApi::PooledApi(const char *path, size_t max_connections)
+	: path(path != NULL ? path : ""),
+	  max_connections(std::max(max_connections, (size_t)1)),
+	  next_request_id(1),
+	  next_cursor(1),
+	  shared_memory(false) {
+	pthread_mutex_init(&this->mutex, NULL);
+	pthread_cond_init(&this->available, NULL);
+}
+
+PooledApi::~PooledApi() {
+	pthread_cond_destroy(&this->available);
+	pthread_mutex_destroy(&this->mutex);
+}
+
+ApiImpl *PooledApi::Acquire() {
+	pthread_mutex_lock(&this->mutex);
+
+	while (this->idle.empty() &&
+	       this->connections.size() >= this->max_connections) {
+		pthread_cond_wait(&this->available, &this->mutex);
+	}
+
+	ApiImpl *connection;
+	if (!this->idle.empty()) {
+		// Prefer the most recently used connection, so that the pool only
+		// grows as far as the concurrency of its callers requires
+		connection = this->idle.back();
+		this->idle.pop_back();
+	} else {
+		// The api file is opened by the connection on its first call
+		connection = this->path.empty() ? new ApiImpl() :
+						  new ApiImpl(this->path.c_str());
+		this->connections.emplace_back(connection);
+	}
+	bool shared_memory = this->shared_memory;
+	std::shared_ptr<BlockCache> block_cache = this->block_cache;
+
+	pthread_mutex_unlock(&this->mutex);
+
+	if (shared_memory) {
+		// A connection which can't set up shared memory carries on
+		// without it
+		connection->EnableSharedMemory();
+	}
+	connection->UseBlockCache(block_cache);
+	return connection;
+}
+
+void PooledApi::AcquireConnection(ApiImpl *connection) {
+	pthread_mutex_lock(&this->mutex);
+
+	while (true) {
+		auto it = std::find(this->idle.begin(), this->idle.end(),
+				    connection);
+		if (it != this->idle.end()) {
+			this->idle.erase(it);
+			break;
+		}
+		pthread_cond_wait(&this->available, &this->mutex);
+	}
+
+	pthread_mutex_unlock(&this->mutex);
+}
+
+void PooledApi::Release(ApiImpl *connection) {
+	pthread_mutex_lock(&this->mutex);
+	this->idle.push_back(connection);
+	pthread_mutex_unlock(&this->mutex);
+
+	// Wait() may be blocked on a particular connection, so every waiter must
+	// check whether it was the one released
+	pthread_cond_broadcast(&this->available);
+}
+
+RequestId PooledApi::TrackRequest(ApiImpl *connection, RequestId request_id) {
+	pthread_mutex_lock(&this->mutex);
+	RequestId pool_request_id = this->next_request_id++;
+	this->requests[pool_request_id] = { connection, request_id };
+	pthread_mutex_unlock(&this->mutex);
+
+	return pool_request_id;
+}
+
+Error PooledApi::GetAccessed(const char *workspace_root, PathsAccessed *paths) {
+	ApiImpl *connection = this->Acquire();
+	Error err = connection->GetAccessed(workspace_root, paths);
+	this->Release(connection);
+
+	return err;
+}
+
+AccessedCursor PooledApi::TrackListing(ApiImpl *connection,
+				       AccessedCursor cursor) {
+	pthread_mutex_lock(&this->mutex);
+	if (this->listings.size() >= kMaxPooledListings) {
+		// pool cursors increase, so the first is the oldest
+		this->listings.erase(this->listings.begin());
+	}
+	AccessedCursor pool_cursor = this->next_cursor++;
+	this->listings[pool_cursor] = { connection, cursor };
+	pthread_mutex_unlock(&this->mutex);
+
+	return pool_cursor;
+}
+
+Error PooledApi::GetAccessedPage(const char *workspace_root,
+				 AccessedCursor *cursor,
+				 uint32_t max_paths,
+				 std::vector<PathAccessed> *paths) {
+	ApiImpl *connection;
+	AccessedCursor connection_cursor = 0;
+	if (*cursor == 0) {
+		connection = this->Acquire();
+	} else {
+		pthread_mutex_lock(&this->mutex);
+		auto it = this->listings.find(*cursor);
+		if (it == this->listings.end()) {
+			pthread_mutex_unlock(&this->mutex);
+			paths->clear();
+			return util::getError(kApiError,
+					      util::getApiError(kCmdBadArgs,
+						"unknown cursor " +
+						std::to_string(*cursor)));
+		}
+
+		connection = it->second.connection;
+		connection_cursor = it->second.cursor;
+		this->listings.erase(it);
+		pthread_mutex_unlock(&this->mutex);
+
+		this->AcquireConnection(connection);
+	}
+
+	Error err = connection->GetAccessedPage(workspace_root, &connection_cursor,
+						max_paths, paths);
+	if (err.code == kSuccess) {
+		*cursor = connection_cursor == 0 ? 0 :
+				this->TrackListing(connection, connection_cursor);
+	}
+	this->Release(connection);
+
+	return err;
+}
+
+Error PooledApi::InsertInode(const char *destination,
+			     const char *key,
+			     uint32_t permissions,
+			     uint32_t uid,
+			     uint32_t gid) {
+	ApiImpl *connection = this->Acquire();
+	Error err = connection->InsertInode(destination, key, permissions, uid,
+					    gid);
+	this->Release(connection);
+
+	return err;
+}
+
+Error PooledApi::InsertInodes(const std::vector<InsertInodeEntry> &inodes,
+			      std::vector<Error> *results) {
+	ApiImpl *connection = this->Acquire();
+	Error err = connection->InsertInodes(inodes, results);
+	this->Release(connection);
+
+	return err;
+}
+
+Error PooledApi::Branch(const char *source, const char *destination) {
+	ApiImpl *connection = this->Acquire();
+	Error err = connection->Branch(source, destination);
+	this->Release(connection);
+
+	return err;
+}
+
+Error PooledApi::Delete(const char *workspace) {
+	ApiImpl *connection = this->Acquire();
+	Error err = connection->Delete(workspace);
+	this->Release(connection);
+
+	return err;
+}
+
+Error PooledApi::SetBlock(const std::vector<byte> &key,
+			  const std::vector<byte> &data) {
+	ApiImpl *connection = this->Acquire();
+	Error err = connection->SetBlock(key, data);
+	this->Release(connection);
+
+	return err;
+}
+
+Error PooledApi::GetBlock(const std::vector<byte> &key, std::vector<byte> *data) {
+	ApiImpl *connection = this->Acquire();
+	Error err = connection->GetBlock(key, data);
+	this->Release(connection);
+
+	return err;
+}
+
+Error PooledApi::SetBlock(const byte *key, size_t key_size,
+			  const byte *data, size_t data_size) {
+	ApiImpl *connection = this->Acquire();
+	Error err = connection->SetBlock(key, key_size, data, data_size);
+	this->Release(connection);
+
+	return err;
+}
+
+Error PooledApi::GetBlock(const byte *key, size_t key_size,
+			  std::vector<byte> *data) {
+	ApiImpl *connection = this->Acquire();
+	Error err = connection->GetBlock(key, key_size, data);
+	this->Release(connection);
+
+	return err;
+}
+
+Error PooledApi::GetBlockInto(const byte *key, size_t key_size,
+			      byte *data, size_t capacity,
+			      size_t *written) {
+	ApiImpl *connection = this->Acquire();
+	Error err = connection->GetBlockInto(key, key_size, data, capacity,
+					     written);
+	this->Release(connection);
+
+	return err;
+}
+
+Error PooledApi::StatBlock(const std::vector<byte> &key, size_t *size) {
+	ApiImpl *connection = this->Acquire();
+	Error err = connection->StatBlock(key, size);
+	this->Release(connection);
+
+	return err;
+}
+
+Error PooledApi::HasBlocks(const std::vector<std::vector<byte>> &keys,
+			   std::vector<bool> *present) {
+	ApiImpl *connection = this->Acquire();
+	Error err = connection->HasBlocks(keys, present);
+	this->Release(connection);
+
+	return err;
+}
+
+Error PooledApi::SetBlockIfAbsent(const byte *data, size_t size,
+				  std::vector<byte> *key,
+				  bool *stored) {
+	ApiImpl *connection = this->Acquire();
+	Error err = connection->SetBlockIfAbsent(data, size, key, stored);
+	this->Release(connection);
+
+	return err;
+}
+
+Error PooledApi::Prefetch(const std::vector<std::vector<byte>> &keys,
+			  const std::vector<std::string> &extended_keys) {
+	ApiImpl *connection = this->Acquire();
+	Error err = connection->Prefetch(keys, extended_keys);
+	this->Release(connection);
+
+	return err;
+}
+
+Error PooledApi::EnableSharedMemory() {
+	pthread_mutex_lock(&this->mutex);
+	this->shared_memory = true;
+	pthread_mutex_unlock(&this->mutex);
+
+	// Acquiring a connection enables shared memory on it, this tells the
+	// caller whether that worked
+	ApiImpl *connection = this->Acquire();
+	Error err = connection->EnableSharedMemory();
+	this->Release(connection);
+
+	return err;
+}
+
+Error PooledApi::StartInsertInode(const char *destination,
+				  const char *key,
+				  uint32_t permissions,
+				  uint32_t uid,
+				  uint32_t gid,
+				  RequestId *request_id) {
+	ApiImpl *connection = this->Acquire();
+	RequestId connection_request_id;
+	Error err = connection->StartInsertInode(destination, key, permissions,
+						 uid, gid, &connection_request_id);
+	if (err.code == kSuccess) {
+		*request_id = this->TrackRequest(connection, connection_request_id);
+	}
+	this->Release(connection);
+
+	return err;
+}
+
+Error PooledApi::StartSetBlock(const std::vector<byte> &key,
+			       const std::vector<byte> &data,
+			       RequestId *request_id) {
+	ApiImpl *connection = this->Acquire();
+	RequestId connection_request_id;
+	Error err = connection->StartSetBlock(key, data, &connection_request_id);
+	if (err.code == kSuccess) {
+		*request_id = this->TrackRequest(connection, connection_request_id);
+	}
+	this->Release(connection);
+
+	return err;
+}
+
+Error PooledApi::StartGetBlock(const std::vector<byte> &key,
+			       RequestId *request_id) {
+	ApiImpl *connection = this->Acquire();
+	RequestId connection_request_id;
+	Error err = connection->StartGetBlock(key, &connection_request_id);
+	if (err.code == kSuccess) {
+		*request_id = this->TrackRequest(connection, connection_request_id);
+	}
+	this->Release(connection);
+
+	return err;
+}
+
+Error PooledApi::Wait(RequestId request_id, std::vector<byte> *data) {
+	pthread_mutex_lock(&this->mutex);
+	auto it = this->requests.find(request_id);
+	if (it == this->requests.end()) {
+		pthread_mutex_unlock(&this->mutex);
+		return util::getError(kUnknownRequestId, std::to_string(request_id));
+	}
+
+	PipelinedRequest request = it->second;
+	this->requests.erase(it);
+	pthread_mutex_unlock(&this->mutex);
+
+	this->AcquireConnection(request.connection);
+	Error err = request.connection->Wait(request.request_id, data);
+	this->Release(request.connection);
+
+	return err;
+}
+
+Error PooledApi::ExecuteBatch(const Batch &batch, std::vector<Error> *results) {
+	ApiImpl *connection = this->Acquire();
+	Error err = connection->ExecuteBatch(batch, results);
+	this->Release(connection);
+
+	return err;
+}
+
+Error PooledApi::SetBlocks(const std::vector<Block> &blocks,
+			   std::vector<Error> *results) {
+	ApiImpl *connection = this->Acquire();
+	Error err = connection->SetBlocks(blocks, results);
+	this->Release(connection);
+
+	return err;
+}
+
+Error PooledApi::GetBlocks(const std::vector<std::vector<byte>> &keys,
+			   std::vector<std::vector<byte>> *blocks,
+			   std::vector<Error> *results) {
+	ApiImpl *connection = this->Acquire();
+	Error err = connection->GetBlocks(keys, blocks, results);
+	this->Release(connection);
+
+	return err;
+}
+
+uint64_t PooledApi::CompressionSavings() {
+	pthread_mutex_lock(&this->mutex);
+	uint64_t savings = 0;
+	for (const auto &connection : this->connections) {
+		savings += connection->CompressionSavings();
+	}
+	pthread_mutex_unlock(&this->mutex);
+
+	return savings;
+}
+
+Error PooledApi::PutObject(const std::vector<byte> &key,
+			   const byte *data,
+			   size_t size) {
+	ApiImpl *connection = this->Acquire();
+	Error err = connection->PutObject(key, data, size);
+	this->Release(connection);
+
+	return err;
+}
+
+Error PooledApi::GetObject(const std::vector<byte> &key,
+			   std::vector<byte> *data) {
+	ApiImpl *connection = this->Acquire();
+	Error err = connection->GetObject(key, data);
+	this->Release(connection);
+
+	return err;
+}
+
+Error PooledApi::GetObject(const std::vector<byte> &key, int fd) {
+	ApiImpl *connection = this->Acquire();
+	Error err = connection->GetObject(key, fd);
+	this->Release(connection);
+
+	return err;
+}
+
+Error PooledApi::EnableBlockCache(size_t max_bytes) {
+	pthread_mutex_lock(&this->mutex);
+	if (max_bytes == 0) {
+		this->block_cache.reset();
+	} else {
+		this->block_cache = std::make_shared<BlockCache>(max_bytes);
+	}
+	pthread_mutex_unlock(&this->mutex);
+
+	return util::getError(kSuccess);
+}
+
+BlockCacheStats PooledApi::GetBlockCacheStats() {
+	pthread_mutex_lock(&this->mutex);
+	std::shared_ptr<BlockCache> block_cache = this->block_cache;
+	pthread_mutex_unlock(&this->mutex);
+
+	if (!block_cache) {
+		return BlockCacheStats();
+	}
+
+	return block_cache->Stats();
+}
+
+}  // namespace qfsclient
@@ -0,0 +1,213 @@
+// Copyright (c) 2018 Arista Networks, Inc.
+// Use of this source code is governed by the Apache License 2.0
+// that can be found in the COPYING file.
+
+#ifndef QFSCLIENT_QFS_CLIENT_POOL_H_
+#define QFSCLIENT_QFS_CLIENT_POOL_H_
+
+#include <pthread.h>
+
+#include <gtest/gtest_prod.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "QFSClient/qfs_client.h"
+#include "QFSClient/qfs_client_implementation.h"
+
+namespace qfsclient {
+
+// The most accessed listings part way through being read which a PooledApi keeps
+// track of. Beyond this, the oldest are forgotten, as a caller may abandon a
+// listing at any point.
+const size_t kMaxPooledListings = 64;
+
+// PooledApi allows many threads to share one Api object. An ApiImpl owns a single
+// api file handle and the reads and writes of a call on it must not interleave
+// with those of another call, so PooledApi keeps a pool of ApiImpl connections
+// and hands each call an idle one, opening a new connection only when every
+// existing one is busy. Once max_connections are open, further calls block until
+// a connection is returned to the pool.
+class PooledApi: public Api {
+ public:
+	// If path is NULL each connection searches for the api file as ApiImpl()
+	// does.
+	PooledApi(const char *path, size_t max_connections);
+	virtual ~PooledApi();
+
+	virtual Error GetAccessed(const char *workspace_root, PathsAccessed *paths);
+
+	virtual Error GetAccessedPage(const char *workspace_root,
+				      AccessedCursor *cursor,
+				      uint32_t max_paths,
+				      std::vector<PathAccessed> *paths);
+
+	virtual Error InsertInode(const char *destination,
+				  const char *key,
+				  uint32_t permissions,
+				  uint32_t uid,
+				  uint32_t gid);
+
+	virtual Error InsertInodes(const std::vector<InsertInodeEntry> &inodes,
+				   std::vector<Error> *results);
+
+	virtual Error Branch(const char *source, const char *destination);
+
+	virtual Error Delete(const char *workspace);
+
+	virtual Error SetBlock(const std::vector<byte> &key,
+			       const std::vector<byte> &data);
+
+	virtual Error GetBlock(const std::vector<byte> &key,
+			       std::vector<byte> *data);
+
+	virtual Error SetBlock(const byte *key, size_t key_size,
+			       const byte *data, size_t data_size);
+
+	virtual Error GetBlock(const byte *key, size_t key_size,
+			       std::vector<byte> *data);
+
+	virtual Error GetBlockInto(const byte *key, size_t key_size,
+				   byte *data, size_t capacity,
+				   size_t *written);
+
+	virtual Error StatBlock(const std::vector<byte> &key, size_t *size);
+
+	virtual Error HasBlocks(const std::vector<std::vector<byte>> &keys,
+				std::vector<bool> *present);
+
+	virtual Error SetBlockIfAbsent(const byte *data, size_t size,
+				       std::vector<byte> *key,
+				       bool *stored);
+
+	// The responses are dropped by whichever caller next uses the connection
+	virtual Error Prefetch(const std::vector<std::vector<byte>> &keys,
+			       const std::vector<std::string> &extended_keys);
+
+	// Every connection sets up a shared memory region of its own, as it is
+	// next acquired.
+	virtual Error EnableSharedMemory();
+
+	virtual Error StartInsertInode(const char *destination,
+				       const char *key,
+				       uint32_t permissions,
+				       uint32_t uid,
+				       uint32_t gid,
+				       RequestId *request_id);
+
+	virtual Error StartSetBlock(const std::vector<byte> &key,
+				    const std::vector<byte> &data,
+				    RequestId *request_id);
+
+	virtual Error StartGetBlock(const std::vector<byte> &key,
+				    RequestId *request_id);
+
+	virtual Error Wait(RequestId request_id, std::vector<byte> *data);
+
+	virtual Error ExecuteBatch(const Batch &batch, std::vector<Error> *results);
+
+	virtual Error SetBlocks(const std::vector<Block> &blocks,
+				std::vector<Error> *results);
+
+	virtual Error GetBlocks(const std::vector<std::vector<byte>> &keys,
+				std::vector<std::vector<byte>> *blocks,
+				std::vector<Error> *results);
+
+	virtual uint64_t CompressionSavings();
+
+	virtual Error PutObject(const std::vector<byte> &key,
+				const byte *data,
+				size_t size);
+
+	virtual Error GetObject(const std::vector<byte> &key,
+				std::vector<byte> *data);
+
+	virtual Error GetObject(const std::vector<byte> &key, int fd);
+
+	// Every connection shares the one block cache
+	virtual Error EnableBlockCache(size_t max_bytes);
+
+	virtual BlockCacheStats GetBlockCacheStats();
+
+ private:
+	// A pipelined command is identified to the caller by a request ID unique
+	// across the pool, as each connection numbers its own commands.
+	struct PipelinedRequest {
+		ApiImpl *connection;
+		RequestId request_id;
+	};
+
+	// A listing belongs to the api file handle which started it, so the pages
+	// of a listing must all be read on the same connection, and its cursors
+	// are renumbered across the pool like request IDs.
+	struct Listing {
+		ApiImpl *connection;
+		AccessedCursor cursor;
+	};
+
+	// Take an idle connection from the pool, opening a new one if they are all
+	// busy and the pool may still grow, or else waiting for one to be
+	// released.
+	ApiImpl *Acquire();
+
+	// Wait for the given connection to become idle and take it from the pool.
+	// Only the connection a pipelined command was sent on can read its
+	// response.
+	void AcquireConnection(ApiImpl *connection);
+
+	// Return a connection to the pool
+	void Release(ApiImpl *connection);
+
+	// Record a pipelined command started on the given connection and return
+	// the request ID the caller should wait on.
+	RequestId TrackRequest(ApiImpl *connection, RequestId request_id);
+
+	// Record the cursor of the next page of a listing on the given connection
+	// and return the cursor the caller should continue with.
+	AccessedCursor TrackListing(ApiImpl *connection, AccessedCursor cursor);
+
+	// Where each connection will look for the api file. Empty if the api file
+	// is to be searched for.
+	std::string path;
+
+	size_t max_connections;
+
+	// Protects every member below. available is signalled whenever a
+	// connection is released.
+	pthread_mutex_t mutex;
+	pthread_cond_t available;
+
+	// Every connection opened so far, and those of them not in use by a call
+	std::vector<std::unique_ptr<ApiImpl>> connections;
+	std::vector<ApiImpl *> idle;
+
+	RequestId next_request_id;
+	std::unordered_map<RequestId, PipelinedRequest> requests;
+
+	AccessedCursor next_cursor;
+	std::map<AccessedCursor, Listing> listings;
+
+	// Whether EnableSharedMemory() has been called
+	bool shared_memory;
+
+	// The block cache given to every connection as it is acquired, if
+	// EnableBlockCache() has been called
+	std::shared_ptr<BlockCache> block_cache;
+
+	// Thread functions of the tests below
+	friend void *AcquireFromPool(void *arg);
+	friend void *UsePool(void *arg);
+
+	FRIEND_TEST(QfsClientTest, PoolGrowthTest);
+	FRIEND_TEST(QfsClientTest, PoolBlockingTest);
+	FRIEND_TEST(QfsClientTest, PoolConcurrencyTest);
+	FRIEND_TEST(QfsClientApiTest, PoolPipelinedTest);
+	FRIEND_TEST(QfsClientApiTest, PoolAccessedPageTest);
+};
+
+}  // namespace qfsclient
+
+#endif  // QFSCLIENT_QFS_CLIENT_POOL_H_
@@ -0,0 +1,298 @@
+// Copyright (c) 2018 Arista Networks, Inc.
+// Use of this source code is governed by the Apache License 2.0
+// that can be found in the COPYING file.
+
+#include "QFSClient/qfs_client_pool.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "QFSClient/qfs_client_binary.h"
+#include "QFSClient/qfs_client_test.h"
+#include "QFSClient/qfs_client_util.h"
+
+namespace qfsclient {
+
+TEST_F(QfsClientTest, PoolGrowthTest) {
+	PooledApi pool(this->api_path.c_str(), 3);
+	ASSERT_EQ(pool.connections.size(), 0);
+
+	// An idle connection is reused rather than opening another
+	ApiImpl *first = pool.Acquire();
+	ASSERT_EQ(pool.connections.size(), 1);
+	pool.Release(first);
+
+	ApiImpl *second = pool.Acquire();
+	ASSERT_EQ(second, first);
+	ASSERT_EQ(pool.connections.size(), 1);
+
+	ApiImpl *third = pool.Acquire();
+	ASSERT_NE(third, second);
+	ASSERT_EQ(pool.connections.size(), 2);
+
+	pool.Release(second);
+	pool.Release(third);
+	ASSERT_EQ(pool.idle.size(), 2);
+
+	Api *api;
+	Error err = GetPooledApi(this->api_path.c_str(), 4, &api);
+	ASSERT_EQ(err.code, kSuccess);
+	ReleaseApi(api);
+}
+
+struct PoolBlockingState {
+	PooledApi *pool;
+	std::atomic<bool> acquired;
+};
+
+void *AcquireFromPool(void *arg) {
+	PoolBlockingState *state = reinterpret_cast<PoolBlockingState *>(arg);
+
+	ApiImpl *connection = state->pool->Acquire();
+	state->acquired = true;
+	state->pool->Release(connection);
+	return NULL;
+}
+
+TEST_F(QfsClientTest, PoolBlockingTest) {
+	PooledApi pool(this->api_path.c_str(), 1);
+
+	ApiImpl *first = pool.Acquire();
+
+	PoolBlockingState state;
+	state.pool = &pool;
+	state.acquired = false;
+	pthread_t waiter;
+	ASSERT_EQ(pthread_create(&waiter, NULL, AcquireFromPool, &state), 0);
+
+	// The pool is full so the waiter can't proceed until the connection is
+	// released
+	usleep(50000);
+	EXPECT_FALSE(state.acquired);
+
+	pool.Release(first);
+	pthread_join(waiter, NULL);
+	EXPECT_TRUE(state.acquired);
+	ASSERT_EQ(pool.connections.size(), 1);
+}
+
+struct PoolConcurrencyState {
+	PooledApi *pool;
+
+	pthread_mutex_t mutex;
+	std::unordered_set<ApiImpl *> in_use;
+	std::atomic<bool> shared;
+
+	std::atomic<size_t> busy;
+	std::atomic<size_t> max_busy;
+};
+
+void *UsePool(void *arg) {
+	PoolConcurrencyState *state = reinterpret_cast<PoolConcurrencyState *>(arg);
+
+	for (int i = 0; i < 100; i++) {
+		ApiImpl *connection = state->pool->Acquire();
+
+		// No other thread may be using the same connection
+		pthread_mutex_lock(&state->mutex);
+		if (!state->in_use.insert(connection).second) {
+			state->shared = true;
+		}
+		pthread_mutex_unlock(&state->mutex);
+
+		size_t busy = ++state->busy;
+		size_t max_busy = state->max_busy;
+		while (busy > max_busy &&
+		       !state->max_busy.compare_exchange_weak(max_busy, busy)) {
+		}
+		sched_yield();
+		--state->busy;
+
+		pthread_mutex_lock(&state->mutex);
+		state->in_use.erase(connection);
+		pthread_mutex_unlock(&state->mutex);
+
+		state->pool->Release(connection);
+	}
+
+	return NULL;
+}
+
+TEST_F(QfsClientTest, PoolConcurrencyTest) {
+	const size_t max_connections = 4;
+	PooledApi pool(this->api_path.c_str(), max_connections);
+
+	PoolConcurrencyState state;
+	state.pool = &pool;
+	pthread_mutex_init(&state.mutex, NULL);
+	state.shared = false;
+	state.busy = 0;
+	state.max_busy = 0;
+
+	std::vector<pthread_t> threads(16);
+	for (auto &thread : threads) {
+		ASSERT_EQ(pthread_create(&thread, NULL, UsePool, &state), 0);
+	}
+	for (auto &thread : threads) {
+		pthread_join(thread, NULL);
+	}
+	pthread_mutex_destroy(&state.mutex);
+
+	ASSERT_FALSE(state.shared);
+	ASSERT_LE(state.max_busy, max_connections);
+	ASSERT_LE(pool.connections.size(), max_connections);
+	ASSERT_EQ(pool.idle.size(), pool.connections.size());
+}
+
+TEST_F(QfsClientApiTest, PoolPipelinedTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
+
+	PooledApi pool(this->api->path.c_str(), 2);
+
+	// Open both connections of the pool on the test api file, with their
+	// responses supplied by this test. Only the binary protocol pipelines
+	// commands.
+	ApiImpl *first = pool.Acquire();
+	ApiImpl *second = pool.Acquire();
+	for (ApiImpl *connection : { first, second }) {
+		connection->test_hook = this->api->test_hook;
+		err = connection->TestOpen();
+		ASSERT_EQ(err.code, kSuccess);
+		connection->protocol = kProtocolBinary;
+	}
+
+	std::vector<byte> key;
+	const char *key_value = "somearbitrarykeyvalue03423278";
+	key.assign(key_value, key_value + strlen(key_value));
+
+	std::vector<byte> data;
+	const char *data_value = "lookbehindyou";
+	data.assign(data_value, data_value + strlen(data_value));
+
+	// Start a command on each connection, which will both number their
+	// command 1
+	pool.Release(second);
+	RequestId get_block_id;
+	err = pool.StartGetBlock(key, &get_block_id);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(second->in_flight.count(1), 1);
+
+	ASSERT_EQ(pool.Acquire(), second);
+	pool.Release(first);
+	RequestId set_block_id;
+	err = pool.StartSetBlock(key, data, &set_block_id);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(first->in_flight.count(1), 1);
+	pool.Release(second);
+
+	ASSERT_NE(get_block_id, set_block_id);
+
+	// Each response must be read on the connection its command was sent on
+	BinaryWriter response(kCmdError, 1);
+	response.AppendUint32(kCmdOk);
+	response.AppendString("success");
+	response.AppendBytes(data);
+	ASSERT_EQ(response.Finish(), kSuccess);
+	this->read_command.Copy(response.Frame());
+
+	std::vector<byte> read_data;
+	err = pool.Wait(get_block_id, &read_data);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(data, read_data);
+	ASSERT_TRUE(second->in_flight.empty());
+	ASSERT_EQ(first->in_flight.count(1), 1);
+
+	err = pool.Wait(set_block_id, NULL);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_TRUE(first->in_flight.empty());
+
+	err = pool.Wait(set_block_id, NULL);
+	ASSERT_EQ(err.code, kUnknownRequestId);
+}
+
+TEST_F(QfsClientApiTest, PoolAccessedPageTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
+
+	PooledApi pool(this->api->path.c_str(), 2);
+
+	ApiImpl *first = pool.Acquire();
+	ApiImpl *second = pool.Acquire();
+	for (ApiImpl *connection : { first, second }) {
+		connection->test_hook = this->api->test_hook;
+		err = connection->TestOpen();
+		ASSERT_EQ(err.code, kSuccess);
+	}
+
+	// Start a listing on the second connection
+	pool.Release(second);
+	std::string page_json = "{'ErrorCode':0,'Message':'',"
+				"'NextCursor':4294967297,"
+				"'Paths':[{'Flags':2,'Path':'/a'}]}";
+	util::requote(&page_json);
+	this->read_command.CopyString(page_json.c_str());
+
+	AccessedCursor cursor = 0;
+	std::vector<PathAccessed> paths;
+	err = pool.GetAccessedPage("test/workspace/root", &cursor, 1, &paths);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(paths.size(), 1);
+	ASSERT_EQ(pool.listings.size(), 1);
+	ASSERT_EQ(pool.listings.at(cursor).connection, second);
+	ASSERT_EQ(pool.listings.at(cursor).cursor, 4294967297);
+
+	// Though the first connection is the next idle one, the listing continues
+	// on the second with the cursor it returned
+	pool.Release(first);
+	ASSERT_EQ(pool.Acquire(), first);
+	pool.Release(first);
+
+	page_json = "{'ErrorCode':0,'Message':'','NextCursor':4294967298,"
+		    "'Paths':[{'Flags':2,'Path':'/b'}]}";
+	util::requote(&page_json);
+	this->read_command.CopyString(page_json.c_str());
+
+	err = pool.GetAccessedPage("test/workspace/root", &cursor, 1, &paths);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(paths[0].path, "/b");
+	ASSERT_EQ(pool.listings.size(), 1);
+	ASSERT_EQ(pool.listings.at(cursor).connection, second);
+
+	std::string expected_written_command_json =
+		"{'CommandId':16,'Cursor':4294967297,'PageSize':1,"
+		"'WorkspaceRoot':'test/workspace/root'}";
+	util::requote(&expected_written_command_json);
+	ASSERT_EQ(std::string((const char *)this->actual_written_command.Data(),
+			      this->actual_written_command.Size()),
+		  expected_written_command_json);
+
+	// The last page forgets the listing
+	page_json = "{'ErrorCode':0,'Message':'','NextCursor':0,"
+		    "'Paths':[{'Flags':2,'Path':'/c'}]}";
+	util::requote(&page_json);
+	this->read_command.CopyString(page_json.c_str());
+
+	AccessedCursor last_cursor = cursor;
+	err = pool.GetAccessedPage("test/workspace/root", &cursor, 1, &paths);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(cursor, 0);
+	ASSERT_TRUE(pool.listings.empty());
+
+	err = pool.GetAccessedPage("test/workspace/root", &last_cursor, 1,
+				   &paths);
+	ASSERT_EQ(err.code, kApiError);
+	ASSERT_TRUE(paths.empty());
+}
+
+}  // namespace qfsclient
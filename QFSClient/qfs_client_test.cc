@@ -6,22 +6,29 @@
 
 #include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 #include <gtest/gtest.h>
-#include <jansson.h>
 
+#include <algorithm>
 #include <iostream>
+#include <map>
 #include <vector>
 #include <unordered_map>
 #include <string>
 
 #include "QFSClient/qfs_client.h"
+#include "QFSClient/qfs_client_binary.h"
 #include "QFSClient/qfs_client_implementation.h"
+#include "QFSClient/qfs_client_json.h"
+#include "QFSClient/qfs_client_object.h"
 #include "QFSClient/qfs_client_util.h"
 
 namespace qfsclient {
@@ -194,6 +201,119 @@ TEST_F(QfsClientTest, SendLargeCommandTest) {
 	ASSERT_EQ(memcmp(send.Data(), result.Data(), size), 0);
 }
 
+// A binary response is read to the length in its header, keeping any trailing
+// zeros, in as few reads as possible
+TEST_F(QfsClientTest, SendLargeBinaryCommandTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
+	this->api->protocol = kProtocolBinary;
+
+	std::vector<byte> data(3 * kResponseReadSize + 100);
+	for (size_t i = 0; i < data.size() - 10; i++) {
+		data[i] = i;
+	}
+
+	BinaryWriter writer(kCmdGetBlock, 0);
+	writer.AppendBytes(data);
+	ASSERT_EQ(writer.Finish(), kSuccess);
+
+	CommandBuffer result;
+	err = this->api->SendCommand(writer.Frame(), &result);
+
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(writer.Frame().Size(), result.Size());
+	ASSERT_EQ(memcmp(writer.Frame().Data(), result.Data(), result.Size()), 0);
+}
+
+// With io_uring, a command is submitted along with the read of its response
+TEST_F(QfsClientTest, IoUringSendCommandTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	setenv(kApiIoUringEnvironment, "1", 1);
+	Error err = this->api->TestOpen();
+	unsetenv(kApiIoUringEnvironment);
+	ASSERT_EQ(err.code, kSuccess);
+	if (!this->api->io_uring) {
+		// The kernel doesn't provide io_uring, so commands are sent as usual
+		return;
+	}
+
+	CommandBuffer send;
+	send.CopyString("sausages");
+	CommandBuffer result;
+
+	err = this->api->SendCommand(send, &result);
+
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(send.Size(), result.Size());
+	ASSERT_EQ(memcmp(send.Data(), result.Data(), send.Size()), 0);
+
+	// A large command is written straight away, and the rest of its response
+	// read after the first part
+	std::vector<byte> data(129 * 1024);
+	for (size_t i = 0; i < data.size(); i++) {
+		data[i] = i;
+	}
+	send.Reset();
+	send.Append(data.data(), data.size());
+
+	err = this->api->SendCommand(send, &result);
+
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_TRUE(this->api->queued_commands.empty());
+	ASSERT_EQ(send.Size(), result.Size());
+	ASSERT_EQ(memcmp(send.Data(), result.Data(), send.Size()), 0);
+}
+
+// Small commands wait for the read of the next response, or for the api file to
+// be closed, to be submitted in order
+TEST_F(QfsClientTest, IoUringQueuedCommandsTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	setenv(kApiIoUringEnvironment, "1", 1);
+	Error err = this->api->TestOpen();
+	unsetenv(kApiIoUringEnvironment);
+	ASSERT_EQ(err.code, kSuccess);
+	if (!this->api->io_uring) {
+		return;
+	}
+
+	CommandBuffer first;
+	first.CopyString("first");
+	CommandBuffer second;
+	second.CopyString("second");
+
+	ASSERT_EQ(this->api->WriteCommand(first).code, kSuccess);
+	ASSERT_EQ(this->api->WriteCommand(second).code, kSuccess);
+	ASSERT_EQ(this->api->queued_commands.size(), 2);
+
+	struct stat api_status;
+	ASSERT_EQ(stat(this->api_path.c_str(), &api_status), 0);
+	ASSERT_EQ(api_status.st_size, 0);
+
+	CommandBuffer result;
+	err = this->api->ReadResponse(&result);
+
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_TRUE(this->api->queued_commands.empty());
+	ASSERT_EQ(second.Size(), result.Size());
+	ASSERT_EQ(memcmp(second.Data(), result.Data(), second.Size()), 0);
+
+	ASSERT_EQ(this->api->WriteCommand(first).code, kSuccess);
+	ASSERT_EQ(this->api->queued_commands.size(), 1);
+	this->api->Close();
+	ASSERT_TRUE(this->api->queued_commands.empty());
+
+	std::vector<char> contents(second.Size());
+	int fd = open(this->api_path.c_str(), O_RDONLY);
+	ASSERT_NE(fd, -1);
+	ASSERT_EQ(read(fd, contents.data(), contents.size()), second.Size());
+	close(fd);
+	ASSERT_EQ(memcmp(first.Data(), contents.data(), first.Size()), 0);
+}
+
 TEST_F(QfsClientTest, SendCommandNoFileTest) {
 	ASSERT_FALSE(this->api == NULL);
 
@@ -251,6 +371,135 @@ TEST_F(QfsClientTest, CheckWorkspacePathValidTest) {
 	ASSERT_EQ(err.code, kSuccess);
 }
 
+// FakeApiSocket stands in for the api socket of quantumfsd. It accepts a single
+// connection and answers each frame read from it with the next of its responses.
+struct FakeApiSocket {
+	int listener;
+	std::vector<CommandBuffer> responses;
+	std::vector<CommandBuffer> requests;
+};
+
+static bool WriteFully(int fd, const byte *data, size_t size) {
+	for (size_t written = 0; written < size;) {
+		ssize_t num = write(fd, data + written, size - written);
+		if (num <= 0) {
+			return false;
+		}
+		written += num;
+	}
+	return true;
+}
+
+static void *ServeFakeApiSocket(void *arg) {
+	FakeApiSocket *fake = reinterpret_cast<FakeApiSocket *>(arg);
+
+	int connection = accept(fake->listener, NULL, NULL);
+	if (connection == -1) {
+		return NULL;
+	}
+
+	for (const CommandBuffer &response : fake->responses) {
+		CommandBuffer request;
+		size_t size = kBinaryHeaderSize;
+		for (size_t offset = 0; offset < size;) {
+			request.Resize(size);
+			ssize_t num = read(connection,
+					   request.MutableData() + offset,
+					   size - offset);
+			if (num <= 0) {
+				close(connection);
+				return NULL;
+			}
+			offset += num;
+
+			if (offset == kBinaryHeaderSize &&
+			    !BinaryFrameSize(request, &size)) {
+				close(connection);
+				return NULL;
+			}
+		}
+		fake->requests.push_back(request);
+
+		// The header and payload arrive separately, as they may from
+		// quantumfsd
+		if (!WriteFully(connection, response.Data(), kBinaryHeaderSize) ||
+		    !WriteFully(connection, response.Data() + kBinaryHeaderSize,
+				response.Size() - kBinaryHeaderSize)) {
+			break;
+		}
+	}
+
+	close(connection);
+	return NULL;
+}
+
+// Commands are sent over the api socket named by the environment as binary frames,
+// without negotiating the protocol, and each response is read to its full length.
+TEST_F(QfsClientTest, SocketTest) {
+	std::string socket_path = this->tmp_root_dir + "/api.sock";
+
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	ASSERT_LT(socket_path.length(), sizeof(address.sun_path));
+	memcpy(address.sun_path, socket_path.c_str(), socket_path.length());
+
+	FakeApiSocket fake;
+	fake.listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	ASSERT_NE(fake.listener, -1);
+	ASSERT_EQ(bind(fake.listener, reinterpret_cast<struct sockaddr *>(&address),
+		       sizeof(address)), 0);
+	ASSERT_EQ(listen(fake.listener, 1), 0);
+
+	BinaryWriter ok(kCmdError, 0);
+	ok.AppendUint32(kCmdOk);
+	ok.AppendString("success");
+	ASSERT_EQ(ok.Finish(), kSuccess);
+	fake.responses.push_back(ok.Frame());
+
+	// larger than a single read of the api file
+	std::vector<byte> data(3 * kResponseReadSize + 100, 'q');
+	BinaryWriter block(kCmdError, 0);
+	block.AppendUint32(kCmdOk);
+	block.AppendString("success");
+	block.AppendBytes(data);
+	ASSERT_EQ(block.Finish(), kSuccess);
+	fake.responses.push_back(block.Frame());
+
+	pthread_t server;
+	ASSERT_EQ(pthread_create(&server, NULL, ServeFakeApiSocket, &fake), 0);
+
+	Api *api;
+	Error err = GetApi(&api);
+	ASSERT_EQ(err.code, kSuccess);
+
+	// The socket is looked for when the first command is sent
+	setenv(kApiSocketEnvironment, socket_path.c_str(), 1);
+	err = api->Branch("test/source/workspace", "test/destination/workspace");
+	unsetenv(kApiSocketEnvironment);
+	ASSERT_EQ(err.code, kSuccess);
+
+	std::vector<byte> key = { 1, 2, 3 };
+	std::vector<byte> read_data;
+	err = api->GetBlock(key, &read_data);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(read_data, data);
+
+	ReleaseApi(api);
+	pthread_join(server, NULL);
+	close(fake.listener);
+
+	BinaryWriter branch(kCmdBranchRequest, 0);
+	branch.AppendString("test/source/workspace");
+	branch.AppendString("test/destination/workspace");
+	ASSERT_EQ(branch.Finish(), kSuccess);
+
+	ASSERT_EQ(fake.requests.size(), 2);
+	ASSERT_EQ(fake.requests[0].Size(), branch.Frame().Size());
+	ASSERT_EQ(memcmp(fake.requests[0].Data(), branch.Frame().Data(),
+			 branch.Frame().Size()), 0);
+}
+
 void QfsClientApiTest::SetUp() {
 	QfsClientTest::SetUp();
 
@@ -275,6 +524,7 @@ void QfsClientApiTest::TearDown() {
 	this->expected_written_command.Reset();
 	this->actual_written_command.Reset();
 	this->read_command.Reset();
+	this->queued_read_commands.clear();
 }
 
 Error QfsClientApiTest::PostWriteHook() {
@@ -291,6 +541,12 @@ Error QfsClientApiTest::PostWriteHook() {
 }
 
 Error QfsClientApiTest::PreReadHook(CommandBuffer *read_result) {
+	if (!this->queued_read_commands.empty()) {
+		read_result->Copy(this->queued_read_commands.front());
+		this->queued_read_commands.pop_front();
+		return util::getError(kSuccess);
+	}
+
 	// copy what's in this->read_command to the supplied command
 	read_result->Copy(this->read_command);
 
@@ -331,6 +587,132 @@ TEST_F(QfsClientApiTest, GetAccessedTest) {
 			 this->actual_written_command.Size()), 0);
 }
 
+// This test covers ApiImpl::GetAccessedPage() and
+// ApiImpl::PrepareAccessedPageResponse()
+TEST_F(QfsClientApiTest, GetAccessedPageTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
+
+	std::string expected_written_command_json =
+		"{'CommandId':16,'Cursor':4294967298,'PageSize':2,"
+		"'WorkspaceRoot':'test/workspace/root'}";
+	util::requote(&expected_written_command_json);
+	this->expected_written_command.CopyString(
+	       expected_written_command_json.c_str());
+
+	std::string read_command_json =
+		"{'CommandId':1,'ErrorCode':0,'Message':'',"
+		"'NextCursor':4294967300,"
+		"'Paths':[{'Flags':2,'Path':'/a'},{'Flags':12,'Path':'/b'}]}";
+	util::requote(&read_command_json);
+	this->read_command.CopyString(read_command_json.c_str());
+
+	AccessedCursor cursor = 4294967298;
+	std::vector<PathAccessed> paths = { { "/stale", kPathRead } };
+	err = this->api->GetAccessedPage("test/workspace/root", &cursor, 2,
+					 &paths);
+	ASSERT_EQ(err.code, kSuccess);
+
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+
+	ASSERT_EQ(cursor, 4294967300);
+	ASSERT_EQ(paths.size(), 2);
+	ASSERT_EQ(paths[0].path, "/a");
+	ASSERT_EQ(paths[0].flags, kPathRead);
+	ASSERT_EQ(paths[1].path, "/b");
+	ASSERT_EQ(paths[1].flags, kPathUpdated|kPathDeleted);
+
+	// the last page of an empty list has no paths
+	read_command_json = "{'CommandId':1,'ErrorCode':0,'Message':'',"
+			    "'NextCursor':0,'Paths':null}";
+	util::requote(&read_command_json);
+	this->read_command.CopyString(read_command_json.c_str());
+
+	err = this->api->GetAccessedPage("test/workspace/root", &cursor, 2,
+					 &paths);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(cursor, 0);
+	ASSERT_TRUE(paths.empty());
+
+	// a malformed page is rejected
+	read_command_json = "{'CommandId':1,'ErrorCode':0,'Message':'',"
+			    "'NextCursor':0,'Paths':[{'Path':'/a'}]}";
+	util::requote(&read_command_json);
+	this->read_command.CopyString(read_command_json.c_str());
+
+	err = this->api->GetAccessedPage("test/workspace/root", &cursor, 2,
+					 &paths);
+	ASSERT_EQ(err.code, kJsonObjectWrongType);
+}
+
+// Test that AccessedIterator visits every page of a listing in turn
+TEST_F(QfsClientApiTest, AccessedIteratorTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
+
+	std::vector<std::string> pages = {
+		"{'ErrorCode':0,'Message':'','NextCursor':4294967298,"
+		"'Paths':[{'Flags':2,'Path':'/a'},{'Flags':2,'Path':'/b'}]}",
+		"{'ErrorCode':0,'Message':'','NextCursor':4294967300,"
+		"'Paths':[{'Flags':1,'Path':'/c'},{'Flags':1,'Path':'/d'}]}",
+	};
+	for (auto &page : pages) {
+		util::requote(&page);
+		CommandBuffer response;
+		response.CopyString(page.c_str());
+		this->queued_read_commands.push_back(response);
+	}
+
+	std::string last_page = "{'ErrorCode':0,'Message':'','NextCursor':0,"
+				"'Paths':[{'Flags':4,'Path':'/e'}]}";
+	util::requote(&last_page);
+	this->read_command.CopyString(last_page.c_str());
+
+	AccessedIterator accessed(this->api, "test/workspace/root", 2);
+	std::vector<PathAccessed> batch;
+	std::vector<std::string> visited;
+	size_t batches = 0;
+	while (accessed.Next(&batch)) {
+		ASSERT_LE(batch.size(), 2);
+		for (const auto &entry : batch) {
+			visited.push_back(entry.path);
+		}
+		batches++;
+	}
+	ASSERT_EQ(accessed.LastError().code, kSuccess);
+	ASSERT_TRUE(batch.empty());
+	ASSERT_EQ(batches, 3);
+	ASSERT_EQ(visited, std::vector<std::string>({ "/a", "/b", "/c", "/d",
+						      "/e" }));
+
+	// the last page was requested with the cursor from the one before it
+	std::string expected_written_command_json =
+		"{'CommandId':16,'Cursor':4294967300,'PageSize':2,"
+		"'WorkspaceRoot':'test/workspace/root'}";
+	util::requote(&expected_written_command_json);
+	ASSERT_EQ(std::string((const char *)this->actual_written_command.Data(),
+			      this->actual_written_command.Size()),
+		  expected_written_command_json);
+
+	// an error ends the iteration
+	std::string failed = "{'ErrorCode':1,'Message':'bad cursor'}";
+	util::requote(&failed);
+	this->read_command.CopyString(failed.c_str());
+
+	AccessedIterator failing(this->api, "test/workspace/root", 0);
+	ASSERT_FALSE(failing.Next(&batch));
+	ASSERT_EQ(failing.LastError().code, kApiError);
+	ASSERT_FALSE(failing.Next(&batch));
+}
+
 // This test covers ApiImpl::InsertInode().
 TEST_F(QfsClientApiTest, InsertInodeTest) {
 	ASSERT_FALSE(this->api == NULL);
@@ -505,148 +887,2045 @@ TEST_F(QfsClientApiTest, GetBlockTest) {
 	ASSERT_EQ(memcmp(data.data(), "lookbehindyou", data.size()), 0);
 }
 
-// Test ApiImpl::SendJson(), which is shared by all API handlers
-TEST_F(QfsClientApiTest, SendJsonTest) {
+// This test covers ApiImpl::GetBlockInto() and ApiImpl::StatBlock()
+TEST_F(QfsClientApiTest, GetBlockIntoTest) {
 	ASSERT_FALSE(this->api == NULL);
 
 	Error err = this->api->TestOpen();
 	ASSERT_EQ(err.code, kSuccess);
 
-	// create JSON for request
-	json_error_t json_error;
-	json_t *request_json = json_pack_ex(&json_error, 0,
-					    kGetAccessedJSON,
-					    "CommandId", kCmdGetAccessed,
-					    "WorkspaceRoot", "one/two/three");
-	ASSERT_FALSE(request_json == NULL);
+	std::vector<byte> key;
+	const char *key_value = "somearbitrarykeyvalue03423278";
+	key.assign(key_value, key_value + strlen(key_value));
 
-	// create expected JSON string to have been written
 	std::string expected_written_command_json =
-		"{'CommandId':3,'WorkspaceRoot':'one/two/three'}";
+	"{'CommandId':9,'Key':'c29tZWFyYml0cmFyeWtleXZhbHVlMDM0MjMyNzg='}";
 	util::requote(&expected_written_command_json);
 	this->expected_written_command.CopyString(
-	       expected_written_command_json.c_str());
+		expected_written_command_json.c_str());
+
+	std::string read_command_json =
+	"{'Data':'bG9va2JlaGluZHlvdQ==','ErrorCode':0,'Message':'success'}";
+	util::requote(&read_command_json);
+	this->read_command.CopyString(read_command_json.c_str());
 
-	ApiContext context;
-	context.SetRequestJsonObject(request_json);
-	err = this->api->SendJson(&context);
+	// the block is decoded straight into a buffer just big enough for it
+	std::vector<byte> data(strlen("lookbehindyou"));
+	size_t written = 0;
+	err = this->api->GetBlockInto(key.data(), key.size(), data.data(),
+				      data.size(), &written);
 	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(written, data.size());
+	ASSERT_EQ(memcmp(data.data(), "lookbehindyou", data.size()), 0);
 
-	// compare what the API function actually wrote with what we expected
 	ASSERT_EQ(this->actual_written_command.Size(),
 		  this->expected_written_command.Size());
 	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
 			 this->expected_written_command.Data(),
 			 this->actual_written_command.Size()), 0);
-}
 
-// Test ApiImpl::CheckCommonApiResponse(), which is shared by all API handlers
-TEST_F(QfsClientApiTest, CheckCommonApiResponseTest) {
-	ASSERT_FALSE(this->api == NULL);
+	// but not into one too small, which is told the size it needs
+	data.assign(data.size() - 1, 0);
+	err = this->api->GetBlockInto(key.data(), key.size(), data.data(),
+				      data.size(), &written);
+	ASSERT_EQ(err.code, kBufferTooSmall);
+	ASSERT_EQ(written, data.size() + 1);
+	ASSERT_EQ(data, std::vector<byte>(data.size(), 0));
+
+	expected_written_command_json =
+	"{'CommandId':21,'Key':'c29tZWFyYml0cmFyeWtleXZhbHVlMDM0MjMyNzg='}";
+	util::requote(&expected_written_command_json);
+	this->expected_written_command.CopyString(
+		expected_written_command_json.c_str());
+
+	read_command_json = "{'ErrorCode':0,'Message':'success','Size':13}";
+	util::requote(&read_command_json);
+	this->read_command.CopyString(read_command_json.c_str());
 
-	ApiContext context;
-	Error err = this->api->CheckCommonApiResponse(this->read_command, &context);
+	size_t size = 0;
+	err = this->api->StatBlock(key, &size);
 	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(size, 13);
+
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
 }
 
-// Negative test for ApiImpl::CheckCommonApiResponse(), which should trigger a JSON
-// parse error
-TEST_F(QfsClientApiTest, CheckCommonApiResponseBadJsonTest) {
+// This test covers ApiImpl::HasBlocks()
+TEST_F(QfsClientApiTest, HasBlocksTest) {
 	ASSERT_FALSE(this->api == NULL);
 
-	CommandBuffer test_response;
-
-	// corrupt the JSON that CheckCommonApiResponse will try to parse
-	ASSERT_GT(this->read_command.Size(), 0);  // fail if no JSON
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
 
-	this->read_command.data.resize(this->read_command.Size() / 2);
-	this->read_command.data[read_command.Size()] = '\0';
+	std::vector<std::vector<byte>> keys = { { 'k', 'e', 'y', '1' },
+						{ 'k', 'e', 'y', '2' } };
 
-	ApiContext context;
-	Error err = this->api->CheckCommonApiResponse(this->read_command, &context);
-	ASSERT_EQ(err.code, kJsonDecodingError);
-}
+	std::string expected_written_command_json =
+		"{'CommandId':22,'Keys':['a2V5MQ==','a2V5Mg==']}";
+	util::requote(&expected_written_command_json);
+	this->expected_written_command.CopyString(
+		expected_written_command_json.c_str());
 
-// Negative test for ApiImpl::CheckCommonApiResponse(), which should trigger a
-// missing JSON object
-TEST_F(QfsClientApiTest, CheckCommonApiMissingJsonObjectTest) {
-	ASSERT_FALSE(this->api == NULL);
+	std::string read_command_json =
+		"{'ErrorCode':0,'Message':'','Present':[false,true]}";
+	util::requote(&read_command_json);
+	this->read_command.CopyString(read_command_json.c_str());
 
-	CommandBuffer test_response;
+	std::vector<bool> present;
+	err = this->api->HasBlocks(keys, &present);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(present, std::vector<bool>({ false, true }));
 
-	// corrupt ErrorCode in the JSON that CheckCommonApiResponse will try
-	// to parse
-	char *error_code_loc = strstr(reinterpret_cast<char*>(const_cast<byte*>(
-	                                this->read_command.Data())), kErrorCode);
-	ASSERT_TRUE(error_code_loc != NULL);  // fail if no ErrorCode field
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
 
-	if (error_code_loc != NULL) {
-		error_code_loc[1] = 'Q';
-	}
+	// an answer for each key is expected
+	read_command_json = "{'ErrorCode':0,'Message':'','Present':[false]}";
+	util::requote(&read_command_json);
+	this->read_command.CopyString(read_command_json.c_str());
 
-	ApiContext context;
-	Error err = this->api->CheckCommonApiResponse(this->read_command, &context);
-	ASSERT_EQ(err.code, kMissingJsonObject);
+	err = this->api->HasBlocks(keys, &present);
+	ASSERT_EQ(err.code, kJsonObjectWrongType);
+	ASSERT_TRUE(present.empty());
 }
 
-TEST_F(QfsClientApiTest, PrepareAccessedListResponseTest) {
+// This test covers ApiImpl::Prefetch() using JSON, which is only used with
+// quantumfsd versions that don't pipeline commands, so the response is read and
+// ignored
+TEST_F(QfsClientApiTest, PrefetchTest) {
 	ASSERT_FALSE(this->api == NULL);
 
-	PathsAccessed accessed_list;
-
-	ApiContext context;
-	Error err = this->api->CheckCommonApiResponse(this->read_command, &context);
+	Error err = this->api->TestOpen();
 	ASSERT_EQ(err.code, kSuccess);
 
-	err = this->api->PrepareAccessedListResponse(&context, &accessed_list);
-	ASSERT_EQ(err.code, kSuccess);
+	std::vector<std::vector<byte>> keys = { { 'k', 'e', 'y', '1' } };
+	std::vector<std::string> extended_keys = { "extended" };
 
-	ASSERT_EQ(3, accessed_list.paths.size());
-	ASSERT_EQ(qfsclient::kPathUpdated, accessed_list.paths.at("file1"));
-	ASSERT_EQ(qfsclient::kPathUpdated|qfsclient::kPathCreated,
-		  accessed_list.paths.at("file2"));
-	ASSERT_EQ(qfsclient::kPathUpdated|qfsclient::kPathDeleted,
-		  accessed_list.paths.at("file3"));
-}
+	std::string expected_written_command_json =
+		"{'CommandId':23,'ExtendedKeys':['extended'],"
+		"'Keys':['a2V5MQ==']}";
+	util::requote(&expected_written_command_json);
+	this->expected_written_command.CopyString(
+		expected_written_command_json.c_str());
 
-// Negative test for ApiImpl::PrepareAccessedListResponse() to check that a missing
-// AccessList triggers a kMissingJSONObject error
-TEST_F(QfsClientApiTest, PrepareAccessedListResponseNoAccessListTest) {
-	ASSERT_FALSE(this->api == NULL);
+	// quantumfsd which doesn't know the command refuses it
+	std::string response_json = "{'ErrorCode':3,'Message':'unknown command'}";
+	util::requote(&response_json);
+	this->queued_read_commands.emplace_back();
+	this->queued_read_commands.back().CopyString(response_json.c_str());
 
-	PathsAccessed accessed_list;
+	err = this->api->Prefetch(keys, extended_keys);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_TRUE(this->queued_read_commands.empty());
 
-	// corrupt AccessList in the JSON that CheckCommonApiResponse will try
-	// to parse
-	char *access_list_loc = strstr(reinterpret_cast<char*>(const_cast<byte*>(
-	                                 this->read_command.Data())), kPathList);
-	ASSERT_TRUE(access_list_loc != NULL);  // fail if no AccessList field
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
 
-	if (access_list_loc != NULL) {
-		access_list_loc[1] = 'Q';
-	}
+	// the next command reads its own response
+	response_json = "{'Data':'YWJj','ErrorCode':0,'Message':'success'}";
+	util::requote(&response_json);
+	this->read_command.CopyString(response_json.c_str());
 
-	ApiContext context;
-	Error err = this->api->CheckCommonApiResponse(this->read_command, &context);
+	std::vector<byte> read_data;
+	err = this->api->GetBlock(keys[0], &read_data);
 	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(read_data, std::vector<byte>({ 'a', 'b', 'c' }));
 
-	err = this->api->PrepareAccessedListResponse(&context, &accessed_list);
-	ASSERT_EQ(err.code, kMissingJsonObject);
+	// there is nothing to send for no keys
+	err = this->api->Prefetch({}, {});
+	ASSERT_EQ(err.code, kSuccess);
 }
 
-void QfsClientDeterminePathTest::SetUp() {
-	QfsClientTest::SetUp();
+// This test covers ApiImpl::InsertInodes(), which sends many inodes in one request
+TEST_F(QfsClientApiTest, InsertInodesTest) {
+	ASSERT_FALSE(this->api == NULL);
 
-	std::string dummy_api_file_location = this->tree.substr(
-	    0, this->tree.find("four"));
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
 
-	dummy_api_file_location.append(kApiPath);
+	std::vector<InsertInodeEntry> inodes = {
+		{ "a/b/c/d", "key1", 0644, 1, 2 },
+		{ "bad", "key2", 0644, 1, 2 },
+		{ "a/b/c/e", "key3", 0600, 3, 4 },
+	};
 
-	int fd = creat(dummy_api_file_location.c_str(), S_IRWXU);
-	if (fd == -1) {
-		util::fperror(__func__, "creat()");
-		return;
-	}
+	std::string expected_written_command_json =
+		"{'CommandId':24,'Inodes':["
+		"{'DstPath':'a/b/c/d','Gid':2,'Key':'key1','Permissions':420,"
+		"'Uid':1},"
+		"{'DstPath':'a/b/c/e','Gid':4,'Key':'key3','Permissions':384,"
+		"'Uid':3}]}";
+	util::requote(&expected_written_command_json);
+	this->expected_written_command.CopyString(
+		expected_written_command_json.c_str());
+
+	std::string read_command_json =
+		"{'ErrorCode':0,'Message':'','Results':["
+		"{'CommandId':1,'ErrorCode':0,'Message':'','RequestId':0},"
+		"{'CommandId':1,'ErrorCode':5,'Message':'missing','RequestId':0}"
+		"]}";
+	util::requote(&read_command_json);
+	this->read_command.CopyString(read_command_json.c_str());
+
+	std::vector<Error> results;
+	err = this->api->InsertInodes(inodes, &results);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(results.size(), 3);
+	ASSERT_EQ(results[0].code, kSuccess);
+	// the invalid path isn't sent at all
+	ASSERT_EQ(results[1].code, kWorkspacePathInvalid);
+	ASSERT_EQ(results[2].code, kApiError);
+
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+
+	// a result is expected for each inode sent
+	read_command_json = "{'ErrorCode':0,'Message':'','Results':[]}";
+	util::requote(&read_command_json);
+	this->read_command.CopyString(read_command_json.c_str());
+
+	err = this->api->InsertInodes(inodes, &results);
+	ASSERT_EQ(err.code, kJsonObjectWrongType);
+	ASSERT_EQ(results[0].code, kJsonObjectWrongType);
+	ASSERT_EQ(results[1].code, kWorkspacePathInvalid);
+}
+
+// This test covers GetBlock() calls answered by the block cache
+TEST_F(QfsClientApiTest, BlockCacheTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
+
+	err = this->api->EnableBlockCache(1024);
+	ASSERT_EQ(err.code, kSuccess);
+
+	std::string read_command_json =
+	"{'Data':'bG9va2JlaGluZHlvdQ==','ErrorCode':0,'Message':'success'}";
+	util::requote(&read_command_json);
+	this->read_command.CopyString(read_command_json.c_str());
+
+	std::vector<byte> key = { 1, 2, 3 };
+	std::vector<byte> data;
+	err = this->api->GetBlock(key, &data);
+	ASSERT_EQ(err.code, kSuccess);
+	const char *expected = "lookbehindyou";
+	ASSERT_EQ(data, std::vector<byte>(expected, expected + strlen(expected)));
+
+	// quantumfsd would now fail the call, but it is never asked
+	std::string failure_json =
+		"{'ErrorCode':5,'Message':'no such key'}";
+	util::requote(&failure_json);
+	this->read_command.CopyString(failure_json.c_str());
+	this->actual_written_command.Reset();
+
+	std::vector<byte> cached_data;
+	err = this->api->GetBlock(key.data(), key.size(), &cached_data);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(cached_data, data);
+	ASSERT_EQ(this->actual_written_command.Size(), 0);
+
+	BlockCacheStats stats = this->api->GetBlockCacheStats();
+	ASSERT_EQ(stats.hits, 1);
+	ASSERT_EQ(stats.misses, 1);
+	ASSERT_EQ(stats.blocks, 1);
+	ASSERT_EQ(stats.bytes, key.size() + data.size());
+
+	// A failed call isn't cached
+	std::vector<byte> other_key = { 4 };
+	err = this->api->GetBlock(other_key, &data);
+	ASSERT_EQ(err.code, kApiError);
+	ASSERT_EQ(this->api->GetBlockCacheStats().blocks, 1);
+
+	// quantumfsd doesn't check that a key matches its block, so storing the
+	// key again drops it from the cache
+	std::string ok_json = "{'ErrorCode':0,'Message':'success'}";
+	util::requote(&ok_json);
+	this->read_command.CopyString(ok_json.c_str());
+
+	std::vector<byte> new_data = { 'a', 'b', 'c' };
+	err = this->api->SetBlock(key, new_data);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(this->api->GetBlockCacheStats().blocks, 0);
+
+	std::string new_data_json =
+		"{'Data':'YWJj','ErrorCode':0,'Message':'success'}";
+	util::requote(&new_data_json);
+	this->read_command.CopyString(new_data_json.c_str());
+
+	err = this->api->GetBlock(key, &data);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(data, new_data);
+
+	this->read_command.CopyString(failure_json.c_str());
+	err = this->api->EnableBlockCache(0);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(this->api->GetBlockCacheStats().hits, 0);
+
+	err = this->api->GetBlock(key, &data);
+	ASSERT_EQ(err.code, kApiError);
+}
+
+// Test ApiImpl::SendJson(), which is shared by all API handlers
+TEST_F(QfsClientApiTest, SendJsonTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
+
+	// create JSON for request
+	CommandBuffer request;
+	JsonWriter writer(&request);
+	writer.AppendInt(kCommandId, kCmdGetAccessed);
+	writer.AppendString(kWorkspaceRoot, "one/two/three");
+
+	// create expected JSON string to have been written
+	std::string expected_written_command_json =
+		"{'CommandId':3,'WorkspaceRoot':'one/two/three'}";
+	util::requote(&expected_written_command_json);
+	this->expected_written_command.CopyString(
+	       expected_written_command_json.c_str());
+
+	CommandBuffer response;
+	JsonReader reader;
+	err = this->api->SendJson(&writer, &response, &reader);
+	ASSERT_EQ(err.code, kSuccess);
+
+	// compare what the API function actually wrote with what we expected
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+}
+
+// Test ApiImpl::CheckCommonApiResponse(), which is shared by all API handlers
+TEST_F(QfsClientApiTest, CheckCommonApiResponseTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	JsonReader reader;
+	Error err = this->api->CheckCommonApiResponse(this->read_command, &reader);
+	ASSERT_EQ(err.code, kSuccess);
+}
+
+// Negative test for ApiImpl::CheckCommonApiResponse(), which should trigger a JSON
+// parse error
+TEST_F(QfsClientApiTest, CheckCommonApiResponseBadJsonTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	CommandBuffer test_response;
+
+	// corrupt the JSON that CheckCommonApiResponse will try to parse
+	ASSERT_GT(this->read_command.Size(), 0);  // fail if no JSON
+
+	this->read_command.data.resize(this->read_command.Size() / 2);
+	this->read_command.data[read_command.Size()] = '\0';
+
+	JsonReader reader;
+	Error err = this->api->CheckCommonApiResponse(this->read_command, &reader);
+	ASSERT_EQ(err.code, kJsonDecodingError);
+}
+
+// Negative test for ApiImpl::CheckCommonApiResponse(), which should trigger a
+// missing JSON object
+TEST_F(QfsClientApiTest, CheckCommonApiMissingJsonObjectTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	CommandBuffer test_response;
+
+	// corrupt ErrorCode in the JSON that CheckCommonApiResponse will try
+	// to parse
+	char *error_code_loc = strstr(reinterpret_cast<char*>(const_cast<byte*>(
+	                                this->read_command.Data())), kErrorCode);
+	ASSERT_TRUE(error_code_loc != NULL);  // fail if no ErrorCode field
+
+	if (error_code_loc != NULL) {
+		error_code_loc[1] = 'Q';
+	}
+
+	JsonReader reader;
+	Error err = this->api->CheckCommonApiResponse(this->read_command, &reader);
+	ASSERT_EQ(err.code, kMissingJsonObject);
+}
+
+TEST_F(QfsClientApiTest, PrepareAccessedListResponseTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	PathsAccessed accessed_list;
+
+	JsonReader reader;
+	Error err = this->api->CheckCommonApiResponse(this->read_command, &reader);
+	ASSERT_EQ(err.code, kSuccess);
+
+	err = this->api->PrepareAccessedListResponse(&reader, &accessed_list);
+	ASSERT_EQ(err.code, kSuccess);
+
+	ASSERT_EQ(3, accessed_list.paths.size());
+	ASSERT_EQ(qfsclient::kPathUpdated, accessed_list.paths.at("file1"));
+	ASSERT_EQ(qfsclient::kPathUpdated|qfsclient::kPathCreated,
+		  accessed_list.paths.at("file2"));
+	ASSERT_EQ(qfsclient::kPathUpdated|qfsclient::kPathDeleted,
+		  accessed_list.paths.at("file3"));
+}
+
+// Negative test for ApiImpl::PrepareAccessedListResponse() to check that a missing
+// AccessList triggers a kMissingJSONObject error
+TEST_F(QfsClientApiTest, PrepareAccessedListResponseNoAccessListTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	PathsAccessed accessed_list;
+
+	// corrupt AccessList in the JSON that CheckCommonApiResponse will try
+	// to parse
+	char *access_list_loc = strstr(reinterpret_cast<char*>(const_cast<byte*>(
+	                                 this->read_command.Data())), kPathList);
+	ASSERT_TRUE(access_list_loc != NULL);  // fail if no AccessList field
+
+	if (access_list_loc != NULL) {
+		access_list_loc[1] = 'Q';
+	}
+
+	JsonReader reader;
+	Error err = this->api->CheckCommonApiResponse(this->read_command, &reader);
+	ASSERT_EQ(err.code, kSuccess);
+
+	err = this->api->PrepareAccessedListResponse(&reader, &accessed_list);
+	ASSERT_EQ(err.code, kMissingJsonObject);
+}
+
+// Build a binary response with the fields of ErrorResponse followed by whatever
+// the caller appends to the writer
+static void StartBinaryResponse(BinaryWriter *writer,
+				CommandError code,
+				const char *message) {
+	writer->AppendUint32(code);
+	writer->AppendString(message);
+}
+
+static void CopyFrame(BinaryWriter *writer, CommandBuffer *frame) {
+	ASSERT_EQ(writer->Finish(), kSuccess);
+	frame->Copy(writer->Frame());
+}
+
+// The end of the first format in the given BinaryField format
+static const char *SkipBinaryFormat(const char *format) {
+	switch (*format++) {
+	case '[':
+		return SkipBinaryFormat(format);
+	case '{':
+		return SkipBinaryFormat(SkipBinaryFormat(format));
+	case '(':
+		while (*format != ')') {
+			format = SkipBinaryFormat(format);
+		}
+		return format + 1;
+	default:
+		return format;
+	}
+}
+
+// Read a value of the first format in the given BinaryField format, advancing the
+// format past it. Integers are given in decimal, strings and bytes as they are and
+// the elements of slices, maps and structures between brackets.
+static bool ReadBinaryValue(BinaryReader *reader, const char **format,
+			    std::string *value) {
+	char kind = **format;
+	const char *inner_format = *format + 1;
+	const char *end = SkipBinaryFormat(*format);
+	*format = end;
+
+	switch (kind) {
+	case 'I': {
+		uint32_t number;
+		if (!reader->ReadUint32(&number)) {
+			return false;
+		}
+		*value = std::to_string(number);
+		return true;
+	}
+	case 'L': {
+		uint64_t number;
+		if (!reader->ReadUint64(&number)) {
+			return false;
+		}
+		*value = std::to_string(number);
+		return true;
+	}
+	case 'B': {
+		bool flag;
+		if (!reader->ReadBool(&flag)) {
+			return false;
+		}
+		*value = flag ? "true" : "false";
+		return true;
+	}
+	case 'S':
+		return reader->ReadString(value);
+	case '[':
+	case '{':
+	case '(': {
+		// A structure is its fields, the others a count of elements, each of
+		// which is a key and a value for a map
+		uint32_t count = 1;
+		if (kind == '(') {
+			end--;
+		} else if (!reader->ReadUint32(&count)) {
+			return false;
+		}
+
+		*value = kind;
+		bool first = true;
+		for (uint32_t i = 0; i < count; i++) {
+			for (const char *f = inner_format; f != end;) {
+				std::string inner;
+				if (!ReadBinaryValue(reader, &f, &inner)) {
+					return false;
+				}
+				*value += (first ? "" : ",") + inner;
+				first = false;
+			}
+		}
+		*value += kind == '[' ? ']' : kind == '{' ? '}' : ')';
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+// Check that the frame holds exactly the fields of an api structure as generated
+// from quantumfs/cmds.go, setting values to the value of each by name. This keeps
+// the hand written encoders and decoders in step with quantumfsd.
+static void ReadBinaryFields(const CommandBuffer &frame,
+			     const BinaryField *fields,
+			     std::map<std::string, std::string> *values) {
+	BinaryReader reader;
+	ASSERT_EQ(reader.Open(frame).code, kSuccess);
+
+	values->clear();
+	for (; fields->name != NULL; fields++) {
+		const char *format = fields->format;
+		std::string value;
+		ASSERT_TRUE(ReadBinaryValue(&reader, &format, &value))
+			<< "field " << fields->name;
+		ASSERT_EQ(*format, '\0') << "field " << fields->name;
+		(*values)[fields->name] = value;
+	}
+	ASSERT_EQ(reader.Remaining(), 0);
+}
+
+// Test ApiImpl::CheckBinaryApiResponse(), which is shared by all API handlers when
+// using the binary protocol
+TEST_F(QfsClientApiTest, CheckBinaryApiResponseTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	BinaryWriter ok(kCmdError, 0);
+	StartBinaryResponse(&ok, kCmdOk, "success");
+	CommandBuffer response;
+	CopyFrame(&ok, &response);
+
+	BinaryReader reader;
+	Error err = this->api->CheckBinaryApiResponse(response, &reader);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(reader.Remaining(), 0);
+
+	// errors from quantumfsd are returned like they are for JSON
+	BinaryWriter failed(kCmdError, 0);
+	StartBinaryResponse(&failed, kCmdBadArgs, "some random bad thing");
+	CopyFrame(&failed, &response);
+
+	err = this->api->CheckBinaryApiResponse(response, &reader);
+	ASSERT_EQ(err.code, kApiError);
+	ASSERT_EQ(err.message, "the API returned an error: the argument is "
+			       "wrong (some random bad thing)");
+
+	// a response cut short within the common fields
+	BinaryWriter truncated(kCmdError, 0);
+	truncated.AppendUint32(kCmdOk);
+	CopyFrame(&truncated, &response);
+
+	err = this->api->CheckBinaryApiResponse(response, &reader);
+	ASSERT_EQ(err.code, kMissingJsonObject);
+
+	// a JSON response can't be mistaken for a binary one
+	err = this->api->CheckBinaryApiResponse(this->read_command, &reader);
+	ASSERT_EQ(err.code, kJsonDecodingError);
+}
+
+// This test covers the binary encoding of the commands which only expect the
+// common response fields back
+TEST_F(QfsClientApiTest, BinaryCommandsTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
+	this->api->protocol = kProtocolBinary;
+
+	BinaryWriter response(kCmdError, 0);
+	StartBinaryResponse(&response, kCmdOk, "success");
+	CopyFrame(&response, &this->read_command);
+
+	// The test api file isn't truncated between commands, so send the shorter
+	// command first
+	BinaryWriter branch(kCmdBranchRequest, 0);
+	branch.AppendString("test/source/workspace");
+	branch.AppendString("test/destination/workspace");
+	CopyFrame(&branch, &this->expected_written_command);
+
+	err = this->api->Branch("test/source/workspace",
+				"test/destination/workspace");
+	ASSERT_EQ(err.code, kSuccess);
+
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+
+	std::map<std::string, std::string> fields;
+	ReadBinaryFields(this->actual_written_command, kBranchRequestFields,
+			 &fields);
+	ASSERT_EQ(fields[kCommandId], std::to_string(kCmdBranchRequest));
+	ASSERT_EQ(fields[kSrc], "test/source/workspace");
+	ASSERT_EQ(fields[kDst], "test/destination/workspace");
+
+	BinaryWriter insert_inode(kCmdInsertInode, 0);
+	insert_inode.AppendString("/path/to/some/place/");
+	insert_inode.AppendString("thisisadummyextendedkey01234567890123456");
+	insert_inode.AppendUint32(2001);
+	insert_inode.AppendUint32(3001);
+	insert_inode.AppendUint32(0765);
+	CopyFrame(&insert_inode, &this->expected_written_command);
+
+	err = this->api->InsertInode("/path/to/some/place/",
+				     "thisisadummyextendedkey01234567890123456",
+				     0765, 2001, 3001);
+	ASSERT_EQ(err.code, kSuccess);
+
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+
+	ReadBinaryFields(this->actual_written_command, kInsertInodeRequestFields,
+			 &fields);
+	ASSERT_EQ(fields[kCommandId], std::to_string(kCmdInsertInode));
+	ASSERT_EQ(fields[kDstPath], "/path/to/some/place/");
+	ASSERT_EQ(fields[kKey], "thisisadummyextendedkey01234567890123456");
+	ASSERT_EQ(fields[kUid], "2001");
+	ASSERT_EQ(fields[kGid], "3001");
+	ASSERT_EQ(fields[kPermissions], std::to_string(0765));
+}
+
+// This test covers ApiImpl::GetAccessed() using the binary protocol
+TEST_F(QfsClientApiTest, BinaryGetAccessedTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
+	this->api->protocol = kProtocolBinary;
+
+	BinaryWriter response(kCmdError, 0);
+	StartBinaryResponse(&response, kCmdOk, "success");
+	response.AppendUint32(2);
+	response.AppendString("file1");
+	response.AppendUint64(kPathUpdated);
+	response.AppendString("dir1");
+	response.AppendUint64(kPathCreated|kPathIsDir);
+	CopyFrame(&response, &this->read_command);
+
+	BinaryWriter request(kCmdGetAccessed, 0);
+	request.AppendString("test/workspace/root");
+	CopyFrame(&request, &this->expected_written_command);
+
+	PathsAccessed paths;
+	err = this->api->GetAccessed("test/workspace/root", &paths);
+	ASSERT_EQ(err.code, kSuccess);
+
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+
+	ASSERT_EQ(2, paths.paths.size());
+	ASSERT_EQ(kPathUpdated, paths.paths.at("file1"));
+	ASSERT_EQ(kPathCreated|kPathIsDir, paths.paths.at("dir1"));
+}
+
+TEST_F(QfsClientApiTest, BinaryGetAccessedPageTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
+	this->api->protocol = kProtocolBinary;
+
+	BinaryWriter response(kCmdError, 0);
+	StartBinaryResponse(&response, kCmdOk, "");
+	response.AppendUint32(2);
+	response.AppendString("/dir1");
+	response.AppendUint64(kPathCreated|kPathIsDir);
+	response.AppendString("/file1");
+	response.AppendUint64(kPathUpdated);
+	response.AppendUint64(0);
+	CopyFrame(&response, &this->read_command);
+
+	BinaryWriter request(kCmdGetAccessedPage, 0);
+	request.AppendString("test/workspace/root");
+	request.AppendUint64(0);
+	request.AppendUint32(100);
+	CopyFrame(&request, &this->expected_written_command);
+
+	AccessedCursor cursor = 0;
+	std::vector<PathAccessed> paths;
+	err = this->api->GetAccessedPage("test/workspace/root", &cursor, 100,
+					 &paths);
+	ASSERT_EQ(err.code, kSuccess);
+
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+
+	std::map<std::string, std::string> fields;
+	ReadBinaryFields(this->actual_written_command,
+			 kAccessedPageRequestFields, &fields);
+	ASSERT_EQ(fields[kWorkspaceRoot], "test/workspace/root");
+	ASSERT_EQ(fields[kCursor], "0");
+	ASSERT_EQ(fields[kPageSize], "100");
+
+	ReadBinaryFields(this->read_command, kAccessedPageResponseFields,
+			 &fields);
+	ASSERT_EQ(fields[kPaths], "[(/dir1," +
+		  std::to_string(kPathCreated|kPathIsDir) + "),(/file1," +
+		  std::to_string(kPathUpdated) + ")]");
+
+	ASSERT_EQ(cursor, 0);
+	ASSERT_EQ(paths.size(), 2);
+	ASSERT_EQ(paths[0].path, "/dir1");
+	ASSERT_EQ(paths[0].flags, kPathCreated|kPathIsDir);
+	ASSERT_EQ(paths[1].path, "/file1");
+	ASSERT_EQ(paths[1].flags, kPathUpdated);
+
+	// a count larger than the response holds is rejected
+	BinaryWriter truncated(kCmdError, 0);
+	StartBinaryResponse(&truncated, kCmdOk, "");
+	truncated.AppendUint32(1000000);
+	truncated.AppendString("/dir1");
+	truncated.AppendUint64(kPathRead);
+	CopyFrame(&truncated, &this->read_command);
+
+	err = this->api->GetAccessedPage("test/workspace/root", &cursor, 100,
+					 &paths);
+	ASSERT_EQ(err.code, kMissingJsonObject);
+}
+
+// This test covers ApiImpl::SetBlock() and ApiImpl::GetBlock() using the binary
+// protocol, which sends the key and data without base64 encoding them
+TEST_F(QfsClientApiTest, BinaryGetBlockTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
+	this->api->protocol = kProtocolBinary;
+
+	std::vector<byte> key;
+	const char *key_value = "somearbitrarykeyvalue03423278";
+	key.assign(key_value, key_value + strlen(key_value));
+
+	// data ending in zeros must not be trimmed like JSON responses are
+	std::vector<byte> data = { 'a', 'b', 'c', 0, 0 };
+
+	// The test api file isn't truncated between commands, so send the shorter
+	// command first
+	BinaryWriter response(kCmdError, 0);
+	StartBinaryResponse(&response, kCmdOk, "success");
+	response.AppendBytes(data);
+	CopyFrame(&response, &this->read_command);
+
+	BinaryWriter get_block(kCmdGetBlock, 0);
+	get_block.AppendBytes(key);
+	CopyFrame(&get_block, &this->expected_written_command);
+
+	std::vector<byte> read_data;
+	err = this->api->GetBlock(key, &read_data);
+	ASSERT_EQ(err.code, kSuccess);
+
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+	ASSERT_EQ(data, read_data);
+
+	std::map<std::string, std::string> fields;
+	ReadBinaryFields(this->actual_written_command, kGetBlockRequestFields,
+			 &fields);
+	ASSERT_EQ(fields[kKey], key_value);
+
+	ReadBinaryFields(this->read_command, kGetBlockResponseFields, &fields);
+	ASSERT_EQ(fields[kData], std::string(data.begin(), data.end()));
+
+	BinaryWriter ok(kCmdError, 0);
+	StartBinaryResponse(&ok, kCmdOk, "success");
+	CopyFrame(&ok, &this->read_command);
+
+	BinaryWriter set_block(kCmdSetBlock, 0);
+	set_block.AppendBytes(key);
+	set_block.AppendBytes(data);
+	CopyFrame(&set_block, &this->expected_written_command);
+
+	err = this->api->SetBlock(key, data);
+	ASSERT_EQ(err.code, kSuccess);
+
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+
+	ReadBinaryFields(this->actual_written_command, kSetBlockRequestFields,
+			 &fields);
+	ASSERT_EQ(fields[kKey], key_value);
+	ASSERT_EQ(fields[kData], std::string(data.begin(), data.end()));
+}
+
+// This test covers ApiImpl::GetBlockInto() and ApiImpl::StatBlock() using the
+// binary protocol, and GetBlockInto() calls answered by the block cache
+TEST_F(QfsClientApiTest, BinaryGetBlockIntoTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
+	this->api->protocol = kProtocolBinary;
+	err = this->api->EnableBlockCache(1024);
+	ASSERT_EQ(err.code, kSuccess);
+
+	std::vector<byte> key = { 1, 2, 3 };
+	std::vector<byte> data = { 'a', 'b', 'c', 0, 0 };
+
+	BinaryWriter stat_response(kCmdError, 0);
+	StartBinaryResponse(&stat_response, kCmdOk, "");
+	stat_response.AppendUint64(data.size());
+	CopyFrame(&stat_response, &this->read_command);
+
+	BinaryWriter stat_block(kCmdStatBlock, 0);
+	stat_block.AppendBytes(key);
+	CopyFrame(&stat_block, &this->expected_written_command);
+
+	size_t size = 0;
+	err = this->api->StatBlock(key, &size);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(size, data.size());
+
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+
+	// A block which doesn't fit isn't cached
+	BinaryWriter response(kCmdError, 0);
+	StartBinaryResponse(&response, kCmdOk, "");
+	response.AppendBytes(data);
+	CopyFrame(&response, &this->read_command);
+
+	std::vector<byte> buffer(size - 1);
+	size_t written = 0;
+	err = this->api->GetBlockInto(key.data(), key.size(), buffer.data(),
+				      buffer.size(), &written);
+	ASSERT_EQ(err.code, kBufferTooSmall);
+	ASSERT_EQ(written, data.size());
+	ASSERT_EQ(this->api->GetBlockCacheStats().blocks, 0);
+
+	buffer.resize(kMaxBlockSize);
+	err = this->api->GetBlockInto(key.data(), key.size(), buffer.data(),
+				      buffer.size(), &written);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(written, data.size());
+	ASSERT_EQ(std::vector<byte>(buffer.begin(), buffer.begin() + written),
+		  data);
+	ASSERT_EQ(this->api->GetBlockCacheStats().blocks, 1);
+
+	// The second time the block comes from the cache
+	BinaryWriter failed(kCmdError, 0);
+	StartBinaryResponse(&failed, kCmdKeyNotFound, "no such key");
+	CopyFrame(&failed, &this->read_command);
+
+	std::fill(buffer.begin(), buffer.end(), 0xff);
+	err = this->api->GetBlockInto(key.data(), key.size(), buffer.data(),
+				      data.size(), &written);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(written, data.size());
+	ASSERT_EQ(std::vector<byte>(buffer.begin(), buffer.begin() + written),
+		  data);
+	ASSERT_EQ(this->api->GetBlockCacheStats().hits, 1);
+}
+
+// This test covers ApiImpl::SetBlockIfAbsent() using the binary protocol, which
+// only stores blocks HasBlocks says are missing
+TEST_F(QfsClientApiTest, BinaryHasBlocksTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
+	this->api->protocol = kProtocolBinary;
+
+	std::vector<byte> data = { 'a', 'b', 'c' };
+	std::vector<byte> expected_key(util::kSha1Size);
+	util::sha1(data.data(), data.size(), expected_key.data());
+
+	BinaryWriter has_blocks(kCmdHasBlocks, 0);
+	has_blocks.AppendUint32(1);
+	has_blocks.AppendBytes(expected_key);
+	CopyFrame(&has_blocks, &this->expected_written_command);
+
+	BinaryWriter present(kCmdError, 0);
+	StartBinaryResponse(&present, kCmdOk, "");
+	// a single bool, followed by padding which isn't read
+	present.AppendUint32(1);
+	present.AppendUint32(1);
+	CopyFrame(&present, &this->read_command);
+
+	// the block is already stored, so only HasBlocks is sent
+	std::vector<byte> key;
+	bool stored = true;
+	err = this->api->SetBlockIfAbsent(data.data(), data.size(), &key,
+					  &stored);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_FALSE(stored);
+	ASSERT_EQ(key, expected_key);
+
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+
+	std::map<std::string, std::string> fields;
+	ReadBinaryFields(this->actual_written_command, kHasBlocksRequestFields,
+			 &fields);
+	ASSERT_EQ(fields[kKeys], "[" + std::string(expected_key.begin(),
+						   expected_key.end()) + "]");
+
+	// it isn't, so the block is then stored
+	BinaryWriter absent(kCmdError, 0);
+	StartBinaryResponse(&absent, kCmdOk, "");
+	absent.AppendUint32(1);
+	absent.AppendUint32(0);
+	this->queued_read_commands.emplace_back();
+	CopyFrame(&absent, &this->queued_read_commands.back());
+
+	BinaryWriter ok(kCmdError, 0);
+	StartBinaryResponse(&ok, kCmdOk, "");
+	CopyFrame(&ok, &this->read_command);
+
+	BinaryWriter set_block(kCmdSetBlock, 0);
+	set_block.AppendBytes(expected_key);
+	set_block.AppendBytes(data);
+	CopyFrame(&set_block, &this->expected_written_command);
+
+	err = this->api->SetBlockIfAbsent(data.data(), data.size(), &key,
+					  &stored);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_TRUE(stored);
+	ASSERT_TRUE(this->queued_read_commands.empty());
+
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+}
+
+// This test covers ApiImpl::Prefetch() using the binary protocol, and that its
+// response is dropped when it is read before that of a later command
+TEST_F(QfsClientApiTest, BinaryPrefetchTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
+	this->api->protocol = kProtocolBinary;
+
+	std::vector<byte> key = { 'k', 'e', 'y', '1' };
+	std::string extended_key = "extended";
+
+	BinaryWriter prefetch(kCmdPrefetch, 1);
+	prefetch.AppendUint32(1);
+	prefetch.AppendBytes(key);
+	prefetch.AppendUint32(1);
+	prefetch.AppendString(extended_key.c_str());
+	CopyFrame(&prefetch, &this->expected_written_command);
+
+	err = this->api->Prefetch({ key }, { extended_key });
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(this->api->in_flight.size(), 1);
+	ASSERT_EQ(this->api->discarded.size(), 1);
+
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+
+	std::map<std::string, std::string> fields;
+	ReadBinaryFields(this->actual_written_command, kPrefetchRequestFields,
+			 &fields);
+	ASSERT_EQ(fields[kRequestId], "1");
+	ASSERT_EQ(fields[kKeys], "[key1]");
+	ASSERT_EQ(fields[kExtendedKeys], "[extended]");
+
+	// the response to Prefetch arrives before that of SetBlock
+	BinaryWriter started(kCmdError, 1);
+	StartBinaryResponse(&started, kCmdOk, "Prefetch started");
+	this->queued_read_commands.emplace_back();
+	CopyFrame(&started, &this->queued_read_commands.back());
+
+	BinaryWriter ok(kCmdError, 0);
+	StartBinaryResponse(&ok, kCmdOk, "");
+	CopyFrame(&ok, &this->read_command);
+
+	std::vector<byte> data(64, 'd');
+	BinaryWriter set_block(kCmdSetBlock, 0);
+	set_block.AppendBytes(key);
+	set_block.AppendBytes(data);
+	CopyFrame(&set_block, &this->expected_written_command);
+
+	err = this->api->SetBlock(key, data);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_TRUE(this->queued_read_commands.empty());
+	ASSERT_TRUE(this->api->in_flight.empty());
+	ASSERT_TRUE(this->api->discarded.empty());
+	ASSERT_TRUE(this->api->completed.empty());
+
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+}
+
+// This test covers ApiImpl::InsertInodes() using the binary protocol, including
+// splitting the inodes over several requests
+TEST_F(QfsClientApiTest, BinaryInsertInodesTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
+	this->api->protocol = kProtocolBinary;
+
+	std::vector<InsertInodeEntry> inodes = {
+		{ "a/b/c/d", "key1", 0644, 1, 2 },
+		{ "a/b/c/e", "key2", 0600, 3, 4 },
+	};
+
+	BinaryWriter request(kCmdInsertInodes, 0);
+	request.AppendUint32(2);
+	for (const InsertInodeEntry &inode : inodes) {
+		request.AppendString(inode.destination.c_str());
+		request.AppendString(inode.key.c_str());
+		request.AppendUint32(inode.uid);
+		request.AppendUint32(inode.gid);
+		request.AppendUint32(inode.permissions);
+	}
+	CopyFrame(&request, &this->expected_written_command);
+
+	// each result is a whole ErrorResponse, with its CommandId and RequestId
+	auto append_result = [](BinaryWriter *writer, CommandError code,
+				const char *message) {
+		writer->AppendUint32(kCmdError);
+		writer->AppendUint64(0);
+		StartBinaryResponse(writer, code, message);
+	};
+
+	BinaryWriter response(kCmdError, 0);
+	StartBinaryResponse(&response, kCmdOk, "");
+	response.AppendUint32(2);
+	append_result(&response, kCmdOk, "");
+	append_result(&response, kCmdKeyNotFound, "missing");
+	CopyFrame(&response, &this->read_command);
+
+	std::vector<Error> results;
+	err = this->api->InsertInodes(inodes, &results);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(results.size(), 2);
+	ASSERT_EQ(results[0].code, kSuccess);
+	ASSERT_EQ(results[1].code, kApiError);
+
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+
+	std::map<std::string, std::string> fields;
+	ReadBinaryFields(this->actual_written_command,
+			 kInsertInodesRequestFields, &fields);
+	ASSERT_EQ(fields[kInodes], "[(a/b/c/d,key1,1,2," + std::to_string(0644) +
+		  "),(a/b/c/e,key2,3,4," + std::to_string(0600) + ")]");
+
+	ReadBinaryFields(this->read_command, kInsertInodesResponseFields,
+			 &fields);
+	ASSERT_EQ(fields[kResults], "[(" + std::to_string(kCmdError) + ",0," +
+		  std::to_string(kCmdOk) + ",),(" + std::to_string(kCmdError) +
+		  ",0," + std::to_string(kCmdKeyNotFound) + ",missing)]");
+
+	// more inodes than fit in one request are sent in two
+	inodes.assign(kMaxInsertInodes + 1, inodes[0]);
+
+	BinaryWriter first(kCmdError, 0);
+	StartBinaryResponse(&first, kCmdOk, "");
+	first.AppendUint32(kMaxInsertInodes);
+	for (int i = 0; i < kMaxInsertInodes; i++) {
+		append_result(&first, kCmdOk, "");
+	}
+	this->queued_read_commands.emplace_back();
+	CopyFrame(&first, &this->queued_read_commands.back());
+
+	BinaryWriter second(kCmdError, 0);
+	StartBinaryResponse(&second, kCmdOk, "");
+	second.AppendUint32(1);
+	append_result(&second, kCmdBadArgs, "exists");
+	CopyFrame(&second, &this->read_command);
+
+	err = this->api->InsertInodes(inodes, &results);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_TRUE(this->queued_read_commands.empty());
+	ASSERT_EQ(results.size(), kMaxInsertInodes + 1);
+	ASSERT_EQ(results[kMaxInsertInodes - 1].code, kSuccess);
+	ASSERT_EQ(results[kMaxInsertInodes].code, kApiError);
+}
+
+// This test covers the versions of ApiImpl::SetBlock() and ApiImpl::GetBlock()
+// which take the key and data as pointers and sizes
+TEST_F(QfsClientApiTest, BinarySpanBlockTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
+	this->api->protocol = kProtocolBinary;
+
+	const byte key[] = { 0, 1, 2, 3, 0xfe, 0xff };
+	const byte data[] = { 'x', 'y', 'z', 0 };
+
+	// The test api file isn't truncated between commands, so send the shorter
+	// command first
+	BinaryWriter response(kCmdError, 0);
+	StartBinaryResponse(&response, kCmdOk, "success");
+	response.AppendBytes(data, sizeof(data));
+	CopyFrame(&response, &this->read_command);
+
+	BinaryWriter get_block(kCmdGetBlock, 0);
+	get_block.AppendBytes(key, sizeof(key));
+	CopyFrame(&get_block, &this->expected_written_command);
+
+	std::vector<byte> read_data;
+	err = this->api->GetBlock(key, sizeof(key), &read_data);
+	ASSERT_EQ(err.code, kSuccess);
+
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+	ASSERT_EQ(std::vector<byte>(data, data + sizeof(data)), read_data);
+
+	BinaryWriter ok(kCmdError, 0);
+	StartBinaryResponse(&ok, kCmdOk, "success");
+	CopyFrame(&ok, &this->read_command);
+
+	BinaryWriter set_block(kCmdSetBlock, 0);
+	set_block.AppendBytes(key, sizeof(key));
+	set_block.AppendBytes(data, sizeof(data));
+	CopyFrame(&set_block, &this->expected_written_command);
+
+	err = this->api->SetBlock(key, sizeof(key), data, sizeof(data));
+	ASSERT_EQ(err.code, kSuccess);
+
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+}
+
+// This test covers ApiImpl::EnableSharedMemory() and the SetBlock() and
+// GetBlock() calls which then move their data through the shared memory
+TEST_F(QfsClientApiTest, SharedMemoryTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
+
+	std::string response_json = "{'CommandId':1,'ErrorCode':0,"
+				    "'Message':'success'}";
+	util::requote(&response_json);
+	this->read_command.CopyString(response_json.c_str());
+
+	err = this->api->EnableSharedMemory();
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_TRUE(this->api->shared_memory != NULL);
+	ASSERT_EQ(this->api->shared_memory_size, kMaxBlockSize);
+
+	// the file was registered, then unlinked
+	std::string written((const char *)this->actual_written_command.Data(),
+			    this->actual_written_command.Size());
+	std::string path_prefix = "\"Path\":\"" + std::string(kSharedMemoryDir) +
+				  "/qfsclient-";
+	size_t path_start = written.find(path_prefix);
+	ASSERT_NE(path_start, std::string::npos);
+	ASSERT_NE(written.find("\"CommandId\":17"), std::string::npos);
+	path_start += strlen("\"Path\":\"");
+	std::string path = written.substr(path_start,
+					  written.find('"', path_start) -
+					  path_start);
+	struct stat path_stat;
+	ASSERT_NE(stat(path.c_str(), &path_stat), 0);
+
+	// the block is placed in the shared memory and only its length is sent
+	std::vector<byte> key;
+	const char *key_value = "somearbitrarykeyvalue03423278";
+	key.assign(key_value, key_value + strlen(key_value));
+	std::string base64_key;
+	ASSERT_EQ(util::base64_encode(key, &base64_key).code, kSuccess);
+
+	std::vector<byte> data = { 'l', 'o', 'o', 'k', 0, 'b', 'e', 'h', 'i', 'n',
+				   'd', 0, 0 };
+
+	std::string expected_written_command_json = "{'CommandId':18,'Key':'" +
+						    base64_key +
+						    "','Length':13,'Offset':0}";
+	util::requote(&expected_written_command_json);
+	this->expected_written_command.CopyString(
+		expected_written_command_json.c_str());
+
+	err = this->api->SetBlock(key, data);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(std::string((const char *)this->actual_written_command.Data(),
+			      this->actual_written_command.Size()),
+		  expected_written_command_json);
+	ASSERT_EQ(memcmp(this->api->shared_memory, data.data(), data.size()), 0);
+
+	// and a block is read from where quantumfsd placed it
+	memcpy(this->api->shared_memory, "quantumfsd", 10);
+	response_json = "{'CommandId':1,'ErrorCode':0,'Length':10,'Message':''}";
+	util::requote(&response_json);
+	this->read_command.CopyString(response_json.c_str());
+
+	expected_written_command_json = "{'Capacity':262144,'CommandId':19,"
+					"'Key':'" + base64_key + "','Offset':0}";
+	util::requote(&expected_written_command_json);
+
+	std::vector<byte> read_data;
+	err = this->api->GetBlock(key, &read_data);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(std::string((const char *)this->actual_written_command.Data(),
+			      this->actual_written_command.Size()),
+		  expected_written_command_json);
+	ASSERT_EQ(std::string(read_data.begin(), read_data.end()), "quantumfsd");
+
+	// a length beyond the shared memory is rejected
+	response_json = "{'CommandId':1,'ErrorCode':0,'Length':262145,"
+			"'Message':''}";
+	util::requote(&response_json);
+	this->read_command.CopyString(response_json.c_str());
+
+	err = this->api->GetBlock(key, &read_data);
+	ASSERT_EQ(err.code, kBufferTooBig);
+
+	// the registration is lost with the api file handle
+	this->api->Close();
+	ASSERT_TRUE(this->api->shared_memory == NULL);
+}
+
+// This test covers shared memory SetBlock() and GetBlock() calls using the binary
+// protocol
+TEST_F(QfsClientApiTest, BinarySharedMemoryTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
+	this->api->protocol = kProtocolBinary;
+
+	BinaryWriter ok(kCmdError, 0);
+	StartBinaryResponse(&ok, kCmdOk, "success");
+	CopyFrame(&ok, &this->read_command);
+
+	err = this->api->EnableSharedMemory();
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_TRUE(this->api->shared_memory != NULL);
+
+	std::vector<byte> key;
+	const char *key_value = "somearbitrarykeyvalue03423278";
+	key.assign(key_value, key_value + strlen(key_value));
+	std::vector<byte> data = { 'a', 'b', 'c', 0, 0 };
+
+	BinaryWriter set_block(kCmdSetBlockShared, 0);
+	set_block.AppendBytes(key);
+	set_block.AppendUint64(0);
+	set_block.AppendUint64(data.size());
+	CopyFrame(&set_block, &this->expected_written_command);
+
+	err = this->api->SetBlock(key, data);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+	ASSERT_EQ(memcmp(this->api->shared_memory, data.data(), data.size()), 0);
+
+	BinaryWriter response(kCmdError, 0);
+	StartBinaryResponse(&response, kCmdOk, "success");
+	response.AppendUint64(4);
+	CopyFrame(&response, &this->read_command);
+
+	BinaryWriter get_block(kCmdGetBlockShared, 0);
+	get_block.AppendBytes(key);
+	get_block.AppendUint64(0);
+	get_block.AppendUint64(kMaxBlockSize);
+	CopyFrame(&get_block, &this->expected_written_command);
+
+	std::vector<byte> read_data;
+	err = this->api->GetBlock(key, &read_data);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+	ASSERT_EQ(read_data, std::vector<byte>({ 'a', 'b', 'c', 0 }));
+}
+
+// This test covers the pipelined API functions and ApiImpl::Wait() using JSON,
+// which quantumfsd versions that don't pipeline commands answer without a RequestId
+TEST_F(QfsClientApiTest, PipelinedTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
+
+	std::vector<byte> key;
+	const char *key_value = "somearbitrarykeyvalue03423278";
+	key.assign(key_value, key_value + strlen(key_value));
+
+	std::vector<byte> data;
+	const char *data_value = "lookbehindyou";
+	data.assign(data_value, data_value + strlen(data_value));
+
+	// The test api file isn't truncated between commands, so send the shorter
+	// command first
+	std::string expected_written_command_json =
+	"{'CommandId':9,'Key':'c29tZWFyYml0cmFyeWtleXZhbHVlMDM0MjMyNzg=',"
+	 "'RequestId':1}";
+	util::requote(&expected_written_command_json);
+	this->expected_written_command.CopyString(
+		expected_written_command_json.c_str());
+
+	// each command is answered before the next one is sent
+	std::string response_json = "{'Data':'bG9va2JlaGluZHlvdQ==','ErrorCode':0,"
+				    "'Message':'success'}";
+	util::requote(&response_json);
+	this->queued_read_commands.emplace_back();
+	this->queued_read_commands.back().CopyString(response_json.c_str());
+
+	RequestId get_block_id;
+	err = this->api->StartGetBlock(key, &get_block_id);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(get_block_id, 1);
+	ASSERT_TRUE(this->queued_read_commands.empty());
+
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+
+	expected_written_command_json =
+	"{'CommandId':8,"
+	 "'Data':'bG9va2JlaGluZHlvdQ==',"
+	 "'Key':'c29tZWFyYml0cmFyeWtleXZhbHVlMDM0MjMyNzg=',"
+	 "'RequestId':2}";
+	util::requote(&expected_written_command_json);
+	this->expected_written_command.CopyString(
+		expected_written_command_json.c_str());
+
+	response_json = "{'ErrorCode':0,'Message':'success'}";
+	util::requote(&response_json);
+	this->queued_read_commands.emplace_back();
+	this->queued_read_commands.back().CopyString(response_json.c_str());
+
+	RequestId set_block_id;
+	err = this->api->StartSetBlock(key, data, &set_block_id);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(set_block_id, 2);
+	ASSERT_TRUE(this->queued_read_commands.empty());
+
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+
+	// a synchronous command reads its own response, not one of the above
+	response_json = "{'Data':'YWJj','ErrorCode':0,'Message':'success'}";
+	util::requote(&response_json);
+	this->read_command.CopyString(response_json.c_str());
+
+	std::vector<byte> read_data;
+	err = this->api->GetBlock(key, &read_data);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(read_data, std::vector<byte>({ 'a', 'b', 'c' }));
+
+	err = this->api->Wait(get_block_id, &read_data);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(data, read_data);
+
+	err = this->api->Wait(set_block_id, NULL);
+	ASSERT_EQ(err.code, kSuccess);
+
+	// every request may only be waited for once
+	err = this->api->Wait(set_block_id, NULL);
+	ASSERT_EQ(err.code, kUnknownRequestId);
+}
+
+// This test covers the pipelined API functions using the binary protocol, including
+// what happens when more commands are started than may be in flight
+TEST_F(QfsClientApiTest, BinaryPipelinedTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
+	this->api->protocol = kProtocolBinary;
+
+	const char *key = "thisisadummyextendedkey01234567890123456";
+	std::vector<RequestId> request_ids;
+
+	for (int i = 0; i < kMaxPipelineDepth; i++) {
+		RequestId request_id;
+		err = this->api->StartInsertInode("/path/to/some/place/", key,
+						  0765, 2001, 3001, &request_id);
+		ASSERT_EQ(err.code, kSuccess);
+		request_ids.push_back(request_id);
+	}
+
+	BinaryWriter insert_inode(kCmdInsertInode, request_ids.back());
+	insert_inode.AppendString("/path/to/some/place/");
+	insert_inode.AppendString(key);
+	insert_inode.AppendUint32(2001);
+	insert_inode.AppendUint32(3001);
+	insert_inode.AppendUint32(0765);
+	CopyFrame(&insert_inode, &this->expected_written_command);
+
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+
+	// The pipeline is full, so the next command must read a response first
+	BinaryWriter failed(kCmdError, request_ids[1]);
+	StartBinaryResponse(&failed, kCmdKeyNotFound, "no such key");
+	this->queued_read_commands.emplace_back();
+	CopyFrame(&failed, &this->queued_read_commands.back());
+
+	RequestId request_id;
+	err = this->api->StartInsertInode("/path/to/some/place/", key, 0765, 2001,
+					  3001, &request_id);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_TRUE(this->queued_read_commands.empty());
+	request_ids.push_back(request_id);
+
+	err = this->api->Wait(request_ids[1], NULL);
+	ASSERT_EQ(err.code, kApiError);
+
+	for (size_t i = 0; i < request_ids.size(); i++) {
+		if (i == 1) {
+			continue;
+		}
+
+		BinaryWriter ok(kCmdError, request_ids[i]);
+		StartBinaryResponse(&ok, kCmdOk, "success");
+		CopyFrame(&ok, &this->read_command);
+
+		err = this->api->Wait(request_ids[i], NULL);
+		ASSERT_EQ(err.code, kSuccess);
+	}
+}
+
+// This test covers Batch and ApiImpl::ExecuteBatch()
+TEST_F(QfsClientApiTest, BatchTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
+
+	// An empty batch sends nothing
+	Batch batch(this->api);
+	std::vector<Error> results;
+	err = batch.Execute(&results);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_TRUE(results.empty());
+	ASSERT_EQ(this->actual_written_command.Size(), 0);
+
+	std::vector<byte> key = { 1, 2 };
+	std::vector<byte> data = { 3 };
+	batch.AddInsertInode("/path/to/some/place/",
+			     "thisisadummyextendedkey01234567890123456",
+			     0765, 2001, 3001);
+	batch.AddBranch("bad", "test/destination/workspace");
+	batch.AddSetBlock(key, data);
+	ASSERT_EQ(batch.Size(), 3);
+
+	// the invalid Branch is never sent
+	std::string expected_written_command_json =
+		"{'CommandId':20,'Commands':["
+		"{'CommandId':6,"
+		 "'DstPath':'/path/to/some/place/',"
+		 "'Gid':3001,"
+		 "'Key':'thisisadummyextendedkey01234567890123456',"
+		 "'Permissions':501,"
+		 "'Uid':2001},"
+		"{'CommandId':8,'Data':'Aw==','Key':'AQI='}]}";
+	util::requote(&expected_written_command_json);
+	this->expected_written_command.CopyString(
+		expected_written_command_json.c_str());
+
+	std::string read_command_json =
+		"{'CommandId':1,'ErrorCode':0,'Message':'','Results':["
+		"{'CommandId':1,'ErrorCode':0,'Message':''},"
+		"{'CommandId':1,'ErrorCode':5,'Message':'no such key'}]}";
+	util::requote(&read_command_json);
+	this->read_command.CopyString(read_command_json.c_str());
+
+	err = batch.Execute(&results);
+	ASSERT_EQ(err.code, kSuccess);
+
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+
+	ASSERT_EQ(results.size(), 3);
+	ASSERT_EQ(results[0].code, kSuccess);
+	ASSERT_EQ(results[1].code, kWorkspaceNameInvalid);
+	ASSERT_EQ(results[2].code, kApiError);
+
+	// every command gets a result, even if the batch fails
+	std::string bad_response_json = "{'ErrorCode':0,'Message':''}";
+	util::requote(&bad_response_json);
+	this->read_command.CopyString(bad_response_json.c_str());
+
+	err = batch.Execute(&results);
+	ASSERT_EQ(err.code, kMissingJsonObject);
+	ASSERT_EQ(results.size(), 3);
+	ASSERT_EQ(results[0].code, kMissingJsonObject);
+	ASSERT_EQ(results[1].code, kWorkspaceNameInvalid);
+	ASSERT_EQ(results[2].code, kMissingJsonObject);
+
+	batch.Clear();
+	ASSERT_EQ(batch.Size(), 0);
+}
+
+// This test covers ApiImpl::ExecuteBatch() using the binary protocol
+TEST_F(QfsClientApiTest, BinaryBatchTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
+	this->api->protocol = kProtocolBinary;
+
+	std::vector<byte> key = { 1, 2 };
+	std::vector<byte> data = { 3 };
+	Batch batch(this->api);
+	batch.AddBranch("test/source/workspace", "test/destination/workspace");
+	batch.AddDelete("bad");
+	batch.AddSetBlock(key, data);
+
+	BinaryWriter branch(kCmdBranchRequest, 0);
+	branch.AppendString("test/source/workspace");
+	branch.AppendString("test/destination/workspace");
+	ASSERT_EQ(branch.Finish(), kSuccess);
+
+	BinaryWriter set_block(kCmdSetBlock, 0);
+	set_block.AppendBytes(key);
+	set_block.AppendBytes(data);
+	ASSERT_EQ(set_block.Finish(), kSuccess);
+
+	BinaryWriter expected(kCmdBatch, 0);
+	expected.AppendUint32(2);
+	expected.AppendBytes(branch.Frame().Data(), branch.Frame().Size());
+	expected.AppendBytes(set_block.Frame().Data(), set_block.Frame().Size());
+	CopyFrame(&expected, &this->expected_written_command);
+
+	BinaryWriter ok(kCmdError, 0);
+	StartBinaryResponse(&ok, kCmdOk, "");
+	ASSERT_EQ(ok.Finish(), kSuccess);
+
+	BinaryWriter failed(kCmdError, 0);
+	StartBinaryResponse(&failed, kCmdKeyNotFound, "no such key");
+	ASSERT_EQ(failed.Finish(), kSuccess);
+
+	BinaryWriter response(kCmdError, 0);
+	StartBinaryResponse(&response, kCmdOk, "");
+	response.AppendUint32(2);
+	response.AppendBytes(ok.Frame().Data(), ok.Frame().Size());
+	response.AppendBytes(failed.Frame().Data(), failed.Frame().Size());
+	CopyFrame(&response, &this->read_command);
+
+	std::vector<Error> results;
+	err = batch.Execute(&results);
+	ASSERT_EQ(err.code, kSuccess);
+
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+
+	ASSERT_EQ(results.size(), 3);
+	ASSERT_EQ(results[0].code, kSuccess);
+	ASSERT_EQ(results[1].code, kWorkspaceNameInvalid);
+	ASSERT_EQ(results[2].code, kApiError);
+
+	// A command which doesn't fit in a batch is sent on its own
+	std::vector<byte> block(kMaxBatchBytes, 7);
+	batch.Clear();
+	batch.AddSetBlock(key, block);
+
+	BinaryWriter large(kCmdSetBlock, 0);
+	large.AppendBytes(key);
+	large.AppendBytes(block);
+	CopyFrame(&large, &this->expected_written_command);
+	CopyFrame(&ok, &this->read_command);
+
+	err = batch.Execute(&results);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(results.size(), 1);
+	ASSERT_EQ(results[0].code, kSuccess);
+
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+}
+
+// This test covers ApiImpl::GetBlocks(), which sends its commands as a Batch
+TEST_F(QfsClientApiTest, BlocksTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
+
+	std::vector<std::vector<byte>> keys = { { 1, 2 }, { 3 } };
+
+	std::string expected_written_command_json =
+		"{'CommandId':20,'Commands':["
+		"{'CommandId':9,'Key':'AQI='},"
+		"{'CommandId':9,'Key':'Aw=='}]}";
+	util::requote(&expected_written_command_json);
+	this->expected_written_command.CopyString(
+		expected_written_command_json.c_str());
+
+	std::string read_command_json =
+		"{'CommandId':1,'ErrorCode':0,'Message':'','Results':["
+		"{'CommandId':1,'Data':'YWJj','ErrorCode':0,'Message':''},"
+		"{'CommandId':1,'ErrorCode':5,'Message':'no such key'}]}";
+	util::requote(&read_command_json);
+	this->read_command.CopyString(read_command_json.c_str());
+
+	std::vector<std::vector<byte>> blocks;
+	std::vector<Error> results;
+	err = this->api->GetBlocks(keys, &blocks, &results);
+	ASSERT_EQ(err.code, kSuccess);
+
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+
+	ASSERT_EQ(results.size(), 2);
+	ASSERT_EQ(results[0].code, kSuccess);
+	ASSERT_EQ(results[1].code, kApiError);
+	ASSERT_EQ(blocks.size(), 2);
+	ASSERT_EQ(blocks[0], std::vector<byte>({ 'a', 'b', 'c' }));
+	ASSERT_TRUE(blocks[1].empty());
+}
+
+// This test covers ApiImpl::SetBlocks() and ApiImpl::GetBlocks() using the binary
+// protocol
+TEST_F(QfsClientApiTest, BinaryBlocksTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
+	this->api->protocol = kProtocolBinary;
+
+	std::vector<Block> blocks = { { { 1, 2 }, { 3 } }, { { 4 }, { 5, 6 } } };
+	std::vector<std::vector<byte>> keys = { blocks[0].key, blocks[1].key };
+
+	BinaryWriter ok(kCmdError, 0);
+	StartBinaryResponse(&ok, kCmdOk, "");
+	ASSERT_EQ(ok.Finish(), kSuccess);
+
+	BinaryWriter failed(kCmdError, 0);
+	StartBinaryResponse(&failed, kCmdKeyNotFound, "no such key");
+	ASSERT_EQ(failed.Finish(), kSuccess);
+
+	// The test api file isn't truncated between commands, so send the shorter
+	// command first
+	BinaryWriter expected_get(kCmdBatch, 0);
+	expected_get.AppendUint32(keys.size());
+	for (const std::vector<byte> &key : keys) {
+		BinaryWriter get_block(kCmdGetBlock, 0);
+		get_block.AppendBytes(key);
+		ASSERT_EQ(get_block.Finish(), kSuccess);
+		expected_get.AppendBytes(get_block.Frame().Data(),
+					 get_block.Frame().Size());
+	}
+	CopyFrame(&expected_get, &this->expected_written_command);
+
+	BinaryWriter found(kCmdError, 0);
+	StartBinaryResponse(&found, kCmdOk, "");
+	found.AppendBytes(blocks[0].data);
+	ASSERT_EQ(found.Finish(), kSuccess);
+
+	BinaryWriter get_response(kCmdError, 0);
+	StartBinaryResponse(&get_response, kCmdOk, "");
+	get_response.AppendUint32(2);
+	get_response.AppendBytes(found.Frame().Data(), found.Frame().Size());
+	get_response.AppendBytes(failed.Frame().Data(), failed.Frame().Size());
+	CopyFrame(&get_response, &this->read_command);
+
+	std::vector<std::vector<byte>> read_blocks;
+	std::vector<Error> results;
+	err = this->api->GetBlocks(keys, &read_blocks, &results);
+	ASSERT_EQ(err.code, kSuccess);
+
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+
+	ASSERT_EQ(results.size(), 2);
+	ASSERT_EQ(results[0].code, kSuccess);
+	ASSERT_EQ(results[1].code, kApiError);
+	ASSERT_EQ(read_blocks.size(), 2);
+	ASSERT_EQ(read_blocks[0], blocks[0].data);
+	ASSERT_TRUE(read_blocks[1].empty());
+
+	BinaryWriter expected_set(kCmdBatch, 0);
+	expected_set.AppendUint32(blocks.size());
+	for (const Block &block : blocks) {
+		BinaryWriter set_block(kCmdSetBlock, 0);
+		set_block.AppendBytes(block.key);
+		set_block.AppendBytes(block.data);
+		ASSERT_EQ(set_block.Finish(), kSuccess);
+		expected_set.AppendBytes(set_block.Frame().Data(),
+					 set_block.Frame().Size());
+	}
+	CopyFrame(&expected_set, &this->expected_written_command);
+
+	BinaryWriter set_response(kCmdError, 0);
+	StartBinaryResponse(&set_response, kCmdOk, "");
+	set_response.AppendUint32(2);
+	set_response.AppendBytes(ok.Frame().Data(), ok.Frame().Size());
+	set_response.AppendBytes(ok.Frame().Data(), ok.Frame().Size());
+	CopyFrame(&set_response, &this->read_command);
+
+	err = this->api->SetBlocks(blocks, &results);
+	ASSERT_EQ(err.code, kSuccess);
+
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+
+	ASSERT_EQ(results.size(), 2);
+	ASSERT_EQ(results[0].code, kSuccess);
+	ASSERT_EQ(results[1].code, kSuccess);
+}
+
+// This test covers ApiImpl::PutObject() and ApiImpl::GetObject() using the binary
+// protocol with an object of two chunks
+TEST_F(QfsClientApiTest, BinaryObjectTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
+	this->api->protocol = kProtocolBinary;
+
+	std::vector<byte> key = { 1, 2, 3 };
+	std::vector<byte> data(kObjectChunkSize + 1);
+	for (size_t i = 0; i < data.size(); i++) {
+		data[i] = i % 251;
+	}
+
+	std::vector<byte> chunk_keys(2 * util::kSha1Size);
+	util::sha1(data.data(), kObjectChunkSize, chunk_keys.data());
+	util::sha1(data.data() + kObjectChunkSize, 1,
+		   chunk_keys.data() + util::kSha1Size);
+	std::vector<byte> manifest;
+	EncodeObjectManifest(data.size(), chunk_keys, &manifest);
+
+	// Both chunks are in flight before either response is read, and the
+	// manifest is stored last, as a plain SetBlock
+	for (RequestId request_id = 1; request_id <= 2; request_id++) {
+		BinaryWriter ok(kCmdError, request_id);
+		StartBinaryResponse(&ok, kCmdOk, "");
+		this->queued_read_commands.emplace_back();
+		CopyFrame(&ok, &this->queued_read_commands.back());
+	}
+	BinaryWriter ok(kCmdError, 0);
+	StartBinaryResponse(&ok, kCmdOk, "");
+	CopyFrame(&ok, &this->read_command);
+
+	err = this->api->PutObject(key, data.data(), data.size());
+	ASSERT_EQ(err.code, kSuccess) << err.message;
+	ASSERT_TRUE(this->queued_read_commands.empty());
+
+	BinaryWriter set_manifest(kCmdSetBlock, 0);
+	set_manifest.AppendBytes(key);
+	set_manifest.AppendBytes(manifest);
+	CopyFrame(&set_manifest, &this->expected_written_command);
+	ASSERT_GE(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->expected_written_command.Size()), 0);
+
+	// Retrieving the object reads the manifest and then both of its chunks,
+	// whose responses may arrive in any order
+	std::vector<std::vector<byte>> chunks = {
+		std::vector<byte>(data.begin(), data.begin() + kObjectChunkSize),
+		std::vector<byte>(data.begin() + kObjectChunkSize, data.end()),
+	};
+	auto queue_object = [&](RequestId first_id,
+				const std::vector<byte> &last_chunk) {
+		BinaryWriter manifest_response(kCmdError, 0);
+		StartBinaryResponse(&manifest_response, kCmdOk, "");
+		manifest_response.AppendBytes(manifest);
+		this->queued_read_commands.emplace_back();
+		CopyFrame(&manifest_response,
+			  &this->queued_read_commands.back());
+
+		BinaryWriter second(kCmdError, first_id + 1);
+		StartBinaryResponse(&second, kCmdOk, "");
+		second.AppendBytes(last_chunk);
+		this->queued_read_commands.emplace_back();
+		CopyFrame(&second, &this->queued_read_commands.back());
+
+		BinaryWriter first(kCmdError, first_id);
+		StartBinaryResponse(&first, kCmdOk, "");
+		first.AppendBytes(chunks[0]);
+		this->queued_read_commands.emplace_back();
+		CopyFrame(&first, &this->queued_read_commands.back());
+	};
+
+	queue_object(3, chunks[1]);
+	std::vector<byte> read_data;
+	err = this->api->GetObject(key, &read_data);
+	ASSERT_EQ(err.code, kSuccess) << err.message;
+	ASSERT_TRUE(this->queued_read_commands.empty());
+	ASSERT_EQ(read_data, data);
+
+	// A chunk of the wrong size is reported rather than returned
+	queue_object(5, std::vector<byte>(2, 'x'));
+	err = this->api->GetObject(key, &read_data);
+	ASSERT_EQ(err.code, kObjectCorrupt);
+	ASSERT_TRUE(this->queued_read_commands.empty());
+	ASSERT_TRUE(read_data.empty());
+
+	// The object may also be written straight to a file
+	queue_object(7, chunks[1]);
+	FILE *file = tmpfile();
+	ASSERT_FALSE(file == NULL);
+	err = this->api->GetObject(key, fileno(file));
+	ASSERT_EQ(err.code, kSuccess) << err.message;
+	ASSERT_TRUE(this->queued_read_commands.empty());
+
+	std::vector<byte> file_data(data.size() + 1);
+	rewind(file);
+	ASSERT_EQ(fread(file_data.data(), 1, file_data.size(), file), data.size());
+	fclose(file);
+	file_data.resize(data.size());
+	ASSERT_EQ(file_data, data);
+}
+
+// This test covers ApiImpl::PutObject() and ApiImpl::GetObject() with the block
+// cache enabled, when the object of a key is replaced
+TEST_F(QfsClientApiTest, BinaryObjectCacheTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
+	this->api->protocol = kProtocolBinary;
+
+	err = this->api->EnableBlockCache(1024);
+	ASSERT_EQ(err.code, kSuccess);
+
+	std::vector<byte> key = { 1, 2, 3 };
+	RequestId next_id = 1;
+
+	// Each object is of a single chunk, which is stored pipelined, and then
+	// the manifest is stored as a plain SetBlock
+	auto put_object = [&](const std::vector<byte> &data) {
+		BinaryWriter chunk_ok(kCmdError, next_id++);
+		StartBinaryResponse(&chunk_ok, kCmdOk, "");
+		this->queued_read_commands.emplace_back();
+		CopyFrame(&chunk_ok, &this->queued_read_commands.back());
+
+		BinaryWriter manifest_ok(kCmdError, 0);
+		StartBinaryResponse(&manifest_ok, kCmdOk, "");
+		this->queued_read_commands.emplace_back();
+		CopyFrame(&manifest_ok, &this->queued_read_commands.back());
+
+		Error err = this->api->PutObject(key, data.data(), data.size());
+		ASSERT_EQ(err.code, kSuccess) << err.message;
+		ASSERT_TRUE(this->queued_read_commands.empty());
+	};
+
+	// quantumfsd answers with the manifest and then the chunk
+	auto get_object = [&](const std::vector<byte> &data) {
+		std::vector<byte> chunk_key(util::kSha1Size);
+		util::sha1(data.data(), data.size(), chunk_key.data());
+		std::vector<byte> manifest;
+		EncodeObjectManifest(data.size(), chunk_key, &manifest);
+
+		BinaryWriter manifest_response(kCmdError, 0);
+		StartBinaryResponse(&manifest_response, kCmdOk, "");
+		manifest_response.AppendBytes(manifest);
+		this->queued_read_commands.emplace_back();
+		CopyFrame(&manifest_response,
+			  &this->queued_read_commands.back());
+
+		BinaryWriter chunk(kCmdError, next_id++);
+		StartBinaryResponse(&chunk, kCmdOk, "");
+		chunk.AppendBytes(data);
+		this->queued_read_commands.emplace_back();
+		CopyFrame(&chunk, &this->queued_read_commands.back());
+
+		std::vector<byte> read_data;
+		Error err = this->api->GetObject(key, &read_data);
+		ASSERT_EQ(err.code, kSuccess) << err.message;
+		ASSERT_TRUE(this->queued_read_commands.empty());
+		ASSERT_EQ(read_data, data);
+	};
+
+	std::vector<byte> first = { 'a', 'b', 'c' };
+	put_object(first);
+	get_object(first);
+	ASSERT_EQ(this->api->GetBlockCacheStats().blocks, 1);
+
+	// the cached manifest of the first object must not be used for the second
+	std::vector<byte> second = { 'd', 'e' };
+	put_object(second);
+	get_object(second);
+}
+
+// This test covers the compression of large binary commands and responses
+TEST_F(QfsClientApiTest, BinaryCompressionTest) {
+	ASSERT_FALSE(this->api == NULL);
+
+	Error err = this->api->TestOpen();
+	ASSERT_EQ(err.code, kSuccess);
+	this->api->protocol = kProtocolBinary;
+	this->api->compression = kCompressionZlib;
+
+	std::vector<byte> key = { 1, 2, 3 };
+	std::vector<byte> data;
+	const char *pattern = "compressible ";
+	while (data.size() < 4 * kCompressionThreshold) {
+		data.insert(data.end(), pattern, pattern + strlen(pattern));
+	}
+
+	// The test api file isn't truncated between commands, so send the shorter
+	// command first. GetBlock is too small to be compressed.
+	BinaryWriter get_block(kCmdGetBlock, 0);
+	get_block.AppendBytes(key);
+	CopyFrame(&get_block, &this->expected_written_command);
+
+	BinaryWriter response(kCmdError, 0);
+	StartBinaryResponse(&response, kCmdOk, "");
+	response.AppendBytes(data);
+	ASSERT_EQ(response.Finish(), kSuccess);
+	ASSERT_TRUE(CompressBinaryFrame(response.Frame(), &this->read_command));
+
+	std::vector<byte> read_data;
+	err = this->api->GetBlock(key, &read_data);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(read_data, data);
+
+	ASSERT_EQ(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(this->actual_written_command.Data(),
+			 this->expected_written_command.Data(),
+			 this->actual_written_command.Size()), 0);
+
+	uint64_t savings = this->api->CompressionSavings();
+	ASSERT_EQ(savings, response.Frame().Size() - this->read_command.Size());
+
+	// SetBlock is written compressed
+	BinaryWriter set_block(kCmdSetBlock, 0);
+	set_block.AppendBytes(key);
+	set_block.AppendBytes(data);
+	CopyFrame(&set_block, &this->expected_written_command);
+
+	BinaryWriter ok(kCmdError, 0);
+	StartBinaryResponse(&ok, kCmdOk, "");
+	CopyFrame(&ok, &this->read_command);
+
+	err = this->api->SetBlock(key, data);
+	ASSERT_EQ(err.code, kSuccess);
+
+	ASSERT_TRUE(IsCompressedBinaryFrame(this->actual_written_command));
+	ASSERT_LT(this->actual_written_command.Size(),
+		  this->expected_written_command.Size());
+
+	CommandBuffer written;
+	err = DecompressBinaryFrame(this->actual_written_command, &written);
+	ASSERT_EQ(err.code, kSuccess);
+	ASSERT_EQ(written.Size(), this->expected_written_command.Size());
+	ASSERT_EQ(memcmp(written.Data(), this->expected_written_command.Data(),
+			 written.Size()), 0);
+
+	ASSERT_EQ(this->api->CompressionSavings(),
+		  savings + written.Size() - this->actual_written_command.Size());
+}
+
+void QfsClientDeterminePathTest::SetUp() {
+	QfsClientTest::SetUp();
+
+	std::string dummy_api_file_location = this->tree.substr(
+	    0, this->tree.find("four"));
+
+	dummy_api_file_location.append(kApiPath);
+
+	int fd = creat(dummy_api_file_location.c_str(), S_IRWXU);
+	if (fd == -1) {
+		util::fperror(__func__, "creat()");
+		return;
+	}
 	close(fd);
 
 	std::string dummy_api_dir_location = this->tree.substr(
@@ -738,7 +3017,7 @@ TEST_F(QfsClientCommandBufferTest, AppendTest) {
 	buffer.Append(data, sizeof(data));
 	ASSERT_EQ(buffer.Size(), sizeof(data));
 
-	const std::vector<byte> &buffer_data = buffer.data;
+	const auto &buffer_data = buffer.data;
 
 	ASSERT_EQ(buffer_data.size(), sizeof(data));
 	ASSERT_EQ(memcmp(buffer_data.data(), data, sizeof(data)), 0);
@@ -752,13 +3031,47 @@ TEST_F(QfsClientCommandBufferTest, CopyStringTest) {
 	ErrorCode err = buffer.CopyString(test_str.c_str());
 	ASSERT_EQ(err, kSuccess);
 
-	const std::vector<byte> &data = buffer.data;
+	const auto &data = buffer.data;
 	ASSERT_EQ(buffer.Size(), test_str.length());
 	ASSERT_EQ(memcmp(data.data(),
 			 test_str.c_str(),
 			 data.size()), 0);
 }
 
+TEST_F(QfsClientCommandBufferTest, AlignedStorageTest) {
+	CommandBuffer buffer;
+	byte datum = 'x';
+
+	buffer.Append(&datum, 1);
+	ASSERT_EQ((uintptr_t)buffer.Data() % kBufferAlignment, 0);
+
+	// Growing the buffer keeps its contents and its alignment
+	ASSERT_EQ(buffer.Resize(kMaxPooledBufferSize + 1), kSuccess);
+	ASSERT_EQ(buffer.Size(), kMaxPooledBufferSize + 1);
+	ASSERT_EQ((uintptr_t)buffer.Data() % kBufferAlignment, 0);
+	ASSERT_EQ(buffer.Data()[0], datum);
+
+	ASSERT_EQ(buffer.Resize(1), kSuccess);
+	ASSERT_EQ(buffer.Size(), 1);
+	ASSERT_EQ(buffer.Data()[0], datum);
+}
+
+TEST_F(QfsClientCommandBufferTest, BufferReuseTest) {
+	// Freed storage is reused for any size in the same class
+	void *buffer = AllocateBuffer(kMinPooledBufferSize + 1);
+	ASSERT_FALSE(buffer == NULL);
+	FreeBuffer(buffer, kMinPooledBufferSize + 1);
+
+	void *reused = AllocateBuffer(2 * kMinPooledBufferSize);
+	ASSERT_EQ(reused, buffer);
+
+	void *other = AllocateBuffer(2 * kMinPooledBufferSize);
+	ASSERT_NE(other, reused);
+
+	FreeBuffer(other, 2 * kMinPooledBufferSize);
+	FreeBuffer(reused, 2 * kMinPooledBufferSize);
+}
+
 }  // namespace qfsclient
 
 class GoLikePrinter : public ::testing::EmptyTestEventListener {
@@ -7,6 +7,7 @@
 
 #include <gtest/gtest.h>
 
+#include <deque>
 #include <string>
 #include <vector>
 
@@ -51,6 +52,10 @@ class QfsClientApiTest : public QfsClientTest, TestHook {
 	CommandBuffer expected_written_command;
 	CommandBuffer actual_written_command;
 	CommandBuffer read_command;
+
+	// Responses to be read before read_command, in order, for tests which
+	// read more than one response
+	std::deque<CommandBuffer> queued_read_commands;
 };
 
 class QfsClientDeterminePathTest : public QfsClientTest {
@@ -0,0 +1,214 @@
+// Copyright (c) 2018 Arista Networks, Inc.
+// Use of this source code is governed by the Apache License 2.0
+// that can be found in the COPYING file.
+
+#include "QFSClient/qfs_client_uring.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+// io_uring is only available with the headers of a Linux kernel which provides it
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(IORING_FEAT_SINGLE_MMAP)
+#define QFSCLIENT_IO_URING
+#endif
+#endif
+#endif
+
+namespace qfsclient {
+
+IoUring::IoUring()
+	: fd(-1),
+	  entries(0),
+	  rings(NULL),
+	  rings_size(0),
+	  sqes(NULL),
+	  sqes_size(0),
+	  sq_tail(NULL),
+	  sq_mask(NULL),
+	  sq_array(NULL),
+	  cq_head(NULL),
+	  cq_tail(NULL),
+	  cq_mask(NULL),
+	  cqes(NULL) {
+}
+
+IoUring::~IoUring() {
+	this->Release();
+}
+
+bool IoUring::Init(unsigned entries) {
+#if defined(QFSCLIENT_IO_URING)
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+
+	int fd = syscall(__NR_io_uring_setup, entries, &params);
+	if (fd == -1) {
+		return false;
+	}
+	this->fd = fd;
+
+	// Every kernel which maps both rings at once can also chain requests
+	if ((params.features & IORING_FEAT_SINGLE_MMAP) == 0) {
+		this->Release();
+		return false;
+	}
+
+	this->rings_size = std::max(
+		params.sq_off.array + params.sq_entries * sizeof(unsigned),
+		params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+	this->rings = mmap(NULL, this->rings_size, PROT_READ | PROT_WRITE,
+			   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (this->rings == MAP_FAILED) {
+		this->rings = NULL;
+		this->Release();
+		return false;
+	}
+
+	this->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+	this->sqes = mmap(NULL, this->sqes_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (this->sqes == MAP_FAILED) {
+		this->sqes = NULL;
+		this->Release();
+		return false;
+	}
+
+	byte *rings = reinterpret_cast<byte *>(this->rings);
+	this->sq_tail = reinterpret_cast<unsigned *>(rings + params.sq_off.tail);
+	this->sq_mask = reinterpret_cast<unsigned *>(rings +
+						     params.sq_off.ring_mask);
+	this->sq_array = reinterpret_cast<unsigned *>(rings + params.sq_off.array);
+	this->cq_head = reinterpret_cast<unsigned *>(rings + params.cq_off.head);
+	this->cq_tail = reinterpret_cast<unsigned *>(rings + params.cq_off.tail);
+	this->cq_mask = reinterpret_cast<unsigned *>(rings +
+						     params.cq_off.ring_mask);
+	this->cqes = rings + params.cq_off.cqes;
+
+	this->entries = params.sq_entries;
+	this->chain.reserve(this->entries);
+	return true;
+#else
+	return false;
+#endif
+}
+
+void IoUring::Release() {
+#if defined(QFSCLIENT_IO_URING)
+	if (this->sqes != NULL) {
+		munmap(this->sqes, this->sqes_size);
+		this->sqes = NULL;
+	}
+	if (this->rings != NULL) {
+		munmap(this->rings, this->rings_size);
+		this->rings = NULL;
+	}
+#endif
+	if (this->fd != -1) {
+		close(this->fd);
+		this->fd = -1;
+	}
+	this->entries = 0;
+}
+
+size_t IoUring::Capacity() const {
+	return this->entries;
+}
+
+void IoUring::AddWrite(int fd, const byte *data, size_t size, off_t offset) {
+	Request request;
+	request.write = true;
+	request.fd = fd;
+	request.iov.iov_base = const_cast<byte *>(data);
+	request.iov.iov_len = size;
+	request.offset = offset;
+	this->chain.push_back(request);
+}
+
+void IoUring::AddRead(int fd, byte *data, size_t size, off_t offset) {
+	Request request;
+	request.write = false;
+	request.fd = fd;
+	request.iov.iov_base = data;
+	request.iov.iov_len = size;
+	request.offset = offset;
+	this->chain.push_back(request);
+}
+
+bool IoUring::Submit(std::vector<ssize_t> *results) {
+	results->assign(this->chain.size(), -ECANCELED);
+	if (this->chain.empty()) {
+		return true;
+	}
+	if (this->fd == -1 || this->chain.size() > this->entries) {
+		this->chain.clear();
+		return false;
+	}
+
+#if defined(QFSCLIENT_IO_URING)
+	// Every request of the previous chain completed before Submit() returned,
+	// so the kernel has consumed all of the submission queue
+	io_uring_sqe *sqes = reinterpret_cast<io_uring_sqe *>(this->sqes);
+	unsigned tail = *this->sq_tail;
+	for (size_t i = 0; i < this->chain.size(); i++) {
+		const Request &request = this->chain[i];
+		unsigned index = tail & *this->sq_mask;
+		io_uring_sqe *sqe = &sqes[index];
+
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = request.write ? IORING_OP_WRITEV : IORING_OP_READV;
+		sqe->fd = request.fd;
+		sqe->off = request.offset;
+		sqe->addr = reinterpret_cast<uint64_t>(&request.iov);
+		sqe->len = 1;
+		sqe->user_data = i;
+		if (i + 1 < this->chain.size()) {
+			sqe->flags = IOSQE_IO_LINK;
+		}
+
+		this->sq_array[index] = index;
+		tail++;
+	}
+	__atomic_store_n(this->sq_tail, tail, __ATOMIC_RELEASE);
+
+	io_uring_cqe *cqes = reinterpret_cast<io_uring_cqe *>(this->cqes);
+	unsigned to_submit = this->chain.size();
+	size_t completed = 0;
+	while (completed < this->chain.size()) {
+		int num = syscall(__NR_io_uring_enter, this->fd, to_submit,
+				  this->chain.size() - completed,
+				  IORING_ENTER_GETEVENTS, NULL, 0);
+		if (num == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			this->chain.clear();
+			this->Release();
+			return false;
+		}
+		to_submit -= std::min((unsigned)num, to_submit);
+
+		unsigned head = *this->cq_head;
+		unsigned cq_tail = __atomic_load_n(this->cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != cq_tail; head++) {
+			const io_uring_cqe &cqe = cqes[head & *this->cq_mask];
+			(*results)[cqe.user_data] = cqe.res;
+			completed++;
+		}
+		__atomic_store_n(this->cq_head, head, __ATOMIC_RELEASE);
+	}
+#endif
+
+	this->chain.clear();
+	return true;
+}
+
+}  // namespace qfsclient
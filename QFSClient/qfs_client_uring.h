@@ -0,0 +1,83 @@
+// Copyright (c) 2018 Arista Networks, Inc.
+// Use of this source code is governed by the Apache License 2.0
+// that can be found in the COPYING file.
+
+#ifndef QFSCLIENT_QFS_CLIENT_URING_H_
+#define QFSCLIENT_QFS_CLIENT_URING_H_
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <vector>
+
+#include "QFSClient/qfs_client.h"
+
+namespace qfsclient {
+
+// IoUring makes reads and writes through an io_uring of the kernel, so that a whole
+// chain of them is submitted and waited for with a single system call. The ring is
+// set up with the system calls themselves, as liburing isn't available everywhere
+// the client is built. An IoUring may only be used by one thread at a time.
+class IoUring {
+ public:
+	IoUring();
+	~IoUring();
+
+	// Set up a ring for chains of up to entries requests. Returns false if the
+	// kernel has no io_uring, doesn't allow it to be used or is too old to
+	// chain requests, in which case plain system calls have to be used instead.
+	bool Init(unsigned entries);
+
+	// The number of requests a chain may hold
+	size_t Capacity() const;
+
+	// Add a write or read at the given offset of fd to the chain, which must
+	// stay within Capacity() requests. Each request only starts once the one
+	// before it has transferred all of its bytes, otherwise it fails with
+	// ECANCELED. The data must stay valid until Submit() returns.
+	void AddWrite(int fd, const byte *data, size_t size, off_t offset);
+	void AddRead(int fd, byte *data, size_t size, off_t offset);
+
+	// Submit the chain and wait for every request of it to complete, setting
+	// results to the outcome of each in the order they were added: the number
+	// of bytes transferred or a negated errno. The chain is emptied either way.
+	// Returns false if the ring failed, after which it mustn't be used again.
+	bool Submit(std::vector<ssize_t> *results);
+
+ private:
+	struct Request {
+		bool write;
+		int fd;
+		struct iovec iov;
+		off_t offset;
+	};
+
+	// Unmap the rings and close the ring file descriptor
+	void Release();
+
+	int fd;
+	unsigned entries;
+
+	// The submission and completion rings, which the kernel maps at once, and
+	// the submission queue entries
+	void *rings;
+	size_t rings_size;
+	void *sqes;
+	size_t sqes_size;
+
+	// The fields of the rings shared with the kernel
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	void *cqes;
+
+	// The chain to be submitted by Submit()
+	std::vector<Request> chain;
+};
+
+}  // namespace qfsclient
+
+#endif  // QFSCLIENT_QFS_CLIENT_URING_H_
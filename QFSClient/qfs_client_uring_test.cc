@@ -0,0 +1,115 @@
+// Copyright (c) 2018 Arista Networks, Inc.
+// Use of this source code is governed by the Apache License 2.0
+// that can be found in the COPYING file.
+
+#include "QFSClient/qfs_client_uring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+namespace qfsclient {
+
+class QfsClientUringTest : public testing::Test {
+ protected:
+	virtual void SetUp() {
+		const char *tmp_dir = getenv("TMPDIR");
+		if (!tmp_dir) {
+			tmp_dir = "/tmp";
+		}
+		snprintf(this->path, sizeof(this->path),
+			 "%s/qfs-client-uring-test-XXXXXX", tmp_dir);
+		this->fd = mkstemp(this->path);
+		ASSERT_NE(this->fd, -1);
+	}
+
+	virtual void TearDown() {
+		close(this->fd);
+		unlink(this->path);
+	}
+
+	char path[PATH_MAX];
+	int fd;
+};
+
+TEST_F(QfsClientUringTest, ChainTest) {
+	IoUring ring;
+	if (!ring.Init(8)) {
+		// The kernel doesn't provide io_uring, so there is nothing to test
+		return;
+	}
+	ASSERT_GE(ring.Capacity(), 8);
+
+	const std::string first = "sausages";
+	const std::string second = "pickles";
+	byte data[32];
+	ring.AddWrite(this->fd, reinterpret_cast<const byte *>(first.data()),
+		      first.size(), 0);
+	ring.AddWrite(this->fd, reinterpret_cast<const byte *>(second.data()),
+		      second.size(), 3);
+	ring.AddRead(this->fd, data, sizeof(data), 0);
+
+	// The requests are made in order, so the read sees both writes
+	std::vector<ssize_t> results;
+	ASSERT_TRUE(ring.Submit(&results));
+	ASSERT_EQ(results.size(), 3);
+	ASSERT_EQ(results[0], first.size());
+	ASSERT_EQ(results[1], second.size());
+	ASSERT_EQ(results[2], 10);
+	ASSERT_EQ(std::string(reinterpret_cast<char *>(data), results[2]),
+		  "saupickles");
+
+	// The ring is ready for the next chain
+	ring.AddRead(this->fd, data, 3, 7);
+	ASSERT_TRUE(ring.Submit(&results));
+	ASSERT_EQ(results.size(), 1);
+	ASSERT_EQ(results[0], 3);
+	ASSERT_EQ(memcmp(data, "les", 3), 0);
+}
+
+TEST_F(QfsClientUringTest, FailedChainTest) {
+	IoUring ring;
+	if (!ring.Init(8)) {
+		return;
+	}
+
+	int read_only = open(this->path, O_RDONLY);
+	ASSERT_NE(read_only, -1);
+
+	// The read isn't made once the write before it has failed
+	const byte command[] = { 1, 2, 3 };
+	byte data[3];
+	ring.AddWrite(read_only, command, sizeof(command), 0);
+	ring.AddRead(read_only, data, sizeof(data), 0);
+
+	std::vector<ssize_t> results;
+	ASSERT_TRUE(ring.Submit(&results));
+	close(read_only);
+	ASSERT_EQ(results.size(), 2);
+	ASSERT_EQ(results[0], -EBADF);
+	ASSERT_EQ(results[1], -ECANCELED);
+}
+
+TEST_F(QfsClientUringTest, InitFailureTest) {
+	// A ring without entries can't be set up, which leaves nothing to submit
+	// to
+	IoUring ring;
+	ASSERT_FALSE(ring.Init(0));
+	ASSERT_EQ(ring.Capacity(), 0);
+
+	byte data[3];
+	ring.AddRead(this->fd, data, sizeof(data), 0);
+	std::vector<ssize_t> results;
+	ASSERT_FALSE(ring.Submit(&results));
+}
+
+}  // namespace qfsclient
@@ -4,9 +4,11 @@
 
 #include "QFSClient/qfs_client_util.h"
 
-#include <openssl/bio.h>
-#include <openssl/buffer.h>
-#include <openssl/evp.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 #include <algorithm>
 
@@ -97,6 +99,19 @@ std::string getErrorMessage(ErrorCode code, const std::string &details) {
 		return "an internal buffer is getting too big";
 	case kJsonObjectWrongType:
 		return "a JSON object had the wrong type: " + details;
+	case kUnknownRequestId:
+		return "no command with request ID " + details + " is in flight";
+	case kSharedMemoryFail:
+		return "couldn't set up shared memory (" + details + ")";
+	case kObjectCorrupt:
+		return "the object is corrupt: " + details;
+	case kObjectFileWriteFail:
+		return "couldn't write the object to its file (" + details + ")";
+	case kBufferTooSmall:
+		return "the buffer is too small for the block of " + details +
+		       " bytes";
+	case kCantStartWorker:
+		return "couldn't start a worker thread (" + details + ")";
 	}
 
 	std::string result("unknown error (");
@@ -124,9 +139,11 @@ std::string getApiError(CommandError code, std::string message) {
 		return "command failed (" + message + ")";
 	case kCmdKeyNotFound:
 		return "extended key not found in datastore (" + message + ")";
-	case kErrorBlockTooLarge:
+	case kCmdBlockTooLarge:
 		return "SetBlock was passed a block that was too large: (" +
 			message + ")";
+	case kCmdWorkspaceNotFound:
+		return "workspace not found (" + message + ")";
 	}
 
 	std::string result("unrecognised error code (");
@@ -159,63 +176,457 @@ void requote(std::string *s) {
 	std::replace(s->begin(), s->end(), '\'', '"');
 }
 
-Error base64_encode(const std::vector<byte> &data, std::string *b64) {
-	b64->clear();
+static const char kBase64Alphabet[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// The value of each base64 character, or -1 for characters which aren't
+struct Base64Values {
+	Base64Values() {
+		memset(this->values, -1, sizeof(this->values));
+		for (int i = 0; i < 64; i++) {
+			this->values[(unsigned char)kBase64Alphabet[i]] = i;
+		}
+	}
+
+	int8_t values[256];
+};
+
+typedef size_t (*Base64Encoder)(const byte *data, size_t size, char *b64);
+typedef size_t (*Base64Decoder)(const char *b64, size_t size, byte *data,
+				bool *valid);
+
+// The vectorised codecs handle as much of the input as they can in whole blocks
+// and return how much that was, leaving the rest, including any padding, to the
+// scalar code. Each returns zero where the CPU doesn't support it.
+
+static size_t Base64EncodeNone(const byte *data, size_t size, char *b64) {
+	return 0;
+}
+
+static size_t Base64DecodeNone(const char *b64, size_t size, byte *data,
+			       bool *valid) {
+	return 0;
+}
+
+#if defined(__x86_64__)
+
+// These follow "Base64 encoding and decoding at almost the speed of a memory copy"
+// by Muła and Lemire. Encoding spreads each three bytes over four, extracts the
+// four six bit indices with multiplies and translates them to characters with a
+// table of offsets for the ranges of the alphabet. Decoding classifies each
+// character by its nibbles, which both validates it and selects the offset back
+// to its value, and then packs four values into three bytes with multiplies.
+
+__attribute__((target("ssse3")))
+static __m128i Base64EncodeIndices128(__m128i in) {
+	in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7,
+					       4, 5, 3, 4, 1, 2, 0, 1));
+	__m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+	__m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+	__m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+	__m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+	return _mm_or_si128(t1, t3);
+}
 
-	BIO *bio = BIO_new(BIO_f_base64());
-	BIO *bio_mem = BIO_new(BIO_s_mem());
+__attribute__((target("ssse3")))
+static __m128i Base64EncodeCharacters128(__m128i indices) {
+	const __m128i offsets = _mm_setr_epi8(
+		'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+		'/' - 63, 'A', 0, 0);
+
+	// 0-25 become 13, 26-51 become 0, 52-61 become 1-10 and 62 and 63
+	// become 11 and 12, the positions of their offsets
+	__m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+	__m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+	range = _mm_or_si128(range, _mm_and_si128(upper, _mm_set1_epi8(13)));
+	return _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, range));
+}
+
+// Encodes 12 bytes at a time, reading 16
+__attribute__((target("ssse3")))
+static size_t Base64EncodeSsse3(const byte *data, size_t size, char *b64) {
+	size_t i = 0;
+	for (; size - i >= 16; i += 12, b64 += 16) {
+		__m128i in = _mm_loadu_si128(
+			reinterpret_cast<const __m128i *>(data + i));
+		__m128i out = Base64EncodeCharacters128(
+			Base64EncodeIndices128(in));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(b64), out);
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static __m256i Base64EncodeIndices256(__m256i in) {
+	in = _mm256_shuffle_epi8(in, _mm256_set_epi8(
+		10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+		10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+	__m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+	__m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+	__m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+	__m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+	return _mm256_or_si256(t1, t3);
+}
+
+__attribute__((target("avx2")))
+static __m256i Base64EncodeCharacters256(__m256i indices) {
+	const __m256i offsets = _mm256_setr_epi8(
+		'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+		'/' - 63, 'A', 0, 0,
+		'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+		'/' - 63, 'A', 0, 0);
+
+	__m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+	__m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+	range = _mm256_or_si256(range,
+				_mm256_and_si256(upper, _mm256_set1_epi8(13)));
+	return _mm256_add_epi8(indices, _mm256_shuffle_epi8(offsets, range));
+}
 
-	if (!bio || !bio_mem) {
-		return getError(kJsonEncodingError, "BIO_new");
+// Encodes 24 bytes at a time, reading 28
+__attribute__((target("avx2")))
+static size_t Base64EncodeAvx2(const byte *data, size_t size, char *b64) {
+	size_t i = 0;
+	for (; size - i >= 28; i += 24, b64 += 32) {
+		__m128i low = _mm_loadu_si128(
+			reinterpret_cast<const __m128i *>(data + i));
+		__m128i high = _mm_loadu_si128(
+			reinterpret_cast<const __m128i *>(data + i + 12));
+		__m256i in = _mm256_inserti128_si256(
+			_mm256_castsi128_si256(low), high, 1);
+		__m256i out = Base64EncodeCharacters256(
+			Base64EncodeIndices256(in));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(b64), out);
 	}
+	return i;
+}
 
-	// we have no need for linebreaks in the generated base64 text
-	BIO_set_flags(bio, BIO_FLAGS_BASE64_NO_NL);
+// Decodes 16 characters at a time into 12 bytes, writing 16. Stops short of the
+// last 8 characters, which may hold padding, so that the extra bytes written are
+// always within the output.
+__attribute__((target("ssse3")))
+static size_t Base64DecodeSsse3(const char *b64, size_t size, byte *data,
+				bool *valid) {
+	const __m128i lut_low = _mm_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+	const __m128i lut_high = _mm_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m128i lut_roll = _mm_setr_epi8(
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i mask_2f = _mm_set1_epi8(0x2f);
+
+	size_t i = 0;
+	for (; size - i >= 24; i += 16, data += 12) {
+		__m128i in = _mm_loadu_si128(
+			reinterpret_cast<const __m128i *>(b64 + i));
+
+		__m128i high_nibbles = _mm_and_si128(_mm_srli_epi32(in, 4),
+						     mask_2f);
+		__m128i low = _mm_shuffle_epi8(lut_low,
+					       _mm_and_si128(in, mask_2f));
+		__m128i high = _mm_shuffle_epi8(lut_high, high_nibbles);
+		__m128i invalid = _mm_and_si128(low, high);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(invalid,
+						     _mm_setzero_si128())) !=
+		    0xffff) {
+			*valid = false;
+			return i;
+		}
 
-	bio = BIO_push(bio, bio_mem);
+		__m128i slash = _mm_cmpeq_epi8(in, mask_2f);
+		__m128i roll = _mm_shuffle_epi8(lut_roll,
+						_mm_add_epi8(slash, high_nibbles));
+		__m128i values = _mm_add_epi8(in, roll);
+
+		__m128i pairs = _mm_maddubs_epi16(values,
+						  _mm_set1_epi32(0x01400140));
+		__m128i out = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+		out = _mm_shuffle_epi8(out, _mm_setr_epi8(
+			2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(data), out);
+	}
+	return i;
+}
 
-	if (BIO_write(bio, data.data(), data.size()) == data.size()) {
-		if (BIO_flush(bio) != 1) {
-			return getError(kJsonEncodingError, "BIO_flush");
+// Decodes 32 characters at a time into 24 bytes, writing 32. Stops short of the
+// last 16 characters for the same reasons as the SSSE3 decoder.
+__attribute__((target("avx2")))
+static size_t Base64DecodeAvx2(const char *b64, size_t size, byte *data,
+			       bool *valid) {
+	const __m256i lut_low = _mm256_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+	const __m256i lut_high = _mm256_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m256i lut_roll = _mm256_setr_epi8(
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+
+	size_t i = 0;
+	for (; size - i >= 48; i += 32, data += 24) {
+		__m256i in = _mm256_loadu_si256(
+			reinterpret_cast<const __m256i *>(b64 + i));
+
+		__m256i high_nibbles = _mm256_and_si256(
+			_mm256_srli_epi32(in, 4), mask_2f);
+		__m256i low = _mm256_shuffle_epi8(lut_low,
+						  _mm256_and_si256(in, mask_2f));
+		__m256i high = _mm256_shuffle_epi8(lut_high, high_nibbles);
+		if (!_mm256_testz_si256(low, high)) {
+			*valid = false;
+			return i;
 		}
-		BUF_MEM *result;
-		BIO_get_mem_ptr(bio, &result);
-		b64->assign((const char *)result->data, (size_t)result->length);
-	} else {
-		return getError(kJsonEncodingError, "BIO_write");
+
+		__m256i slash = _mm256_cmpeq_epi8(in, mask_2f);
+		__m256i roll = _mm256_shuffle_epi8(
+			lut_roll, _mm256_add_epi8(slash, high_nibbles));
+		__m256i values = _mm256_add_epi8(in, roll);
+
+		__m256i pairs = _mm256_maddubs_epi16(
+			values, _mm256_set1_epi32(0x01400140));
+		__m256i out = _mm256_madd_epi16(pairs,
+						_mm256_set1_epi32(0x00011000));
+		out = _mm256_shuffle_epi8(out, _mm256_setr_epi8(
+			2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+			2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+		// gather the twelve bytes of each lane together
+		out = _mm256_permutevar8x32_epi32(
+			out, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(data), out);
 	}
+	return i;
+}
 
-	BIO_free_all(bio);
+static Base64Encoder SelectBase64Encoder() {
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return Base64EncodeAvx2;
+	}
+	if (__builtin_cpu_supports("ssse3")) {
+		return Base64EncodeSsse3;
+	}
+	return Base64EncodeNone;
+}
 
-	return getError(kSuccess);
+static Base64Decoder SelectBase64Decoder() {
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return Base64DecodeAvx2;
+	}
+	if (__builtin_cpu_supports("ssse3")) {
+		return Base64DecodeSsse3;
+	}
+	return Base64DecodeNone;
 }
 
-Error base64_decode(const std::string &b64, std::vector<byte> *data) {
-	data->clear();
+#else
+
+static Base64Encoder SelectBase64Encoder() {
+	return Base64EncodeNone;
+}
+
+static Base64Decoder SelectBase64Decoder() {
+	return Base64DecodeNone;
+}
+
+#endif
+
+size_t base64_encoded_size(size_t size) {
+	return (size + 2) / 3 * 4;
+}
+
+size_t base64_decoded_capacity(size_t size) {
+	return size / 4 * 3;
+}
 
-	int max_result_size = ((b64.length() * 6) + 7) / 8;
-	data->resize(max_result_size);
+void base64_encode(const byte *data, size_t size, char *b64) {
+	// chosen once for the CPU the library finds itself running on
+	static const Base64Encoder encode = SelectBase64Encoder();
 
-	BIO *bio = BIO_new(BIO_f_base64());
-	BIO *bio_mem = BIO_new_mem_buf(const_cast<char*>(b64.c_str()),
-	                               b64.length() + 1);
-	if(!bio || !bio_mem) {
-		return getError(kJsonDecodingError, "BIO_new");
+	size_t i = encode(data, size, b64);
+	b64 += i / 3 * 4;
+
+	for (; size - i >= 3; i += 3, b64 += 4) {
+		uint32_t triple = (data[i] << 16) | (data[i + 1] << 8) |
+				  data[i + 2];
+		b64[0] = kBase64Alphabet[(triple >> 18) & 0x3f];
+		b64[1] = kBase64Alphabet[(triple >> 12) & 0x3f];
+		b64[2] = kBase64Alphabet[(triple >> 6) & 0x3f];
+		b64[3] = kBase64Alphabet[triple & 0x3f];
+	}
+
+	if (size - i == 1) {
+		b64[0] = kBase64Alphabet[data[i] >> 2];
+		b64[1] = kBase64Alphabet[(data[i] & 0x03) << 4];
+		b64[2] = '=';
+		b64[3] = '=';
+	} else if (size - i == 2) {
+		b64[0] = kBase64Alphabet[data[i] >> 2];
+		b64[1] = kBase64Alphabet[((data[i] & 0x03) << 4) |
+					 (data[i + 1] >> 4)];
+		b64[2] = kBase64Alphabet[(data[i + 1] & 0x0f) << 2];
+		b64[3] = '=';
+	}
+}
+
+bool base64_decode(const char *b64, size_t size, byte *data, size_t *decoded) {
+	static const Base64Decoder decode = SelectBase64Decoder();
+	static const Base64Values table;
+	const int8_t *values = table.values;
+
+	if (size % 4 != 0) {
+		return false;
+	}
+
+	bool valid = true;
+	size_t i = decode(b64, size, data, &valid);
+	if (!valid) {
+		return false;
+	}
+	byte *out = data + i / 4 * 3;
+
+	for (; i < size; i += 4) {
+		// only the last four characters may be padded, with one or two '='
+		size_t padding = 0;
+		if (i + 4 == size) {
+			padding = b64[i + 3] != '=' ? 0 : b64[i + 2] != '=' ? 1 : 2;
+		}
+
+		uint32_t quad = 0;
+		for (size_t j = 0; j < 4 - padding; j++) {
+			int8_t value = values[(unsigned char)b64[i + j]];
+			if (value < 0) {
+				return false;
+			}
+			quad |= value << (18 - 6 * j);
+		}
+
+		*out++ = quad >> 16;
+		if (padding < 2) {
+			*out++ = quad >> 8;
+		}
+		if (padding < 1) {
+			*out++ = quad;
+		}
+	}
+
+	*decoded = out - data;
+	return true;
+}
+
+static uint32_t Rotl32(uint32_t value, int bits) {
+	return (value << bits) | (value >> (32 - bits));
+}
+
+// Mix a 64 byte block of the message into the state
+static void Sha1Block(uint32_t *state, const byte *block) {
+	uint32_t w[80];
+	for (int i = 0; i < 16; i++) {
+		w[i] = (block[4 * i] << 24) | (block[4 * i + 1] << 16) |
+		       (block[4 * i + 2] << 8) | block[4 * i + 3];
+	}
+	for (int i = 16; i < 80; i++) {
+		w[i] = Rotl32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
 	}
 
-	// if we don't set this flag, the decoder will expect at least a
-	// terminating linebreak in the input string
-	BIO_set_flags(bio, BIO_FLAGS_BASE64_NO_NL);
+	uint32_t a = state[0];
+	uint32_t b = state[1];
+	uint32_t c = state[2];
+	uint32_t d = state[3];
+	uint32_t e = state[4];
+	for (int i = 0; i < 80; i++) {
+		uint32_t f, k;
+		if (i < 20) {
+			f = (b & c) | (~b & d);
+			k = 0x5a827999;
+		} else if (i < 40) {
+			f = b ^ c ^ d;
+			k = 0x6ed9eba1;
+		} else if (i < 60) {
+			f = (b & c) | (b & d) | (c & d);
+			k = 0x8f1bbcdc;
+		} else {
+			f = b ^ c ^ d;
+			k = 0xca62c1d6;
+		}
+
+		uint32_t temp = Rotl32(a, 5) + f + e + k + w[i];
+		e = d;
+		d = c;
+		c = Rotl32(b, 30);
+		b = a;
+		a = temp;
+	}
 
-	bio = BIO_push(bio, bio_mem);
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+}
+
+void sha1(const byte *data, size_t size, byte *digest) {
+	uint32_t state[5] = {
+		0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+	};
+
+	size_t whole = size / 64 * 64;
+	for (size_t i = 0; i < whole; i += 64) {
+		Sha1Block(state, data + i);
+	}
+
+	// The rest of the message is padded with a one bit, zeros and its length
+	// in bits, which may take another block
+	byte tail[128] = {};
+	size_t rest = size - whole;
+	if (rest != 0) {
+		memcpy(tail, data + whole, rest);
+	}
+	tail[rest] = 0x80;
+	size_t tail_size = rest + 9 <= 64 ? 64 : 128;
+	uint64_t bits = static_cast<uint64_t>(size) * 8;
+	for (int i = 0; i < 8; i++) {
+		tail[tail_size - 1 - i] = bits >> (8 * i);
+	}
+	for (size_t i = 0; i < tail_size; i += 64) {
+		Sha1Block(state, tail + i);
+	}
 
-	int actual_result_size = BIO_read(bio, data->data(), max_result_size);
-	if (actual_result_size <= 0) {
-		return getError(kJsonDecodingError, "BIO_read");
+	for (int i = 0; i < 5; i++) {
+		digest[4 * i] = state[i] >> 24;
+		digest[4 * i + 1] = state[i] >> 16;
+		digest[4 * i + 2] = state[i] >> 8;
+		digest[4 * i + 3] = state[i];
 	}
-	data->resize(actual_result_size);
+}
 
-	BIO_free_all(bio);
+Error base64_encode(const std::vector<byte> &data, std::string *b64) {
+	b64->resize(base64_encoded_size(data.size()));
+	base64_encode(data.data(), data.size(), &(*b64)[0]);
+
+	return getError(kSuccess);
+}
+
+Error base64_decode(const std::string &b64, std::vector<byte> *data) {
+	data->resize(base64_decoded_capacity(b64.size()));
+
+	size_t decoded;
+	if (!base64_decode(b64.data(), b64.size(), data->data(), &decoded)) {
+		data->clear();
+		return getError(kJsonDecodingError, "invalid base64");
+	}
+	data->resize(decoded);
 
 	return getError(kSuccess);
 }
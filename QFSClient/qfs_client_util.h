@@ -5,8 +5,6 @@
 #ifndef QFSCLIENT_QFS_CLIENT_UTIL_H_
 #define QFSCLIENT_QFS_CLIENT_UTIL_H_
 
-#include <jansson.h>
-
 #include <string>
 #include <vector>
 
@@ -65,6 +63,31 @@ Error base64_encode(const std::vector<byte> &data, std::string *b64);
 // std::vector<byte> pointed to by the data parameter.
 Error base64_decode(const std::string &b64, std::vector<byte> *data);
 
+// The base64 codec works on the caller's buffers, so that it may encode straight
+// into a request and decode straight out of a response. It is vectorised with
+// AVX2 or SSSE3 where the CPU supports them.
+
+// The number of characters in the base64 encoding of size bytes
+size_t base64_encoded_size(size_t size);
+
+// The room needed to decode size characters of base64
+size_t base64_decoded_capacity(size_t size);
+
+// Encode size bytes of data into the base64_encoded_size(size) characters at b64
+void base64_encode(const byte *data, size_t size, char *b64);
+
+// Decode size characters of padded base64 into data, which must have room for
+// base64_decoded_capacity(size) bytes, setting decoded to the number of bytes
+// decoded. Returns false if b64 isn't valid base64.
+bool base64_decode(const char *b64, size_t size, byte *data, size_t *decoded);
+
+// The size of a SHA-1 digest, which is that of the key of a block
+const size_t kSha1Size = 20;
+
+// Compute the SHA-1 digest of size bytes of data into the kSha1Size bytes at
+// digest
+void sha1(const byte *data, size_t size, byte *digest);
+
 template <unsigned N>
 class AlignedMem {
  public:
@@ -4,6 +4,13 @@
 
 #include "QFSClient/qfs_client_util.h"
 
+#include <openssl/bio.h>
+#include <openssl/buffer.h>
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+#include <stdio.h>
+#include <time.h>
+
 #include <gtest/gtest.h>
 
 #include <string>
@@ -163,4 +170,185 @@ TEST_F(QfsClientUtilTest, Base64BigBadTest) {
 	ASSERT_NE(memcmp(data.data(), result.data(), data.size()), 0);
 }
 
+// Test the base64 codec against OpenSSL at every length around the blocks of the
+// vectorised code, so that each of its tails is covered
+TEST_F(QfsClientUtilTest, Base64LengthsTest) {
+	std::vector<byte> block(1024 + 100);
+	QfsClientUtilTest::RandomiseBlock(block.data(), block.size());
+
+	std::vector<size_t> sizes;
+	for (size_t size = 0; size <= 200; size++) {
+		sizes.push_back(size);
+	}
+	sizes.push_back(1024);
+	sizes.push_back(1024 + 99);
+
+	for (size_t size : sizes) {
+		std::vector<byte> data(block.begin(), block.begin() + size);
+
+		std::string expected(util::base64_encoded_size(size) + 1, '\0');
+		int length = EVP_EncodeBlock((unsigned char *)&expected[0],
+					     data.data(), size);
+		expected.resize(length);
+
+		std::string b64;
+		ASSERT_EQ(util::base64_encode(data, &b64).code, kSuccess);
+		ASSERT_EQ(b64, expected) << "size " << size;
+
+		std::vector<byte> result;
+		ASSERT_EQ(util::base64_decode(b64, &result).code, kSuccess);
+		ASSERT_EQ(result, data) << "size " << size;
+	}
+}
+
+// Negative test for decoding malformed base64
+TEST_F(QfsClientUtilTest, Base64InvalidTest) {
+	std::vector<byte> block(300);
+	QfsClientUtilTest::RandomiseBlock(block.data(), block.size());
+
+	std::string b64;
+	util::base64_encode(block, &b64);
+	ASSERT_EQ(b64.size(), 400);
+
+	std::vector<std::string> invalid = {
+		"QUJD=",   // not a multiple of four characters
+		"QU=D",    // padding before the end
+		"Q===",    // too much padding
+		"QUJ\\",   // not in the alphabet
+		"QUJD\n",  // line breaks aren't expected
+	};
+
+	// a bad character early in, and late in, a long string, where the
+	// vectorised decoders are used
+	std::string bad = b64;
+	bad[5] = '.';
+	invalid.push_back(bad);
+	bad = b64;
+	bad[b64.size() - 30] = '\x80';
+	invalid.push_back(bad);
+	bad = b64;
+	bad[200] = '=';
+	invalid.push_back(bad);
+
+	for (const std::string &value : invalid) {
+		std::vector<byte> result;
+		ASSERT_EQ(util::base64_decode(value, &result).code,
+			  kJsonDecodingError) << value;
+	}
+
+	// whereas an empty string is an empty block
+	std::vector<byte> result = { 1 };
+	ASSERT_EQ(util::base64_decode("", &result).code, kSuccess);
+	ASSERT_TRUE(result.empty());
+}
+
+// Check the SHA-1 digests of messages of every length around the block size, for
+// which the padding differs, against those of OpenSSL
+TEST_F(QfsClientUtilTest, Sha1Test) {
+	const byte abc[] = { 'a', 'b', 'c' };
+	const byte abc_digest[] = {
+		0xa9, 0x99, 0x3e, 0x36, 0x47, 0x06, 0x81, 0x6a, 0xba, 0x3e,
+		0x25, 0x71, 0x78, 0x50, 0xc2, 0x6c, 0x9c, 0xd0, 0xd8, 0x9d,
+	};
+	byte digest[util::kSha1Size];
+	util::sha1(abc, sizeof(abc), digest);
+	ASSERT_EQ(memcmp(digest, abc_digest, sizeof(digest)), 0);
+
+	std::vector<byte> data(1000);
+	for (size_t i = 0; i < data.size(); i++) {
+		data[i] = i * 7 + 3;
+	}
+
+	for (size_t size = 0; size <= data.size(); size++) {
+		byte expected[SHA_DIGEST_LENGTH];
+		SHA1(data.data(), size, expected);
+
+		util::sha1(data.data(), size, digest);
+		ASSERT_EQ(memcmp(digest, expected, sizeof(digest)), 0) << size;
+	}
+}
+
+// The codec base64 used to be done with, an OpenSSL BIO chain, for comparison
+static void BioBase64Encode(const std::vector<byte> &data, std::string *b64) {
+	BIO *bio = BIO_new(BIO_f_base64());
+	BIO_set_flags(bio, BIO_FLAGS_BASE64_NO_NL);
+	bio = BIO_push(bio, BIO_new(BIO_s_mem()));
+
+	BIO_write(bio, data.data(), data.size());
+	BIO_flush(bio);
+	BUF_MEM *result;
+	BIO_get_mem_ptr(bio, &result);
+	b64->assign((const char *)result->data, (size_t)result->length);
+
+	BIO_free_all(bio);
+}
+
+static void BioBase64Decode(const std::string &b64, std::vector<byte> *data) {
+	data->resize(b64.length() * 3 / 4);
+
+	BIO *bio = BIO_new(BIO_f_base64());
+	BIO_set_flags(bio, BIO_FLAGS_BASE64_NO_NL);
+	bio = BIO_push(bio, BIO_new_mem_buf(const_cast<char *>(b64.c_str()),
+					    b64.length()));
+
+	data->resize(BIO_read(bio, data->data(), data->size()));
+
+	BIO_free_all(bio);
+}
+
+static double Seconds() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Print the throughput, in MB/s of the block, of the base64 codec and of the BIO
+// chain it replaced for the sizes of block SetBlock and GetBlock handle. Run with
+// --gtest_also_run_disabled_tests --gtest_filter=*Base64Benchmark*
+TEST_F(QfsClientUtilTest, DISABLED_Base64BenchmarkTest) {
+	const size_t kBytesPerSize = 256 * 1024 * 1024;
+
+	printf("%8s %12s %12s %12s %12s\n", "size", "encode", "BIO encode",
+	       "decode", "BIO decode");
+
+	for (size_t size = 4096; size <= kMaxBlockSize; size *= 2) {
+		std::vector<byte> data(size);
+		QfsClientUtilTest::RandomiseBlock(data.data(), size);
+		size_t iterations = kBytesPerSize / size;
+
+		std::string b64;
+		std::vector<byte> result;
+		double rates[4];
+
+		double start = Seconds();
+		for (size_t i = 0; i < iterations; i++) {
+			util::base64_encode(data, &b64);
+		}
+		rates[0] = kBytesPerSize / (Seconds() - start) / 1e6;
+
+		start = Seconds();
+		for (size_t i = 0; i < iterations; i++) {
+			BioBase64Encode(data, &b64);
+		}
+		rates[1] = kBytesPerSize / (Seconds() - start) / 1e6;
+
+		start = Seconds();
+		for (size_t i = 0; i < iterations; i++) {
+			util::base64_decode(b64, &result);
+		}
+		rates[2] = kBytesPerSize / (Seconds() - start) / 1e6;
+		ASSERT_EQ(result, data);
+
+		start = Seconds();
+		for (size_t i = 0; i < iterations; i++) {
+			BioBase64Decode(b64, &result);
+		}
+		rates[3] = kBytesPerSize / (Seconds() - start) / 1e6;
+		ASSERT_EQ(result, data);
+
+		printf("%8zu %12.0f %12.0f %12.0f %12.0f\n", size, rates[0],
+		       rates[1], rates[2], rates[3]);
+	}
+}
+
 }  // namespace qfsclient
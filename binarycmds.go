@@ -0,0 +1,479 @@
+// Copyright (c) 2018 Arista Networks, Inc.
+// Use of this source code is governed by the Apache License 2.0
+// that can be found in the COPYING file.
+
+package quantumfs
+
+// This file contains the binary encoding of the api commands. A client may switch
+// an api file handle from JSON to the binary encoding with CmdSetProtocol, after
+// which every command and response on that handle is a single binary frame.
+//
+// A frame is a BinaryHeaderSize byte header followed by the payload. All integers
+// are little endian. The payload is the command structure with its fields encoded
+// in declaration order, with embedded structures (such as CommandCommon) encoded
+// inline where they are declared:
+//
+// - uint32 and int32 are encoded as four bytes
+// - uint64, int64, uint and int are encoded as eight bytes
+// - bool is encoded as a single byte
+// - string and []byte are encoded as a uint32 length followed by the raw bytes
+// - other slices are encoded as a uint32 count followed by each element
+// - maps are encoded as a uint32 count followed by each key and value pair
+//
+// The payload of every command therefore begins with the CommandId. QFSClient
+// (qfs_client_binary.h) must encode and decode fields in exactly this order, which
+// its tests check against the field tables "make qfsclientdata" generates.
+//
+// A frame with BinaryFlagCompressed set in its header carries its payload
+// compressed. Such a payload is the uint32 length of the uncompressed payload
+// followed by the zlib stream of it. Either side may compress a request, but
+// responses are only compressed once the client has asked for it with
+// CmdSetProtocol.
+
+import (
+	"bytes"
+	"compress/zlib"
+	"encoding/binary"
+	"fmt"
+	"io"
+	"math"
+	"reflect"
+)
+
+// The protocols an api file handle may speak. See CmdSetProtocol.
+const (
+	ProtocolJson   = 0
+	ProtocolBinary = 1
+)
+
+// The compression of binary frames a client may ask for with CmdSetProtocol
+const (
+	CompressionNone = 0
+	CompressionZlib = 1
+)
+
+const BinaryMagic = 0x42534651 // "QFSB"
+const BinaryVersion = 1
+const BinaryHeaderSize = 12
+
+// Flags of the BinaryHeader
+const BinaryFlagCompressed = 1 << 0
+
+// Frames with less payload than this aren't worth compressing
+const CompressionThreshold = 4096
+
+// The header at the start of every binary frame
+type BinaryHeader struct {
+	Magic   uint32
+	Version uint16
+	Flags   uint16
+	Length  uint32 // Length of the payload following the header
+}
+
+// Decode the header at the start of the frame, which may not yet hold the payload
+func decodeBinaryHeader(frame []byte) (BinaryHeader, error) {
+	var header BinaryHeader
+	if len(frame) < BinaryHeaderSize {
+		return header, fmt.Errorf("Binary frame too short: %d bytes",
+			len(frame))
+	}
+
+	header.Magic = binary.LittleEndian.Uint32(frame[0:4])
+	header.Version = binary.LittleEndian.Uint16(frame[4:6])
+	header.Flags = binary.LittleEndian.Uint16(frame[6:8])
+	header.Length = binary.LittleEndian.Uint32(frame[8:12])
+
+	if header.Magic != BinaryMagic {
+		return header, fmt.Errorf("Bad binary frame magic %x", header.Magic)
+	}
+	if header.Version != BinaryVersion {
+		return header, fmt.Errorf("Unsupported binary frame version %d",
+			header.Version)
+	}
+	return header, nil
+}
+
+func parseBinaryHeader(frame []byte) (BinaryHeader, error) {
+	header, err := decodeBinaryHeader(frame)
+	if err != nil {
+		return header, err
+	}
+	if uint64(header.Length) > uint64(len(frame)-BinaryHeaderSize) {
+		return header, fmt.Errorf("Binary frame truncated: %d of %d bytes",
+			len(frame)-BinaryHeaderSize, header.Length)
+	}
+	return header, nil
+}
+
+// ReadBinaryFrame reads a single whole frame from a stream, such as the api socket,
+// where frames follow one another. Frames with a payload longer than maxLength
+// bytes are refused without reading the payload.
+func ReadBinaryFrame(reader io.Reader, maxLength uint32) ([]byte, error) {
+	header := make([]byte, BinaryHeaderSize)
+	if _, err := io.ReadFull(reader, header); err != nil {
+		return nil, err
+	}
+
+	decoded, err := decodeBinaryHeader(header)
+	if err != nil {
+		return nil, err
+	}
+	if decoded.Length > maxLength {
+		return nil, fmt.Errorf("Binary frame of %d bytes exceeds %d bytes",
+			decoded.Length, maxLength)
+	}
+
+	frame := make([]byte, BinaryHeaderSize+int(decoded.Length))
+	copy(frame, header)
+	if _, err := io.ReadFull(reader, frame[BinaryHeaderSize:]); err != nil {
+		if err == io.EOF {
+			err = io.ErrUnexpectedEOF
+		}
+		return nil, err
+	}
+	return frame, nil
+}
+
+// EncodeBinaryCommand returns the binary frame of the given command or response,
+// which must be a structure or a pointer to one.
+func EncodeBinaryCommand(cmd interface{}) []byte {
+	frame := make([]byte, BinaryHeaderSize, BinaryHeaderSize+256)
+	frame = appendBinaryValue(frame, reflect.Indirect(reflect.ValueOf(cmd)))
+
+	binary.LittleEndian.PutUint32(frame[0:4], BinaryMagic)
+	binary.LittleEndian.PutUint16(frame[4:6], BinaryVersion)
+	binary.LittleEndian.PutUint16(frame[6:8], 0)
+	binary.LittleEndian.PutUint32(frame[8:12],
+		uint32(len(frame)-BinaryHeaderSize))
+	return frame
+}
+
+// DecodeBinaryCommand fills the structure pointed to by cmd from the payload of
+// the given frame. Trailing payload which isn't described by the structure is
+// ignored, so any command may be decoded into a CommandCommon to learn its id.
+func DecodeBinaryCommand(frame []byte, cmd interface{}) error {
+	header, err := parseBinaryHeader(frame)
+	if err != nil {
+		return err
+	}
+
+	value := reflect.ValueOf(cmd)
+	if value.Kind() != reflect.Ptr || value.IsNil() {
+		return fmt.Errorf("Cannot decode into non-pointer %T", cmd)
+	}
+
+	if header.Flags&BinaryFlagCompressed != 0 {
+		return fmt.Errorf("Cannot decode compressed binary frame")
+	}
+
+	decoder := binaryDecoder{
+		buf: frame[BinaryHeaderSize : BinaryHeaderSize+header.Length],
+	}
+	return decoder.decode(value.Elem())
+}
+
+// CompressBinaryFrame returns the frame with its payload compressed. Frames which
+// are too small to be worth compressing, or which don't shrink, are returned as
+// they are.
+func CompressBinaryFrame(frame []byte) []byte {
+	payload := frame[BinaryHeaderSize:]
+	if len(payload) < CompressionThreshold {
+		return frame
+	}
+
+	var compressed bytes.Buffer
+	compressed.Grow(len(frame) / 2)
+	compressed.Write(frame[:BinaryHeaderSize])
+	var length [4]byte
+	binary.LittleEndian.PutUint32(length[:], uint32(len(payload)))
+	compressed.Write(length[:])
+
+	writer, err := zlib.NewWriterLevel(&compressed, zlib.BestSpeed)
+	if err != nil {
+		return frame
+	}
+	if _, err := writer.Write(payload); err != nil {
+		return frame
+	}
+	if err := writer.Close(); err != nil {
+		return frame
+	}
+
+	result := compressed.Bytes()
+	if len(result) >= len(frame) {
+		return frame
+	}
+
+	flags := binary.LittleEndian.Uint16(frame[6:8]) | BinaryFlagCompressed
+	binary.LittleEndian.PutUint16(result[6:8], flags)
+	binary.LittleEndian.PutUint32(result[8:12],
+		uint32(len(result)-BinaryHeaderSize))
+	return result
+}
+
+// DecompressBinaryFrame returns the frame with its payload decompressed, or the
+// frame as it is if it isn't compressed. Frames whose payload would decompress to
+// more than maxLength bytes are refused.
+func DecompressBinaryFrame(frame []byte, maxLength uint32) ([]byte, error) {
+	header, err := parseBinaryHeader(frame)
+	if err != nil {
+		return nil, err
+	}
+	if header.Flags&BinaryFlagCompressed == 0 {
+		return frame, nil
+	}
+
+	payload := frame[BinaryHeaderSize : BinaryHeaderSize+header.Length]
+	if len(payload) < 4 {
+		return nil, fmt.Errorf("Compressed binary payload truncated")
+	}
+	length := binary.LittleEndian.Uint32(payload[0:4])
+	if length > maxLength {
+		return nil, fmt.Errorf("Compressed binary frame of %d bytes "+
+			"exceeds %d bytes", length, maxLength)
+	}
+
+	reader, err := zlib.NewReader(bytes.NewReader(payload[4:]))
+	if err != nil {
+		return nil, err
+	}
+
+	result := make([]byte, BinaryHeaderSize+int(length))
+	copy(result, frame[:BinaryHeaderSize])
+	if _, err := io.ReadFull(reader, result[BinaryHeaderSize:]); err != nil {
+		return nil, fmt.Errorf("Compressed binary payload corrupt: %s",
+			err.Error())
+	}
+
+	// Reaching the end of the stream also verifies its checksum
+	var extra [1]byte
+	if n, err := reader.Read(extra[:]); n != 0 {
+		return nil, fmt.Errorf("Compressed binary payload exceeds its "+
+			"length %d", length)
+	} else if err != io.EOF {
+		return nil, fmt.Errorf("Compressed binary payload corrupt: %v", err)
+	}
+
+	flags := header.Flags &^ BinaryFlagCompressed
+	binary.LittleEndian.PutUint16(result[6:8], flags)
+	binary.LittleEndian.PutUint32(result[8:12], length)
+	return result, nil
+}
+
+func appendUint32(buf []byte, value uint32) []byte {
+	return append(buf, byte(value), byte(value>>8), byte(value>>16),
+		byte(value>>24))
+}
+
+func appendUint64(buf []byte, value uint64) []byte {
+	buf = appendUint32(buf, uint32(value))
+	return appendUint32(buf, uint32(value>>32))
+}
+
+func appendBinaryValue(buf []byte, value reflect.Value) []byte {
+	switch value.Kind() {
+	default:
+		panic(fmt.Sprintf("Unsupported binary command field type %s",
+			value.Type()))
+	case reflect.Bool:
+		if value.Bool() {
+			return append(buf, 1)
+		}
+		return append(buf, 0)
+	case reflect.Uint32:
+		return appendUint32(buf, uint32(value.Uint()))
+	case reflect.Int32:
+		return appendUint32(buf, uint32(value.Int()))
+	case reflect.Uint64, reflect.Uint:
+		return appendUint64(buf, value.Uint())
+	case reflect.Int64, reflect.Int:
+		return appendUint64(buf, uint64(value.Int()))
+	case reflect.String:
+		buf = appendUint32(buf, uint32(value.Len()))
+		return append(buf, value.String()...)
+	case reflect.Slice:
+		buf = appendUint32(buf, uint32(value.Len()))
+		if value.Type().Elem().Kind() == reflect.Uint8 {
+			return append(buf, value.Bytes()...)
+		}
+		for i := 0; i < value.Len(); i++ {
+			buf = appendBinaryValue(buf, value.Index(i))
+		}
+		return buf
+	case reflect.Map:
+		buf = appendUint32(buf, uint32(value.Len()))
+		for _, key := range value.MapKeys() {
+			buf = appendBinaryValue(buf, key)
+			buf = appendBinaryValue(buf, value.MapIndex(key))
+		}
+		return buf
+	case reflect.Struct:
+		for i := 0; i < value.NumField(); i++ {
+			if value.Type().Field(i).PkgPath != "" {
+				// Unexported fields aren't part of the encoding
+				continue
+			}
+			buf = appendBinaryValue(buf, value.Field(i))
+		}
+		return buf
+	}
+}
+
+type binaryDecoder struct {
+	buf    []byte
+	offset int
+}
+
+func (d *binaryDecoder) next(size int) ([]byte, error) {
+	if size < 0 || size > len(d.buf)-d.offset {
+		return nil, fmt.Errorf("Binary payload truncated at offset %d",
+			d.offset)
+	}
+	data := d.buf[d.offset : d.offset+size]
+	d.offset += size
+	return data, nil
+}
+
+func (d *binaryDecoder) uint32() (uint32, error) {
+	data, err := d.next(4)
+	if err != nil {
+		return 0, err
+	}
+	return binary.LittleEndian.Uint32(data), nil
+}
+
+func (d *binaryDecoder) uint64() (uint64, error) {
+	data, err := d.next(8)
+	if err != nil {
+		return 0, err
+	}
+	return binary.LittleEndian.Uint64(data), nil
+}
+
+// Read a uint32 element count and ensure the payload could hold that many
+// elements of at least minSize bytes each, to prevent a corrupt count from
+// causing a huge allocation.
+func (d *binaryDecoder) count(minSize int) (int, error) {
+	count, err := d.uint32()
+	if err != nil {
+		return 0, err
+	}
+	if uint64(count) > math.MaxInt32 ||
+		int(count)*minSize > len(d.buf)-d.offset {
+
+		return 0, fmt.Errorf("Binary payload count %d exceeds payload",
+			count)
+	}
+	return int(count), nil
+}
+
+func (d *binaryDecoder) decode(value reflect.Value) error {
+	switch value.Kind() {
+	default:
+		return fmt.Errorf("Unsupported binary command field type %s",
+			value.Type())
+	case reflect.Bool:
+		data, err := d.next(1)
+		if err != nil {
+			return err
+		}
+		value.SetBool(data[0] != 0)
+	case reflect.Uint32:
+		v, err := d.uint32()
+		if err != nil {
+			return err
+		}
+		value.SetUint(uint64(v))
+	case reflect.Int32:
+		v, err := d.uint32()
+		if err != nil {
+			return err
+		}
+		value.SetInt(int64(int32(v)))
+	case reflect.Uint64, reflect.Uint:
+		v, err := d.uint64()
+		if err != nil {
+			return err
+		}
+		value.SetUint(v)
+	case reflect.Int64, reflect.Int:
+		v, err := d.uint64()
+		if err != nil {
+			return err
+		}
+		value.SetInt(int64(v))
+	case reflect.String:
+		length, err := d.count(1)
+		if err != nil {
+			return err
+		}
+		data, err := d.next(length)
+		if err != nil {
+			return err
+		}
+		value.SetString(string(data))
+	case reflect.Slice:
+		if value.Type().Elem().Kind() == reflect.Uint8 {
+			length, err := d.count(1)
+			if err != nil {
+				return err
+			}
+			data, err := d.next(length)
+			if err != nil {
+				return err
+			}
+			// Copy so the result doesn't alias the frame, which the
+			// caller may reuse.
+			bytes := reflect.MakeSlice(value.Type(), length, length)
+			reflect.Copy(bytes, reflect.ValueOf(data))
+			value.Set(bytes)
+			return nil
+		}
+
+		count, err := d.count(1)
+		if err != nil {
+			return err
+		}
+		slice := reflect.MakeSlice(value.Type(), count, count)
+		for i := 0; i < count; i++ {
+			if err := d.decode(slice.Index(i)); err != nil {
+				return err
+			}
+		}
+		value.Set(slice)
+	case reflect.Map:
+		count, err := d.count(1)
+		if err != nil {
+			return err
+		}
+		mapType := value.Type()
+		result := reflect.MakeMapWithSize(mapType, count)
+		for i := 0; i < count; i++ {
+			key := reflect.New(mapType.Key()).Elem()
+			if err := d.decode(key); err != nil {
+				return err
+			}
+			elem := reflect.New(mapType.Elem()).Elem()
+			if err := d.decode(elem); err != nil {
+				return err
+			}
+			result.SetMapIndex(key, elem)
+		}
+		value.Set(result)
+	case reflect.Struct:
+		for i := 0; i < value.NumField(); i++ {
+			if value.Type().Field(i).PkgPath != "" {
+				continue
+			}
+			if d.offset == len(d.buf) {
+				// A shorter payload leaves the remaining fields
+				// zeroed, as JSON does for missing fields.
+				return nil
+			}
+			if err := d.decode(value.Field(i)); err != nil {
+				return err
+			}
+		}
+	}
+	return nil
+}
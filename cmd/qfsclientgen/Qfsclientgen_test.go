@@ -0,0 +1,90 @@
+// Copyright (c) 2018 Arista Networks, Inc.
+// Use of this source code is governed by the Apache License 2.0
+// that can be found in the COPYING file.
+
+package main
+
+import (
+	"bytes"
+	"io/ioutil"
+	"strings"
+	"testing"
+)
+
+const root = "../.."
+
+// The header must be regenerated whenever the api changes
+func TestHeaderUpToDate(t *testing.T) {
+	header, err := generate(root)
+	if err != nil {
+		t.Fatalf("Generating header failed: %s", err.Error())
+	}
+
+	existing, err := ioutil.ReadFile(root + "/QFSClient/qfs_client_data.h")
+	if err != nil {
+		t.Fatalf("Reading header failed: %s", err.Error())
+	}
+
+	if !bytes.Equal(header, existing) {
+		t.Fatalf("QFSClient/qfs_client_data.h is out of date, " +
+			"run \"make qfsclientdata\"")
+	}
+}
+
+func TestHeaderContents(t *testing.T) {
+	header, err := generate(root)
+	if err != nil {
+		t.Fatalf("Generating header failed: %s", err.Error())
+	}
+
+	expected := []string{
+		"\tkCmdWorkspaceFinished = 14,\n",
+		"\tkCmdOk = 0,\n",
+		"\tkCompressionZlib = 1,\n",
+		"static const char kSrc[] = \"Src\";\n",
+		"const int kMaxBlockSize = 262144;\n",
+		"static const char kSharedMemoryDir[] = \"/dev/shm\";\n",
+
+		// Binary fields are in declaration order, with embedded
+		// structures in their place
+		"static const BinaryField kInsertInodeRequestFields[] = {\n" +
+			"\t{ kCommandId, \"I\" },\n" +
+			"\t{ kRequestId, \"L\" },\n" +
+			"\t{ kDstPath, \"S\" },\n" +
+			"\t{ kKey, \"S\" },\n" +
+			"\t{ kUid, \"I\" },\n" +
+			"\t{ kGid, \"I\" },\n" +
+			"\t{ kPermissions, \"I\" },\n" +
+			"\t{ NULL, NULL },\n",
+		"\t{ kInodes, \"[(SSIII)\" },\n",
+		"\t{ kPathList, \"({SL)\" },\n",
+		"\t{ kResults, \"[(ILIS)\" },\n",
+		"\t{ kCommands, \"[S\" },\n",
+		"\t{ kPresent, \"[B\" },\n",
+	}
+	for _, text := range expected {
+		if !strings.Contains(string(header), text) {
+			t.Errorf("Header is missing %q", text)
+		}
+	}
+
+	// Commands without a fixed id aren't available to QFSClient
+	if strings.Contains(string(header), "RefreshWorkspace") {
+		t.Errorf("Header contains CmdRefreshWorkspace")
+	}
+}
+
+func TestCppCase(t *testing.T) {
+	cases := map[string]string{
+		"OK":          "Ok",
+		"BadJson":     "BadJson",
+		"BlockTooBig": "BlockTooBig",
+		"X":           "X",
+	}
+	for name, expected := range cases {
+		if cppCase(name) != expected {
+			t.Errorf("cppCase(%s) is %s, not %s", name, cppCase(name),
+				expected)
+		}
+	}
+}
@@ -0,0 +1,697 @@
+// Copyright (c) 2018 Arista Networks, Inc.
+// Use of this source code is governed by the Apache License 2.0
+// that can be found in the COPYING file.
+
+// qfsclientgen writes QFSClient/qfs_client_data.h, the C++ copy of the command ids,
+// error codes, field names, binary field layouts and limits of the api, from their
+// master definitions in the quantumfs package so that QFSClient can't fall behind
+// quantumfsd.
+package main
+
+import (
+	"bytes"
+	"flag"
+	"fmt"
+	"go/ast"
+	"go/constant"
+	"go/parser"
+	"go/token"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"reflect"
+	"sort"
+	"strconv"
+	"strings"
+)
+
+// The Go source files the header is generated from, with the package each is
+// referred to by from the others
+var sources = []struct {
+	pkg  string
+	path string
+}{
+	{"", "binarycmds.go"},
+	{"", "cmds.go"},
+	{"", "datastore.go"},
+	{"encoding", "encoding/metadata.capnp.go"},
+}
+
+// The file whose structures give the names of the fields of the JSON commands
+const commandsFile = "cmds.go"
+
+// A C++ enum holding the constants of a const block of the quantumfs package
+type enumSpec struct {
+	name      string // Of the C++ enum
+	doc       string
+	first     string // The first Go constant of the block
+	goPrefix  string // Only the Go constants with this prefix are included
+	cppPrefix string // Which replaces goPrefix in the C++ names
+}
+
+var enums = []enumSpec{
+	{
+		name:      "CommandID",
+		doc:       "The ids of the api commands",
+		first:     "CmdInvalid",
+		goPrefix:  "Cmd",
+		cppPrefix: "kCmd",
+	},
+	{
+		name: "Protocol",
+		doc: "The encodings an api file handle may use, " +
+			"see qfs_client_binary.h",
+		first:     "ProtocolJson",
+		goPrefix:  "Protocol",
+		cppPrefix: "kProtocol",
+	},
+	{
+		name: "Compression",
+		doc: "The compression of binary frames which may be asked " +
+			"for with SetProtocol",
+		first:     "CompressionNone",
+		goPrefix:  "Compression",
+		cppPrefix: "kCompression",
+	},
+	{
+		name:      "CommandError",
+		doc:       "The errors the api commands may fail with",
+		first:     "ErrorOK",
+		goPrefix:  "Error",
+		cppPrefix: "kCmd",
+	},
+}
+
+// Single Go constants copied as they are, with a 'k' prefix
+var constants = []string{
+	"ExtendedKeyLength",
+	"MaxBlockSize",
+	"SharedMemoryDir",
+	"MaxPipelineDepth",
+	"CompressionThreshold",
+	"MaxBatchCommands",
+	"MaxHasBlocksKeys",
+	"MaxPrefetchKeys",
+	"MaxInsertInodes",
+}
+
+type constDef struct {
+	pkg   string
+	name  string
+	value ast.Expr // Repeated from an earlier spec of the block if it has none
+	iota  int
+	doc   []string // The lines of its comment
+	group *ast.GenDecl
+}
+
+type field struct {
+	cppName  string
+	jsonName string
+}
+
+type generator struct {
+	fset      *token.FileSet
+	constDefs map[string]*constDef // By package qualified name
+	ordered   []*constDef
+	fields    map[string]field
+	values    map[string]constant.Value
+	types     map[string]*ast.TypeSpec // Of the commands file, by name
+	structs   []*ast.TypeSpec          // Its structures in declaration order
+}
+
+func newGenerator() *generator {
+	return &generator{
+		fset:      token.NewFileSet(),
+		constDefs: map[string]*constDef{},
+		fields:    map[string]field{},
+		values:    map[string]constant.Value{},
+		types:     map[string]*ast.TypeSpec{},
+	}
+}
+
+func qualified(pkg string, name string) string {
+	if pkg == "" {
+		return name
+	}
+	return pkg + "." + name
+}
+
+// The lines of a comment without the comment markers
+func commentLines(group *ast.CommentGroup) []string {
+	if group == nil {
+		return nil
+	}
+	return strings.Split(strings.TrimSpace(group.Text()), "\n")
+}
+
+func (g *generator) parse(root string) error {
+	for _, source := range sources {
+		file, err := parser.ParseFile(g.fset,
+			filepath.Join(root, source.path), nil,
+			parser.ParseComments)
+		if err != nil {
+			return err
+		}
+
+		for _, decl := range file.Decls {
+			genDecl, ok := decl.(*ast.GenDecl)
+			if !ok {
+				continue
+			}
+
+			switch genDecl.Tok {
+			case token.CONST:
+				g.parseConsts(source.pkg, genDecl)
+			case token.TYPE:
+				if source.path != commandsFile {
+					continue
+				}
+				if err := g.parseFields(genDecl); err != nil {
+					return err
+				}
+			}
+		}
+	}
+	return nil
+}
+
+func (g *generator) parseConsts(pkg string, decl *ast.GenDecl) {
+	var value ast.Expr
+	for i, spec := range decl.Specs {
+		valueSpec := spec.(*ast.ValueSpec)
+		if len(valueSpec.Values) != 0 {
+			value = valueSpec.Values[0]
+		}
+
+		doc := commentLines(valueSpec.Doc)
+		if doc == nil {
+			doc = commentLines(valueSpec.Comment)
+		}
+		if doc == nil && !decl.Lparen.IsValid() {
+			doc = commentLines(decl.Doc)
+		}
+
+		for _, name := range valueSpec.Names {
+			def := &constDef{
+				pkg:   pkg,
+				name:  name.Name,
+				value: value,
+				iota:  i,
+				doc:   doc,
+				group: decl,
+			}
+			g.constDefs[qualified(pkg, name.Name)] = def
+			g.ordered = append(g.ordered, def)
+		}
+	}
+}
+
+func (g *generator) parseFields(decl *ast.GenDecl) error {
+	for _, spec := range decl.Specs {
+		typeSpec := spec.(*ast.TypeSpec)
+		g.types[typeSpec.Name.Name] = typeSpec
+
+		structType, ok := typeSpec.Type.(*ast.StructType)
+		if !ok {
+			continue
+		}
+		if typeSpec.Name.IsExported() {
+			g.structs = append(g.structs, typeSpec)
+		}
+
+		for _, structField := range structType.Fields.List {
+			jsonName := ""
+			if structField.Tag != nil {
+				tag, err := strconv.Unquote(structField.Tag.Value)
+				if err != nil {
+					return err
+				}
+				jsonName = strings.Split(
+					reflect.StructTag(tag).Get("json"), ",")[0]
+			}
+
+			for _, name := range structField.Names {
+				if !name.IsExported() || jsonName == "-" {
+					continue
+				}
+
+				f := field{
+					cppName:  "k" + name.Name,
+					jsonName: jsonName,
+				}
+				if f.jsonName == "" {
+					f.jsonName = name.Name
+				}
+
+				existing, ok := g.fields[f.cppName]
+				if ok && existing != f {
+					return fmt.Errorf("Field %s is named "+
+						"both %s and %s", f.cppName,
+						existing.jsonName, f.jsonName)
+				}
+				g.fields[f.cppName] = f
+			}
+		}
+	}
+	return nil
+}
+
+func usesIota(expr ast.Expr) bool {
+	if expr == nil {
+		return false
+	}
+
+	found := false
+	ast.Inspect(expr, func(node ast.Node) bool {
+		if ident, ok := node.(*ast.Ident); ok && ident.Name == "iota" {
+			found = true
+		}
+		return !found
+	})
+	return found
+}
+
+func (g *generator) value(pkg string, name string) (constant.Value, error) {
+	key := qualified(pkg, name)
+	if value, ok := g.values[key]; ok {
+		return value, nil
+	}
+
+	def, ok := g.constDefs[key]
+	if !ok || def.value == nil {
+		return nil, fmt.Errorf("Unknown constant %s", key)
+	}
+
+	value, err := g.eval(def, def.value)
+	if err != nil {
+		return nil, fmt.Errorf("Constant %s: %s", key, err.Error())
+	}
+	g.values[key] = value
+	return value, nil
+}
+
+// Evaluate the constant expressions found in the sources, which are only ever
+// literals, other constants, conversions and arithmetic
+func (g *generator) eval(def *constDef, expr ast.Expr) (constant.Value, error) {
+	switch expr := expr.(type) {
+	case *ast.BasicLit:
+		return constant.MakeFromLiteral(expr.Value, expr.Kind, 0), nil
+
+	case *ast.Ident:
+		if expr.Name == "iota" {
+			return constant.MakeInt64(int64(def.iota)), nil
+		}
+		return g.value(def.pkg, expr.Name)
+
+	case *ast.SelectorExpr:
+		pkg, ok := expr.X.(*ast.Ident)
+		if !ok {
+			break
+		}
+		return g.value(pkg.Name, expr.Sel.Name)
+
+	case *ast.ParenExpr:
+		return g.eval(def, expr.X)
+
+	case *ast.CallExpr:
+		// Only conversions, such as uint32(262144), are constant
+		if len(expr.Args) != 1 {
+			break
+		}
+		return g.eval(def, expr.Args[0])
+
+	case *ast.BinaryExpr:
+		x, err := g.eval(def, expr.X)
+		if err != nil {
+			return nil, err
+		}
+		y, err := g.eval(def, expr.Y)
+		if err != nil {
+			return nil, err
+		}
+
+		switch expr.Op {
+		case token.SHL, token.SHR:
+			shift, ok := constant.Uint64Val(y)
+			if !ok {
+				break
+			}
+			return constant.Shift(x, expr.Op, uint(shift)), nil
+		case token.QUO:
+			if x.Kind() == constant.Int && y.Kind() == constant.Int {
+				return constant.BinaryOp(x, token.QUO_ASSIGN, y), nil
+			}
+			return constant.BinaryOp(x, expr.Op, y), nil
+		default:
+			return constant.BinaryOp(x, expr.Op, y), nil
+		}
+	}
+
+	return nil, fmt.Errorf("unsupported expression at %s",
+		g.fset.Position(expr.Pos()))
+}
+
+// C++ names are CamelCase even where the Go name is an acronym, so ErrorOK is
+// kCmdOk
+func cppCase(name string) string {
+	if len(name) > 1 && strings.ToUpper(name) == name {
+		return name[:1] + strings.ToLower(name[1:])
+	}
+	return name
+}
+
+// Write the lines as a comment, rewrapping any which would be wider than the 85
+// columns cpplint allows
+func writeComment(out *bytes.Buffer, indent string, lines []string) {
+	width := 85 - len("// ")
+	if indent != "" {
+		width -= 8
+	}
+
+	for _, text := range lines {
+		line := ""
+		for _, word := range strings.Fields(text) {
+			if line != "" && len(line)+1+len(word) > width {
+				fmt.Fprintf(out, "%s// %s\n", indent, line)
+				line = ""
+			}
+			if line != "" {
+				line += " "
+			}
+			line += word
+		}
+		fmt.Fprintf(out, "%s// %s\n", indent, line)
+	}
+}
+
+func (g *generator) writeEnum(out *bytes.Buffer, spec enumSpec) error {
+	first, ok := g.constDefs[spec.first]
+	if !ok {
+		return fmt.Errorf("Unknown constant %s", spec.first)
+	}
+
+	var members []*constDef
+	commented := false
+	for _, def := range g.ordered {
+		// Constants numbered with iota, such as CmdRefreshWorkspace, are
+		// deliberately left without a fixed value
+		if def.group != first.group ||
+			!strings.HasPrefix(def.name, spec.goPrefix) ||
+			usesIota(def.value) {
+
+			continue
+		}
+		members = append(members, def)
+		commented = commented || def.doc != nil
+	}
+
+	writeComment(out, "", []string{spec.doc})
+	fmt.Fprintf(out, "enum %s {\n", spec.name)
+	for i, def := range members {
+		value, err := g.value(def.pkg, def.name)
+		if err != nil {
+			return err
+		}
+
+		if commented {
+			if i != 0 {
+				fmt.Fprintf(out, "\n")
+			}
+			writeComment(out, "\t", def.doc)
+		}
+		fmt.Fprintf(out, "\t%s%s = %s,\n", spec.cppPrefix,
+			cppCase(strings.TrimPrefix(def.name, spec.goPrefix)),
+			value.ExactString())
+	}
+	fmt.Fprintf(out, "};\n\n")
+	return nil
+}
+
+func (g *generator) writeFields(out *bytes.Buffer) {
+	names := make([]string, 0, len(g.fields))
+	for name := range g.fields {
+		names = append(names, name)
+	}
+	sort.Strings(names)
+
+	writeComment(out, "", []string{"The names of the fields of the JSON " +
+		"commands and responses"})
+	for _, name := range names {
+		fmt.Fprintf(out, "static const char %s[] = %q;\n", name,
+			g.fields[name].jsonName)
+	}
+	fmt.Fprintf(out, "\n")
+}
+
+// The format of a type in the binary encoding described in binarycmds.go, as
+// explained by the comment of BinaryField in the header
+func (g *generator) format(expr ast.Expr) (string, error) {
+	switch expr := expr.(type) {
+	case *ast.Ident:
+		switch expr.Name {
+		case "uint32", "int32":
+			return "I", nil
+		case "uint64", "int64", "uint", "int":
+			return "L", nil
+		case "bool":
+			return "B", nil
+		case "string":
+			return "S", nil
+		}
+
+		spec, ok := g.types[expr.Name]
+		if !ok {
+			break
+		}
+		if structType, ok := spec.Type.(*ast.StructType); ok {
+			fields, err := g.structFormats(structType)
+			if err != nil {
+				return "", err
+			}
+
+			format := "("
+			for _, f := range fields {
+				format += f.format
+			}
+			return format + ")", nil
+		}
+		return g.format(spec.Type)
+
+	case *ast.SelectorExpr:
+		// json.RawMessage is a []byte
+		pkg, ok := expr.X.(*ast.Ident)
+		if ok && pkg.Name == "json" && expr.Sel.Name == "RawMessage" {
+			return "S", nil
+		}
+
+	case *ast.ArrayType:
+		if expr.Len != nil {
+			break
+		}
+		if elem, ok := expr.Elt.(*ast.Ident); ok && elem.Name == "byte" {
+			return "S", nil
+		}
+		format, err := g.format(expr.Elt)
+		if err != nil {
+			return "", err
+		}
+		return "[" + format, nil
+
+	case *ast.MapType:
+		key, err := g.format(expr.Key)
+		if err != nil {
+			return "", err
+		}
+		value, err := g.format(expr.Value)
+		if err != nil {
+			return "", err
+		}
+		return "{" + key + value, nil
+	}
+
+	return "", fmt.Errorf("unsupported binary type at %s",
+		g.fset.Position(expr.Pos()))
+}
+
+type binaryField struct {
+	cppName string
+	format  string
+}
+
+// The exported fields of a structure in the order they are encoded, with those of
+// embedded structures in their place
+func (g *generator) structFormats(structType *ast.StructType) ([]binaryField,
+	error) {
+
+	var fields []binaryField
+	for _, structField := range structType.Fields.List {
+		if len(structField.Names) == 0 {
+			embedded, ok := structField.Type.(*ast.Ident)
+			if !ok || g.types[embedded.Name] == nil {
+				return nil, fmt.Errorf("unsupported embedded "+
+					"field at %s",
+					g.fset.Position(structField.Pos()))
+			}
+			spec := g.types[embedded.Name]
+			embeddedType, ok := spec.Type.(*ast.StructType)
+			if !ok {
+				return nil, fmt.Errorf("embedded %s isn't a "+
+					"structure", embedded.Name)
+			}
+
+			inner, err := g.structFormats(embeddedType)
+			if err != nil {
+				return nil, err
+			}
+			fields = append(fields, inner...)
+			continue
+		}
+
+		for _, name := range structField.Names {
+			if !name.IsExported() {
+				continue
+			}
+
+			format, err := g.format(structField.Type)
+			if err != nil {
+				return nil, err
+			}
+			fields = append(fields, binaryField{
+				cppName: "k" + name.Name,
+				format:  format,
+			})
+		}
+	}
+	return fields, nil
+}
+
+func (g *generator) writeBinaryFields(out *bytes.Buffer) error {
+	writeComment(out, "", []string{
+		"A field of an api structure in the binary encoding of " +
+			"binarycmds.go. Its format gives the encoding of its " +
+			"type: 'I' for uint32 and int32; 'L' for uint64, int64, " +
+			"uint and int; 'B' for bool; 'S' for string and []byte; " +
+			"'[' followed by the format of the elements for other " +
+			"slices; '{' followed by the formats of the key and the " +
+			"value for maps; and the formats of the fields between " +
+			"'(' and ')' for other structures.",
+	})
+	fmt.Fprintf(out, "struct BinaryField {\n")
+	fmt.Fprintf(out, "\tconst char *name;\n")
+	fmt.Fprintf(out, "\tconst char *format;\n")
+	fmt.Fprintf(out, "};\n\n")
+
+	writeComment(out, "", []string{
+		"The fields of each api structure in encoding order, " +
+			"ending at a NULL name",
+	})
+	for _, spec := range g.structs {
+		fields, err := g.structFormats(spec.Type.(*ast.StructType))
+		if err != nil {
+			return fmt.Errorf("Structure %s: %s", spec.Name.Name,
+				err.Error())
+		}
+
+		fmt.Fprintf(out, "static const BinaryField k%sFields[] = {\n",
+			spec.Name.Name)
+		for _, f := range fields {
+			fmt.Fprintf(out, "\t{ %s, %q },\n", f.cppName, f.format)
+		}
+		fmt.Fprintf(out, "\t{ NULL, NULL },\n")
+		fmt.Fprintf(out, "};\n\n")
+	}
+	return nil
+}
+
+func (g *generator) writeConstant(out *bytes.Buffer, name string) error {
+	def, ok := g.constDefs[name]
+	if !ok {
+		return fmt.Errorf("Unknown constant %s", name)
+	}
+
+	value, err := g.value(def.pkg, def.name)
+	if err != nil {
+		return err
+	}
+
+	writeComment(out, "", def.doc)
+	switch value.Kind() {
+	case constant.Int:
+		fmt.Fprintf(out, "const int k%s = %s;\n\n", name,
+			value.ExactString())
+	case constant.String:
+		fmt.Fprintf(out, "static const char k%s[] = %s;\n\n", name,
+			value.ExactString())
+	default:
+		return fmt.Errorf("Constant %s is neither an integer nor a string",
+			name)
+	}
+	return nil
+}
+
+// Generate the header from the quantumfs package in the root directory
+func generate(root string) ([]byte, error) {
+	g := newGenerator()
+	if err := g.parse(root); err != nil {
+		return nil, err
+	}
+
+	var out bytes.Buffer
+	fmt.Fprintf(&out, `// Copyright (c) 2017 Arista Networks, Inc.
+// Use of this source code is governed by the Apache License 2.0
+// that can be found in the COPYING file.
+
+// Code generated by cmd/qfsclientgen from the quantumfs package. DO NOT EDIT.
+// Run "make qfsclientdata" after changing the api to regenerate it.
+
+#ifndef QFSCLIENT_QFS_CLIENT_DATA_H_
+#define QFSCLIENT_QFS_CLIENT_DATA_H_
+
+#include <stddef.h>
+
+`)
+
+	for _, spec := range enums {
+		if err := g.writeEnum(&out, spec); err != nil {
+			return nil, err
+		}
+	}
+
+	g.writeFields(&out)
+
+	if err := g.writeBinaryFields(&out); err != nil {
+		return nil, err
+	}
+
+	for _, name := range constants {
+		if err := g.writeConstant(&out, name); err != nil {
+			return nil, err
+		}
+	}
+
+	fmt.Fprintf(&out, "#endif  // QFSCLIENT_QFS_CLIENT_DATA_H_\n")
+	return out.Bytes(), nil
+}
+
+func main() {
+	root := flag.String("root", ".",
+		"The root directory of the quantumfs package")
+	output := flag.String("o", "", "Where to write the header, or stdout")
+	flag.Parse()
+
+	header, err := generate(*root)
+	if err != nil {
+		fmt.Fprintf(os.Stderr, "qfsclientgen: %s\n", err.Error())
+		os.Exit(1)
+	}
+
+	if *output == "" {
+		_, err = os.Stdout.Write(header)
+	} else {
+		err = ioutil.WriteFile(*output, header, 0644)
+	}
+	if err != nil {
+		fmt.Fprintf(os.Stderr, "qfsclientgen: %s\n", err.Error())
+		os.Exit(1)
+	}
+}
@@ -71,6 +71,11 @@ func init() {
 		qlogstats.NewExtPointStats(daemon.CacheHitLog, "readcache_hit"),
 		qlogstats.NewExtPointStats(daemon.CacheMissLog, "readcache_miss"),
 
+		// Bytes kept from crossing the api file by compression
+		qlogstats.NewHistogramExtractor(daemon.ApiCompressedLog,
+			"api_compression_saved", 0, int64(quantumfs.MaxBlockSize),
+			16, false, 0),
+
 		// FUSE Requests
 		newQfsExtPair(daemon.LookupLog, daemon.InodeNameLog),
 		newQfsExtPair(daemon.ForgetLog, ""),
@@ -122,6 +122,9 @@ func initFlags() {
 
 	qflag.BoolVar(&config.MagicOwnership, "magicOwnership",
 		config.MagicOwnership, "Enable magic ownership")
+
+	qflag.StringVar(&config.ApiSocketPath, "apiSocket", config.ApiSocketPath,
+		"Path of a unix socket to also serve the api on")
 }
 
 func maxSizes() {
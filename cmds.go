@@ -9,6 +9,8 @@ import (
 	"encoding/json"
 	"fmt"
 	"io"
+	"math"
+	"net"
 	"os"
 	"strings"
 	"syscall"
@@ -23,11 +25,16 @@ import (
 // interpreting the results.
 
 // NewApi searches for the QuantumFS API files. The search order is:
-// 1. The path in the environment variable QUANTUMFS_API_PATH, ie "/qfs/api"
-// 2. The api file at the root of the sole mounted QuantumFS instance. If more than
+// 1. The api socket in the environment variable QUANTUMFS_API_SOCKET
+// 2. The path in the environment variable QUANTUMFS_API_PATH, ie "/qfs/api"
+// 3. The api file at the root of the sole mounted QuantumFS instance. If more than
 //    one instance is mounted none of them will be used.
-// 3. Searching upwards in the directory tree for the api file
+// 4. Searching upwards in the directory tree for the api file
 func NewApi() (Api, error) {
+	if socketPath := libqfs.FindApiSocketPath(); socketPath != "" {
+		return NewApiWithSocket(socketPath)
+	}
+
 	path, err := libqfs.FindApiPath()
 	if err != nil {
 		return nil, err
@@ -47,6 +54,50 @@ func NewApiWithPath(path string) (Api, error) {
 	return &api, nil
 }
 
+// NewApiWithSocket connects to the api socket of quantumfsd at the given path. The
+// socket only speaks the binary protocol.
+func NewApiWithSocket(path string) (Api, error) {
+	conn, err := net.Dial("unix", path)
+	if err != nil {
+		return nil, err
+	}
+
+	return &apiImpl{
+		conn:     conn,
+		protocol: ProtocolBinary,
+	}, nil
+}
+
+// NewBinaryApiWithPath is the same as NewApiWithPath, except that the api file
+// handle is switched to the binary protocol, with large frames compressed if
+// quantumfsd supports it, before it is returned.
+func NewBinaryApiWithPath(path string) (Api, error) {
+	api, err := NewApiWithPath(path)
+	if err != nil {
+		return nil, err
+	}
+
+	impl := api.(*apiImpl)
+	cmd := SetProtocolRequest{
+		CommandCommon: CommandCommon{CommandId: CmdSetProtocol},
+		Protocol:      ProtocolBinary,
+		Compression:   CompressionZlib,
+	}
+	var response SetProtocolResponse
+	err = impl.processCmd(cmd, &response)
+	if err == nil && response.ErrorCode != ErrorOK {
+		err = fmt.Errorf("qfs command Error:%s", response.Message)
+	}
+	if err != nil {
+		impl.Close()
+		return nil, err
+	}
+	impl.protocol = ProtocolBinary
+	impl.compression = response.Compression
+
+	return impl, nil
+}
+
 // A description of the files and directories which were accessed within a particular
 // workspace on a single instance.
 //
@@ -137,6 +188,12 @@ type Api interface {
 	// Get the list of accessed file from workspaceroot
 	GetAccessed(wsr string) (*PathsAccessed, error)
 
+	// Get one page of the list of accessed files from workspaceroot, see
+	// AccessedPageRequest. Returns the paths of the page and the cursor of the
+	// next page, which is zero after the last page.
+	GetAccessedPage(wsr string, cursor uint64, pageSize uint32) ([]AccessedPath,
+		uint64, error)
+
 	// Clear the list of accessed files in workspaceroot
 	ClearAccessed(wsr string) error
 
@@ -186,23 +243,46 @@ type Api interface {
 }
 
 type apiImpl struct {
-	fdMutex utils.DeferableMutex
-	fd      *os.File
+	fdMutex  utils.DeferableMutex
+	fd       *os.File
+	conn     net.Conn // Used instead of fd when connected to the api socket
+	protocol uint32
+
+	// One of Compression*, as agreed with quantumfsd
+	compression uint32
 }
 
 func (api *apiImpl) Close() {
 	defer api.fdMutex.Lock().Unlock()
+	if api.conn != nil {
+		api.conn.Close()
+		api.conn = nil
+		return
+	}
 	api.fd.Close()
 	api.fd = nil
 }
 
 type CommandCommon struct {
 	CommandId uint32 // One of CmdType*
+
+	// Requests with a non-zero RequestId are processed concurrently with
+	// other requests on the same api file handle and may be answered in any
+	// order. The response carries the RequestId of its request. Requests
+	// without a RequestId are answered before the write of the request
+	// returns.
+	RequestId uint64 `json:",omitempty"`
+}
+
+// Set the RequestId of a response to that of the request it answers
+func (cmd *CommandCommon) SetRequestId(requestId uint64) {
+	cmd.RequestId = requestId
 }
 
 // The various command ID constants
 // IMPORTANT: please do not change the order/values of the above constants, QFSClient
-// depends on the fact that the values should not change !!!!!
+// depends on the fact that the values should not change !!!!! Run
+// "make qfsclientdata" to copy new constants into QFSClient/qfs_client_data.h.
 const (
 	CmdInvalid               = 0
 	CmdError                 = 1
@@ -219,6 +299,16 @@ const (
 	CmdMergeWorkspaces       = 12
 	CmdSyncWorkspace         = 13
 	CmdWorkspaceFinished     = 14
+	CmdSetProtocol           = 15
+	CmdGetAccessedPage       = 16
+	CmdRegisterSharedMemory  = 17
+	CmdSetBlockShared        = 18
+	CmdGetBlockShared        = 19
+	CmdBatch                 = 20
+	CmdStatBlock             = 21
+	CmdHasBlocks             = 22
+	CmdPrefetch              = 23
+	CmdInsertInodes          = 24
 
 	// The following commands might be removed in the future versions so we
 	// do not allocate a known id for them
@@ -228,7 +318,8 @@ const (
 
 // The various error codes
 // IMPORTANT: please do not change the order/values of the above constants, QFSClient
-// depends on the fact that the values should not change !!!!!
+// depends on the fact that the values should not change !!!!! Run
+// "make qfsclientdata" to copy new constants into QFSClient/qfs_client_data.h.
 const (
 	ErrorOK                = 0 // Command Successful
 	ErrorBadArgs           = 1 // The argument is wrong
@@ -242,6 +333,30 @@ const (
 
 const BufferSize = 4096
 
+// The maximum number of requests on a single api file handle whose responses
+// haven't been read yet. Writing further requests fails with EAGAIN.
+const MaxPipelineDepth = 64
+
+// The number of paths returned by a GetAccessedPage request which doesn't give a
+// PageSize, and the largest PageSize which is honoured.
+const DefaultAccessedPageSize = 4096
+const MaxAccessedPageSize = 65536
+
+// The directory files registered by RegisterSharedMemory requests must be in
+const SharedMemoryDir = "/dev/shm"
+
+// The most commands a single Batch request may carry
+const MaxBatchCommands = 4096
+
+// The most keys a single HasBlocks request may carry
+const MaxHasBlocksKeys = 4096
+
+// The most keys, of both kinds together, a single Prefetch request may carry
+const MaxPrefetchKeys = 4096
+
+// The most inodes a single InsertInodes request may carry
+const MaxInsertInodes = 4096
+
 type ErrorResponse struct {
 	CommandCommon
 	ErrorCode uint32
@@ -295,6 +410,30 @@ type AccessedRequest struct {
 	WorkspaceRoot string
 }
 
+// Request one page of the accessed list of a workspace root, so that very large
+// lists needn't be sent in a single response. The first page of a listing is
+// requested with a zero Cursor and each following page with the NextCursor of the
+// previous response. The list is captured when the first page is requested, so
+// the pages of a listing are consistent with each other. Paths are returned in
+// sorted order. A listing belongs to the api file handle which started it.
+type AccessedPageRequest struct {
+	CommandCommon
+	WorkspaceRoot string
+	Cursor        uint64
+	PageSize      uint32 // Zero for DefaultAccessedPageSize
+}
+
+type AccessedPath struct {
+	Path  string
+	Flags PathFlags
+}
+
+type AccessedPageResponse struct {
+	ErrorResponse
+	Paths      []AccessedPath
+	NextCursor uint64 // Zero once the last page has been returned
+}
+
 type SyncAllRequest struct {
 	CommandCommon
 }
@@ -313,6 +452,30 @@ type InsertInodeRequest struct {
 	Permissions uint32
 }
 
+// One of the inodes of an InsertInodesRequest, with the fields of an
+// InsertInodeRequest
+type InsertInodeEntry struct {
+	DstPath     string
+	Key         string
+	Uid         uint32
+	Gid         uint32
+	Permissions uint32
+}
+
+// Insert many inodes with a single request. The inodes are grouped by the directory
+// they are inserted into, which is found and locked once for all of its inodes.
+// The outcome of inserting each inode is given in Results, in order. As with
+// separate requests, inserting the same path twice leaves the latter inode.
+type InsertInodesRequest struct {
+	CommandCommon
+	Inodes []InsertInodeEntry
+}
+
+type InsertInodesResponse struct {
+	ErrorResponse
+	Results []ErrorResponse
+}
+
 type EnableRootWriteRequest struct {
 	CommandCommon
 	Workspace string
@@ -349,8 +512,124 @@ type WorkspaceFinishedRequest struct {
 	WorkspacePath string
 }
 
+// Switch the api file handle the request is written to over to the given protocol,
+// one of Protocol*. The response to this request is still encoded in the protocol
+// the handle used before, all subsequent requests and responses on the handle use
+// the new protocol. Compression, one of Compression*, asks for large binary
+// responses to be compressed. The response gives the compression which will be
+// used, older versions of QuantumFS don't send one and don't compress.
+type SetProtocolRequest struct {
+	CommandCommon
+	Protocol    uint32
+	Compression uint32
+}
+
+type SetProtocolResponse struct {
+	ErrorResponse
+	Compression uint32
+}
+
+// Register a file for moving the payloads of SetBlockShared and GetBlockShared
+// requests, so that they needn't be encoded into requests and responses and
+// copied through the api file. The file must be in SharedMemoryDir and owned by
+// the caller, who normally maps it. Only its first Size bytes are used. The file
+// belongs to the api file handle the request is written to and replaces any file
+// registered on it before. QuantumFS keeps the file open, so it may be unlinked
+// once the request succeeds.
+type RegisterSharedMemoryRequest struct {
+	CommandCommon
+	Path string
+	Size uint64
+}
+
+// The same as SetBlockRequest, except that the data is the Length bytes at Offset
+// in the shared memory file of the handle.
+type SetBlockSharedRequest struct {
+	CommandCommon
+	Key    []byte
+	Offset uint64
+	Length uint64
+}
+
+// The same as GetBlockRequest, except that the block is written to Offset in the
+// shared memory file of the handle and must fit within Capacity bytes.
+type GetBlockSharedRequest struct {
+	CommandCommon
+	Key      []byte
+	Offset   uint64
+	Capacity uint64
+}
+
+type GetBlockSharedResponse struct {
+	ErrorResponse
+	Length uint64
+}
+
+// Find the size of a block without retrieving it, so that a buffer for it can be
+// sized before it is retrieved
+type StatBlockRequest struct {
+	CommandCommon
+	Key []byte
+}
+
+type StatBlockResponse struct {
+	ErrorResponse
+	Size uint64
+}
+
+// Find which of many blocks are stored, so that a client can skip storing those
+// which already are. Present gives the answer for each key, in order.
+type HasBlocksRequest struct {
+	CommandCommon
+	Keys [][]byte
+}
+
+type HasBlocksResponse struct {
+	ErrorResponse
+	Present []bool
+}
+
+// Ask quantumfsd to load blocks from the durable datastore into its cache in the
+// background, ahead of their being read. Keys are KeyTypeApi keys as given to
+// SetBlock and ExtendedKeys are as read from the quantumfs.key extended attribute.
+// The response only reports whether the request was valid and is sent before any
+// block has been loaded.
+type PrefetchRequest struct {
+	CommandCommon
+	Keys         [][]byte
+	ExtendedKeys []string
+}
+
+// Process many commands with a single request. Each command is encoded in the
+// protocol of the api file handle just as it would be if it were sent on its own,
+// as a JSON object or a whole binary frame. The commands are processed in order
+// and the failure of one doesn't prevent the rest from being processed, except
+// that consecutive SetBlock commands, or consecutive GetBlock commands, are
+// independent of each other and are processed concurrently. Batch and SetProtocol
+// commands may not be batched.
+type BatchRequest struct {
+	CommandCommon
+	Commands []json.RawMessage
+}
+
+// The response to each command of a batch, encoded like the commands, in the
+// order of the commands
+type BatchResponse struct {
+	ErrorResponse
+	Results []json.RawMessage
+}
+
 func (api *apiImpl) sendCmd(buf []byte) ([]byte, error) {
 	defer api.fdMutex.Lock().Unlock()
+	if api.conn != nil {
+		// Frames follow one another on the socket, each response is read to
+		// the length in its header
+		if _, err := api.conn.Write(buf); err != nil {
+			return nil, err
+		}
+		return ReadBinaryFrame(api.conn, math.MaxUint32)
+	}
+
 	err := utils.WriteAll(api.fd, buf)
 	if err != nil {
 		return nil, err
@@ -372,11 +651,38 @@ func (api *apiImpl) sendCmd(buf []byte) ([]byte, error) {
 		result = append(result, buf[:size]...)
 	}
 
+	if api.protocol == ProtocolBinary {
+		// Binary frames carry their own length and may legitimately end
+		// with zero bytes.
+		return result, nil
+	}
 	return bytes.TrimRight(result, "\u0000"), nil
 }
 
+func (api *apiImpl) marshal(cmd interface{}) ([]byte, error) {
+	if api.protocol == ProtocolBinary {
+		frame := EncodeBinaryCommand(cmd)
+		if api.compression == CompressionZlib {
+			frame = CompressBinaryFrame(frame)
+		}
+		return frame, nil
+	}
+	return json.Marshal(cmd)
+}
+
+func (api *apiImpl) unmarshal(buf []byte, res interface{}) error {
+	if api.protocol == ProtocolBinary {
+		frame, err := DecompressBinaryFrame(buf, math.MaxUint32)
+		if err != nil {
+			return err
+		}
+		return DecodeBinaryCommand(frame, res)
+	}
+	return json.Unmarshal(buf, res)
+}
+
 func (api *apiImpl) processCmd(cmd interface{}, res interface{}) error {
-	cmdBuf, err := json.Marshal(cmd)
+	cmdBuf, err := api.marshal(cmd)
 	if err != nil {
 		return err
 	}
@@ -388,7 +694,7 @@ func (api *apiImpl) processCmd(cmd interface{}, res interface{}) error {
 
 	if res == nil {
 		var errorResponse ErrorResponse
-		err = json.Unmarshal(buf, &errorResponse)
+		err = api.unmarshal(buf, &errorResponse)
 		if err != nil {
 			return fmt.Errorf("%s. buffer: %q", err.Error(), buf)
 		}
@@ -398,7 +704,7 @@ func (api *apiImpl) processCmd(cmd interface{}, res interface{}) error {
 		}
 	} else {
 		// The client must check res.errorResponse.ErrorCode
-		return json.Unmarshal(buf, res)
+		return api.unmarshal(buf, res)
 	}
 	return nil
 }
@@ -508,6 +814,35 @@ func (api *apiImpl) GetAccessed(wsr string) (*PathsAccessed, error) {
 	return &accesslistResponse.PathList, nil
 }
 
+func (api *apiImpl) GetAccessedPage(wsr string, cursor uint64,
+	pageSize uint32) ([]AccessedPath, uint64, error) {
+
+	if !isWorkspaceNameValid(wsr) {
+		return nil, 0,
+			fmt.Errorf("\"%s\" must contain precisely two \"/\"\n", wsr)
+	}
+
+	cmd := AccessedPageRequest{
+		CommandCommon: CommandCommon{CommandId: CmdGetAccessedPage},
+		WorkspaceRoot: wsr,
+		Cursor:        cursor,
+		PageSize:      pageSize,
+	}
+
+	var pageResponse AccessedPageResponse
+	err := api.processCmd(cmd, &pageResponse)
+	if err != nil {
+		return nil, 0, err
+	}
+	errorResponse := pageResponse.ErrorResponse
+	if errorResponse.ErrorCode != ErrorOK {
+		return nil, 0,
+			fmt.Errorf("qfs command Error:%s", errorResponse.Message)
+	}
+
+	return pageResponse.Paths, pageResponse.NextCursor, nil
+}
+
 func (api *apiImpl) ClearAccessed(wsr string) error {
 	if !isWorkspaceNameValid(wsr) {
 		return fmt.Errorf("\"%s\" must contain precisely two \"/\"\n", wsr)
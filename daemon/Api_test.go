@@ -11,6 +11,8 @@ import (
 	"encoding/json"
 	"fmt"
 	"io"
+	"io/ioutil"
+	"net"
 	"os"
 	"strings"
 	"sync/atomic"
@@ -162,6 +164,51 @@ func TestApiAccessListLargeSize(t *testing.T) {
 	})
 }
 
+func TestApiAccessListPaged(t *testing.T) {
+	runTest(t, func(test *testHelper) {
+		workspace := test.NewWorkspace()
+		accessList, _ := generateFiles(test, 200, workspace, "pagedfile")
+
+		api := test.getApi()
+		relpath := test.RelPath(workspace)
+
+		// Files accessed part way through the listing aren't included in it
+		pages := 0
+		lastPath := ""
+		responselist := quantumfs.NewPathsAccessed()
+		paths, cursor, err := api.GetAccessedPage(relpath, 0, 64)
+		for {
+			test.AssertNoErr(err)
+			test.Assert(len(paths) <= 64, "Page too large: %d",
+				len(paths))
+			pages++
+
+			for _, path := range paths {
+				test.Assert(path.Path > lastPath,
+					"Paths out of order %s after %s", path.Path,
+					lastPath)
+				lastPath = path.Path
+				responselist.Paths[path.Path] = path.Flags
+			}
+
+			if cursor == 0 {
+				break
+			}
+
+			test.createFile(workspace, fmt.Sprintf("late%d", pages), 10)
+			paths, cursor, err = api.GetAccessedPage(relpath, cursor, 64)
+		}
+
+		test.Assert(pages == 4, "Expected 4 pages, got %d", pages)
+		test.assertAccessList(accessList, &responselist,
+			"Error two maps different")
+
+		// A finished listing can't be continued
+		_, _, err = api.GetAccessedPage(relpath, 1<<32|64, 64)
+		test.Assert(err != nil, "Continued a finished listing")
+	})
+}
+
 func TestApiAccessListApiFileSizeResidue(t *testing.T) {
 	runTest(t, func(test *testHelper) {
 		workspace := test.NewWorkspace()
@@ -473,6 +520,99 @@ func TestApiInsertInodeAsUser(t *testing.T) {
 	})
 }
 
+func TestApiInsertInodes(t *testing.T) {
+	runTest(t, func(test *testHelper) {
+		api, err := os.OpenFile(test.AbsPath(quantumfs.ApiPath),
+			os.O_RDWR|syscall.O_DIRECT, 0)
+		test.AssertNoErr(err)
+		defer api.Close()
+
+		workspaceSrc := test.NewWorkspace()
+		workspaceDst := test.NewWorkspace()
+		dst := test.RelPath(workspaceDst)
+
+		fileA := workspaceSrc + "/a"
+		fileB := workspaceSrc + "/b"
+		test.AssertNoErr(testutils.PrintToFile(fileA, "contents of a"))
+		test.AssertNoErr(testutils.PrintToFile(fileB, "b"))
+		keyA := getExtendedKeyHelper(test, fileA, "file")
+		keyB := getExtendedKeyHelper(test, fileB, "file")
+
+		test.AssertNoErr(utils.MkdirAll(workspaceDst+"/dir", 0777))
+		test.AssertNoErr(testutils.PrintToFile(workspaceDst+"/dir/a",
+			"overwritten"))
+
+		inode := func(path string, key string) quantumfs.InsertInodeEntry {
+			return quantumfs.InsertInodeEntry{
+				DstPath:     dst + path,
+				Key:         key,
+				Permissions: 0644,
+			}
+		}
+
+		var response quantumfs.InsertInodesResponse
+		sendApiRequest(test, api, quantumfs.InsertInodesRequest{
+			CommandCommon: quantumfs.CommandCommon{
+				CommandId: quantumfs.CmdInsertInodes,
+			},
+			Inodes: []quantumfs.InsertInodeEntry{
+				inode("/dir/a", keyA),
+				inode("/dir/b", keyB),
+				inode("/missing/a", keyA),
+				inode("", keyA),
+				inode("/dir/c", keyA[1:]),
+				inode("/a", keyB),
+				// the latter inode at a path is the one left
+				inode("/b", keyA),
+				inode("/b", keyB),
+			},
+		}, &response)
+		test.Assert(response.ErrorCode == quantumfs.ErrorOK,
+			"InsertInodes failed: %s", response.Message)
+
+		expected := []uint32{
+			quantumfs.ErrorOK,
+			quantumfs.ErrorOK,
+			quantumfs.ErrorBadArgs,
+			quantumfs.ErrorBadArgs,
+			quantumfs.ErrorBadArgs,
+			quantumfs.ErrorOK,
+			quantumfs.ErrorOK,
+			quantumfs.ErrorOK,
+		}
+		test.Assert(len(response.Results) == len(expected),
+			"Wrong number of results %d", len(response.Results))
+		for i, result := range response.Results {
+			test.Assert(result.ErrorCode == expected[i],
+				"Inode %d gave %d: %s", i, result.ErrorCode,
+				result.Message)
+		}
+
+		for path, contents := range map[string]string{
+			"/dir/a": "contents of a",
+			"/dir/b": "b",
+			"/a":     "b",
+			"/b":     "b",
+		} {
+			data, err := ioutil.ReadFile(workspaceDst + path)
+			test.AssertNoErr(err)
+			test.Assert(string(data) == contents,
+				"Wrong contents of %s: %s", path, data)
+		}
+
+		response = quantumfs.InsertInodesResponse{}
+		sendApiRequest(test, api, quantumfs.InsertInodesRequest{
+			CommandCommon: quantumfs.CommandCommon{
+				CommandId: quantumfs.CmdInsertInodes,
+			},
+			Inodes: make([]quantumfs.InsertInodeEntry,
+				quantumfs.MaxInsertInodes+1),
+		}, &response)
+		test.Assert(response.ErrorCode == quantumfs.ErrorBadArgs,
+			"Too many inodes allowed in InsertInodes")
+	})
+}
+
 func TestInsertInodeDirties(t *testing.T) {
 	runTest(t, func(test *testHelper) {
 		workspace := test.NewWorkspace()
@@ -629,6 +769,546 @@ func TestApiGetAndSetBlock(t *testing.T) {
 	})
 }
 
+// Send a request on the api file and decode its response
+func sendApiRequest(test *testHelper, api *os.File, cmd interface{},
+	response interface{}) {
+
+	test.AssertNoErr(writeApiRequest(test, api, cmd))
+	test.AssertNoErr(json.Unmarshal(readApiResponse(test, api), response))
+}
+
+func TestApiSharedMemoryBlocks(t *testing.T) {
+	runTest(t, func(test *testHelper) {
+		api, err := os.OpenFile(test.AbsPath(quantumfs.ApiPath),
+			os.O_RDWR|syscall.O_DIRECT, 0)
+		test.AssertNoErr(err)
+		defer api.Close()
+
+		const sharedSize = 1024 * 1024
+		shared, err := ioutil.TempFile(quantumfs.SharedMemoryDir,
+			"qfsApiTest")
+		test.AssertNoErr(err)
+		defer shared.Close()
+		test.AssertNoErr(shared.Truncate(sharedSize))
+
+		var response quantumfs.ErrorResponse
+		sendApiRequest(test, api, quantumfs.RegisterSharedMemoryRequest{
+			CommandCommon: quantumfs.CommandCommon{
+				CommandId: quantumfs.CmdRegisterSharedMemory,
+			},
+			Path: shared.Name(),
+			Size: sharedSize,
+		}, &response)
+		test.Assert(response.ErrorCode == quantumfs.ErrorOK,
+			"Registering shared memory failed: %s", response.Message)
+
+		// The file stays open in quantumfsd once registered
+		test.AssertNoErr(os.Remove(shared.Name()))
+
+		key := []byte("11112222333344445555")
+		data := GenData(300)
+		_, err = shared.WriteAt(data, 100)
+		test.AssertNoErr(err)
+
+		response = quantumfs.ErrorResponse{}
+		sendApiRequest(test, api, quantumfs.SetBlockSharedRequest{
+			CommandCommon: quantumfs.CommandCommon{
+				CommandId: quantumfs.CmdSetBlockShared,
+			},
+			Key:    key,
+			Offset: 100,
+			Length: uint64(len(data)),
+		}, &response)
+		test.Assert(response.ErrorCode == quantumfs.ErrorOK,
+			"SetBlockShared failed: %s", response.Message)
+
+		readData, err := test.getApi().GetBlock(key)
+		test.AssertNoErr(err)
+		test.Assert(bytes.Equal(data, readData), "Data mismatch")
+
+		var blockResponse quantumfs.GetBlockSharedResponse
+		sendApiRequest(test, api, quantumfs.GetBlockSharedRequest{
+			CommandCommon: quantumfs.CommandCommon{
+				CommandId: quantumfs.CmdGetBlockShared,
+			},
+			Key:      key,
+			Offset:   4096,
+			Capacity: uint64(quantumfs.MaxBlockSize),
+		}, &blockResponse)
+		test.Assert(blockResponse.ErrorCode == quantumfs.ErrorOK,
+			"GetBlockShared failed: %s", blockResponse.Message)
+		test.Assert(blockResponse.Length == uint64(len(data)),
+			"Wrong length %d", blockResponse.Length)
+
+		readData = make([]byte, len(data))
+		_, err = shared.ReadAt(readData, 4096)
+		test.AssertNoErr(err)
+		test.Assert(bytes.Equal(data, readData), "Shared data mismatch")
+
+		// Payloads must lie within the registered size
+		response = quantumfs.ErrorResponse{}
+		sendApiRequest(test, api, quantumfs.SetBlockSharedRequest{
+			CommandCommon: quantumfs.CommandCommon{
+				CommandId: quantumfs.CmdSetBlockShared,
+			},
+			Key:    key,
+			Offset: sharedSize - 10,
+			Length: uint64(len(data)),
+		}, &response)
+		test.Assert(response.ErrorCode == quantumfs.ErrorBadArgs,
+			"Out of range payload allowed: %d", response.ErrorCode)
+
+		// as must the file
+		response = quantumfs.ErrorResponse{}
+		sendApiRequest(test, api, quantumfs.RegisterSharedMemoryRequest{
+			CommandCommon: quantumfs.CommandCommon{
+				CommandId: quantumfs.CmdRegisterSharedMemory,
+			},
+			Path: "/dev/shm/../etc/passwd",
+			Size: 1,
+		}, &response)
+		test.Assert(response.ErrorCode == quantumfs.ErrorBadArgs,
+			"File outside %s allowed: %d", quantumfs.SharedMemoryDir,
+			response.ErrorCode)
+	})
+}
+
+func TestApiStatBlock(t *testing.T) {
+	runTest(t, func(test *testHelper) {
+		api, err := os.OpenFile(test.AbsPath(quantumfs.ApiPath),
+			os.O_RDWR|syscall.O_DIRECT, 0)
+		test.AssertNoErr(err)
+		defer api.Close()
+
+		key := []byte("11112222333344445555")
+		data := GenData(300)
+		test.AssertNoErr(test.getApi().SetBlock(key, data))
+
+		var response quantumfs.StatBlockResponse
+		sendApiRequest(test, api, quantumfs.StatBlockRequest{
+			CommandCommon: quantumfs.CommandCommon{
+				CommandId: quantumfs.CmdStatBlock,
+			},
+			Key: key,
+		}, &response)
+		test.Assert(response.ErrorCode == quantumfs.ErrorOK,
+			"StatBlock failed: %s", response.Message)
+		test.Assert(response.Size == uint64(len(data)),
+			"Wrong size %d", response.Size)
+
+		response = quantumfs.StatBlockResponse{}
+		sendApiRequest(test, api, quantumfs.StatBlockRequest{
+			CommandCommon: quantumfs.CommandCommon{
+				CommandId: quantumfs.CmdStatBlock,
+			},
+			Key: key[:1],
+		}, &response)
+		test.Assert(response.ErrorCode == quantumfs.ErrorBadArgs,
+			"Invalid key length allowed in StatBlock")
+	})
+}
+
+func TestApiHasBlocks(t *testing.T) {
+	runTest(t, func(test *testHelper) {
+		api, err := os.OpenFile(test.AbsPath(quantumfs.ApiPath),
+			os.O_RDWR|syscall.O_DIRECT, 0)
+		test.AssertNoErr(err)
+		defer api.Close()
+
+		stored := []byte("11112222333344445555")
+		missing := []byte("55554444333322221111")
+		test.AssertNoErr(test.getApi().SetBlock(stored, GenData(300)))
+
+		var response quantumfs.HasBlocksResponse
+		sendApiRequest(test, api, quantumfs.HasBlocksRequest{
+			CommandCommon: quantumfs.CommandCommon{
+				CommandId: quantumfs.CmdHasBlocks,
+			},
+			Keys: [][]byte{missing, stored, stored},
+		}, &response)
+		test.Assert(response.ErrorCode == quantumfs.ErrorOK,
+			"HasBlocks failed: %s", response.Message)
+		test.Assert(len(response.Present) == 3 && !response.Present[0] &&
+			response.Present[1] && response.Present[2],
+			"Wrong blocks present %v", response.Present)
+
+		response = quantumfs.HasBlocksResponse{}
+		sendApiRequest(test, api, quantumfs.HasBlocksRequest{
+			CommandCommon: quantumfs.CommandCommon{
+				CommandId: quantumfs.CmdHasBlocks,
+			},
+			Keys: [][]byte{stored, missing[:1]},
+		}, &response)
+		test.Assert(response.ErrorCode == quantumfs.ErrorBadArgs,
+			"Invalid key length allowed in HasBlocks")
+	})
+}
+
+// A datastore whose blocks expire unless they are set or freshened again, as with
+// the CQL backend
+type expiringDataStore struct {
+	quantumfs.DataStore
+
+	lock utils.DeferableMutex
+	ttls map[string]int // The remaining lifetime of each block, in seconds
+	gets int
+}
+
+const expiringDataStoreTtl = 3600
+
+func (store *expiringDataStore) Get(c *quantumfs.Ctx, key quantumfs.ObjectKey,
+	buf quantumfs.Buffer) error {
+
+	func() {
+		defer store.lock.Lock().Unlock()
+		store.gets++
+	}()
+	return store.DataStore.Get(c, key, buf)
+}
+
+func (store *expiringDataStore) Set(c *quantumfs.Ctx, key quantumfs.ObjectKey,
+	buf quantumfs.Buffer) error {
+
+	func() {
+		defer store.lock.Lock().Unlock()
+		store.ttls[key.String()] = expiringDataStoreTtl
+	}()
+	return store.DataStore.Set(c, key, buf)
+}
+
+func (store *expiringDataStore) Freshen(c *quantumfs.Ctx,
+	key quantumfs.ObjectKey) error {
+
+	err := store.DataStore.Freshen(c, key)
+	if err == nil {
+		defer store.lock.Lock().Unlock()
+		store.ttls[key.String()] = expiringDataStoreTtl
+	}
+	return err
+}
+
+func TestApiHasBlocksFreshens(t *testing.T) {
+	runTest(t, func(test *testHelper) {
+		api, err := os.OpenFile(test.AbsPath(quantumfs.ApiPath),
+			os.O_RDWR|syscall.O_DIRECT, 0)
+		test.AssertNoErr(err)
+		defer api.Close()
+
+		store := &expiringDataStore{
+			DataStore: test.GetDataStore(),
+			ttls:      map[string]int{},
+		}
+		test.SetDataStore(store)
+
+		// Store the block behind the cache of quantumfsd, as if it was
+		// stored long ago
+		stored := []byte("11112222333344445555")
+		var hash [quantumfs.HashSize]byte
+		copy(hash[:], stored)
+		objectKey := quantumfs.NewObjectKey(quantumfs.KeyTypeApi, hash)
+		test.AssertNoErr(store.Set(&test.qfs.c.Ctx, objectKey,
+			newBuffer(&test.qfs.c, GenData(300), quantumfs.KeyTypeApi)))
+
+		// and it is about to expire
+		key := objectKey.String()
+		func() {
+			defer store.lock.Lock().Unlock()
+			store.ttls[key] = 1
+		}()
+
+		var response quantumfs.HasBlocksResponse
+		sendApiRequest(test, api, quantumfs.HasBlocksRequest{
+			CommandCommon: quantumfs.CommandCommon{
+				CommandId: quantumfs.CmdHasBlocks,
+			},
+			Keys: [][]byte{stored},
+		}, &response)
+		test.Assert(response.ErrorCode == quantumfs.ErrorOK,
+			"HasBlocks failed: %s", response.Message)
+		test.Assert(len(response.Present) == 1 && response.Present[0],
+			"Stored block not present %v", response.Present)
+
+		// A client skips storing the block again, so its lifetime must have
+		// been extended, without loading the block
+		defer store.lock.Lock().Unlock()
+		test.Assert(store.ttls[key] == expiringDataStoreTtl,
+			"Block not freshened, %d seconds left", store.ttls[key])
+		test.Assert(store.gets == 0, "Block loaded %d times", store.gets)
+	})
+}
+
+func TestApiPrefetch(t *testing.T) {
+	runTest(t, func(test *testHelper) {
+		api, err := os.OpenFile(test.AbsPath(quantumfs.ApiPath),
+			os.O_RDWR|syscall.O_DIRECT, 0)
+		test.AssertNoErr(err)
+		defer api.Close()
+
+		workspace := test.NewWorkspace()
+		file := workspace + "/file"
+		test.AssertNoErr(testutils.PrintToFile(file, "prefetched"))
+		extendedKey := getExtendedKeyHelper(test, file, "file")
+
+		stored := []byte("11112222333344445555")
+		missing := []byte("55554444333322221111")
+		test.AssertNoErr(test.getApi().SetBlock(stored, GenData(300)))
+
+		// Keys which aren't stored are valid, they just aren't loaded
+		var response quantumfs.ErrorResponse
+		sendApiRequest(test, api, quantumfs.PrefetchRequest{
+			CommandCommon: quantumfs.CommandCommon{
+				CommandId: quantumfs.CmdPrefetch,
+			},
+			Keys:         [][]byte{stored, missing},
+			ExtendedKeys: []string{extendedKey},
+		}, &response)
+		test.Assert(response.ErrorCode == quantumfs.ErrorOK,
+			"Prefetch failed: %s", response.Message)
+
+		response = quantumfs.ErrorResponse{}
+		sendApiRequest(test, api, quantumfs.PrefetchRequest{
+			CommandCommon: quantumfs.CommandCommon{
+				CommandId: quantumfs.CmdPrefetch,
+			},
+			Keys: [][]byte{stored, missing[:1]},
+		}, &response)
+		test.Assert(response.ErrorCode == quantumfs.ErrorBadArgs,
+			"Invalid key length allowed in Prefetch")
+
+		response = quantumfs.ErrorResponse{}
+		sendApiRequest(test, api, quantumfs.PrefetchRequest{
+			CommandCommon: quantumfs.CommandCommon{
+				CommandId: quantumfs.CmdPrefetch,
+			},
+			ExtendedKeys: []string{extendedKey[1:]},
+		}, &response)
+		test.Assert(response.ErrorCode == quantumfs.ErrorBadArgs,
+			"Invalid extended key allowed in Prefetch")
+
+		// Prefetches are dropped once every slot of the daemon is busy
+		for i := 0; i < prefetchConcurrency; i++ {
+			test.qfs.prefetches <- struct{}{}
+		}
+		response = quantumfs.ErrorResponse{}
+		sendApiRequest(test, api, quantumfs.PrefetchRequest{
+			CommandCommon: quantumfs.CommandCommon{
+				CommandId: quantumfs.CmdPrefetch,
+			},
+			Keys: [][]byte{stored, missing},
+		}, &response)
+		for i := 0; i < prefetchConcurrency; i++ {
+			<-test.qfs.prefetches
+		}
+		test.Assert(response.ErrorCode == quantumfs.ErrorOK,
+			"Prefetch failed: %s", response.Message)
+		test.Assert(response.Message == "Prefetch started for 0 of 2 blocks",
+			"Prefetch not dropped: %s", response.Message)
+		test.WaitForLogString(fmt.Sprintf(PrefetchDroppedLog, 2),
+			"Dropped prefetch not logged")
+	})
+}
+
+func TestApiBatch(t *testing.T) {
+	runTest(t, func(test *testHelper) {
+		api, err := os.OpenFile(test.AbsPath(quantumfs.ApiPath),
+			os.O_RDWR|syscall.O_DIRECT, 0)
+		test.AssertNoErr(err)
+		defer api.Close()
+
+		command := func(cmd interface{}) json.RawMessage {
+			bytes, err := json.Marshal(cmd)
+			test.AssertNoErr(err)
+			return bytes
+		}
+
+		key := []byte("11112222333344445555")
+		data := GenData(300)
+		workspace := test.NewWorkspace()
+		dst := "work/apibatch/branch"
+
+		setBlock := command(quantumfs.SetBlockRequest{
+			CommandCommon: quantumfs.CommandCommon{
+				CommandId: quantumfs.CmdSetBlock,
+			},
+			Key:  key,
+			Data: data,
+		})
+		branch := command(quantumfs.BranchRequest{
+			CommandCommon: quantumfs.CommandCommon{
+				CommandId: quantumfs.CmdBranchRequest,
+			},
+			Src: test.RelPath(workspace),
+			Dst: dst,
+		})
+		unknown := command(quantumfs.CommandCommon{CommandId: 9999})
+		nested := command(quantumfs.BatchRequest{
+			CommandCommon: quantumfs.CommandCommon{
+				CommandId: quantumfs.CmdBatch,
+			},
+		})
+
+		var response quantumfs.BatchResponse
+		sendApiRequest(test, api, quantumfs.BatchRequest{
+			CommandCommon: quantumfs.CommandCommon{
+				CommandId: quantumfs.CmdBatch,
+			},
+			Commands: []json.RawMessage{
+				setBlock, branch, unknown, nested,
+			},
+		}, &response)
+		test.Assert(response.ErrorCode == quantumfs.ErrorOK,
+			"Batch failed: %s", response.Message)
+		test.Assert(len(response.Results) == 4, "Wrong number of results %d",
+			len(response.Results))
+
+		// One failed command doesn't affect the others
+		expected := []uint32{
+			quantumfs.ErrorOK,
+			quantumfs.ErrorOK,
+			quantumfs.ErrorBadCommandId,
+			quantumfs.ErrorBadArgs,
+		}
+		for i, result := range response.Results {
+			var itemResponse quantumfs.ErrorResponse
+			test.AssertNoErr(json.Unmarshal(result, &itemResponse))
+			test.Assert(itemResponse.ErrorCode == expected[i],
+				"Command %d: wrong error %d: %s", i,
+				itemResponse.ErrorCode, itemResponse.Message)
+		}
+
+		readData, err := test.getApi().GetBlock(key)
+		test.AssertNoErr(err)
+		test.Assert(bytes.Equal(data, readData), "Data mismatch")
+
+		_, err = os.Stat(test.AbsPath(dst))
+		test.AssertNoErr(err)
+	})
+}
+
+func TestApiBatchBlocks(t *testing.T) {
+	runTest(t, func(test *testHelper) {
+		api, err := os.OpenFile(test.AbsPath(quantumfs.ApiPath),
+			os.O_RDWR|syscall.O_DIRECT, 0)
+		test.AssertNoErr(err)
+		defer api.Close()
+
+		command := func(cmd interface{}) json.RawMessage {
+			bytes, err := json.Marshal(cmd)
+			test.AssertNoErr(err)
+			return bytes
+		}
+
+		// Runs of SetBlock and of GetBlock commands are processed
+		// concurrently, but each run only after the one before it
+		const numBlocks = 8
+		keys := make([][]byte, numBlocks)
+		blocks := make([][]byte, numBlocks)
+		commands := make([]json.RawMessage, 0, 2*numBlocks)
+		for i := 0; i < numBlocks; i++ {
+			keys[i] = []byte(fmt.Sprintf("1111222233334444%04d", i))
+			blocks[i] = GenData(300 + i)
+			setBlock := command(quantumfs.SetBlockRequest{
+				CommandCommon: quantumfs.CommandCommon{
+					CommandId: quantumfs.CmdSetBlock,
+				},
+				Key:  keys[i],
+				Data: blocks[i],
+			})
+			commands = append(commands, setBlock)
+		}
+		for i := 0; i < numBlocks; i++ {
+			getBlock := command(quantumfs.GetBlockRequest{
+				CommandCommon: quantumfs.CommandCommon{
+					CommandId: quantumfs.CmdGetBlock,
+				},
+				Key: keys[i],
+			})
+			commands = append(commands, getBlock)
+		}
+
+		var response quantumfs.BatchResponse
+		sendApiRequest(test, api, quantumfs.BatchRequest{
+			CommandCommon: quantumfs.CommandCommon{
+				CommandId: quantumfs.CmdBatch,
+			},
+			Commands: commands,
+		}, &response)
+		test.Assert(response.ErrorCode == quantumfs.ErrorOK,
+			"Batch failed: %s", response.Message)
+		test.Assert(len(response.Results) == 2*numBlocks,
+			"Wrong number of results %d", len(response.Results))
+
+		for i := 0; i < numBlocks; i++ {
+			var setResponse quantumfs.ErrorResponse
+			test.AssertNoErr(json.Unmarshal(response.Results[i],
+				&setResponse))
+			test.Assert(setResponse.ErrorCode == quantumfs.ErrorOK,
+				"SetBlock %d failed: %s", i, setResponse.Message)
+
+			var getResponse quantumfs.GetBlockResponse
+			test.AssertNoErr(json.Unmarshal(
+				response.Results[numBlocks+i], &getResponse))
+			test.Assert(getResponse.ErrorCode == quantumfs.ErrorOK,
+				"GetBlock %d failed: %s", i, getResponse.Message)
+			test.Assert(bytes.Equal(blocks[i], getResponse.Data),
+				"Data mismatch for block %d", i)
+		}
+	})
+}
+
+func TestApiSocket(t *testing.T) {
+	useApiSocket := func(test *testHelper, config *QuantumFsConfig) {
+		config.ApiSocketPath = test.TempDir + "/api.sock"
+	}
+
+	runTestCustomConfig(t, useApiSocket, func(test *testHelper) {
+		socketPath := test.TempDir + "/api.sock"
+		api, err := quantumfs.NewApiWithSocket(socketPath)
+		test.AssertNoErr(err)
+		defer api.Close()
+
+		// Blocks are shared with the api file
+		key := []byte("11112222333344445555")
+		data := GenData(300)
+		test.AssertNoErr(api.SetBlock(key, data))
+
+		readData, err := test.getApi().GetBlock(key)
+		test.AssertNoErr(err)
+		test.Assert(bytes.Equal(data, readData), "Data mismatch")
+
+		readData, err = api.GetBlock(key)
+		test.AssertNoErr(err)
+		test.Assert(bytes.Equal(data, readData), "Socket data mismatch")
+
+		workspace := test.NewWorkspace()
+		dst := "work/apisocket/branch"
+		test.AssertNoErr(api.Branch(test.RelPath(workspace), dst))
+		_, err = os.Stat(test.AbsPath(dst))
+		test.AssertNoErr(err)
+
+		// The socket only speaks the binary protocol
+		conn, err := net.Dial("unix", socketPath)
+		test.AssertNoErr(err)
+		defer conn.Close()
+
+		_, err = conn.Write(quantumfs.EncodeBinaryCommand(
+			quantumfs.SetProtocolRequest{
+				CommandCommon: quantumfs.CommandCommon{
+					CommandId: quantumfs.CmdSetProtocol,
+				},
+				Protocol: quantumfs.ProtocolJson,
+			}))
+		test.AssertNoErr(err)
+
+		frame, err := quantumfs.ReadBinaryFrame(conn, 4096)
+		test.AssertNoErr(err)
+		var response quantumfs.ErrorResponse
+		test.AssertNoErr(quantumfs.DecodeBinaryCommand(frame, &response))
+		test.Assert(response.ErrorCode == quantumfs.ErrorBadArgs,
+			"JSON allowed on api socket: %d", response.ErrorCode)
+	})
+}
+
 func TestInvalidWorkspaceName(t *testing.T) {
 	runTest(t, func(test *testHelper) {
 		api := test.getApi()
@@ -789,3 +1469,251 @@ func TestWorkspaceFinished(t *testing.T) {
 			"Waiting for workspace to have finished message")
 	})
 }
+
+func TestApiBinaryProtocol(t *testing.T) {
+	runTest(t, func(test *testHelper) {
+		api, err := quantumfs.NewBinaryApiWithPath(
+			test.AbsPath(quantumfs.ApiPath))
+		test.AssertNoErr(err)
+		defer api.Close()
+
+		workspace := test.NewWorkspace()
+		test.createFile(workspace, "testFile", 1000)
+
+		dst := "work/apitest/binary"
+		test.AssertNoErr(api.Branch(test.RelPath(workspace), dst))
+		test.AssertNoErr(api.EnableRootWrite(dst))
+
+		accessed, err := api.GetAccessed(test.RelPath(workspace))
+		test.AssertNoErr(err)
+		test.Assert(accessed.Paths["/testFile"].Created(),
+			"testFile not created: %v", accessed.Paths)
+
+		// Blocks ending in zeros must not be truncated
+		key := []byte("11112222333344445555")
+		data := append(GenData(300), 0, 0, 0, 0)
+		test.AssertNoErr(api.SetBlock(key, data))
+
+		readData, err := api.GetBlock(key)
+		test.AssertNoErr(err)
+		test.Assert(bytes.Equal(data, readData), "Data mismatch")
+
+		// Errors are returned in the binary protocol as well
+		err = api.SetBlock(key[:1], data)
+		test.Assert(err != nil, "Invalid key length allowed in SetBlock")
+		test.Assert(strings.Contains(err.Error(), "Key must be"),
+			"Unexpected error: %s", err.Error())
+	})
+}
+
+func TestApiCompression(t *testing.T) {
+	runTest(t, func(test *testHelper) {
+		api, err := quantumfs.NewBinaryApiWithPath(
+			test.AbsPath(quantumfs.ApiPath))
+		test.AssertNoErr(err)
+		defer api.Close()
+
+		// Large blocks travel compressed in both directions
+		key := []byte("11112222333344445555")
+		data := bytes.Repeat([]byte("compressible "), 5000)
+		test.AssertNoErr(api.SetBlock(key, data))
+		test.WaitForLogString("Api frame compressed saving",
+			"Request not compressed")
+
+		readData, err := api.GetBlock(key)
+		test.AssertNoErr(err)
+		test.Assert(bytes.Equal(data, readData), "Data mismatch")
+		test.WaitForNLogStrings("Api frame compressed saving", 2,
+			"Response not compressed")
+	})
+}
+
+func readApiResponse(test *testHelper, api *os.File) []byte {
+	api.Seek(0, 0)
+	size := quantumfs.BufferSize
+	buf := make([]byte, quantumfs.BufferSize)
+	result := make([]byte, 0)
+	for size == quantumfs.BufferSize {
+		var err error
+		size, err = api.Read(buf)
+		if err == io.EOF {
+			break
+		}
+		test.AssertNoErr(err)
+		result = append(result, buf[:size]...)
+	}
+	return bytes.TrimRight(result, "\u0000")
+}
+
+func writeApiRequest(test *testHelper, api *os.File, cmd interface{}) error {
+	buf, err := json.Marshal(cmd)
+	test.AssertNoErr(err)
+	return utils.WriteAll(api, buf)
+}
+
+func TestApiPipelinedRequests(t *testing.T) {
+	runTest(t, func(test *testHelper) {
+		api, err := os.OpenFile(test.AbsPath(quantumfs.ApiPath),
+			os.O_RDWR|syscall.O_DIRECT, 0)
+		test.AssertNoErr(err)
+		defer api.Close()
+
+		const numRequests = 20
+		keyOf := func(requestId uint64) []byte {
+			return []byte(fmt.Sprintf("%020d", requestId))
+		}
+		dataOf := func(requestId uint64) []byte {
+			return GenData(100 + int(requestId))
+		}
+
+		for i := uint64(1); i <= numRequests; i++ {
+			test.AssertNoErr(writeApiRequest(test, api,
+				quantumfs.SetBlockRequest{
+					CommandCommon: quantumfs.CommandCommon{
+						CommandId: quantumfs.CmdSetBlock,
+						RequestId: i,
+					},
+					Key:  keyOf(i),
+					Data: dataOf(i),
+				}))
+		}
+
+		// The responses may arrive in any order
+		answered := map[uint64]bool{}
+		for i := 0; i < numRequests; i++ {
+			var response quantumfs.ErrorResponse
+			test.AssertNoErr(json.Unmarshal(readApiResponse(test, api),
+				&response))
+			test.Assert(response.ErrorCode == quantumfs.ErrorOK,
+				"SetBlock failed: %s", response.Message)
+			test.Assert(!answered[response.RequestId],
+				"Request %d answered twice", response.RequestId)
+			answered[response.RequestId] = true
+		}
+		test.Assert(len(answered) == numRequests, "Missing responses %v",
+			answered)
+
+		for i := uint64(1); i <= numRequests; i++ {
+			test.AssertNoErr(writeApiRequest(test, api,
+				quantumfs.GetBlockRequest{
+					CommandCommon: quantumfs.CommandCommon{
+						CommandId: quantumfs.CmdGetBlock,
+						RequestId: i,
+					},
+					Key: keyOf(i),
+				}))
+		}
+
+		for i := 0; i < numRequests; i++ {
+			var response quantumfs.GetBlockResponse
+			test.AssertNoErr(json.Unmarshal(readApiResponse(test, api),
+				&response))
+			test.Assert(response.ErrorCode == quantumfs.ErrorOK,
+				"GetBlock failed: %s", response.Message)
+			test.Assert(bytes.Equal(response.Data,
+				dataOf(response.RequestId)),
+				"Wrong data for request %d", response.RequestId)
+		}
+
+		// Synchronous requests are still answered without a RequestId
+		test.AssertNoErr(writeApiRequest(test, api,
+			quantumfs.GetBlockRequest{
+				CommandCommon: quantumfs.CommandCommon{
+					CommandId: quantumfs.CmdGetBlock,
+				},
+				Key: keyOf(1),
+			}))
+		var response quantumfs.GetBlockResponse
+		test.AssertNoErr(json.Unmarshal(readApiResponse(test, api),
+			&response))
+		test.Assert(response.RequestId == 0, "Unexpected RequestId %d",
+			response.RequestId)
+		test.Assert(bytes.Equal(response.Data, dataOf(1)), "Data mismatch")
+	})
+}
+
+func TestApiPipelinedReadWithQueuedWriter(t *testing.T) {
+	runTest(t, func(test *testHelper) {
+		api, err := os.OpenFile(test.AbsPath(quantumfs.ApiPath),
+			os.O_RDWR|syscall.O_DIRECT, 0)
+		test.AssertNoErr(err)
+		defer api.Close()
+
+		workspace := test.NewWorkspace()
+		test.AssertNoErr(testutils.PrintToFile(workspace+"/file", "data"))
+		key := getExtendedKeyHelper(test, workspace+"/file", "file")
+
+		// Keep the pipelined request from completing while a blocking read
+		// waits for its response
+		wsr, cleanup := test.GetWorkspaceRoot(workspace)
+		defer cleanup()
+		wsrUnlock := wsr.LockTree()
+
+		test.AssertNoErr(writeApiRequest(test, api,
+			quantumfs.InsertInodeRequest{
+				CommandCommon: quantumfs.CommandCommon{
+					CommandId: quantumfs.CmdInsertInode,
+					RequestId: 1,
+				},
+				DstPath:     test.RelPath(workspace) + "/copy",
+				Key:         key,
+				Permissions: 0644,
+			}))
+
+		responseRead := make(chan []byte)
+		go func() {
+			responseRead <- readApiResponse(test, api)
+		}()
+		test.WaitForLogString(ApiAwaitLog, "Read waiting for response")
+
+		// A writer to the tree of the api file must not wait for the read
+		c := test.qfs.c.newThread()
+		apiInode, release := test.qfs.inode(c, quantumfs.InodeIdApi)
+		defer release()
+		writerDone := make(chan struct{})
+		go func() {
+			apiInode.LockTree().Unlock()
+			close(writerDone)
+		}()
+		test.WaitFor("writer to take the tree lock", func() bool {
+			select {
+			case <-writerDone:
+				return true
+			default:
+				return false
+			}
+		})
+
+		wsrUnlock.Unlock()
+
+		var response quantumfs.ErrorResponse
+		test.AssertNoErr(json.Unmarshal(<-responseRead, &response))
+		test.Assert(response.ErrorCode == quantumfs.ErrorOK,
+			"InsertInode failed: %s", response.Message)
+		test.Assert(response.RequestId == 1, "Unexpected RequestId %d",
+			response.RequestId)
+	})
+}
+
+func TestApiPipelineDepth(t *testing.T) {
+	runTest(t, func(test *testHelper) {
+		api, err := os.OpenFile(test.AbsPath(quantumfs.ApiPath),
+			os.O_RDWR|syscall.O_DIRECT, 0)
+		test.AssertNoErr(err)
+		defer api.Close()
+
+		cmd := quantumfs.CommandCommon{CommandId: quantumfs.CmdInvalid}
+		for i := 0; i < quantumfs.MaxPipelineDepth; i++ {
+			test.AssertNoErr(writeApiRequest(test, api, cmd))
+		}
+
+		err = writeApiRequest(test, api, cmd)
+		test.Assert(err != nil && strings.Contains(err.Error(),
+			syscall.EAGAIN.Error()),
+			"Request beyond pipeline depth allowed: %v", err)
+
+		// Reading a response makes room for another request
+		readApiResponse(test, api)
+		test.AssertNoErr(writeApiRequest(test, api, cmd))
+	})
+}
@@ -9,7 +9,12 @@ package daemon
 import (
 	"encoding/json"
 	"fmt"
+	"net"
+	"os"
+	"path/filepath"
+	"sort"
 	"strings"
+	"sync"
 	"sync/atomic"
 	"syscall"
 	"time"
@@ -300,7 +305,7 @@ func newApiHandle(c *ctx, treeState *TreeState, api *ApiInode) *ApiHandle {
 			inode:      api,
 			treeState_: treeState,
 		},
-		responses: make(chan fuse.ReadResult, 10),
+		responses: make(chan fuse.ReadResult, quantumfs.MaxPipelineDepth),
 	}
 	utils.Assert(handle.treeState() != nil, "ApiHandle treeState nil at init")
 	return &handle
@@ -312,6 +317,59 @@ type ApiHandle struct {
 	FileHandleCommon
 	responses       chan fuse.ReadResult
 	currentResponse []byte
+
+	// Responses received by awaitResponse() for the following reads at offset
+	// zero, in the order they were received
+	awaitLock utils.DeferableMutex
+	awaited   []fuse.ReadResult
+
+	// The encoding of requests and responses on this handle, one of
+	// quantumfs.Protocol*. Only changed by setProtocol(), accessed atomically.
+	protocol uint32
+
+	// How binary responses on this handle are compressed, one of
+	// quantumfs.Compression*. Only changed by setProtocol(), accessed
+	// atomically.
+	compression uint32
+
+	// The number of requests whose response hasn't been read yet, including
+	// those still being processed. Accessed atomically.
+	outstanding int32
+
+	// Pipelined requests may complete after the handle has been released, the
+	// lock ensures they don't queue their response after that.
+	responseLock utils.DeferableMutex
+	released     bool
+
+	// The api socket connection served by this handle, on which responses are
+	// written as they are queued. Nil for handles of the api file.
+	socket net.Conn
+
+	// Accessed lists being read a page at a time, by listing id. See
+	// getAccessedPage().
+	listingLock   utils.DeferableMutex
+	listings      map[uint32]*accessedListing
+	nextListingId uint32
+
+	// The file registered by RegisterSharedMemory, if any, and the size of it
+	// which may be used. Payloads are moved with pread and pwrite rather than
+	// by mapping the file, so that a client truncating it only causes its own
+	// requests to fail.
+	sharedLock utils.DeferableRwMutex
+	shared     *os.File
+	sharedSize uint64
+}
+
+// The most accessed listings kept for one handle. Starting a further listing
+// discards the oldest, so that a client which abandons listings can't hold on to
+// memory without limit.
+const maxAccessedListings = 8
+
+// A snapshot of the accessed list of a workspace root, which is being returned a
+// page at a time.
+type accessedListing struct {
+	workspaceRoot string
+	paths         []quantumfs.AccessedPath
 }
 
 func (api *ApiHandle) ReadDirPlus(c *ctx, input *fuse.ReadIn,
@@ -328,18 +386,24 @@ func (api *ApiHandle) Read(c *ctx, offset uint64, size uint32, buf []byte,
 		size, nonblocking).Out()
 
 	// Read() returns nil only if there is no response. There are two cases:
-	// 1. The offset is zero and channel api.responses is empty;
+	// 1. The offset is zero and there is no response ready. Read() never waits
+	//    for one, as the tree lock is held; see awaitResponse().
 	// 2. Buffer api.currentResponse finishes reading.
-	if (offset == 0 && len(api.responses) == 0) ||
-		(offset > 0 && offset >= uint64(len(api.currentResponse))) {
-		c.vlog("No outstanding requests, returning early")
+	if offset > 0 && offset >= uint64(len(api.currentResponse)) {
+		c.vlog("Response read, returning early")
 		return nil, fuse.OK
 	}
 
 	if offset == 0 {
+		response := api.nextResponse()
+		if response == nil {
+			c.vlog("No outstanding requests, returning early")
+			return nil, fuse.OK
+		}
+		atomic.AddInt32(&api.outstanding, -1)
+
 		// Subtract the file size of last response
 		c.qfs.decreaseApiFileSize(c, len(api.currentResponse))
-		response := <-api.responses
 
 		buffer := make([]byte, response.Size())
 		bytes, _ := response.Bytes(buffer)
@@ -360,7 +424,57 @@ func (api *ApiHandle) Read(c *ctx, offset uint64, size uint32, buf []byte,
 	return fuse.ReadResultData(bytes[offset:maxReturnIndx]), fuse.OK
 }
 
+const ApiAwaitLog = "Waiting for a pipelined request to complete"
+
+// Wait for a pipelined request to complete, if the read is blocking and there is no
+// response for it yet. The request may need the tree lock, so this must be called
+// before the tree lock is taken for Read(), which would otherwise keep the request
+// from completing once a writer is waiting for the lock.
+func (api *ApiHandle) awaitResponse(c *ctx, offset uint64, nonblocking bool) {
+	if offset != 0 || nonblocking || len(api.responses) > 0 ||
+		atomic.LoadInt32(&api.outstanding) == 0 {
+
+		return
+	}
+
+	if func() bool {
+		defer api.awaitLock.Lock().Unlock()
+		return len(api.awaited) > 0
+	}() {
+		return
+	}
+
+	defer c.FuncIn("ApiHandle::awaitResponse", "outstanding %d",
+		atomic.LoadInt32(&api.outstanding)).Out()
+	c.vlog(ApiAwaitLog)
+
+	response := <-api.responses
+
+	defer api.awaitLock.Lock().Unlock()
+	api.awaited = append(api.awaited, response)
+}
+
+// The next response to return from Read(), or nil if there is none yet
+func (api *ApiHandle) nextResponse() fuse.ReadResult {
+	defer api.awaitLock.Lock().Unlock()
+	if len(api.awaited) > 0 {
+		response := api.awaited[0]
+		api.awaited = api.awaited[1:]
+		return response
+	}
+
+	select {
+	case response := <-api.responses:
+		return response
+	default:
+		return nil
+	}
+}
+
 func (api *ApiHandle) drainResponseData(c *ctx) {
+	defer api.responseLock.Lock().Unlock()
+	api.released = true
+
 	c.qfs.decreaseApiFileSize(c, len(api.currentResponse))
 
 	// In case the queue is not empty
@@ -368,58 +482,119 @@ func (api *ApiHandle) drainResponseData(c *ctx) {
 		response := <-api.responses
 		c.qfs.decreaseApiFileSize(c, response.Size())
 	}
+
+	func() {
+		defer api.awaitLock.Lock().Unlock()
+		for _, response := range api.awaited {
+			c.qfs.decreaseApiFileSize(c, response.Size())
+		}
+		api.awaited = nil
+	}()
+
+	defer api.listingLock.Lock().Unlock()
+	api.listings = nil
+
+	api.setSharedMemory(nil, 0)
+}
+
+// Decode a request in the protocol of this handle
+func (api *ApiHandle) unmarshal(buf []byte, cmd interface{}) error {
+	if atomic.LoadUint32(&api.protocol) == quantumfs.ProtocolBinary {
+		return quantumfs.DecodeBinaryCommand(buf, cmd)
+	}
+	return json.Unmarshal(buf, cmd)
 }
 
-func makeErrorResponse(code uint32, message string) []byte {
-	response := quantumfs.ErrorResponse{
-		CommandCommon: quantumfs.CommandCommon{
-			CommandId: quantumfs.CmdError,
-		},
-		ErrorCode: code,
-		Message:   message,
+// Encode a response in the given protocol
+func marshalResponse(protocol uint32, response interface{}) []byte {
+	if protocol == quantumfs.ProtocolBinary {
+		return quantumfs.EncodeBinaryCommand(response)
 	}
+
 	bytes, err := json.Marshal(response)
 	if err != nil {
-		panic("Failed to marshal API error response")
+		panic(fmt.Sprintf("Failed to marshal API response %T", response))
 	}
 	return bytes
 }
 
-func (api *ApiHandle) queueErrorResponse(code uint32, format string,
-	a ...interface{}) int {
+// The response to an api request. Every response embeds quantumfs.ErrorResponse,
+// which provides SetRequestId().
+type apiResponse interface {
+	SetRequestId(requestId uint64)
+}
 
-	message := fmt.Sprintf(format, a...)
-	bytes := makeErrorResponse(code, message)
-	api.responses <- fuse.ReadResultData(bytes)
+func (api *ApiHandle) queueResponse(c *ctx, protocol uint32, requestId uint64,
+	response apiResponse) {
 
-	return len(bytes)
+	response.SetRequestId(requestId)
+	bytes := marshalResponse(protocol, response)
+	if protocol == quantumfs.ProtocolBinary &&
+		atomic.LoadUint32(&api.compression) == quantumfs.CompressionZlib {
+
+		compressed := quantumfs.CompressBinaryFrame(bytes)
+		if len(compressed) < len(bytes) {
+			c.dlog(ApiCompressedLog, len(bytes)-len(compressed))
+		}
+		bytes = compressed
+	}
+
+	defer api.responseLock.Lock().Unlock()
+	if api.released {
+		c.vlog("Dropping response to released handle")
+		return
+	}
+
+	if api.socket != nil {
+		// The lock keeps concurrent responses from interleaving
+		if _, err := api.socket.Write(bytes); err != nil {
+			c.vlog("Failed writing response to api socket: %s",
+				err.Error())
+		}
+		return
+	}
+
+	// This never blocks since Write() limits the number of outstanding
+	// responses to the capacity of the channel.
+	api.responses <- fuse.ReadResultData(bytes)
+	c.qfs.increaseApiFileSize(c, len(bytes))
 }
 
-func makeAccessListResponse(list quantumfs.PathsAccessed) []byte {
-	response := quantumfs.AccessListResponse{
-		ErrorResponse: quantumfs.ErrorResponse{
-			CommandCommon: quantumfs.CommandCommon{
-				CommandId: quantumfs.CmdError,
-			},
-			ErrorCode: quantumfs.ErrorOK,
-			Message:   "",
-		},
-		PathList: list,
+// The largest request accepted once it has been decompressed
+const maxDecompressedRequest = 16 * 1024 * 1024
+
+const ApiCompressedLog = "Api frame compressed saving %d bytes"
+
+// Decompress a binary request, if it is compressed
+func decompressRequest(c *ctx, frame []byte) ([]byte, error) {
+	request, err := quantumfs.DecompressBinaryFrame(frame,
+		maxDecompressedRequest)
+	if err == nil && len(request) > len(frame) {
+		c.dlog(ApiCompressedLog, len(request)-len(frame))
 	}
+	return request, err
+}
 
-	bytes, err := json.Marshal(response)
-	if err != nil {
-		panic("Failed to marshal API AccessListResponse")
+func makeErrorResponse(code uint32, message string) quantumfs.ErrorResponse {
+	return quantumfs.ErrorResponse{
+		CommandCommon: quantumfs.CommandCommon{
+			CommandId: quantumfs.CmdError,
+		},
+		ErrorCode: code,
+		Message:   message,
 	}
-	return bytes
 }
 
-func (api *ApiHandle) queueAccesslistResponse(
-	pathList quantumfs.PathsAccessed) int {
+func errorResponse(code uint32, format string, a ...interface{}) apiResponse {
+	response := makeErrorResponse(code, fmt.Sprintf(format, a...))
+	return &response
+}
 
-	bytes := makeAccessListResponse(pathList)
-	api.responses <- fuse.ReadResultData(bytes)
-	return len(bytes)
+func accessListResponse(list quantumfs.PathsAccessed) apiResponse {
+	return &quantumfs.AccessListResponse{
+		ErrorResponse: makeErrorResponse(quantumfs.ErrorOK, ""),
+		PathList:      list,
+	}
 }
 
 func (api *ApiHandle) Write(c *ctx, offset uint64, size uint32, flags uint32,
@@ -428,99 +603,363 @@ func (api *ApiHandle) Write(c *ctx, offset uint64, size uint32, flags uint32,
 	defer c.FuncIn("ApiHandle::Write", "offset %d size %d flags %d", offset,
 		size, flags).Out()
 
+	// Every request is answered by exactly one response, which is counted
+	// until the client reads it.
+	outstanding := atomic.AddInt32(&api.outstanding, 1)
+	if outstanding > quantumfs.MaxPipelineDepth {
+		atomic.AddInt32(&api.outstanding, -1)
+		c.vlog("Too many outstanding requests %d", outstanding)
+		return 0, fuse.Status(syscall.EAGAIN)
+	}
+
+	// Requests and their responses are encoded in the protocol in use when
+	// the request arrives, even if the request changes the protocol.
+	protocol := atomic.LoadUint32(&api.protocol)
+
 	var cmd quantumfs.CommandCommon
-	err := json.Unmarshal(buf, &cmd)
+	var err error
+	if protocol == quantumfs.ProtocolBinary {
+		buf, err = decompressRequest(c, buf)
+	}
+	if err == nil {
+		err = api.unmarshal(buf, &cmd)
+	}
 
 	if err != nil {
 		c.vlog("Error unmarshaling JSON: %s", err.Error())
-		api.queueErrorResponse(quantumfs.ErrorBadJson, "%s", err.Error())
+		api.queueResponse(c, protocol, 0,
+			errorResponse(quantumfs.ErrorBadJson, "%s", err.Error()))
+		return size, fuse.OK
 	}
 
-	var responseSize int
-	switch cmd.CommandId {
+	if cmd.RequestId == 0 {
+		api.processRequest(c, protocol, cmd, buf)
+		c.vlog("done writing to file")
+		return size, fuse.OK
+	}
+
+	// Pipelined requests are processed concurrently and may be answered out of
+	// order. The buffer belongs to FUSE and must be copied first.
+	c.vlog("Processing request %d asynchronously", cmd.RequestId)
+	request := make([]byte, len(buf))
+	copy(request, buf)
+	go func(c *ctx) {
+		defer logRequestPanic(c)
+		api.processRequest(c, protocol, cmd, request)
+	}(c.newThread())
+
+	return size, fuse.OK
+}
+
+// Process a single request and queue its response
+func (api *ApiHandle) processRequest(c *ctx, protocol uint32,
+	cmd quantumfs.CommandCommon, buf []byte) {
+
+	defer c.FuncIn("ApiHandle::processRequest", "command %d request %d",
+		cmd.CommandId, cmd.RequestId).Out()
+
+	queued := false
+	defer func() {
+		if !queued {
+			// The command panicked, but the client still waits for a
+			// response.
+			api.queueResponse(c, protocol, cmd.RequestId,
+				errorResponse(quantumfs.ErrorCommandFailed,
+					"Command %d failed unexpectedly",
+					cmd.CommandId))
+		}
+	}()
+
+	response := api.processCommand(c, cmd.CommandId, buf)
+	api.queueResponse(c, protocol, cmd.RequestId, response)
+	queued = true
+}
+
+func (api *ApiHandle) processCommand(c *ctx, commandId uint32,
+	buf []byte) apiResponse {
+
+	switch commandId {
 	default:
 		c.vlog("Received unknown request")
-		responseSize = api.queueErrorResponse(quantumfs.ErrorBadCommandId,
-			"Unknown command number %d", cmd.CommandId)
+		return errorResponse(quantumfs.ErrorBadCommandId,
+			"Unknown command number %d", commandId)
 
 	case quantumfs.CmdError:
 		c.vlog("Received error from above")
-		responseSize = api.queueErrorResponse(quantumfs.ErrorBadCommandId,
-			"Invalid message %d to send to quantumfsd",
-			cmd.CommandId)
+		return errorResponse(quantumfs.ErrorBadCommandId,
+			"Invalid message %d to send to quantumfsd", commandId)
 
 	case quantumfs.CmdBranchRequest:
 		c.vlog("Received branch request")
-		responseSize = api.branchWorkspace(c, buf)
+		return api.branchWorkspace(c, buf)
 	case quantumfs.CmdGetAccessed:
 		c.vlog("Received GetAccessed request")
-		responseSize = api.getAccessed(c, buf)
+		return api.getAccessed(c, buf)
 	case quantumfs.CmdClearAccessed:
 		c.vlog("Received ClearAccessed request")
-		responseSize = api.clearAccessed(c, buf)
+		return api.clearAccessed(c, buf)
 	case quantumfs.CmdSyncAll:
 		c.vlog("Received all workspace sync request")
-		responseSize = api.syncAll(c)
+		return api.syncAll(c)
 	case quantumfs.CmdSyncWorkspace:
 		c.vlog("Received workspace sync request")
-		responseSize = api.syncWorkspace(c, buf)
+		return api.syncWorkspace(c, buf)
 	// create an object with a given ObjectKey and path
 	case quantumfs.CmdInsertInode:
 		c.vlog("Received InsertInode request")
-		responseSize = api.insertInode(c, buf)
+		return api.insertInode(c, buf)
 	case quantumfs.CmdDeleteWorkspace:
 		c.vlog("Received DeleteWorkspace request")
-		responseSize = api.deleteWorkspace(c, buf)
+		return api.deleteWorkspace(c, buf)
 	case quantumfs.CmdSetBlock:
 		c.vlog("Received SetBlock request")
-		responseSize = api.setBlock(c, buf)
+		return api.setBlock(c, buf)
 	case quantumfs.CmdGetBlock:
 		c.vlog("Received GetBlock request")
-		responseSize = api.getBlock(c, buf)
+		return api.getBlock(c, buf)
 	case quantumfs.CmdEnableRootWrite:
 		c.vlog("Received EnableRootWrite request")
-		responseSize = api.enableRootWrite(c, buf)
+		return api.enableRootWrite(c, buf)
 	case quantumfs.CmdSetWorkspaceImmutable:
 		c.vlog("Received SetWorkspaceImmutable request")
-		responseSize = api.setWorkspaceImmutable(c, buf)
+		return api.setWorkspaceImmutable(c, buf)
 	case quantumfs.CmdMergeWorkspaces:
 		c.vlog("Received merge request")
-		responseSize = api.mergeWorkspace(c, buf)
+		return api.mergeWorkspace(c, buf)
 	case quantumfs.CmdWorkspaceFinished:
 		c.vlog("Received WorkspaceFinished request")
-		responseSize = api.workspaceFinished(c, buf)
+		return api.workspaceFinished(c, buf)
 	case quantumfs.CmdRefreshWorkspace:
 		c.vlog("Received refresh request")
-		responseSize = api.refreshWorkspace(c, buf)
+		return api.refreshWorkspace(c, buf)
 	case quantumfs.CmdAdvanceWSDB:
 		c.vlog("Received advanceWSDB request")
-		responseSize = api.advanceWSDB(c, buf)
+		return api.advanceWSDB(c, buf)
+	case quantumfs.CmdSetProtocol:
+		c.vlog("Received SetProtocol request")
+		return api.setProtocol(c, buf)
+	case quantumfs.CmdGetAccessedPage:
+		c.vlog("Received GetAccessedPage request")
+		return api.getAccessedPage(c, buf)
+	case quantumfs.CmdRegisterSharedMemory:
+		c.vlog("Received RegisterSharedMemory request")
+		return api.registerSharedMemory(c, buf)
+	case quantumfs.CmdSetBlockShared:
+		c.vlog("Received SetBlockShared request")
+		return api.setBlockShared(c, buf)
+	case quantumfs.CmdGetBlockShared:
+		c.vlog("Received GetBlockShared request")
+		return api.getBlockShared(c, buf)
+	case quantumfs.CmdBatch:
+		c.vlog("Received Batch request")
+		return api.batch(c, buf)
+	case quantumfs.CmdStatBlock:
+		c.vlog("Received StatBlock request")
+		return api.statBlock(c, buf)
+	case quantumfs.CmdHasBlocks:
+		c.vlog("Received HasBlocks request")
+		return api.hasBlocks(c, buf)
+	case quantumfs.CmdPrefetch:
+		c.vlog("Received Prefetch request")
+		return api.prefetch(c, buf)
+	case quantumfs.CmdInsertInodes:
+		c.vlog("Received InsertInodes request")
+		return api.insertInodes(c, buf)
 	}
+}
 
-	c.vlog("done writing to file")
-	c.qfs.increaseApiFileSize(c, responseSize)
-	return size, fuse.OK
+func (api *ApiHandle) batch(c *ctx, buf []byte) apiResponse {
+	defer c.funcIn("ApiHandle::batch").Out()
+
+	var cmd quantumfs.BatchRequest
+	if err := api.unmarshal(buf, &cmd); err != nil {
+		c.vlog("Error unmarshaling JSON: %s", err.Error())
+		return errorResponse(quantumfs.ErrorBadJson, "%s", err.Error())
+	}
+
+	if len(cmd.Commands) > quantumfs.MaxBatchCommands {
+		c.vlog("Batch of %d commands is too large", len(cmd.Commands))
+		return errorResponse(quantumfs.ErrorBadArgs,
+			"Batch of %d commands exceeds the maximum of %d",
+			len(cmd.Commands), quantumfs.MaxBatchCommands)
+	}
+
+	// SetProtocol can't be batched, so the protocol of the handle stays that
+	// of the commands
+	protocol := atomic.LoadUint32(&api.protocol)
+
+	// Commands which can't be processed at all are answered up front
+	commandIds := make([]uint32, len(cmd.Commands))
+	responses := make([]apiResponse, len(cmd.Commands))
+	for i, command := range cmd.Commands {
+		commandIds[i], responses[i] = api.batchCommandId(c, command)
+	}
+
+	for start := 0; start < len(cmd.Commands); {
+		end := start + 1
+		if isBlockCommand(commandIds[start]) {
+			for end < len(cmd.Commands) &&
+				commandIds[end] == commandIds[start] {
+
+				end++
+			}
+		}
+
+		if end-start == 1 {
+			if responses[start] == nil {
+				responses[start] = api.processCommand(c,
+					commandIds[start], cmd.Commands[start])
+			}
+		} else {
+			api.batchBlockCommands(c, commandIds[start],
+				cmd.Commands[start:end], responses[start:end])
+		}
+		start = end
+	}
+
+	results := make([]json.RawMessage, 0, len(cmd.Commands))
+	for _, response := range responses {
+		results = append(results, marshalResponse(protocol, response))
+	}
+
+	return &quantumfs.BatchResponse{
+		ErrorResponse: makeErrorResponse(quantumfs.ErrorOK, ""),
+		Results:       results,
+	}
+}
+
+// Find the id of a command of a batch. If the command can't be processed the
+// response to it is returned as well.
+func (api *ApiHandle) batchCommandId(c *ctx, buf []byte) (uint32, apiResponse) {
+	var cmd quantumfs.CommandCommon
+	if err := api.unmarshal(buf, &cmd); err != nil {
+		c.vlog("Error unmarshaling batched command: %s", err.Error())
+		return quantumfs.CmdInvalid, errorResponse(quantumfs.ErrorBadJson,
+			"%s", err.Error())
+	}
+
+	switch cmd.CommandId {
+	case quantumfs.CmdBatch, quantumfs.CmdSetProtocol:
+		c.vlog("Command %d can't be batched", cmd.CommandId)
+		return cmd.CommandId, errorResponse(quantumfs.ErrorBadArgs,
+			"Command %d cannot be batched", cmd.CommandId)
+	}
+
+	return cmd.CommandId, nil
+}
+
+// The most block commands of a batch, or blocks of a single command, which are
+// processed at once
+const batchBlockConcurrency = 32
+
+// Call f for every index below n, at most batchBlockConcurrency at once, and wait
+// for all of them. The datastore may be remote, so commands which involve many
+// blocks process them concurrently. A panic in f is logged and only ends that
+// call, so f should fill in a failure for its index before anything which may
+// panic.
+func forEachConcurrently(c *ctx, n int, f func(c *ctx, i int)) {
+	var wg sync.WaitGroup
+	running := make(chan struct{}, batchBlockConcurrency)
+	for i := 0; i < n; i++ {
+		running <- struct{}{}
+		wg.Add(1)
+		go func(c *ctx, i int) {
+			defer wg.Done()
+			defer func() { <-running }()
+			defer logRequestPanic(c)
+
+			f(c, i)
+		}(c.newThread(), i)
+	}
+	wg.Wait()
 }
 
-func (api *ApiHandle) branchWorkspace(c *ctx, buf []byte) int {
+// SetBlock and GetBlock commands only move a block to or from the datastore, so
+// a run of either in a batch doesn't depend on its order
+func isBlockCommand(commandId uint32) bool {
+	return commandId == quantumfs.CmdSetBlock ||
+		commandId == quantumfs.CmdGetBlock
+}
+
+// Process a run of block commands of a batch concurrently, placing the response
+// to each in responses
+func (api *ApiHandle) batchBlockCommands(c *ctx, commandId uint32,
+	commands []json.RawMessage, responses []apiResponse) {
+
+	defer c.FuncIn("ApiHandle::batchBlockCommands", "command %d count %d",
+		commandId, len(commands)).Out()
+
+	forEachConcurrently(c, len(commands), func(c *ctx, i int) {
+		if responses[i] != nil {
+			return
+		}
+
+		responses[i] = errorResponse(quantumfs.ErrorCommandFailed,
+			"Command %d failed unexpectedly", commandId)
+		responses[i] = api.processCommand(c, commandId, commands[i])
+	})
+}
+
+func (api *ApiHandle) setProtocol(c *ctx, buf []byte) apiResponse {
+	defer c.funcIn("ApiHandle::setProtocol").Out()
+
+	var cmd quantumfs.SetProtocolRequest
+	if err := api.unmarshal(buf, &cmd); err != nil {
+		c.vlog("Error unmarshaling JSON: %s", err.Error())
+		return errorResponse(quantumfs.ErrorBadJson, "%s", err.Error())
+	}
+
+	switch cmd.Protocol {
+	default:
+		c.vlog("Unknown protocol %d", cmd.Protocol)
+		return errorResponse(quantumfs.ErrorBadArgs,
+			"Unknown protocol %d", cmd.Protocol)
+	case quantumfs.ProtocolJson, quantumfs.ProtocolBinary:
+	}
+
+	if api.socket != nil && cmd.Protocol != quantumfs.ProtocolBinary {
+		c.vlog("Api socket cannot use protocol %d", cmd.Protocol)
+		return errorResponse(quantumfs.ErrorBadArgs,
+			"The api socket only supports the binary protocol")
+	}
+
+	// Only binary frames have room to mark themselves compressed
+	compression := uint32(quantumfs.CompressionNone)
+	if cmd.Protocol == quantumfs.ProtocolBinary &&
+		cmd.Compression == quantumfs.CompressionZlib {
+
+		compression = quantumfs.CompressionZlib
+	}
+
+	// The response is still sent in the protocol the client used to ask
+	atomic.StoreUint32(&api.protocol, cmd.Protocol)
+	atomic.StoreUint32(&api.compression, compression)
+	return &quantumfs.SetProtocolResponse{
+		ErrorResponse: makeErrorResponse(quantumfs.ErrorOK,
+			"SetProtocol Succeeded"),
+		Compression: compression,
+	}
+}
+
+func (api *ApiHandle) branchWorkspace(c *ctx, buf []byte) apiResponse {
 	defer c.funcIn("ApiHandle::branchWorkspace").Out()
 
 	var cmd quantumfs.BranchRequest
-	if err := json.Unmarshal(buf, &cmd); err != nil {
+	if err := api.unmarshal(buf, &cmd); err != nil {
 		c.vlog("Error unmarshaling JSON: %s", err.Error())
-		return api.queueErrorResponse(quantumfs.ErrorBadJson, "%s",
+		return errorResponse(quantumfs.ErrorBadJson, "%s",
 			err.Error())
 	}
 
 	if !isWorkspaceNameValid(cmd.Src) {
 		c.vlog("workspace name '%s' is malformed", cmd.Src)
-		return api.queueErrorResponse(quantumfs.ErrorBadArgs,
+		return errorResponse(quantumfs.ErrorBadArgs,
 			"workspace name '%s' is malformed", cmd.Src)
 	}
 
 	if !isWorkspaceNameValid(cmd.Dst) {
 		c.vlog("workspace name '%s' is malformed", cmd.Dst)
-		return api.queueErrorResponse(quantumfs.ErrorBadArgs,
+		return errorResponse(quantumfs.ErrorBadArgs,
 			"workspace name '%s' is malformed", cmd.Dst)
 	}
 
@@ -532,7 +971,7 @@ func (api *ApiHandle) branchWorkspace(c *ctx, buf []byte) int {
 
 	if err := c.qfs.syncWorkspace(c, cmd.Src); err != nil {
 		c.vlog("syncWorkspace failed: %s", err.Error())
-		return api.queueErrorResponse(
+		return errorResponse(
 			quantumfs.ErrorCommandFailed, "%s", err.Error())
 	}
 
@@ -540,37 +979,37 @@ func (api *ApiHandle) branchWorkspace(c *ctx, buf []byte) int {
 		dst[0], dst[1], dst[2]); err != nil {
 
 		c.vlog("branch failed: %s", err.Error())
-		return api.queueErrorResponse(
+		return errorResponse(
 			quantumfs.ErrorCommandFailed, "%s", err.Error())
 	}
 
-	return api.queueErrorResponse(quantumfs.ErrorOK, "Branch Succeeded")
+	return errorResponse(quantumfs.ErrorOK, "Branch Succeeded")
 }
 
-func (api *ApiHandle) mergeWorkspace(c *ctx, buf []byte) int {
+func (api *ApiHandle) mergeWorkspace(c *ctx, buf []byte) apiResponse {
 	defer c.funcIn("ApiHandle::mergeWorkspace").Out()
 
 	var cmd quantumfs.MergeRequest
 	var err error
-	if err := json.Unmarshal(buf, &cmd); err != nil {
+	if err := api.unmarshal(buf, &cmd); err != nil {
 		c.vlog("Error unmarshaling JSON: %s", err.Error())
-		return api.queueErrorResponse(quantumfs.ErrorBadJson, "%s",
+		return errorResponse(quantumfs.ErrorBadJson, "%s",
 			err.Error())
 	}
 
 	if !isWorkspaceNameValid(cmd.BaseWorkspace) {
 		c.vlog("workspace name '%s' is malformed", cmd.BaseWorkspace)
-		return api.queueErrorResponse(quantumfs.ErrorBadArgs,
+		return errorResponse(quantumfs.ErrorBadArgs,
 			"workspace name '%s' is malformed", cmd.BaseWorkspace)
 	}
 	if !isWorkspaceNameValid(cmd.RemoteWorkspace) {
 		c.vlog("workspace name '%s' is malformed", cmd.RemoteWorkspace)
-		return api.queueErrorResponse(quantumfs.ErrorBadArgs,
+		return errorResponse(quantumfs.ErrorBadArgs,
 			"workspace name '%s' is malformed", cmd.RemoteWorkspace)
 	}
 	if !isWorkspaceNameValid(cmd.LocalWorkspace) {
 		c.vlog("workspace name '%s' is malformed", cmd.LocalWorkspace)
-		return api.queueErrorResponse(quantumfs.ErrorBadArgs,
+		return errorResponse(quantumfs.ErrorBadArgs,
 			"workspace name '%s' is malformed", cmd.LocalWorkspace)
 	}
 
@@ -582,7 +1021,7 @@ func (api *ApiHandle) mergeWorkspace(c *ctx, buf []byte) int {
 		base[2])
 	if err != nil {
 		c.vlog("Workspace not fetched (%s): %s", base, err.Error())
-		return api.queueErrorResponse(0+
+		return errorResponse(0+
 			quantumfs.ErrorWorkspaceNotFound,
 			"WorkspaceRoot %s does not exist or is not active",
 			cmd.BaseWorkspace)
@@ -595,7 +1034,7 @@ func (api *ApiHandle) mergeWorkspace(c *ctx, buf []byte) int {
 		remote[2])
 	if err != nil {
 		c.vlog("Workspace not fetched (%s): %s", remote, err.Error())
-		return api.queueErrorResponse(quantumfs.ErrorWorkspaceNotFound,
+		return errorResponse(quantumfs.ErrorWorkspaceNotFound,
 			"WorkspaceRoot %s does not exist or is not active",
 			cmd.RemoteWorkspace)
 	}
@@ -607,7 +1046,7 @@ func (api *ApiHandle) mergeWorkspace(c *ctx, buf []byte) int {
 	defer cleanup()
 	if !ok {
 		c.vlog("Unable to instantiate local workspace")
-		return api.queueErrorResponse(quantumfs.ErrorWorkspaceNotFound,
+		return errorResponse(quantumfs.ErrorWorkspaceNotFound,
 			"WorkspaceRoot %s could not be instantiated (not found)",
 			cmd.LocalWorkspace)
 	}
@@ -616,7 +1055,7 @@ func (api *ApiHandle) mergeWorkspace(c *ctx, buf []byte) int {
 	defer localWsr.LockTree().Unlock()
 	if err := c.qfs.flusher.syncWorkspace_(c, cmd.LocalWorkspace); err != nil {
 		c.vlog("Failed flushing local workspace: %s", err.Error())
-		return api.queueErrorResponse(quantumfs.ErrorBadCommandId,
+		return errorResponse(quantumfs.ErrorBadCommandId,
 			"Failed flushing local workspace: %s", err.Error())
 	}
 
@@ -639,7 +1078,7 @@ func (api *ApiHandle) mergeWorkspace(c *ctx, buf []byte) int {
 		cmd.LocalWorkspace)
 	if err != nil {
 		c.vlog("Merge failed: %s", err.Error())
-		return api.queueErrorResponse(quantumfs.ErrorCommandFailed,
+		return errorResponse(quantumfs.ErrorCommandFailed,
 			"Merge failed: %s", err.Error())
 	}
 
@@ -648,29 +1087,29 @@ func (api *ApiHandle) mergeWorkspace(c *ctx, buf []byte) int {
 	if err != nil {
 		c.vlog("Workspace can't advance after merge began, try again: %s",
 			err.Error())
-		return api.queueErrorResponse(quantumfs.ErrorCommandFailed,
+		return errorResponse(quantumfs.ErrorCommandFailed,
 			"Workspace rootId advanced after merge began, try again.")
 	}
 
 	localWsr.refresh_(c)
 
-	return api.queueErrorResponse(quantumfs.ErrorOK, "Merge Succeeded")
+	return errorResponse(quantumfs.ErrorOK, "Merge Succeeded")
 }
 
-func (api *ApiHandle) refreshWorkspace(c *ctx, buf []byte) int {
+func (api *ApiHandle) refreshWorkspace(c *ctx, buf []byte) apiResponse {
 	defer c.funcIn("ApiHandle::refreshWorkspace").Out()
 
 	var cmd quantumfs.RefreshRequest
-	if err := json.Unmarshal(buf, &cmd); err != nil {
+	if err := api.unmarshal(buf, &cmd); err != nil {
 		c.vlog("Error unmarshaling JSON: %s", err.Error())
-		return api.queueErrorResponse(quantumfs.ErrorBadJson, "%s",
+		return errorResponse(quantumfs.ErrorBadJson, "%s",
 			err.Error())
 	}
 	c.vlog("Refreshing workspace %s", cmd.Workspace)
 
 	if !isWorkspaceNameValid(cmd.Workspace) {
 		c.vlog("workspace name '%s' is malformed", cmd.Workspace)
-		return api.queueErrorResponse(quantumfs.ErrorBadArgs,
+		return errorResponse(quantumfs.ErrorBadArgs,
 			"workspace name '%s' is malformed", cmd.Workspace)
 	}
 
@@ -680,22 +1119,22 @@ func (api *ApiHandle) refreshWorkspace(c *ctx, buf []byte) int {
 
 	if err != nil {
 		c.elog("Unable to get workspace rootId")
-		return api.queueErrorResponse(quantumfs.ErrorWorkspaceNotFound,
+		return errorResponse(quantumfs.ErrorWorkspaceNotFound,
 			"Unable to get workspace rootId")
 	}
 
 	c.qfs.refreshWorkspace(c, cmd.Workspace, rootId, nonce)
 
-	return api.queueErrorResponse(quantumfs.ErrorOK, "Refresh Succeeded")
+	return errorResponse(quantumfs.ErrorOK, "Refresh Succeeded")
 }
 
-func (api *ApiHandle) advanceWSDB(c *ctx, buf []byte) int {
+func (api *ApiHandle) advanceWSDB(c *ctx, buf []byte) apiResponse {
 	defer c.funcIn("ApiHandle::advanceWSDB").Out()
 
 	var cmd quantumfs.AdvanceWSDBRequest
-	if err := json.Unmarshal(buf, &cmd); err != nil {
+	if err := api.unmarshal(buf, &cmd); err != nil {
 		c.vlog("Error unmarshaling JSON: %s", err.Error())
-		return api.queueErrorResponse(quantumfs.ErrorBadJson, "%s",
+		return errorResponse(quantumfs.ErrorBadJson, "%s",
 			err.Error())
 	}
 	c.vlog("Advancing wsdb of %s to that of %s", cmd.Workspace,
@@ -703,7 +1142,7 @@ func (api *ApiHandle) advanceWSDB(c *ctx, buf []byte) int {
 
 	if !isWorkspaceNameValid(cmd.Workspace) {
 		c.vlog("workspace name '%s' is malformed", cmd.Workspace)
-		return api.queueErrorResponse(quantumfs.ErrorBadArgs,
+		return errorResponse(quantumfs.ErrorBadArgs,
 			"workspace name '%s' is malformed", cmd.Workspace)
 	}
 
@@ -713,7 +1152,7 @@ func (api *ApiHandle) advanceWSDB(c *ctx, buf []byte) int {
 	defer cleanup()
 	if !ok {
 		c.vlog("Workspace not found: %s", cmd.Workspace)
-		return api.queueErrorResponse(quantumfs.ErrorWorkspaceNotFound,
+		return errorResponse(quantumfs.ErrorWorkspaceNotFound,
 			"Workspace %s does not exist or is not active",
 			cmd.Workspace)
 	}
@@ -723,7 +1162,7 @@ func (api *ApiHandle) advanceWSDB(c *ctx, buf []byte) int {
 		ref[2])
 
 	if err != nil {
-		return api.queueErrorResponse(quantumfs.ErrorWorkspaceNotFound,
+		return errorResponse(quantumfs.ErrorWorkspaceNotFound,
 			"Workspace %s does not exist or is not active",
 			cmd.ReferenceWorkspace)
 	}
@@ -732,28 +1171,28 @@ func (api *ApiHandle) advanceWSDB(c *ctx, buf []byte) int {
 		workspace[1], workspace[2], nonce, wsr.publishedRootId, refRootId)
 
 	if err != nil {
-		return api.queueErrorResponse(quantumfs.ErrorCommandFailed,
+		return errorResponse(quantumfs.ErrorCommandFailed,
 			"Workspace %s is already at %s",
 			cmd.Workspace, rootId.String())
 	}
 
-	return api.queueErrorResponse(quantumfs.ErrorOK,
+	return errorResponse(quantumfs.ErrorOK,
 		"AdvanceWSDB Succeeded")
 }
 
-func (api *ApiHandle) getAccessed(c *ctx, buf []byte) int {
+func (api *ApiHandle) getAccessed(c *ctx, buf []byte) apiResponse {
 	defer c.funcIn("ApiHandle::getAccessed").Out()
 
 	var cmd quantumfs.AccessedRequest
-	if err := json.Unmarshal(buf, &cmd); err != nil {
+	if err := api.unmarshal(buf, &cmd); err != nil {
 		c.vlog("Error unmarshaling JSON: %s", err.Error())
-		return api.queueErrorResponse(quantumfs.ErrorBadJson, "%s",
+		return errorResponse(quantumfs.ErrorBadJson, "%s",
 			err.Error())
 	}
 
 	if !isWorkspaceNameValid(cmd.WorkspaceRoot) {
 		c.vlog("workspace name '%s' is malformed", cmd.WorkspaceRoot)
-		return api.queueErrorResponse(quantumfs.ErrorBadArgs,
+		return errorResponse(quantumfs.ErrorBadArgs,
 			"workspace name '%s' is malformed", cmd.WorkspaceRoot)
 	}
 
@@ -763,27 +1202,168 @@ func (api *ApiHandle) getAccessed(c *ctx, buf []byte) int {
 	defer cleanup()
 	if !ok {
 		c.vlog("Workspace not found: %s", wsr)
-		return api.queueErrorResponse(quantumfs.ErrorWorkspaceNotFound,
+		return errorResponse(quantumfs.ErrorWorkspaceNotFound,
 			"WorkspaceRoot %s does not exist or is not active", wsr)
 	}
 
 	accessList := workspace.getList(c)
-	return api.queueAccesslistResponse(accessList)
+	return accessListResponse(accessList)
+}
+
+// The cursor of a page of an accessed listing holds the id of the listing in its
+// upper half and the index of the first path of the page in its lower half.
+// Listing ids start at one so that no cursor within a listing is zero.
+func accessedCursor(listingId uint32, offset int) uint64 {
+	return uint64(listingId)<<32 | uint64(offset)
+}
+
+func (api *ApiHandle) getAccessedPage(c *ctx, buf []byte) apiResponse {
+	defer c.funcIn("ApiHandle::getAccessedPage").Out()
+
+	var cmd quantumfs.AccessedPageRequest
+	if err := api.unmarshal(buf, &cmd); err != nil {
+		c.vlog("Error unmarshaling JSON: %s", err.Error())
+		return errorResponse(quantumfs.ErrorBadJson, "%s",
+			err.Error())
+	}
+
+	if !isWorkspaceNameValid(cmd.WorkspaceRoot) {
+		c.vlog("workspace name '%s' is malformed", cmd.WorkspaceRoot)
+		return errorResponse(quantumfs.ErrorBadArgs,
+			"workspace name '%s' is malformed", cmd.WorkspaceRoot)
+	}
+
+	pageSize := int(cmd.PageSize)
+	if pageSize == 0 {
+		pageSize = quantumfs.DefaultAccessedPageSize
+	} else if pageSize > quantumfs.MaxAccessedPageSize {
+		pageSize = quantumfs.MaxAccessedPageSize
+	}
+
+	var listingId uint32
+	var listing *accessedListing
+	offset := 0
+	if cmd.Cursor == 0 {
+		var ok bool
+		listing, ok = api.newAccessedListing(c, cmd.WorkspaceRoot)
+		if !ok {
+			c.vlog("Workspace not found: %s", cmd.WorkspaceRoot)
+			return errorResponse(quantumfs.ErrorWorkspaceNotFound,
+				"WorkspaceRoot %s does not exist or is not active",
+				cmd.WorkspaceRoot)
+		}
+	} else {
+		listingId = uint32(cmd.Cursor >> 32)
+		offset = int(uint32(cmd.Cursor))
+		listing = api.getAccessedListing(listingId)
+		if listing == nil || listing.workspaceRoot != cmd.WorkspaceRoot ||
+			offset > len(listing.paths) {
+
+			c.vlog("Unknown cursor %x for %s", cmd.Cursor,
+				cmd.WorkspaceRoot)
+			return errorResponse(quantumfs.ErrorBadArgs,
+				"Cursor %x is not a listing of %s", cmd.Cursor,
+				cmd.WorkspaceRoot)
+		}
+	}
+
+	end := offset + pageSize
+	var nextCursor uint64
+	if end >= len(listing.paths) {
+		end = len(listing.paths)
+		if listingId != 0 {
+			api.dropAccessedListing(listingId)
+		}
+	} else {
+		if listingId == 0 {
+			listingId = api.addAccessedListing(listing)
+		}
+		nextCursor = accessedCursor(listingId, end)
+	}
+
+	return &quantumfs.AccessedPageResponse{
+		ErrorResponse: makeErrorResponse(quantumfs.ErrorOK, ""),
+		Paths:         listing.paths[offset:end],
+		NextCursor:    nextCursor,
+	}
+}
+
+// Capture the accessed list of a workspace root, sorted by path
+func (api *ApiHandle) newAccessedListing(c *ctx,
+	workspaceRoot string) (*accessedListing, bool) {
+
+	dst := strings.Split(workspaceRoot, "/")
+	workspace, cleanup, ok := c.qfs.getWorkspaceRoot(c, dst[0], dst[1], dst[2])
+	defer cleanup()
+	if !ok {
+		return nil, false
+	}
+
+	accessList := workspace.getList(c)
+	listing := accessedListing{
+		workspaceRoot: workspaceRoot,
+		paths: make([]quantumfs.AccessedPath, 0,
+			len(accessList.Paths)),
+	}
+	for path, flags := range accessList.Paths {
+		listing.paths = append(listing.paths,
+			quantumfs.AccessedPath{Path: path, Flags: flags})
+	}
+	sort.Slice(listing.paths, func(i, j int) bool {
+		return listing.paths[i].Path < listing.paths[j].Path
+	})
+
+	return &listing, true
 }
 
-func (api *ApiHandle) clearAccessed(c *ctx, buf []byte) int {
+func (api *ApiHandle) addAccessedListing(listing *accessedListing) uint32 {
+	defer api.listingLock.Lock().Unlock()
+
+	if api.listings == nil {
+		api.listings = make(map[uint32]*accessedListing)
+	}
+
+	if len(api.listings) >= maxAccessedListings {
+		oldest := api.nextListingId
+		for id := range api.listings {
+			if id < oldest {
+				oldest = id
+			}
+		}
+		delete(api.listings, oldest)
+	}
+
+	api.nextListingId++
+	if api.nextListingId == 0 {
+		api.nextListingId++
+	}
+	api.listings[api.nextListingId] = listing
+	return api.nextListingId
+}
+
+func (api *ApiHandle) getAccessedListing(listingId uint32) *accessedListing {
+	defer api.listingLock.Lock().Unlock()
+	return api.listings[listingId]
+}
+
+func (api *ApiHandle) dropAccessedListing(listingId uint32) {
+	defer api.listingLock.Lock().Unlock()
+	delete(api.listings, listingId)
+}
+
+func (api *ApiHandle) clearAccessed(c *ctx, buf []byte) apiResponse {
 	defer c.funcIn("ApiHandle::clearAccessed").Out()
 
 	var cmd quantumfs.AccessedRequest
-	if err := json.Unmarshal(buf, &cmd); err != nil {
+	if err := api.unmarshal(buf, &cmd); err != nil {
 		c.vlog("Error unmarshaling JSON: %s", err.Error())
-		return api.queueErrorResponse(quantumfs.ErrorBadJson, "%s",
+		return errorResponse(quantumfs.ErrorBadJson, "%s",
 			err.Error())
 	}
 
 	if !isWorkspaceNameValid(cmd.WorkspaceRoot) {
 		c.vlog("workspace name '%s' is malformed", cmd.WorkspaceRoot)
-		return api.queueErrorResponse(quantumfs.ErrorBadArgs,
+		return errorResponse(quantumfs.ErrorBadArgs,
 			"workspace name '%s' is malformed", cmd.WorkspaceRoot)
 	}
 
@@ -793,65 +1373,65 @@ func (api *ApiHandle) clearAccessed(c *ctx, buf []byte) int {
 	defer cleanup()
 	if !ok {
 		c.vlog("Workspace not found: %s", wsr)
-		return api.queueErrorResponse(quantumfs.ErrorWorkspaceNotFound,
+		return errorResponse(quantumfs.ErrorWorkspaceNotFound,
 			"WorkspaceRoot %s does not exist or is not active", wsr)
 	}
 
 	workspace.clearList()
-	return api.queueErrorResponse(quantumfs.ErrorOK,
+	return errorResponse(quantumfs.ErrorOK,
 		"Clear AccessList Succeeded")
 }
 
-func (api *ApiHandle) syncAll(c *ctx) int {
+func (api *ApiHandle) syncAll(c *ctx) apiResponse {
 	defer c.funcIn("ApiHandle::syncAll").Out()
 
 	if err := c.qfs.syncAll(c); err != nil {
 		c.vlog("Error syncAll %s", err.Error())
-		return api.queueErrorResponse(quantumfs.ErrorCommandFailed, "%s",
+		return errorResponse(quantumfs.ErrorCommandFailed, "%s",
 			err.Error())
 
 	}
-	return api.queueErrorResponse(quantumfs.ErrorOK, "SyncAll Succeeded")
+	return errorResponse(quantumfs.ErrorOK, "SyncAll Succeeded")
 }
 
-func (api *ApiHandle) syncWorkspace(c *ctx, buf []byte) int {
+func (api *ApiHandle) syncWorkspace(c *ctx, buf []byte) apiResponse {
 	defer c.funcIn("ApiHandle::syncWorkspace").Out()
 
 	var cmd quantumfs.SyncWorkspaceRequest
-	if err := json.Unmarshal(buf, &cmd); err != nil {
+	if err := api.unmarshal(buf, &cmd); err != nil {
 		c.vlog("Error unmarshaling JSON: %s", err.Error())
-		return api.queueErrorResponse(quantumfs.ErrorBadJson, "%s",
+		return errorResponse(quantumfs.ErrorBadJson, "%s",
 			err.Error())
 	}
 	c.vlog("Syncing workspace %s", cmd.Workspace)
 
 	if !isWorkspaceNameValid(cmd.Workspace) {
 		c.vlog("workspace name '%s' is malformed", cmd.Workspace)
-		return api.queueErrorResponse(quantumfs.ErrorBadArgs,
+		return errorResponse(quantumfs.ErrorBadArgs,
 			"workspace name '%s' is malformed", cmd.Workspace)
 	}
 
 	if err := c.qfs.syncWorkspace(c, cmd.Workspace); err != nil {
 		c.vlog("Error sync %s", err.Error())
-		return api.queueErrorResponse(quantumfs.ErrorCommandFailed, "%s",
+		return errorResponse(quantumfs.ErrorCommandFailed, "%s",
 			err.Error())
 
 	}
-	return api.queueErrorResponse(quantumfs.ErrorOK, "SyncWorkspace Succeeded")
+	return errorResponse(quantumfs.ErrorOK, "SyncWorkspace Succeeded")
 }
 
-func (api *ApiHandle) insertInode(c *ctx, buf []byte) int {
+func (api *ApiHandle) insertInode(c *ctx, buf []byte) apiResponse {
 	defer c.funcIn("Api::insertInode").Out()
 
 	var cmd quantumfs.InsertInodeRequest
-	if err := json.Unmarshal(buf, &cmd); err != nil {
+	if err := api.unmarshal(buf, &cmd); err != nil {
 		c.vlog("Error unmarshaling JSON: %s", err.Error())
-		return api.queueErrorResponse(quantumfs.ErrorBadJson, "%s",
+		return errorResponse(quantumfs.ErrorBadJson, "%s",
 			err.Error())
 	}
 
 	if !isKeyValid(cmd.Key) {
-		return api.queueErrorResponse(quantumfs.ErrorBadArgs,
+		return errorResponse(quantumfs.ErrorBadArgs,
 			"key \"%s\" should be %d bytes",
 			cmd.Key, quantumfs.ExtendedKeyLength)
 	}
@@ -862,7 +1442,7 @@ func (api *ApiHandle) insertInode(c *ctx, buf []byte) int {
 	if err != nil {
 		c.vlog("Could not decode key \"%s\". Errror %s",
 			cmd.Key, err.Error())
-		return api.queueErrorResponse(quantumfs.ErrorBadArgs,
+		return errorResponse(quantumfs.ErrorBadArgs,
 			"Could not decode key \"%s\". Errror %s",
 			cmd.Key, err.Error())
 	}
@@ -872,7 +1452,7 @@ func (api *ApiHandle) insertInode(c *ctx, buf []byte) int {
 
 	if type_ == quantumfs.ObjectTypeDirectory {
 		c.vlog("Attempted to insert a directory")
-		return api.queueErrorResponse(quantumfs.ErrorBadArgs,
+		return errorResponse(quantumfs.ErrorBadArgs,
 			"InsertInode with directories is not supported")
 	}
 
@@ -880,7 +1460,7 @@ func (api *ApiHandle) insertInode(c *ctx, buf []byte) int {
 
 	if !isWorkspaceNameValid(wsr) {
 		c.vlog("workspace name '%s' is malformed", wsr)
-		return api.queueErrorResponse(quantumfs.ErrorBadArgs,
+		return errorResponse(quantumfs.ErrorBadArgs,
 			"workspace name '%s' is malformed", wsr)
 	}
 
@@ -888,21 +1468,21 @@ func (api *ApiHandle) insertInode(c *ctx, buf []byte) int {
 	defer cleanup()
 	if !ok {
 		c.vlog("Workspace not found: %s", wsr)
-		return api.queueErrorResponse(quantumfs.ErrorWorkspaceNotFound,
+		return errorResponse(quantumfs.ErrorWorkspaceNotFound,
 			"WorkspaceRoot %s does not exist or is not active", wsr)
 	}
 
 	if len(dst) == 3 { // only have typespace/namespace/workspace
 		// duplicate the entire workspace root is illegal
 		c.vlog("Attempted to insert workspace root")
-		return api.queueErrorResponse(quantumfs.ErrorBadArgs,
+		return errorResponse(quantumfs.ErrorBadArgs,
 			"WorkspaceRoot can not be duplicated")
 	}
 
 	if key.Type() != quantumfs.KeyTypeEmbedded {
 		if buffer := c.dataStore.Get(&c.Ctx, key); buffer == nil {
 			c.vlog("Key not found: %s", key.String())
-			return api.queueErrorResponse(quantumfs.ErrorKeyNotFound,
+			return errorResponse(quantumfs.ErrorKeyNotFound,
 				"Key does not exist in the datastore")
 		}
 	}
@@ -920,7 +1500,7 @@ func (api *ApiHandle) insertInode(c *ctx, buf []byte) int {
 	defer cleanup()
 	if err != nil {
 		c.vlog("Path does not exist: %s", cmd.DstPath)
-		return api.queueErrorResponse(quantumfs.ErrorBadArgs,
+		return errorResponse(quantumfs.ErrorBadArgs,
 			"Path %s does not exist", cmd.DstPath)
 	}
 
@@ -930,7 +1510,7 @@ func (api *ApiHandle) insertInode(c *ctx, buf []byte) int {
 	// The parent may have been deleted between the search and locking its tree.
 	if p == nil {
 		c.vlog("Path does not exist: %s", cmd.DstPath)
-		return api.queueErrorResponse(quantumfs.ErrorBadArgs,
+		return errorResponse(quantumfs.ErrorBadArgs,
 			"Path %s does not exist", cmd.DstPath)
 	}
 
@@ -945,7 +1525,7 @@ func (api *ApiHandle) insertInode(c *ctx, buf []byte) int {
 	status := parent.Unlink(c, target)
 	c.fuseCtx = origContext
 	if status != fuse.OK && status != fuse.ENOENT {
-		return api.queueErrorResponse(quantumfs.ErrorBadArgs,
+		return errorResponse(quantumfs.ErrorBadArgs,
 			"Inode %s should not exist, error unlinking %d", target,
 			status)
 	}
@@ -955,7 +1535,7 @@ func (api *ApiHandle) insertInode(c *ctx, buf []byte) int {
 
 	err = freshenKeys(c, key, type_)
 	if err != nil {
-		return api.queueErrorResponse(quantumfs.ErrorKeyNotFound,
+		return errorResponse(quantumfs.ErrorKeyNotFound,
 			"Unable to freshen all blocks for key: %s", err)
 	}
 
@@ -972,22 +1552,304 @@ func (api *ApiHandle) insertInode(c *ctx, buf []byte) int {
 	parent.self.markAccessed(c, target, markType(type_, quantumfs.PathCreated))
 
 	parent.updateSize(c, fuse.OK)
-	return api.queueErrorResponse(quantumfs.ErrorOK, "Insert Inode Succeeded")
+	return errorResponse(quantumfs.ErrorOK, "Insert Inode Succeeded")
+}
+
+// An inode of an InsertInodes request which has been checked and awaits insertion
+type insertion struct {
+	index       int // of the inode in the request
+	dst         []string
+	key         quantumfs.ObjectKey
+	type_       quantumfs.ObjectType
+	size        uint64
+	permissions uint32
+	uid         quantumfs.UID
+	gid         quantumfs.GID
 }
 
-func (api *ApiHandle) deleteWorkspace(c *ctx, buf []byte) int {
+func (ins *insertion) name() string {
+	return ins.dst[len(ins.dst)-1]
+}
+
+// The directory the inode is inserted into, including the workspace
+func (ins *insertion) parentPath() string {
+	return strings.Join(ins.dst[:len(ins.dst)-1], "/")
+}
+
+func (api *ApiHandle) insertInodes(c *ctx, buf []byte) apiResponse {
+	defer c.funcIn("ApiHandle::insertInodes").Out()
+
+	var cmd quantumfs.InsertInodesRequest
+	if err := api.unmarshal(buf, &cmd); err != nil {
+		c.vlog("Error unmarshaling JSON: %s", err.Error())
+		return errorResponse(quantumfs.ErrorBadJson, "%s",
+			err.Error())
+	}
+
+	if len(cmd.Inodes) > quantumfs.MaxInsertInodes {
+		c.vlog("InsertInodes of %d inodes is too large", len(cmd.Inodes))
+		return errorResponse(quantumfs.ErrorBadArgs,
+			"InsertInodes of %d inodes exceeds the maximum of %d",
+			len(cmd.Inodes), quantumfs.MaxInsertInodes)
+	}
+
+	results := make([]quantumfs.ErrorResponse, len(cmd.Inodes))
+	insertions := make([]*insertion, 0, len(cmd.Inodes))
+	for i, inode := range cmd.Inodes {
+		ins, failure := checkInsertion(c, inode)
+		if failure != nil {
+			results[i] = *failure
+			continue
+		}
+		ins.index = i
+		results[i] = makeErrorResponse(quantumfs.ErrorOK,
+			"Insert Inode Succeeded")
+		insertions = append(insertions, ins)
+	}
+
+	freshenInsertions(c, insertions, results)
+
+	// Each directory is found and locked once, in the order the inodes to
+	// insert into them first appear
+	groups := make(map[string][]*insertion)
+	var parents []string
+	for _, ins := range insertions {
+		if results[ins.index].ErrorCode != quantumfs.ErrorOK {
+			continue
+		}
+
+		parent := ins.parentPath()
+		if _, exists := groups[parent]; !exists {
+			parents = append(parents, parent)
+		}
+		groups[parent] = append(groups[parent], ins)
+	}
+
+	for _, parent := range parents {
+		insertIntoDirectory(c, parent, groups[parent], results)
+	}
+
+	return &quantumfs.InsertInodesResponse{
+		ErrorResponse: makeErrorResponse(quantumfs.ErrorOK, ""),
+		Results:       results,
+	}
+}
+
+// Check an inode of an InsertInodes request as insertInode does, other than that
+// its workspace exists and its key is stored
+func checkInsertion(c *ctx, inode quantumfs.InsertInodeEntry) (*insertion,
+	*quantumfs.ErrorResponse) {
+
+	failure := func(code uint32, format string,
+		a ...interface{}) (*insertion, *quantumfs.ErrorResponse) {
+
+		response := makeErrorResponse(code, fmt.Sprintf(format, a...))
+		return nil, &response
+	}
+
+	if !isKeyValid(inode.Key) {
+		return failure(quantumfs.ErrorBadArgs,
+			"key \"%s\" should be %d bytes",
+			inode.Key, quantumfs.ExtendedKeyLength)
+	}
+
+	key, type_, size, err := quantumfs.DecodeExtendedKey(inode.Key)
+	if err != nil {
+		c.vlog("Could not decode key \"%s\". Error %s",
+			inode.Key, err.Error())
+		return failure(quantumfs.ErrorBadArgs,
+			"Could not decode key \"%s\". Error %s",
+			inode.Key, err.Error())
+	}
+
+	if type_ == quantumfs.ObjectTypeDirectory {
+		c.vlog("Attempted to insert a directory")
+		return failure(quantumfs.ErrorBadArgs,
+			"InsertInode with directories is not supported")
+	}
+
+	dst := strings.Split(inode.DstPath, "/")
+	if len(dst) < 3 || !isWorkspaceNameValid(strings.Join(dst[:3], "/")) {
+		c.vlog("workspace of '%s' is malformed", inode.DstPath)
+		return failure(quantumfs.ErrorBadArgs,
+			"workspace of '%s' is malformed", inode.DstPath)
+	}
+
+	if len(dst) == 3 {
+		c.vlog("Attempted to insert workspace root")
+		return failure(quantumfs.ErrorBadArgs,
+			"WorkspaceRoot can not be duplicated")
+	}
+
+	return &insertion{
+		dst:         dst,
+		key:         key,
+		type_:       type_,
+		size:        size,
+		permissions: inode.Permissions,
+		uid: quantumfs.UID(quantumfs.ObjectUid(inode.Uid,
+			inode.Uid)),
+		gid: quantumfs.GID(quantumfs.ObjectGid(inode.Gid,
+			inode.Gid)),
+	}, nil
+}
+
+// Check that the key of each inode is stored and freshen its blocks
+func freshenInsertions(c *ctx, insertions []*insertion,
+	results []quantumfs.ErrorResponse) {
+
+	defer c.FuncIn("daemon::freshenInsertions", "count %d",
+		len(insertions)).Out()
+
+	forEachConcurrently(c, len(insertions), func(c *ctx, i int) {
+		ins := insertions[i]
+		results[ins.index] = makeErrorResponse(quantumfs.ErrorCommandFailed,
+			"Freshening keys failed unexpectedly")
+
+		if ins.key.Type() != quantumfs.KeyTypeEmbedded {
+			buffer := c.dataStore.Get(&c.Ctx, ins.key)
+			if buffer == nil {
+				c.vlog("Key not found: %s", ins.key.String())
+				results[ins.index] = makeErrorResponse(
+					quantumfs.ErrorKeyNotFound,
+					"Key does not exist in the datastore")
+				return
+			}
+		}
+
+		if err := freshenKeys(c, ins.key, ins.type_); err != nil {
+			results[ins.index] = makeErrorResponse(
+				quantumfs.ErrorKeyNotFound,
+				fmt.Sprintf("Unable to freshen all blocks "+
+					"for key: %s", err))
+			return
+		}
+
+		results[ins.index] = makeErrorResponse(quantumfs.ErrorOK,
+			"Insert Inode Succeeded")
+	})
+}
+
+// Insert the given inodes, which all belong in the directory at parentPath,
+// following the path and locking the tree of the workspace once for all of them
+func insertIntoDirectory(c *ctx, parentPath string, group []*insertion,
+	results []quantumfs.ErrorResponse) {
+
+	defer c.FuncIn("daemon::insertIntoDirectory", "%s count %d", parentPath,
+		len(group)).Out()
+
+	failAll := func(code uint32, format string, a ...interface{}) {
+		response := makeErrorResponse(code, fmt.Sprintf(format, a...))
+		for _, ins := range group {
+			results[ins.index] = response
+		}
+	}
+
+	dst := group[0].dst
+	workspace, cleanup, ok := c.qfs.getWorkspaceRoot(c, dst[0], dst[1], dst[2])
+	defer cleanup()
+	if !ok {
+		wsr := strings.Join(dst[:3], "/")
+		c.vlog("Workspace not found: %s", wsr)
+		failAll(quantumfs.ErrorWorkspaceNotFound,
+			"WorkspaceRoot %s does not exist or is not active", wsr)
+		return
+	}
+
+	// As in insertInode, the tree lock of the WorkspaceRoot must be taken here
+	p, cleanup, err := func() (Inode, func(), error) {
+		defer workspace.LockTree().Unlock()
+		return workspace.followPath_DOWN(c.DisableLockCheck(), dst)
+	}()
+	defer cleanup()
+	if err != nil {
+		c.vlog("Path does not exist: %s", parentPath)
+		failAll(quantumfs.ErrorBadArgs, "Path %s does not exist", parentPath)
+		return
+	}
+
+	p, treeUnlock := c.qfs.RLockTreeGetInode(c, p.inodeNum())
+	defer treeUnlock()
+
+	// The parent may have been deleted between the search and locking its tree.
+	if p == nil {
+		c.vlog("Path does not exist: %s", parentPath)
+		failAll(quantumfs.ErrorBadArgs, "Path %s does not exist", parentPath)
+		return
+	}
+
+	parent := asDirectory(p)
+
+	// Only the last inode inserted at each name remains, so the others are
+	// superseded without being inserted at all
+	latest := make(map[string]*insertion, len(group))
+	for _, ins := range group {
+		latest[ins.name()] = ins
+	}
+
+	unlinkContext := *c.fuseCtx
+	unlinkContext.Owner.Uid = 0
+	unlinkContext.Owner.Gid = 0
+	origContext := c.fuseCtx
+	c.fuseCtx = &unlinkContext
+	inserting := make([]*insertion, 0, len(latest))
+	for _, ins := range group {
+		if latest[ins.name()] != ins {
+			continue
+		}
+
+		status := parent.Unlink(c, ins.name())
+		if status != fuse.OK && status != fuse.ENOENT {
+			results[ins.index] = makeErrorResponse(
+				quantumfs.ErrorBadArgs,
+				fmt.Sprintf("Inode %s should not exist, error "+
+					"unlinking %d", ins.name(), status))
+			continue
+		}
+		inserting = append(inserting, ins)
+	}
+	c.fuseCtx = origContext
+
+	if len(inserting) == 0 {
+		return
+	}
+
+	fileIds := make([]quantumfs.FileId, len(inserting))
+	func() {
+		defer parent.Lock(c).Unlock()
+		for i, ins := range inserting {
+			c.vlog("Api::insertInodes put key %v into node %d - %s",
+				ins.key.Value(), parent.inodeNum(), ins.name())
+			fileIds[i] = parent.duplicateInode_(c, ins.name(),
+				ins.permissions, 0, 0, ins.size, ins.uid, ins.gid,
+				ins.type_, ins.key)
+		}
+	}()
+
+	for i, ins := range inserting {
+		if ins.type_ == quantumfs.ObjectTypeHardlink {
+			parent.markHardlinkPath(c, ins.name(), fileIds[i])
+		}
+		parent.self.markAccessed(c, ins.name(),
+			markType(ins.type_, quantumfs.PathCreated))
+	}
+
+	parent.updateSize(c, fuse.OK)
+}
+
+func (api *ApiHandle) deleteWorkspace(c *ctx, buf []byte) apiResponse {
 	defer c.funcIn("ApiHandle::deleteWorkspace").Out()
 
 	var cmd quantumfs.DeleteWorkspaceRequest
-	if err := json.Unmarshal(buf, &cmd); err != nil {
+	if err := api.unmarshal(buf, &cmd); err != nil {
 		c.vlog("Error unmarshaling JSON: %s", err.Error())
-		return api.queueErrorResponse(quantumfs.ErrorBadJson, "%s",
+		return errorResponse(quantumfs.ErrorBadJson, "%s",
 			err.Error())
 	}
 
 	if !isWorkspaceNameValid(cmd.WorkspacePath) {
 		c.vlog("workspace name '%s' is malformed", cmd.WorkspacePath)
-		return api.queueErrorResponse(quantumfs.ErrorBadArgs,
+		return errorResponse(quantumfs.ErrorBadArgs,
 			"workspace name '%s' is malformed", cmd.WorkspacePath)
 	}
 
@@ -997,7 +1859,7 @@ func (api *ApiHandle) deleteWorkspace(c *ctx, buf []byte) int {
 		parts[2]); err != nil {
 
 		c.vlog("DeleteWorkspace failed: %s", err.Error())
-		return api.queueErrorResponse(quantumfs.ErrorCommandFailed,
+		return errorResponse(quantumfs.ErrorCommandFailed,
 			"%s", err.Error())
 	}
 
@@ -1006,49 +1868,49 @@ func (api *ApiHandle) deleteWorkspace(c *ctx, buf []byte) int {
 	defer c.qfs.mutabilityLock.Lock().Unlock()
 	delete(c.qfs.workspaceMutability, workspacePath)
 
-	return api.queueErrorResponse(quantumfs.ErrorOK,
+	return errorResponse(quantumfs.ErrorOK,
 		"Workspace deletion succeeded")
 }
 
 func (api *ApiHandle) processImmutablilityError(c *ctx, err error,
-	workspacePath string, msg string) int {
+	workspacePath string, msg string) apiResponse {
 
 	switch err := err.(type) {
 	default:
 		c.wlog("Unknown error type from WorkspaceDB."+
 			"WorkspaceIsImmutable: %s", err.Error())
-		return api.queueErrorResponse(quantumfs.ErrorCommandFailed,
+		return errorResponse(quantumfs.ErrorCommandFailed,
 			"%s of WorkspaceRoot %s", msg, workspacePath)
 	case quantumfs.WorkspaceDbErr:
 		switch err.Code {
 		default:
 			c.wlog("Unhandled error from WorkspaceDB."+
 				"WorkspaceIsImmutable: %s", err.Error())
-			return api.queueErrorResponse(
+			return errorResponse(
 				quantumfs.ErrorCommandFailed,
 				"%s of WorkspaceRoot %s", msg, workspacePath)
 		case quantumfs.WSDB_WORKSPACE_NOT_FOUND:
 			c.vlog("Workspace does not exist: %s", workspacePath)
-			return api.queueErrorResponse(
+			return errorResponse(
 				quantumfs.ErrorWorkspaceNotFound,
 				"WorkspaceRoot %s does not exist", workspacePath)
 		}
 	}
 }
 
-func (api *ApiHandle) enableRootWrite(c *ctx, buf []byte) int {
+func (api *ApiHandle) enableRootWrite(c *ctx, buf []byte) apiResponse {
 	defer c.funcIn("Api::enableRootWrite").Out()
 
 	var cmd quantumfs.EnableRootWriteRequest
-	if err := json.Unmarshal(buf, &cmd); err != nil {
+	if err := api.unmarshal(buf, &cmd); err != nil {
 		c.vlog("Error unmarshaling JSON: %s", err.Error())
-		return api.queueErrorResponse(quantumfs.ErrorBadJson, "%s",
+		return errorResponse(quantumfs.ErrorBadJson, "%s",
 			err.Error())
 	}
 
 	if !isWorkspaceNameValid(cmd.Workspace) {
 		c.vlog("workspace name '%s' is malformed", cmd.Workspace)
-		return api.queueErrorResponse(quantumfs.ErrorBadArgs,
+		return errorResponse(quantumfs.ErrorBadArgs,
 			"workspace name '%s' is malformed", cmd.Workspace)
 	}
 
@@ -1066,35 +1928,35 @@ func (api *ApiHandle) enableRootWrite(c *ctx, buf []byte) int {
 	defer c.qfs.mutabilityLock.Lock().Unlock()
 	if immutable {
 		delete(c.qfs.workspaceMutability, workspacePath)
-		return api.queueErrorResponse(quantumfs.ErrorCommandFailed,
+		return errorResponse(quantumfs.ErrorCommandFailed,
 			"WorkspaceRoot has already been set immutable")
 	}
 
 	mutability, exists := c.qfs.workspaceMutability[workspacePath]
 	if exists && mutability == workspaceImmutableUntilRestart {
-		return api.queueErrorResponse(quantumfs.ErrorCommandFailed,
+		return errorResponse(quantumfs.ErrorCommandFailed,
 			"Another user is writing to this workspace. Writes are "+
 				"disabled, some changes already made may be lost.")
 	}
 
 	c.qfs.workspaceMutability[workspacePath] = workspaceMutable
-	return api.queueErrorResponse(quantumfs.ErrorOK,
+	return errorResponse(quantumfs.ErrorOK,
 		"Enable Workspace Write Permission Succeeded")
 }
 
-func (api *ApiHandle) setBlock(c *ctx, buf []byte) int {
+func (api *ApiHandle) setBlock(c *ctx, buf []byte) apiResponse {
 	defer c.funcIn("ApiHandle::setBlock").Out()
 
 	var cmd quantumfs.SetBlockRequest
-	if err := json.Unmarshal(buf, &cmd); err != nil {
+	if err := api.unmarshal(buf, &cmd); err != nil {
 		c.vlog("Error unmarshaling JSON: %s", err.Error())
-		return api.queueErrorResponse(quantumfs.ErrorBadJson, "%s",
+		return errorResponse(quantumfs.ErrorBadJson, "%s",
 			err.Error())
 	}
 
 	if len(cmd.Key) != quantumfs.HashSize {
 		c.vlog("Key incorrect size %d", len(cmd.Key))
-		return api.queueErrorResponse(quantumfs.ErrorBadArgs,
+		return errorResponse(quantumfs.ErrorBadArgs,
 			"Key must be %d bytes", quantumfs.HashSize)
 	}
 
@@ -1107,26 +1969,26 @@ func (api *ApiHandle) setBlock(c *ctx, buf []byte) int {
 	err := c.dataStore.durableStore.Set(&c.Ctx, key, buffer)
 	if err != nil {
 		c.vlog("Setting block in datastore failed: %s", err.Error())
-		return api.queueErrorResponse(quantumfs.ErrorCommandFailed, "%s",
+		return errorResponse(quantumfs.ErrorCommandFailed, "%s",
 			err.Error())
 	}
 
-	return api.queueErrorResponse(quantumfs.ErrorOK, "Block set succeeded")
+	return errorResponse(quantumfs.ErrorOK, "Block set succeeded")
 }
 
-func (api *ApiHandle) getBlock(c *ctx, buf []byte) int {
+func (api *ApiHandle) getBlock(c *ctx, buf []byte) apiResponse {
 	defer c.funcIn("ApiHandle::getBlock").Out()
 
 	var cmd quantumfs.GetBlockRequest
-	if err := json.Unmarshal(buf, &cmd); err != nil {
+	if err := api.unmarshal(buf, &cmd); err != nil {
 		c.vlog("Error unmarshaling JSON: %s ", err.Error())
-		return api.queueErrorResponse(quantumfs.ErrorBadJson, "%s",
+		return errorResponse(quantumfs.ErrorBadJson, "%s",
 			err.Error())
 	}
 
 	if len(cmd.Key) != quantumfs.HashSize {
 		c.vlog("Key incorrect size %d", len(cmd.Key))
-		return api.queueErrorResponse(quantumfs.ErrorBadArgs,
+		return errorResponse(quantumfs.ErrorBadArgs,
 			"Key must be %d bytes", quantumfs.HashSize)
 	}
 
@@ -1137,43 +1999,400 @@ func (api *ApiHandle) getBlock(c *ctx, buf []byte) int {
 	buffer := c.dataStore.Get(&c.Ctx, key)
 	if buffer == nil {
 		c.vlog("Datastore returned no data")
-		return api.queueErrorResponse(quantumfs.ErrorCommandFailed,
+		return errorResponse(quantumfs.ErrorCommandFailed,
 			"Nil buffer returned from datastore")
 	}
 
 	response := quantumfs.GetBlockResponse{
-		ErrorResponse: quantumfs.ErrorResponse{
-			CommandCommon: quantumfs.CommandCommon{
-				CommandId: quantumfs.CmdError,
-			},
-			ErrorCode: quantumfs.ErrorOK,
-			Message:   "",
-		},
-		Data: slowCopy(buffer),
+		ErrorResponse: makeErrorResponse(quantumfs.ErrorOK, ""),
+		Data:          slowCopy(buffer),
 	}
 
-	bytes, err := json.Marshal(response)
+	c.vlog("Data length %d", buffer.Size())
+	return &response
+}
+
+func (api *ApiHandle) statBlock(c *ctx, buf []byte) apiResponse {
+	defer c.funcIn("ApiHandle::statBlock").Out()
+
+	var cmd quantumfs.StatBlockRequest
+	if err := api.unmarshal(buf, &cmd); err != nil {
+		c.vlog("Error unmarshaling JSON: %s ", err.Error())
+		return errorResponse(quantumfs.ErrorBadJson, "%s",
+			err.Error())
+	}
+
+	if len(cmd.Key) != quantumfs.HashSize {
+		c.vlog("Key incorrect size %d", len(cmd.Key))
+		return errorResponse(quantumfs.ErrorBadArgs,
+			"Key must be %d bytes", quantumfs.HashSize)
+	}
+
+	var hash [quantumfs.HashSize]byte
+	copy(hash[:len(hash)], cmd.Key)
+	key := quantumfs.NewObjectKey(quantumfs.KeyTypeApi, hash)
+
+	// The datastore has no cheaper way to find the size of a block, but the
+	// block isn't copied into the response
+	buffer := c.dataStore.Get(&c.Ctx, key)
+	if buffer == nil {
+		c.vlog("Datastore returned no data")
+		return errorResponse(quantumfs.ErrorCommandFailed,
+			"Nil buffer returned from datastore")
+	}
+
+	c.vlog("Data length %d", buffer.Size())
+	return &quantumfs.StatBlockResponse{
+		ErrorResponse: makeErrorResponse(quantumfs.ErrorOK, ""),
+		Size:          uint64(buffer.Size()),
+	}
+}
+
+func (api *ApiHandle) hasBlocks(c *ctx, buf []byte) apiResponse {
+	defer c.funcIn("ApiHandle::hasBlocks").Out()
+
+	var cmd quantumfs.HasBlocksRequest
+	if err := api.unmarshal(buf, &cmd); err != nil {
+		c.vlog("Error unmarshaling JSON: %s ", err.Error())
+		return errorResponse(quantumfs.ErrorBadJson, "%s",
+			err.Error())
+	}
+
+	if len(cmd.Keys) > quantumfs.MaxHasBlocksKeys {
+		c.vlog("HasBlocks of %d keys is too large", len(cmd.Keys))
+		return errorResponse(quantumfs.ErrorBadArgs,
+			"HasBlocks of %d keys exceeds the maximum of %d",
+			len(cmd.Keys), quantumfs.MaxHasBlocksKeys)
+	}
+
+	keys := make([]quantumfs.ObjectKey, len(cmd.Keys))
+	for i, key := range cmd.Keys {
+		if len(key) != quantumfs.HashSize {
+			c.vlog("Key %d incorrect size %d", i, len(key))
+			return errorResponse(quantumfs.ErrorBadArgs,
+				"Key must be %d bytes", quantumfs.HashSize)
+		}
+
+		var hash [quantumfs.HashSize]byte
+		copy(hash[:len(hash)], key)
+		keys[i] = quantumfs.NewObjectKey(quantumfs.KeyTypeApi, hash)
+	}
+
+	// Freshening a block both finds whether it is stored and extends its
+	// lifetime, which the client relies on when it skips storing the block
+	// again. Unlike a Get, it doesn't load the block into the cache.
+	present := make([]bool, len(keys))
+	forEachConcurrently(c, len(keys), func(c *ctx, i int) {
+		err := c.dataStore.Freshen(c, keys[i])
+		if err != nil {
+			c.vlog("Key %s not stored: %s", keys[i].String(),
+				err.Error())
+		}
+		present[i] = err == nil
+	})
+
+	return &quantumfs.HasBlocksResponse{
+		ErrorResponse: makeErrorResponse(quantumfs.ErrorOK, ""),
+		Present:       present,
+	}
+}
+
+func (api *ApiHandle) prefetch(c *ctx, buf []byte) apiResponse {
+	defer c.funcIn("ApiHandle::prefetch").Out()
+
+	var cmd quantumfs.PrefetchRequest
+	if err := api.unmarshal(buf, &cmd); err != nil {
+		c.vlog("Error unmarshaling JSON: %s ", err.Error())
+		return errorResponse(quantumfs.ErrorBadJson, "%s",
+			err.Error())
+	}
+
+	count := len(cmd.Keys) + len(cmd.ExtendedKeys)
+	if count > quantumfs.MaxPrefetchKeys {
+		c.vlog("Prefetch of %d keys is too large", count)
+		return errorResponse(quantumfs.ErrorBadArgs,
+			"Prefetch of %d keys exceeds the maximum of %d",
+			count, quantumfs.MaxPrefetchKeys)
+	}
+
+	keys := make([]quantumfs.ObjectKey, 0, count)
+	for i, key := range cmd.Keys {
+		if len(key) != quantumfs.HashSize {
+			c.vlog("Key %d incorrect size %d", i, len(key))
+			return errorResponse(quantumfs.ErrorBadArgs,
+				"Key must be %d bytes", quantumfs.HashSize)
+		}
+
+		var hash [quantumfs.HashSize]byte
+		copy(hash[:len(hash)], key)
+		keys = append(keys, quantumfs.NewObjectKey(quantumfs.KeyTypeApi,
+			hash))
+	}
+
+	for _, extendedKey := range cmd.ExtendedKeys {
+		if !isKeyValid(extendedKey) {
+			return errorResponse(quantumfs.ErrorBadArgs,
+				"key \"%s\" should be %d bytes",
+				extendedKey, quantumfs.ExtendedKeyLength)
+		}
+
+		key, _, _, err := quantumfs.DecodeExtendedKey(extendedKey)
+		if err != nil {
+			c.vlog("Could not decode key \"%s\". Error %s",
+				extendedKey, err.Error())
+			return errorResponse(quantumfs.ErrorBadArgs,
+				"Could not decode key \"%s\". Error %s",
+				extendedKey, err.Error())
+		}
+
+		// Embedded keys carry their content and have no block to load
+		if key.Type() != quantumfs.KeyTypeEmbedded {
+			keys = append(keys, key)
+		}
+	}
+
+	started := api.prefetchBlocks(c, keys)
+
+	return errorResponse(quantumfs.ErrorOK,
+		"Prefetch started for %d of %d blocks", started, len(keys))
+}
+
+// The most blocks prefetched at once by the whole daemon
+const prefetchConcurrency = 64
+
+const PrefetchDroppedLog = "Prefetch slots full, dropping %d blocks"
+
+// Start loading the blocks of keys into the cache of the datastore, and return how
+// many were started. Prefetches are only hints, so blocks which find every slot of
+// the daemon busy are dropped rather than queued. Blocks which cannot be found are
+// skipped, there is nobody left to tell.
+func (api *ApiHandle) prefetchBlocks(c *ctx, keys []quantumfs.ObjectKey) int {
+	defer c.FuncIn("ApiHandle::prefetchBlocks", "count %d", len(keys)).Out()
+
+	// The datastore may be remote, so the blocks are loaded concurrently
+	for i := range keys {
+		select {
+		case c.qfs.prefetches <- struct{}{}:
+		default:
+			c.vlog(PrefetchDroppedLog, len(keys)-i)
+			return i
+		}
+
+		go func(c *ctx, key quantumfs.ObjectKey) {
+			defer func() { <-c.qfs.prefetches }()
+			defer logRequestPanic(c)
+
+			c.dataStore.prefetch(&c.Ctx, key)
+		}(c.newThread(), keys[i])
+	}
+	return len(keys)
+}
+
+func (api *ApiHandle) registerSharedMemory(c *ctx, buf []byte) apiResponse {
+	defer c.funcIn("ApiHandle::registerSharedMemory").Out()
+
+	var cmd quantumfs.RegisterSharedMemoryRequest
+	if err := api.unmarshal(buf, &cmd); err != nil {
+		c.vlog("Error unmarshaling JSON: %s", err.Error())
+		return errorResponse(quantumfs.ErrorBadJson, "%s",
+			err.Error())
+	}
+
+	path := filepath.Clean(cmd.Path)
+	if filepath.Dir(path) != quantumfs.SharedMemoryDir {
+		c.vlog("Shared memory %s is outside %s", cmd.Path,
+			quantumfs.SharedMemoryDir)
+		return errorResponse(quantumfs.ErrorBadArgs,
+			"Shared memory must be in %s", quantumfs.SharedMemoryDir)
+	}
+
+	file, err := os.OpenFile(path, os.O_RDWR|syscall.O_NOFOLLOW, 0)
 	if err != nil {
-		panic("Failed to marshal API GetBlockResponse")
+		c.vlog("Opening shared memory failed: %s", err.Error())
+		return errorResponse(quantumfs.ErrorCommandFailed, "%s",
+			err.Error())
 	}
 
-	c.vlog("Data length %d, response length %d", buffer.Size(), len(bytes))
-	api.responses <- fuse.ReadResultData(bytes)
-	return len(bytes)
+	// Only a file of the caller's own may be used, as QuantumFS will read
+	// and write it on their behalf.
+	var stat syscall.Stat_t
+	err = syscall.Fstat(int(file.Fd()), &stat)
+	if err != nil {
+		file.Close()
+		c.vlog("Stat of shared memory failed: %s", err.Error())
+		return errorResponse(quantumfs.ErrorCommandFailed, "%s",
+			err.Error())
+	}
+
+	if stat.Mode&syscall.S_IFMT != syscall.S_IFREG ||
+		stat.Uid != c.fuseCtx.Owner.Uid {
+
+		file.Close()
+		c.vlog("Shared memory %s isn't a file of uid %d", path,
+			c.fuseCtx.Owner.Uid)
+		return errorResponse(quantumfs.ErrorBadArgs,
+			"%s is not a regular file owned by the caller", path)
+	}
+
+	if uint64(stat.Size) < cmd.Size {
+		file.Close()
+		c.vlog("Shared memory is %d bytes, not %d", stat.Size, cmd.Size)
+		return errorResponse(quantumfs.ErrorBadArgs,
+			"%s is smaller than %d bytes", path, cmd.Size)
+	}
+
+	api.setSharedMemory(file, cmd.Size)
+	return errorResponse(quantumfs.ErrorOK, "Shared memory registered")
+}
+
+// Replace the shared memory file of the handle, closing the previous one
+func (api *ApiHandle) setSharedMemory(file *os.File, size uint64) {
+	defer api.sharedLock.Lock().Unlock()
+
+	if api.shared != nil {
+		api.shared.Close()
+	}
+	api.shared = file
+	api.sharedSize = size
+}
+
+// Check that length bytes at offset lie within the shared memory of the handle,
+// which the caller must have locked.
+func (api *ApiHandle) checkSharedRange(offset uint64, length uint64) error {
+	if api.shared == nil {
+		return fmt.Errorf("No shared memory is registered")
+	}
+
+	if offset > api.sharedSize || length > api.sharedSize-offset {
+		return fmt.Errorf("%d bytes at %d exceed the %d bytes of shared "+
+			"memory", length, offset, api.sharedSize)
+	}
+	return nil
+}
+
+func (api *ApiHandle) setBlockShared(c *ctx, buf []byte) apiResponse {
+	defer c.funcIn("ApiHandle::setBlockShared").Out()
+
+	var cmd quantumfs.SetBlockSharedRequest
+	if err := api.unmarshal(buf, &cmd); err != nil {
+		c.vlog("Error unmarshaling JSON: %s", err.Error())
+		return errorResponse(quantumfs.ErrorBadJson, "%s",
+			err.Error())
+	}
+
+	if len(cmd.Key) != quantumfs.HashSize {
+		c.vlog("Key incorrect size %d", len(cmd.Key))
+		return errorResponse(quantumfs.ErrorBadArgs,
+			"Key must be %d bytes", quantumfs.HashSize)
+	}
+
+	if cmd.Length > uint64(quantumfs.MaxBlockSize) {
+		c.vlog("Block too large %d", cmd.Length)
+		return errorResponse(quantumfs.ErrorBlockTooLarge,
+			"Block must be at most %d bytes", quantumfs.MaxBlockSize)
+	}
+
+	var hash [quantumfs.HashSize]byte
+	copy(hash[:len(hash)], cmd.Key)
+	key := quantumfs.NewObjectKey(quantumfs.KeyTypeApi, hash)
+
+	// The block is read straight into the buffer which is stored
+	data := make([]byte, cmd.Length)
+	err := func() error {
+		defer api.sharedLock.RLock().RUnlock()
+
+		if err := api.checkSharedRange(cmd.Offset, cmd.Length); err != nil {
+			return err
+		}
+		_, err := api.shared.ReadAt(data, int64(cmd.Offset))
+		return err
+	}()
+	if err != nil {
+		c.vlog("Reading block from shared memory failed: %s", err.Error())
+		return errorResponse(quantumfs.ErrorBadArgs, "%s", err.Error())
+	}
+
+	buffer := newBuffer(c, data, key.Type())
+
+	err = c.dataStore.durableStore.Set(&c.Ctx, key, buffer)
+	if err != nil {
+		c.vlog("Setting block in datastore failed: %s", err.Error())
+		return errorResponse(quantumfs.ErrorCommandFailed, "%s",
+			err.Error())
+	}
+
+	return errorResponse(quantumfs.ErrorOK, "Block set succeeded")
+}
+
+func (api *ApiHandle) getBlockShared(c *ctx, buf []byte) apiResponse {
+	defer c.funcIn("ApiHandle::getBlockShared").Out()
+
+	var cmd quantumfs.GetBlockSharedRequest
+	if err := api.unmarshal(buf, &cmd); err != nil {
+		c.vlog("Error unmarshaling JSON: %s ", err.Error())
+		return errorResponse(quantumfs.ErrorBadJson, "%s",
+			err.Error())
+	}
+
+	if len(cmd.Key) != quantumfs.HashSize {
+		c.vlog("Key incorrect size %d", len(cmd.Key))
+		return errorResponse(quantumfs.ErrorBadArgs,
+			"Key must be %d bytes", quantumfs.HashSize)
+	}
+
+	var hash [quantumfs.HashSize]byte
+	copy(hash[:len(hash)], cmd.Key)
+	key := quantumfs.NewObjectKey(quantumfs.KeyTypeApi, hash)
+
+	buffer := c.dataStore.Get(&c.Ctx, key)
+	if buffer == nil {
+		c.vlog("Datastore returned no data")
+		return errorResponse(quantumfs.ErrorCommandFailed,
+			"Nil buffer returned from datastore")
+	}
+
+	length := uint64(buffer.Size())
+	if length > cmd.Capacity {
+		c.vlog("Block of %d bytes exceeds capacity %d", length,
+			cmd.Capacity)
+		return errorResponse(quantumfs.ErrorBlockTooLarge,
+			"Block of %d bytes exceeds capacity %d", length,
+			cmd.Capacity)
+	}
+
+	err := func() error {
+		defer api.sharedLock.RLock().RUnlock()
+
+		if err := api.checkSharedRange(cmd.Offset, length); err != nil {
+			return err
+		}
+		_, err := api.shared.WriteAt(buffer.Get(), int64(cmd.Offset))
+		return err
+	}()
+	if err != nil {
+		c.vlog("Writing block to shared memory failed: %s", err.Error())
+		return errorResponse(quantumfs.ErrorBadArgs, "%s", err.Error())
+	}
+
+	c.vlog("Data length %d", length)
+	return &quantumfs.GetBlockSharedResponse{
+		ErrorResponse: makeErrorResponse(quantumfs.ErrorOK, ""),
+		Length:        length,
+	}
 }
 
-func (api *ApiHandle) setWorkspaceImmutable(c *ctx, buf []byte) int {
+func (api *ApiHandle) setWorkspaceImmutable(c *ctx, buf []byte) apiResponse {
 	defer c.funcIn("Api::setWorkspaceImmutable").Out()
 
 	var cmd quantumfs.SetWorkspaceImmutableRequest
-	if err := json.Unmarshal(buf, &cmd); err != nil {
-		return api.queueErrorResponse(quantumfs.ErrorBadJson, "%s",
+	if err := api.unmarshal(buf, &cmd); err != nil {
+		return errorResponse(quantumfs.ErrorBadJson, "%s",
 			err.Error())
 	}
 
 	if !isWorkspaceNameValid(cmd.WorkspacePath) {
 		c.vlog("workspace name '%s' is malformed", cmd.WorkspacePath)
-		return api.queueErrorResponse(quantumfs.ErrorBadArgs,
+		return errorResponse(quantumfs.ErrorBadArgs,
 			"workspace name '%s' is malformed", cmd.WorkspacePath)
 	}
 
@@ -1189,36 +2408,36 @@ func (api *ApiHandle) setWorkspaceImmutable(c *ctx, buf []byte) int {
 
 	mutability, exists := c.qfs.workspaceMutability[workspacePath]
 	if exists && mutability == workspaceImmutableUntilRestart {
-		return api.queueErrorResponse(quantumfs.ErrorCommandFailed,
+		return errorResponse(quantumfs.ErrorCommandFailed,
 			"Another user is writing to this workspace. Writes are "+
 				"disabled, some changes already made may be lost.")
 	}
 
 	delete(c.qfs.workspaceMutability, workspacePath)
 
-	return api.queueErrorResponse(quantumfs.ErrorOK,
+	return errorResponse(quantumfs.ErrorOK,
 		"Making workspace immutable succeeded")
 }
 
 const WorkspaceFinishedFormat = "Workspace %s finished"
 
-func (api *ApiHandle) workspaceFinished(c *ctx, buf []byte) int {
+func (api *ApiHandle) workspaceFinished(c *ctx, buf []byte) apiResponse {
 	defer c.funcIn("ApiHandle::workspaceFinished").Out()
 
 	var cmd quantumfs.WorkspaceFinishedRequest
-	if err := json.Unmarshal(buf, &cmd); err != nil {
+	if err := api.unmarshal(buf, &cmd); err != nil {
 		c.vlog("Error unmarshaling JSON: %s", err.Error())
-		return api.queueErrorResponse(quantumfs.ErrorBadJson, "%s",
+		return errorResponse(quantumfs.ErrorBadJson, "%s",
 			err.Error())
 	}
 	if !isWorkspaceNameValid(cmd.WorkspacePath) {
 		c.vlog("workspace name '%s' is malformed", cmd.WorkspacePath)
-		return api.queueErrorResponse(quantumfs.ErrorBadArgs,
+		return errorResponse(quantumfs.ErrorBadArgs,
 			"workspace name '%s' is malformed", cmd.WorkspacePath)
 	}
 
 	c.vlog(WorkspaceFinishedFormat, cmd.WorkspacePath)
 
-	return api.queueErrorResponse(quantumfs.ErrorOK,
+	return errorResponse(quantumfs.ErrorOK,
 		"WorkspaceFinished Succeeded")
 }
@@ -0,0 +1,271 @@
+// Copyright (c) 2018 Arista Networks, Inc.
+// Use of this source code is governed by the Apache License 2.0
+// that can be found in the COPYING file.
+
+package daemon
+
+// This file contains the optional unix socket on which the api is served alongside
+// the api file. Requests on the socket don't pass through the kernel FUSE layer,
+// which makes each of them considerably cheaper.
+
+import (
+	"io"
+	"net"
+	"os"
+	"sync"
+	"syscall"
+	"time"
+
+	"github.com/aristanetworks/quantumfs"
+	"github.com/aristanetworks/quantumfs/utils"
+	"github.com/hanwen/go-fuse/fuse"
+)
+
+// The largest request accepted on the api socket. Requests on the api file are
+// limited by the FUSE write size instead.
+const maxApiSocketRequest = 16 * 1024 * 1024
+
+// apiSocket accepts connections to the api socket. Every connection is served by
+// an ApiHandle of its own, as if the client had opened the api file, except that
+// only the binary protocol is spoken.
+type apiSocket struct {
+	listener *net.UnixListener
+
+	lock        utils.DeferableMutex
+	closed      bool
+	connections map[net.Conn]struct{}
+
+	// Counts the goroutines serving the socket, so that closing it may wait
+	// for them
+	serving sync.WaitGroup
+}
+
+// Start serving the api on the socket at the configured path, if there is one
+func (qfs *QuantumFs) listenApiSocket() error {
+	path := qfs.config.ApiSocketPath
+	if path == "" {
+		return nil
+	}
+
+	c := qfs.c.newThread()
+	defer c.FuncIn("Mux::listenApiSocket", "path %s", path).Out()
+
+	// Replace the socket of an earlier instance, but nothing else
+	stat, err := os.Lstat(path)
+	if err == nil && stat.Mode()&os.ModeSocket != 0 {
+		if err := os.Remove(path); err != nil {
+			c.elog("Failed to remove stale api socket: %s", err.Error())
+			return err
+		}
+	}
+
+	listener, err := net.ListenUnix("unix",
+		&net.UnixAddr{Name: path, Net: "unix"})
+	if err != nil {
+		c.elog("Failed to listen on api socket: %s", err.Error())
+		return err
+	}
+
+	// Anybody may use the socket, just as anybody may use the api file
+	if err := os.Chmod(path, 0666); err != nil {
+		listener.Close()
+		c.elog("Failed to set api socket permissions: %s", err.Error())
+		return err
+	}
+
+	socket := &apiSocket{
+		listener:    listener,
+		connections: make(map[net.Conn]struct{}),
+	}
+	qfs.apiSocket = socket
+
+	socket.serving.Add(1)
+	go socket.accept(c.newThread())
+	return nil
+}
+
+// Stop serving the api socket, closing every connection to it
+func (qfs *QuantumFs) closeApiSocket() {
+	socket := qfs.apiSocket
+	if socket == nil {
+		return
+	}
+
+	c := qfs.c.newThread()
+	defer c.funcIn("Mux::closeApiSocket").Out()
+
+	func() {
+		defer socket.lock.Lock().Unlock()
+		socket.closed = true
+		for conn := range socket.connections {
+			conn.Close()
+		}
+	}()
+
+	// Closing the listener also removes the socket file
+	socket.listener.Close()
+	socket.serving.Wait()
+}
+
+func (socket *apiSocket) accept(c *ctx) {
+	defer socket.serving.Done()
+	defer logRequestPanic(c)
+
+	for {
+		conn, err := socket.listener.AcceptUnix()
+		if err != nil {
+			if socket.isClosed() {
+				return
+			}
+
+			if netErr, ok := err.(net.Error); ok && netErr.Temporary() {
+				// Such as running out of file descriptors, which
+				// may pass
+				c.wlog("Accepting api connection failed: %s",
+					err.Error())
+				time.Sleep(10 * time.Millisecond)
+				continue
+			}
+
+			c.elog("Api socket failed: %s", err.Error())
+			return
+		}
+
+		if !socket.track(conn) {
+			conn.Close()
+			return
+		}
+		go socket.serve(c.newThread(), conn)
+	}
+}
+
+func (socket *apiSocket) isClosed() bool {
+	defer socket.lock.Lock().Unlock()
+	return socket.closed
+}
+
+// Record a new connection, unless the socket has already been closed
+func (socket *apiSocket) track(conn net.Conn) bool {
+	defer socket.lock.Lock().Unlock()
+	if socket.closed {
+		return false
+	}
+
+	socket.connections[conn] = struct{}{}
+	socket.serving.Add(1)
+	return true
+}
+
+func (socket *apiSocket) untrack(conn net.Conn) {
+	defer socket.lock.Lock().Unlock()
+	delete(socket.connections, conn)
+}
+
+// The credentials of the process at the other end of the connection, which take
+// the place of those FUSE provides with each request on the api file.
+func peerContext(conn *net.UnixConn) (*fuse.Context, error) {
+	raw, err := conn.SyscallConn()
+	if err != nil {
+		return nil, err
+	}
+
+	var cred *syscall.Ucred
+	var credErr error
+	err = raw.Control(func(fd uintptr) {
+		cred, credErr = syscall.GetsockoptUcred(int(fd),
+			syscall.SOL_SOCKET, syscall.SO_PEERCRED)
+	})
+	if err != nil {
+		return nil, err
+	}
+	if credErr != nil {
+		return nil, credErr
+	}
+
+	return &fuse.Context{
+		Owner: fuse.Owner{
+			Uid: cred.Uid,
+			Gid: cred.Gid,
+		},
+		Pid: uint32(cred.Pid),
+	}, nil
+}
+
+// Serve the requests of a single connection until it is closed
+func (socket *apiSocket) serve(c *ctx, conn *net.UnixConn) {
+	defer socket.serving.Done()
+	defer socket.untrack(conn)
+	defer conn.Close()
+	defer logRequestPanic(c)
+
+	defer c.funcIn("apiSocket::serve").Out()
+
+	peer, err := peerContext(conn)
+	if err != nil {
+		c.elog("Api socket peer unknown: %s", err.Error())
+		return
+	}
+
+	inode, release := c.qfs.inodeNoInstantiate(c, quantumfs.InodeIdApi)
+	defer release()
+	apiInode, ok := inode.(*ApiInode)
+	if !ok {
+		c.elog("Api inode unavailable")
+		return
+	}
+
+	api := newApiHandle(c, apiInode.treeState(), apiInode)
+	api.protocol = quantumfs.ProtocolBinary
+	api.socket = conn
+
+	// Pipelined requests are processed concurrently, but no further requests
+	// are read while MaxPipelineDepth of them are outstanding.
+	var pipelined sync.WaitGroup
+	pipeline := make(chan struct{}, quantumfs.MaxPipelineDepth)
+
+	for {
+		request, err := quantumfs.ReadBinaryFrame(conn, maxApiSocketRequest)
+		if err != nil {
+			if err != io.EOF {
+				// The stream can't be resynchronised after a bad
+				// frame
+				c.vlog("Closing api connection: %s", err.Error())
+			}
+			break
+		}
+
+		rc := c.apiSocketCtx(peer)
+
+		var cmd quantumfs.CommandCommon
+		request, err = decompressRequest(rc, request)
+		if err == nil {
+			err = quantumfs.DecodeBinaryCommand(request, &cmd)
+		}
+		if err != nil {
+			rc.vlog("Error unmarshaling request: %s", err.Error())
+			api.queueResponse(rc, quantumfs.ProtocolBinary, 0,
+				errorResponse(quantumfs.ErrorBadJson, "%s",
+					err.Error()))
+			continue
+		}
+
+		if cmd.RequestId == 0 {
+			api.processRequest(rc, quantumfs.ProtocolBinary, cmd,
+				request)
+			continue
+		}
+
+		pipeline <- struct{}{}
+		pipelined.Add(1)
+		go func(rc *ctx) {
+			defer pipelined.Done()
+			defer func() { <-pipeline }()
+			defer logRequestPanic(rc)
+			api.processRequest(rc, quantumfs.ProtocolBinary, cmd,
+				request)
+		}(rc)
+	}
+
+	pipelined.Wait()
+	api.drainResponseData(c)
+}
@@ -76,4 +76,8 @@ type QuantumFsConfig struct {
 	MagicOwnership bool
 
 	DisableLockChecks bool
+
+	// If set, the api is also served on a unix socket at this path, so that
+	// clients may use it without going through FUSE.
+	ApiSocketPath string
 }
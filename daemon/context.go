@@ -99,6 +99,15 @@ func (c *ctx) forgetCtx() *ctx {
 	return &nc
 }
 
+var apiSocketRequestIdGenerator = qlog.ApiSocketRequestIdMin
+
+// Assign a unique request id to the context for a request on the api socket made
+// by the given peer
+func (c *ctx) apiSocketCtx(peer *fuse.Context) *ctx {
+	reqId := atomic.AddUint64(&apiSocketRequestIdGenerator, 1)
+	return c.newThread().reqId(reqId, peer)
+}
+
 // local daemon package specific log wrappers
 func (c *ctx) elog(format string, args ...interface{}) {
 	c.Ctx.Elog(qlog.LogDaemon, format, args...)
@@ -72,7 +72,34 @@ func (store *dataStore) Get(c *quantumfs.Ctx,
 		return &thinBuf
 	}
 
-	// Check cache
+	return store.getCached(c, key, func(err error) {
+		c.Elog(qlog.LogDaemon, getFailureLog, err.Error(), key.String())
+	})
+}
+
+// Load the block of the key into the cache, if it is stored. Unlike Get(), the
+// block being missing isn't treated as an error.
+func (store *dataStore) prefetch(c *quantumfs.Ctx, key quantumfs.ObjectKey) {
+	defer c.FuncIn(qlog.LogDaemon, "dataStore::prefetch",
+		"key %s", key.String()).Out()
+
+	var thinBuf buffer
+	initBuffer(&thinBuf, store, key)
+	if quantumfs.ConstantStore.Get(c, key, &thinBuf) == nil {
+		return
+	}
+
+	store.getCached(c, key, func(err error) {
+		c.Vlog(qlog.LogDaemon, "Key %s not found: %s", key.String(),
+			err.Error())
+	})
+}
+
+// Get the block of the key through the cache, calling missing if it isn't in the
+// durable store either
+func (store *dataStore) getCached(c *quantumfs.Ctx, key quantumfs.ObjectKey,
+	missing func(err error)) ImmutableBuffer {
+
 	bufResult, resultChannel := store.cache.get(c, key,
 		func() ImmutableBuffer {
 			buf := newEmptyBuffer()
@@ -80,8 +107,7 @@ func (store *dataStore) Get(c *quantumfs.Ctx,
 
 			err := store.durableStore.Get(c, key, &buf)
 			if err != nil {
-				c.Elog(qlog.LogDaemon, getFailureLog, err.Error(),
-					key.String())
+				missing(err)
 				return nil
 			}
 
@@ -51,6 +51,7 @@ func NewQuantumFs_(config QuantumFsConfig, qlogIn *qlog.Qlog) *QuantumFs {
 		toBeReleased:           make(chan uint64, 1000000),
 		toNotifyFuse:           make(chan FuseNotification, 10000),
 		stopWaitingForSignals:  make(chan struct{}),
+		prefetches:             make(chan struct{}, prefetchConcurrency),
 		syncAllRetries:         -1,
 		c: ctx{
 			Ctx: quantumfs.Ctx{
@@ -131,6 +132,12 @@ type QuantumFs struct {
 	// a large number of ApiHandles.
 	apiFileSize int64
 
+	// The optional unix socket the api is also served on
+	apiSocket *apiSocket
+
+	// The slots of the blocks being prefetched for the api, see prefetchBlocks()
+	prefetches chan struct{}
+
 	// This is a leaf lock for protecting the instantiation maps
 	// Do not grab other locks while holding this
 	mapMutex       orderedMapMutex
@@ -208,9 +215,14 @@ func (qfs *QuantumFs) Mount(mountOptions fuse.MountOptions) error {
 			"default_permissions")
 	}
 
+	if err := qfs.listenApiSocket(); err != nil {
+		return err
+	}
+
 	server, err := fuse.NewServer(qfs, qfs.config.MountPath, &mountOptions)
 	if err != nil {
 		qfs.c.elog("Failed to create new server %s", err.Error())
+		qfs.closeApiSocket()
 		return err
 	}
 
@@ -387,6 +399,8 @@ func (qfs *QuantumFs) Serve() {
 	qfs.server.Serve()
 	c.dlog("QuantumFs::Serve Finished serving")
 
+	qfs.closeApiSocket()
+
 	c.dlog("QuantumFs::Serve Waiting for flush thread to end")
 
 	for qfs.flusher.syncAll(c) != nil {
@@ -2313,6 +2327,15 @@ func (qfs *QuantumFs) Read(input *fuse.ReadIn, buf []byte) (readRes fuse.ReadRes
 	defer logRequestPanic(c)
 	defer c.StatsFuncIn(ReadLog, FileHandleLog, input.Fh).Out()
 
+	nonblocking := utils.BitFlagsSet(uint(input.Flags), uint(syscall.O_NONBLOCK))
+
+	// A read of the api file may have to wait for a pipelined request, which
+	// may need the tree lock, so it waits before the lock is taken
+	apiHandle, isApi := qfs.fileHandle(c, FileHandleId(input.Fh)).(*ApiHandle)
+	if isApi {
+		apiHandle.awaitResponse(c, input.Offset, nonblocking)
+	}
+
 	fileHandle, unlock := qfs.RLockTreeGetHandle(c, FileHandleId(input.Fh))
 	defer unlock()
 	logFilehandleWorkspace(c, fileHandle)
@@ -2321,8 +2344,7 @@ func (qfs *QuantumFs) Read(input *fuse.ReadIn, buf []byte) (readRes fuse.ReadRes
 		return nil, fuse.ENOENT
 	}
 
-	return fileHandle.Read(c, input.Offset, input.Size,
-		buf, utils.BitFlagsSet(uint(input.Flags), uint(syscall.O_NONBLOCK)))
+	return fileHandle.Read(c, input.Offset, input.Size, buf, nonblocking)
 }
 
 const ReleaseLog = "Mux::Release"
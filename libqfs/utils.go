@@ -20,6 +20,10 @@ const ApiPath = "api"
 
 const InodeIdApi = 2
 
+// The environment variable which gives the path of the api socket of quantumfsd,
+// if it was started with one.
+const ApiSocketEnvironment = "QUANTUMFS_API_SOCKET"
+
 func fileIsApi(stat os.FileInfo) bool {
 	stat_t, ok := stat.Sys().(*syscall.Stat_t)
 	if ok && stat_t.Ino == InodeIdApi {
@@ -158,6 +162,29 @@ func findApiPathUpwards() (string, error) {
 	}
 }
 
+// Returns the path of the api socket named by the environment, or "" if there is
+// no such socket. The socket is optional, so its absence isn't an error.
+func FindApiSocketPath() string {
+	path := os.Getenv(ApiSocketEnvironment)
+	if !IsApiSocket(path) {
+		return ""
+	}
+
+	return path
+}
+
+// Whether there is a socket at the path. Callers from C must look the path up in
+// the environment themselves, as the Go runtime of a shared library only sees the
+// environment as it was when the library was loaded.
+func IsApiSocket(path string) bool {
+	if path == "" {
+		return false
+	}
+
+	stat, err := os.Stat(path)
+	return err == nil && stat.Mode()&os.ModeSocket != 0
+}
+
 func FindApiPath() (string, error) {
 	path := findApiPathEnvironment()
 	if path != "" {
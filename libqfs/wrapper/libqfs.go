@@ -22,6 +22,11 @@ func FindApiPath() (*C.char, *C.char) {
 	return C.CString(rtn), C.CString(errStr)
 }
 
+//export IsApiSocket
+func IsApiSocket(path *C.char) bool {
+	return libqfs.IsApiSocket(C.GoString(path))
+}
+
 func main() {
 	// Main function must exist for this to be compiled as a shared library
 }
@@ -20,6 +20,7 @@ PKGS_TO_TEST+=quantumfs/utils/aggregatedatastore
 PKGS_TO_TEST+=quantumfs/utils/excludespec quantumfs/backends/grpc
 PKGS_TO_TEST+=quantumfs/backends/grpc/server quantumfs/qlogstats
 PKGS_TO_TEST+=quantumfs/cmd/qupload quantumfs/cmd/cqlwalkerd
+PKGS_TO_TEST+=quantumfs/cmd/qfsclientgen
 TEST_PKGS_TO_COMPILE=quantumfs/backends/cql_longrunningtests
 LIBRARIES=libqfs.so libqfs.h libqfs32.so libqfs32.h
 
@@ -206,8 +207,7 @@ RPM_VER_SUFFIX := $(RPM_VERSION)-$(RPM_RELEASE)
 clientRPM: check-fpm qfsclient
 	$(FPM) -n QuantumFS-client \
 		--description='QuantumFS client API' \
-		--depends jansson \
-		--depends openssl \
+		--depends zlib \
 		--depends libstdc++ \
 		QFSClient/libqfsclient.so=$(RPM_LIBDIR)/libqfsclient.so \
 		libqfs.so=$(RPM_LIBDIR)/libqfs.so
@@ -225,7 +225,7 @@ clientRPM32: check-fpm libqfs32.so
 		trap 'rm -f $$MOCKLOCK' EXIT ; \
 		(flock 9 || exit 1 ; \
 			mock -r fedora-18-i386 --init ; \
-			mock -r fedora-18-i386 --install sudo procps-ng git gtest-devel jansson-devel openssl-devel ruby-devel rubygems ; \
+			mock -r fedora-18-i386 --install sudo procps-ng git gtest-devel openssl-devel ruby-devel rubygems ; \
 			mock -r fedora-18-i386 --shell "sudo gem install --no-ri --no-rdoc fpm" ; \
 			mock -r fedora-18-i386 --copyin . /quantumfs ; \
 			mock -r fedora-18-i386 --shell "cd /quantumfs && make clean" ; \
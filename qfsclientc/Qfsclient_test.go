@@ -58,6 +58,10 @@ func TestBasicInterface(t *testing.T) {
 		test.AssertNoErr(err)
 		test.Assert(bytes.Equal(testData, readBack),
 			"Data changed between SetBlock and GetBlock")
+
+		size, err := api.StatBlock(testKey)
+		test.AssertNoErr(err)
+		test.Assert(size == len(testData), "Wrong block size %d", size)
 	})
 }
 
@@ -168,18 +168,31 @@ extern "C" {
 			return "Api doesn't exist.";
 		}
 
-		uint8_t *convertedKey = (uint8_t*)key;
-		std::vector<uint8_t> inputKey(convertedKey,
-			convertedKey + strlen(key));
+		qfsclient::Error err = api->SetBlock((const uint8_t*)key,
+			strlen(key), data, len);
+
+		return errStr(err);
+	}
+
+	// The block is written straight into the capacity bytes at dataOut. If it
+	// doesn't fit nothing is written, but lenOut is still set to its size.
+	const char * cGetBlock(uint32_t apiHandle, const char *key, char *dataOut,
+		uint32_t capacity, uint32_t *lenOut) {
 
-		std::vector<uint8_t> inputData(data, data + len);
+		auto api = findApi(apiHandle);
+		if (!api) {
+			return "Api doesn't exist.";
+		}
 
-		qfsclient::Error err = api->SetBlock(inputKey, inputData);
+		size_t written = 0;
+		qfsclient::Error err = api->GetBlockInto((const uint8_t*)key,
+			strlen(key), (uint8_t*)dataOut, capacity, &written);
+		*lenOut = written;
 
 		return errStr(err);
 	}
 
-	const char * cGetBlock(uint32_t apiHandle, const char *key, char *dataOut,
+	const char * cStatBlock(uint32_t apiHandle, const char *key,
 		uint32_t *lenOut) {
 
 		auto api = findApi(apiHandle);
@@ -191,17 +204,10 @@ extern "C" {
 		std::vector<uint8_t> inputKey(convertedKey,
 			convertedKey + strlen(key));
 
-		std::vector<uint8_t> data;
-		qfsclient::Error err = api->GetBlock(inputKey, &data);
-
-		const char *rtn = errStr(err);
-		if (strcmp(rtn, "") != 0) {
-			return rtn;
-		}
-
-		memcpy(dataOut, &data[0], data.size());
-		*lenOut = data.size();
+		size_t size = 0;
+		qfsclient::Error err = api->StatBlock(inputKey, &size);
+		*lenOut = size;
 
-		return "";
+		return errStr(err);
 	}
 }
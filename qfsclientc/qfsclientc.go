@@ -5,7 +5,7 @@
 package qfsclientc
 
 /*
-#cgo LDFLAGS: -lqfsclient -ljansson -lcrypto
+#cgo LDFLAGS: -lqfsclient
 #cgo CXXFLAGS: -std=c++11
 
 #include <stdint.h>
@@ -23,7 +23,8 @@ const char * cDelete(uint32_t apiHandle, const char *workspace);
 const char * cSetBlock(uint32_t apiHandle, const char *key, uint8_t *data,
 	uint32_t len);
 const char * cGetBlock(uint32_t apiHandle, const char *key, char *dataOut,
-	uint32_t *lenOut);
+	uint32_t capacity, uint32_t *lenOut);
+const char * cStatBlock(uint32_t apiHandle, const char *key, uint32_t *lenOut);
 
 */
 import "C"
@@ -146,19 +147,25 @@ func (api *QfsClientApi) Delete(workspace string) error {
 }
 
 func (api *QfsClientApi) SetBlock(key string, data []byte) error {
+	// The contents of the slice are passed, not its header
+	var dataPtr *C.uint8_t
+	if len(data) > 0 {
+		dataPtr = (*C.uint8_t)(unsafe.Pointer(&data[0]))
+	}
+
 	err := C.GoString(C.cSetBlock(C.uint32_t(api.handle), C.CString(key),
-		(*C.uint8_t)(unsafe.Pointer(&data)),
-		C.uint32_t(len(data))))
+		dataPtr, C.uint32_t(len(data))))
 
 	return checkError(err)
 }
 
 func (api *QfsClientApi) GetBlock(key string) ([]byte, error) {
+	// Any block fits, so the block is retrieved straight into data
 	data := make([]byte, quantumfs.MaxBlockSize)
 	var dataLen uint32
 
 	err := C.GoString(C.cGetBlock(C.uint32_t(api.handle), C.CString(key),
-		(*C.char)(unsafe.Pointer(&data)),
+		(*C.char)(unsafe.Pointer(&data[0])), C.uint32_t(len(data)),
 		(*C.uint32_t)(unsafe.Pointer(&dataLen))))
 
 	if err != "" {
@@ -167,3 +174,12 @@ func (api *QfsClientApi) GetBlock(key string) ([]byte, error) {
 
 	return data[:dataLen], nil
 }
+
+func (api *QfsClientApi) StatBlock(key string) (int, error) {
+	var size uint32
+
+	err := C.GoString(C.cStatBlock(C.uint32_t(api.handle), C.CString(key),
+		(*C.uint32_t)(unsafe.Pointer(&size))))
+
+	return int(size), checkError(err)
+}
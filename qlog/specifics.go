@@ -34,11 +34,12 @@ const (
 )
 
 const (
-	MinSpecialReqId     = uint64(0xb) << 48
-	FlusherRequestIdMin = uint64(0xb) << 48
-	RefreshRequestIdMin = uint64(0xc) << 48
-	ForgetRequstIdMin   = uint64(0xd) << 48
-	UnusedRequestIdMin  = uint64(0xe) << 48
+	MinSpecialReqId       = uint64(0xb) << 48
+	FlusherRequestIdMin   = uint64(0xb) << 48
+	RefreshRequestIdMin   = uint64(0xc) << 48
+	ForgetRequstIdMin     = uint64(0xd) << 48
+	ApiSocketRequestIdMin = uint64(0xe) << 48
+	UnusedRequestIdMin    = uint64(0xf) << 48
 )
 
 func specialReq(reqId uint64) string {
@@ -71,9 +72,12 @@ func specialReq(reqId uint64) string {
 	case RefreshRequestIdMin <= reqId && reqId < ForgetRequstIdMin:
 		format = "[Refresh%d]"
 		offset = RefreshRequestIdMin
-	case ForgetRequstIdMin <= reqId && reqId < UnusedRequestIdMin:
+	case ForgetRequstIdMin <= reqId && reqId < ApiSocketRequestIdMin:
 		format = "[Forget%d]"
 		offset = ForgetRequstIdMin
+	case ApiSocketRequestIdMin <= reqId && reqId < UnusedRequestIdMin:
+		format = "[ApiSocket%d]"
+		offset = ApiSocketRequestIdMin
 	}
 
 	return fmt.Sprintf(format, reqId-offset)